@@ -0,0 +1,88 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bench_common.h"
+
+uint64_t db_bench_time_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+void db_bench_hist_reset(db_bench_hist_t *hist) {
+    memset(hist, 0, sizeof(db_bench_hist_t));
+    hist->min = UINT64_MAX;
+}
+
+static int hist_bucket(uint64_t value) {
+    if (value < DB_BENCH_HIST_SUB_BUCKETS) return (int) value;
+    int msb = 63 - __builtin_clzll(value);
+    return (msb - 2) * DB_BENCH_HIST_SUB_BUCKETS + (int) ((value >> (msb - 3)) & (DB_BENCH_HIST_SUB_BUCKETS - 1));
+}
+
+static uint64_t hist_bucket_upper(int bucket) {
+    if (bucket < DB_BENCH_HIST_SUB_BUCKETS) return (uint64_t) bucket;
+    int msb = bucket / DB_BENCH_HIST_SUB_BUCKETS + 2;
+    uint64_t sub = (uint64_t) (bucket % DB_BENCH_HIST_SUB_BUCKETS);
+    return ((DB_BENCH_HIST_SUB_BUCKETS + sub + 1) << (msb - 3)) - 1;
+}
+
+void db_bench_hist_add(db_bench_hist_t *hist, uint64_t value_ns) {
+    hist->count++;
+    hist->sum += value_ns;
+    if (value_ns < hist->min) hist->min = value_ns;
+    if (value_ns > hist->max) hist->max = value_ns;
+    hist->buckets[hist_bucket(value_ns)]++;
+}
+
+/**
+ * @param hist
+ * @param percentile 0-100
+ * @return Upper bound of the bucket the percentile falls into, never more than the max. value
+ */
+uint64_t db_bench_hist_percentile(const db_bench_hist_t *hist, double percentile) {
+    if (hist->count == 0) return 0;
+    uint64_t rank = (uint64_t) (percentile / 100.0 * (double) hist->count + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < DB_BENCH_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint64_t upper = hist_bucket_upper(i);
+            return upper < hist->max ? upper : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+/**
+ * Prints count, min, avg, percentiles and max in us
+ */
+void db_bench_hist_print(const char *name, const db_bench_hist_t *hist) {
+    if (hist->count == 0) {
+        printf("%-22s no samples\n", name);
+        return;
+    }
+    printf("%-22s n=%llu min=%.1f avg=%.1f p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f us\n", name,
+           (unsigned long long) hist->count, hist->min / 1e3, (double) hist->sum / (double) hist->count / 1e3,
+           db_bench_hist_percentile(hist, 50) / 1e3, db_bench_hist_percentile(hist, 90) / 1e3,
+           db_bench_hist_percentile(hist, 99) / 1e3, db_bench_hist_percentile(hist, 99.9) / 1e3, hist->max / 1e3);
+}
@@ -0,0 +1,60 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DRONEBRIDGE_BENCH_COMMON_H
+#define DRONEBRIDGE_BENCH_COMMON_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define DB_BENCH_MAGIC          0x44424231  // "DBB1"
+#define DB_BENCH_DEFAULT_PORT   10          // DroneBridge raw port used by the benchmark (not used by any module)
+#define DB_BENCH_DEFAULT_COMMID 16
+#define DB_BENCH_HIST_SUB_BUCKETS 8         // linear sub buckets per power of two (~12% resolution)
+#define DB_BENCH_HIST_BUCKETS   (62 * DB_BENCH_HIST_SUB_BUCKETS)
+
+// Start of every benchmark payload. The rest of the payload is filler
+struct __attribute__((packed)) db_bench_header_t {
+    uint32_t magic;
+    uint32_t run_id;        // random per sender run. The receiver resets its statistics when it changes
+    uint32_t seq_num;       // message counter of the sender, the same for the copies sent on every adapter
+    uint32_t payload_size;
+    uint64_t tx_time_ns;    // CLOCK_REALTIME when the message was sent. Clocks must be in sync for one-way latency
+};
+
+// Log-linear histogram of durations in ns
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[DB_BENCH_HIST_BUCKETS];
+} db_bench_hist_t;
+
+uint64_t db_bench_time_ns(clockid_t clock);
+
+void db_bench_hist_reset(db_bench_hist_t *hist);
+
+void db_bench_hist_add(db_bench_hist_t *hist, uint64_t value_ns);
+
+uint64_t db_bench_hist_percentile(const db_bench_hist_t *hist, double percentile);
+
+void db_bench_hist_print(const char *name, const db_bench_hist_t *hist);
+
+#endif //DRONEBRIDGE_BENCH_COMMON_H
@@ -18,63 +18,260 @@
  */
 
 /**
- * Example on how to use DroneBridge common library to receive data.
- * This example receives on the port of the status module.
- * Set port & adapter name to match your configuration
+ * Raw link benchmark - receiver. Receives the messages of db_bench_send on one or more adapters and reports
+ * packets/s, Mbit/s, loss, duplicates (copies received on multiple adapters), reordering, bad FCS frames and the
+ * one-way latency. One-way latency needs the clocks (CLOCK_REALTIME) of sender and receiver to be in sync.
  */
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <signal.h>
-#include <zconf.h>
+#include <unistd.h>
+#include <poll.h>
+#include <getopt.h>
 #include "../common/db_raw_send_receive.h"
 #include "../common/db_raw_receive.h"
+#include "../common/radiotap/radiotap_iter.h"
+#include "bench_common.h"
 
-#define BUFFER_SIZE 2048
+#define BUFFER_SIZE 4096
+#define SEEN_WINDOW 65536 // messages. Copies that arrive later than that behind the newest message count as duplicates
 
-#define ADAPTER_NAME "wlx8416f916382c"    // Name of WiFi adapter. Must be in monitor mode
-#define DB_RECEIVING_PORT DB_PORT_STATUS  // Receive data on DB raw port for status module
-#define DB_SEND_DIRECTION DB_DIREC_DRONE  // Send data in direction of UAV
+typedef struct {
+    uint64_t frames;
+    uint64_t bad_fcs;
+    int8_t last_rssi;
+    db_radiotap_cache_t radiotap_cache;
+} bench_adapter_t;
 
-int keep_going = 1;
+typedef struct {
+    uint32_t run_id;
+    int started;
+    uint32_t first_seq_num;
+    uint32_t highest_seq_num;
+    uint64_t messages;      // unique messages with valid payload
+    uint64_t bytes;
+    uint64_t duplicates;
+    uint64_t reordered;
+    uint64_t malformed;
+    uint64_t first_rx_ns, last_rx_ns;   // CLOCK_MONOTONIC, rates of the total report are based on the active time
+    uint64_t seen[SEEN_WINDOW / 64]; // received messages, bit seq_num % SEEN_WINDOW
+    db_bench_hist_t latency;
+} bench_stats_t;
+
+volatile int keep_going = 1;
+char adapters[DB_MAX_ADAPTERS][IFNAMSIZ];
+int num_adapters = 0;
+uint8_t comm_id = DB_BENCH_DEFAULT_COMMID;
+uint8_t port = DB_BENCH_DEFAULT_PORT;
+double duration_s = 0;
+double report_interval_s = 1;
+bench_adapter_t bench_adapters[DB_MAX_ADAPTERS];
 
 void sig_handler(int sig) {
-    printf("DroneBridge example receiver: Terminating...\n");
     keep_going = 0;
 }
 
+void print_usage() {
+    printf("DroneBridge raw link benchmark (receiver). Use"
+           "\n\t-n <network interface> Repeat for multiple adapters (max %i)"
+           "\n\t-c <communication id> default %i"
+           "\n\t-p <port> DroneBridge raw port, default %i"
+           "\n\t-t <seconds> duration, default 0 = until SIGINT"
+           "\n\t-i <seconds> report interval, default 1\n", DB_MAX_ADAPTERS, DB_BENCH_DEFAULT_COMMID,
+           DB_BENCH_DEFAULT_PORT);
+}
+
+void process_command_line_args(int argc, char *argv[]) {
+    int c;
+    while ((c = getopt(argc, argv, "n:c:p:t:i:?")) != -1) {
+        switch (c) {
+            case 'n':
+                if (num_adapters < DB_MAX_ADAPTERS) {
+                    strncpy(adapters[num_adapters], optarg, IFNAMSIZ - 1);
+                    num_adapters++;
+                }
+                break;
+            case 'c':
+                comm_id = (uint8_t) strtol(optarg, NULL, 10);
+                break;
+            case 'p':
+                port = (uint8_t) strtol(optarg, NULL, 10);
+                break;
+            case 't':
+                duration_s = strtod(optarg, NULL);
+                break;
+            case 'i':
+                report_interval_s = strtod(optarg, NULL);
+                break;
+            case '?':
+            default:
+                print_usage();
+                exit(EXIT_SUCCESS);
+        }
+    }
+    if (num_adapters == 0) {
+        print_usage();
+        exit(EXIT_FAILURE);
+    }
+}
+
+void reset_stats(bench_stats_t *stats, uint32_t run_id) {
+    memset(stats, 0, sizeof(bench_stats_t));
+    stats->run_id = run_id;
+    db_bench_hist_reset(&stats->latency);
+    for (int a = 0; a < num_adapters; a++) {
+        bench_adapters[a].frames = 0;
+        bench_adapters[a].bad_fcs = 0;
+    }
+}
+
+/**
+ * @return 1 if the radiotap header marks the frame as received with a bad FCS
+ */
+int has_bad_fcs(bench_adapter_t *adapter, uint8_t *frame, db_frame_view_t *view) {
+    const db_radiotap_layout_t *layout = db_radiotap_get_layout(&adapter->radiotap_cache, frame, view->radiotap_length);
+    if (layout == NULL) return 0;
+    int bad_fcs = 0;
+    for (int i = 0; i < layout->num_fields; i++) {
+        uint8_t *field = frame + layout->fields[i].offset;
+        if (layout->fields[i].index == IEEE80211_RADIOTAP_FLAGS)
+            bad_fcs = (*field & IEEE80211_RADIOTAP_F_BADFCS) != 0;
+        else if (layout->fields[i].index == IEEE80211_RADIOTAP_DBM_ANTSIGNAL)
+            adapter->last_rssi = (int8_t) *field;
+    }
+    return bad_fcs;
+}
+
+/**
+ * Duplicate detection on the 32 bit message counter of the benchmark header. The raw protocol sequence number only
+ * has a short lookback, copies of other adapters may arrive far behind when sending in batches
+ *
+ * @return 1 if the message was not received before
+ */
+int check_seen(bench_stats_t *stats, uint32_t seq_num) {
+    if ((int32_t) (seq_num - stats->highest_seq_num) > 0) {
+        // forget the messages that dropped out of the window
+        if (seq_num - stats->highest_seq_num >= SEEN_WINDOW) {
+            memset(stats->seen, 0, sizeof(stats->seen));
+        } else {
+            for (uint32_t s = stats->highest_seq_num + 1; s != seq_num; s++)
+                stats->seen[(s % SEEN_WINDOW) / 64] &= ~(1ULL << (s % 64));
+        }
+    } else if (stats->highest_seq_num - seq_num >= SEEN_WINDOW) {
+        return 0;
+    } else if (stats->seen[(seq_num % SEEN_WINDOW) / 64] & (1ULL << (seq_num % 64))) {
+        return 0;
+    }
+    stats->seen[(seq_num % SEEN_WINDOW) / 64] |= 1ULL << (seq_num % 64);
+    return 1;
+}
+
+void process_frame(bench_stats_t *stats, int adapter_no, uint8_t *frame, ssize_t length) {
+    db_frame_view_t view;
+    uint64_t rx_time = db_bench_time_ns(CLOCK_REALTIME);
+    bench_adapter_t *adapter = &bench_adapters[adapter_no];
+    if (db_parse_frame(frame, length, &view) != 0 || view.payload_length < sizeof(struct db_bench_header_t)) {
+        stats->malformed++;
+        return;
+    }
+    adapter->frames++;
+    if (has_bad_fcs(adapter, frame, &view)) {
+        adapter->bad_fcs++;
+        return;
+    }
+    struct db_bench_header_t header;
+    memcpy(&header, view.payload, sizeof(header));
+    if (header.magic != DB_BENCH_MAGIC) {
+        stats->malformed++;
+        return;
+    }
+    if (!stats->started || header.run_id != stats->run_id) {
+        if (stats->started) printf("DB_BENCH: New sender run detected, resetting statistics\n");
+        reset_stats(stats, header.run_id);
+        adapter->frames = 1;
+        stats->started = 1;
+        stats->first_seq_num = header.seq_num;
+        stats->highest_seq_num = header.seq_num;
+    }
+    if (!check_seen(stats, header.seq_num)) {
+        stats->duplicates++;
+        return;
+    }
+    stats->last_rx_ns = db_bench_time_ns(CLOCK_MONOTONIC);
+    if (stats->messages == 0) stats->first_rx_ns = stats->last_rx_ns;
+    stats->messages++;
+    stats->bytes += view.payload_length;
+    if (header.seq_num < stats->highest_seq_num) stats->reordered++;
+    else stats->highest_seq_num = header.seq_num;
+    if (rx_time > header.tx_time_ns) db_bench_hist_add(&stats->latency, rx_time - header.tx_time_ns);
+}
+
+void print_report(const char *name, bench_stats_t *stats, uint64_t messages, uint64_t bytes, double seconds) {
+    uint64_t expected = stats->started ? (uint64_t) (stats->highest_seq_num - stats->first_seq_num) + 1 : 0;
+    uint64_t lost = expected > stats->messages ? expected - stats->messages : 0;
+    printf("%s: %.0f msg/s %.2f Mbit/s | total %llu msgs, lost %llu (%.2f%%), dup %llu, reordered %llu, "
+           "malformed %llu", name, messages / seconds, bytes * 8 / seconds / 1e6,
+           (unsigned long long) stats->messages, (unsigned long long) lost,
+           expected > 0 ? 100.0 * lost / expected : 0.0, (unsigned long long) stats->duplicates,
+           (unsigned long long) stats->reordered, (unsigned long long) stats->malformed);
+    for (int a = 0; a < num_adapters; a++) {
+        printf(" | %s: %llu frames, %llu bad FCS, %i dBm", adapters[a], (unsigned long long) bench_adapters[a].frames,
+               (unsigned long long) bench_adapters[a].bad_fcs, bench_adapters[a].last_rssi);
+    }
+    printf("\n");
+}
+
 int main(int argc, char *argv[]) {
+    process_command_line_args(argc, argv);
     uint8_t buffer[BUFFER_SIZE];
-    uint8_t payload_buff[DATA_UNI_LENGTH];
-    uint8_t seq_num = 0;
-    memset(buffer, 0, BUFFER_SIZE);
-
-    uint8_t comm_id = 200;
-    char db_mode = 'm';
-    char adapters[DB_MAX_ADAPTERS][IFNAMSIZ];
-    strncpy(adapters[0], ADAPTER_NAME, IFNAMSIZ);
-
-    // init DroneBridge sockets for raw protocol
-    db_socket_t raw_interfaces[DB_MAX_ADAPTERS];  // array of DroneBridge sockets
-    memset(raw_interfaces, 0, DB_MAX_ADAPTERS);
-    raw_interfaces[0] = open_db_socket(adapters[0], comm_id, db_mode, 6, DB_SEND_DIRECTION,
-                                       DB_RECEIVING_PORT, DB_FRAMETYPE_DEFAULT);
-    // Some stuff for proper termination
+    struct pollfd fds[DB_MAX_ADAPTERS];
+    db_socket_t raw_interfaces[DB_MAX_ADAPTERS];
+    for (int a = 0; a < num_adapters; a++) {
+        raw_interfaces[a] = open_db_socket(adapters[a], comm_id, 'm', 1, DB_DIREC_DRONE, port, DB_FRAMETYPE_DEFAULT);
+        if (raw_interfaces[a].db_socket < 0) exit(EXIT_FAILURE);
+        fds[a].fd = raw_interfaces[a].db_socket;
+        fds[a].events = POLLIN;
+        memset(&bench_adapters[a], 0, sizeof(bench_adapter_t));
+    }
     struct sigaction action;
     memset(&action, 0, sizeof(struct sigaction));
     action.sa_handler = sig_handler;
     sigaction(SIGTERM, &action, NULL);
     sigaction(SIGINT, &action, NULL);
-    printf("DroneBridge example receiver: Waiting for data\n");
+
+    static bench_stats_t stats;
+    reset_stats(&stats, 0);
+    printf("DB_BENCH: Waiting for benchmark messages on port %i\n", port);
+    uint64_t start = db_bench_time_ns(CLOCK_MONOTONIC), last_report = start;
+    uint64_t report_messages = 0, report_bytes = 0;
     while (keep_going) {
-        uint16_t radiotap_length = 0;
-        ssize_t received_bytes = recv(raw_interfaces[0].db_socket, buffer, BUFFER_SIZE, 0);
-        uint16_t payload_length = get_db_payload(buffer, received_bytes, payload_buff, &seq_num, &radiotap_length);
-        int8_t rssi = get_rssi(buffer, radiotap_length);
-        printf("Received raw frame with %zi bytes & %i bytes of payload (%i dBm)\n", received_bytes,
-               payload_length, rssi);
+        int ret = poll(fds, (nfds_t) num_adapters, 100);
+        uint64_t now = db_bench_time_ns(CLOCK_MONOTONIC);
+        if (duration_s > 0 && now - start >= (uint64_t) (duration_s * 1e9)) break;
+        if (ret > 0) {
+            for (int a = 0; a < num_adapters; a++) {
+                if (!(fds[a].revents & POLLIN)) continue;
+                ssize_t length;
+                while ((length = recv(fds[a].fd, buffer, BUFFER_SIZE, MSG_DONTWAIT)) > 0)
+                    process_frame(&stats, a, buffer, length);
+            }
+        }
+        if (stats.messages < report_messages) report_messages = report_bytes = 0; // new sender run
+        if (report_interval_s > 0 && now - last_report >= (uint64_t) (report_interval_s * 1e9)) {
+            print_report("interval", &stats, stats.messages - report_messages, stats.bytes - report_bytes,
+                         (now - last_report) / 1e9);
+            report_messages = stats.messages;
+            report_bytes = stats.bytes;
+            last_report = now;
+        }
     }
-    for (int i = 0; i < DB_MAX_ADAPTERS; i++)
-        close(raw_interfaces[i].db_socket);
+    printf("----\n");
+    double active_s = stats.messages > 1 ? (stats.last_rx_ns - stats.first_rx_ns) / 1e9 : 1;
+    print_report("total", &stats, stats.messages, stats.bytes, active_s);
+    db_bench_hist_print("one-way latency", &stats.latency);
+    for (int a = 0; a < num_adapters; a++)
+        close(raw_interfaces[a].db_socket);
     return 0;
 }
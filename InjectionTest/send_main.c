@@ -17,48 +17,268 @@
  *
  */
 
+/**
+ * Raw link benchmark - sender. Injects benchmark messages via the DroneBridge send APIs (db_send_div, db_send_hp_div
+ * or batched with sendmmsg) on one or more adapters and reports packets/s, Mbit/s and the latency of the send calls.
+ * Run db_bench_receive on the other side for loss and one-way latency. Works with real monitor mode adapters, "lo" and
+ * emulated adapters (emu*, see link_emu).
+ */
+
 #include <signal.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <zconf.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
 #include "../common/db_raw_send_receive.h"
+#include "bench_common.h"
 
-// DroneBridge options
-#define INTERFACE "wlx8416f916382c"
-#define FRAME_TYPE  2   // 1=RTS; 2=DATA
-#define DATARATE    11  // Mbit
-#define COMMID      16
-#define DST_PORT    10  // destination port
-#define RECV_PORT   DST_PORT
-
-#define PAYLOAD_BUFF_SIZ 1024
+#define BENCH_API_DIV   0   // db_send_div: payload gets copied into the frame buffer of the socket
+#define BENCH_API_HP    1   // db_send_hp_div: payload is written into the frame buffer directly
+#define BENCH_API_BATCH 2   // db_batch_add + db_send_batch: one sendmmsg per batch
 
-int keep_running = 1;
+volatile int keep_running = 1;
+char adapters[DB_MAX_ADAPTERS][IFNAMSIZ];
+int num_adapters = 0;
+uint8_t comm_id = DB_BENCH_DEFAULT_COMMID;
+uint8_t port = DB_BENCH_DEFAULT_PORT;
+uint8_t frame_type = DB_FRAMETYPE_DATA;
+int bitrate_op = 1;
+int api = BENCH_API_DIV;
+int batch_size = 16;
+int payload_size = 1024;
+double rate_pps = 0;        // messages per second, 0 = as fast as possible
+double duration_s = 10;
+uint64_t max_messages = 0;  // 0 = unlimited
+int adhere_80211 = 0;
+int protocol_version = DB_RAW_DEFAULT_VERSION;
+uint32_t tx_ring_frames = 0;
+double report_interval_s = 1;
 
 void int_handler(int dummy) {
     keep_running = 0;
 }
 
+void print_usage() {
+    printf("DroneBridge raw link benchmark (sender). Use"
+           "\n\t-n <network interface> Repeat for multiple adapters (max %i). Every message is sent on every adapter"
+           "\n\t-c <communication id> default %i"
+           "\n\t-p <port> DroneBridge raw port, default %i"
+           "\n\t-f <1|2|3> frame type RTS, DATA, BEACON. Default 2"
+           "\n\t-b <bitrate> in Mbps (1|2|5|6|9|11|12|18|24|36|48|54), default 1"
+           "\n\t-s <payload size> bytes, default 1024"
+           "\n\t-r <messages/s> default 0 = as fast as possible"
+           "\n\t-t <seconds> duration, default 10"
+           "\n\t-N <messages> stop after this number of messages"
+           "\n\t-a <div|hp|batch> send API, default div"
+           "\n\t-B <frames> messages per sendmmsg with -a batch, default 16 (max %i)"
+           "\n\t-R <frames> use a PACKET_TX_RING with this number of frames"
+           "\n\t-v <2|3> raw protocol version, default %i"
+           "\n\t-o Adhere to 802.11 header (DB_RAW_OFFSET)"
+           "\n\t-i <seconds> report interval, default 1\n", DB_MAX_ADAPTERS, DB_BENCH_DEFAULT_COMMID,
+           DB_BENCH_DEFAULT_PORT, DB_BATCH_MAX_FRAMES, DB_RAW_DEFAULT_VERSION);
+}
+
+void process_command_line_args(int argc, char *argv[]) {
+    int c;
+    while ((c = getopt(argc, argv, "n:c:p:f:b:s:r:t:N:a:B:R:v:oi:?")) != -1) {
+        switch (c) {
+            case 'n':
+                if (num_adapters < DB_MAX_ADAPTERS) {
+                    strncpy(adapters[num_adapters], optarg, IFNAMSIZ - 1);
+                    num_adapters++;
+                }
+                break;
+            case 'c':
+                comm_id = (uint8_t) strtol(optarg, NULL, 10);
+                break;
+            case 'p':
+                port = (uint8_t) strtol(optarg, NULL, 10);
+                break;
+            case 'f':
+                frame_type = (uint8_t) strtol(optarg, NULL, 10);
+                break;
+            case 'b':
+                bitrate_op = (int) strtol(optarg, NULL, 10);
+                break;
+            case 's':
+                payload_size = (int) strtol(optarg, NULL, 10);
+                break;
+            case 'r':
+                rate_pps = strtod(optarg, NULL);
+                break;
+            case 't':
+                duration_s = strtod(optarg, NULL);
+                break;
+            case 'N':
+                max_messages = strtoull(optarg, NULL, 10);
+                break;
+            case 'a':
+                if (strcmp(optarg, "hp") == 0) api = BENCH_API_HP;
+                else if (strcmp(optarg, "batch") == 0) api = BENCH_API_BATCH;
+                else api = BENCH_API_DIV;
+                break;
+            case 'B':
+                batch_size = (int) strtol(optarg, NULL, 10);
+                break;
+            case 'R':
+                tx_ring_frames = (uint32_t) strtoul(optarg, NULL, 10);
+                break;
+            case 'v':
+                protocol_version = (int) strtol(optarg, NULL, 10);
+                break;
+            case 'o':
+                adhere_80211 = 1;
+                break;
+            case 'i':
+                report_interval_s = strtod(optarg, NULL);
+                break;
+            case '?':
+            default:
+                print_usage();
+                exit(EXIT_SUCCESS);
+        }
+    }
+    if (num_adapters == 0) {
+        print_usage();
+        exit(EXIT_FAILURE);
+    }
+    int max_payload = DATA_UNI_LENGTH - (adhere_80211 ? DB_RAW_OFFSET : 0);
+    if (payload_size < (int) sizeof(struct db_bench_header_t)) payload_size = sizeof(struct db_bench_header_t);
+    if (payload_size > max_payload) payload_size = max_payload;
+    if (batch_size < 1) batch_size = 1;
+    if (batch_size > DB_BATCH_MAX_FRAMES) batch_size = DB_BATCH_MAX_FRAMES;
+    if (api != BENCH_API_BATCH) batch_size = 1;
+}
+
+static void fill_header(uint8_t *payload, uint32_t run_id, uint32_t seq_num) {
+    struct db_bench_header_t *header = (struct db_bench_header_t *) payload;
+    header->magic = DB_BENCH_MAGIC;
+    header->run_id = run_id;
+    header->seq_num = seq_num;
+    header->payload_size = (uint32_t) payload_size;
+    header->tx_time_ns = db_bench_time_ns(CLOCK_REALTIME);
+}
+
+static void print_report(const char *name, uint64_t messages, uint64_t failed, double seconds) {
+    int frame_size = RADIOTAP_LENGTH + (protocol_version == 2 ? DB_RAW_V2_HEADER_LENGTH : DB_RAW_V3_HEADER_LENGTH) +
+                     (adhere_80211 ? DB_RAW_OFFSET : 0) + payload_size;
+    double pps = messages / seconds;
+    printf("%s: %llu messages (%llu frames, %llu failed) in %.2fs: %.0f msg/s %.0f frames/s, payload %.2f Mbit/s, "
+           "on air %.2f Mbit/s\n", name, (unsigned long long) messages,
+           (unsigned long long) (messages * num_adapters), (unsigned long long) failed, seconds, pps,
+           pps * num_adapters, pps * payload_size * 8 / 1e6, pps * num_adapters * frame_size * 8 / 1e6);
+}
+
 int main(int argc, char *argv[]) {
+    process_command_line_args(argc, argv);
     signal(SIGINT, int_handler);
     signal(SIGTERM, int_handler);
-    char interface[IFNAMSIZ];
-    strcpy(interface, argv[1]);
 
-    db_socket_t raw_socket = open_db_socket(interface, COMMID, 'm', DATARATE, DB_DIREC_GROUND,
-                                            RECV_PORT, (uint8_t) FRAME_TYPE);
+    db_socket_t raw_sockets[DB_MAX_ADAPTERS];
+    for (int a = 0; a < num_adapters; a++) {
+        raw_sockets[a] = open_db_socket(adapters[a], comm_id, 'm', bitrate_op, DB_DIREC_GROUND, port, frame_type);
+        if (raw_sockets[a].db_socket < 0) exit(EXIT_FAILURE);
+        db_socket_set_version(&raw_sockets[a], protocol_version);
+        if (tx_ring_frames > 0 && db_socket_enable_tx_ring(&raw_sockets[a], tx_ring_frames) < 0)
+            printf("DB_BENCH: TX ring not available on %s, using sendto\n", adapters[a]);
+    }
+
+    static uint8_t payloads[DB_BATCH_MAX_FRAMES][DATA_UNI_LENGTH];
+    for (int i = 0; i < batch_size; i++) {
+        for (int j = 0; j < payload_size; j++) payloads[i][j] = (uint8_t) j;
+    }
+    static db_send_batch_t send_batch;
+    db_bench_hist_t call_hist;
+    db_bench_hist_reset(&call_hist);
+    srand((unsigned int) db_bench_time_ns(CLOCK_REALTIME));
+    uint32_t run_id = (uint32_t) rand();
+    uint32_t bench_seq_num = 0;
+    uint16_t raw_seq_num = 0;
+    uint64_t messages = 0, failed = 0, interval_messages = 0, interval_failed = 0;
 
-    uint8_t seq_num = 0;
-    uint8_t payload[PAYLOAD_BUFF_SIZ];
-    memset(payload, 1, PAYLOAD_BUFF_SIZ);
+    printf("DB_BENCH: Sending %i byte messages on %i adapter(s) using %s%s, %s\n", payload_size, num_adapters,
+           api == BENCH_API_HP ? "db_send_hp_div" : (api == BENCH_API_BATCH ? "sendmmsg batches" : "db_send_div"),
+           tx_ring_frames > 0 ? " + TX ring" : "", rate_pps > 0 ? "rate limited" : "as fast as possible");
+    uint64_t start = db_bench_time_ns(CLOCK_MONOTONIC);
+    uint64_t end = start + (uint64_t) (duration_s * 1e9);
+    uint64_t next_report = start + (uint64_t) (report_interval_s * 1e9), last_report = start;
+    double interval_ns = rate_pps > 0 ? 1e9 / rate_pps * batch_size : 0;
+    uint64_t rounds = 0;
+    while (keep_running && (max_messages == 0 || messages < max_messages)) {
+        uint64_t now = db_bench_time_ns(CLOCK_MONOTONIC);
+        if (now >= end) break;
+        if (interval_ns > 0) {
+            uint64_t due = start + (uint64_t) (rounds * interval_ns);
+            if (due > now) {
+                struct timespec ts = {.tv_sec = (time_t) (due / 1000000000ULL), .tv_nsec = (long) (due % 1000000000ULL)};
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            }
+        }
+        rounds++;
+        int num_messages = batch_size;
+        if (max_messages > 0 && messages + num_messages > max_messages) num_messages = (int) (max_messages - messages);
+        uint16_t first_raw_seq_num = raw_seq_num;
+        for (int a = 0; a < num_adapters; a++) {
+            int ret = 0;
+            uint64_t t0 = 0;
+            switch (api) {
+                case BENCH_API_HP: {
+                    uint8_t *buffer = get_hp_raw_buffer(&raw_sockets[a], adhere_80211)->bytes;
+                    if (a == 0) update_seq_num16(&raw_seq_num);
+                    memcpy(buffer, payloads[0], (size_t) payload_size);
+                    fill_header(buffer, run_id, bench_seq_num);
+                    t0 = db_bench_time_ns(CLOCK_MONOTONIC);
+                    ret = db_send_hp_div(&raw_sockets[a], port, (uint16_t) payload_size, raw_seq_num);
+                    break;
+                }
+                case BENCH_API_BATCH:
+                    raw_seq_num = first_raw_seq_num;
+                    db_batch_reset(&send_batch);
+                    for (int i = 0; i < num_messages; i++) {
+                        struct iovec iov = {.iov_base = payloads[i], .iov_len = (size_t) payload_size};
+                        if (a == 0) fill_header(payloads[i], run_id, bench_seq_num + i);
+                        db_batch_add(&send_batch, &raw_sockets[a], port, &iov, 1, update_seq_num16(&raw_seq_num),
+                                     adhere_80211);
+                    }
+                    t0 = db_bench_time_ns(CLOCK_MONOTONIC);
+                    ret = db_send_batch(&raw_sockets[a], &send_batch);
+                    break;
+                default:
+                    if (a == 0) {
+                        update_seq_num16(&raw_seq_num);
+                        fill_header(payloads[0], run_id, bench_seq_num);
+                    }
+                    t0 = db_bench_time_ns(CLOCK_MONOTONIC);
+                    ret = db_send_div(&raw_sockets[a], payloads[0], port, (uint16_t) payload_size, raw_seq_num,
+                                      adhere_80211);
+                    break;
+            }
+            db_bench_hist_add(&call_hist, db_bench_time_ns(CLOCK_MONOTONIC) - t0);
+            // db_send_batch returns the number of failed frames, the div functions -1 on error
+            uint64_t num_failed = api == BENCH_API_BATCH ? (uint64_t) ret : (ret < 0 ? 1 : 0);
+            failed += num_failed;
+            interval_failed += num_failed;
+        }
+        bench_seq_num += num_messages;
+        messages += num_messages;
+        interval_messages += num_messages;
 
-    while (keep_running) {
-        db_send_div(&raw_socket, payload, DST_PORT, PAYLOAD_BUFF_SIZ, update_seq_num(&seq_num), 0);
-        printf(".");
-        fflush(stdout);
-        usleep((unsigned int) 1e6);
+        now = db_bench_time_ns(CLOCK_MONOTONIC);
+        if (report_interval_s > 0 && now >= next_report) {
+            print_report("interval", interval_messages, interval_failed, (now - last_report) / 1e9);
+            interval_messages = interval_failed = 0;
+            last_report = now;
+            next_report = now + (uint64_t) (report_interval_s * 1e9);
+        }
     }
-    close(raw_socket.db_socket);
-    printf("Terminated");
-}
\ No newline at end of file
+    double seconds = (db_bench_time_ns(CLOCK_MONOTONIC) - start) / 1e9;
+    printf("----\n");
+    print_report("total", messages, failed, seconds);
+    db_bench_hist_print(api == BENCH_API_BATCH ? "send call (per batch)" : "send call", &call_hist);
+    for (int a = 0; a < num_adapters; a++)
+        close(raw_sockets[a].db_socket);
+    return 0;
+}
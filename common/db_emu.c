@@ -0,0 +1,129 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include "db_emu.h"
+#include "db_common.h"
+
+#define EMU_RCVBUF_SIZE (1 << 21) // like the socket buffer of a real adapter, the hub drops frames once it is full
+
+/**
+ * @param ifname Name of the network interface passed to open_db_socket()
+ * @return 1 if the interface is emulated: it starts with DB_EMU_IF_PREFIX or the DB_EMU environment variable is set
+ */
+int db_emu_is_emulated(const char *ifname) {
+    const char *env = getenv(DB_EMU_ENV);
+    return (env != NULL && env[0] != '\0') || strncmp(ifname, DB_EMU_IF_PREFIX, strlen(DB_EMU_IF_PREFIX)) == 0;
+}
+
+/**
+ * @return Name of the hub emulated sockets connect to. Taken from DB_EMU, DB_EMU_DEFAULT_HUB if not set
+ */
+const char *db_emu_hub_name() {
+    const char *env = getenv(DB_EMU_ENV);
+    return (env != NULL && env[0] != '\0') ? env : DB_EMU_DEFAULT_HUB;
+}
+
+static socklen_t emu_abstract_address(struct sockaddr_un *addr, const char *name) {
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    // abstract namespace: leading zero byte, nothing is created on the file system
+    size_t name_length = strnlen(name, sizeof(addr->sun_path) - 1);
+    memcpy(addr->sun_path + 1, name, name_length);
+    return (socklen_t) (offsetof(struct sockaddr_un, sun_path) + 1 + name_length);
+}
+
+/**
+ * Builds the (abstract) address of the link emulator hub
+ * @param addr Filled with the address
+ * @param hub_name Name of the hub
+ * @return Length of the address
+ */
+socklen_t db_emu_hub_address(struct sockaddr_un *addr, const char *hub_name) {
+    char name[sizeof(addr->sun_path)];
+    snprintf(name, sizeof(name), DB_EMU_ADDR_PREFIX ":%s", hub_name);
+    return emu_abstract_address(addr, name);
+}
+
+/**
+ * Extracts the interface name from the address of an emulated socket (dbemu:<hub>:<ifname>:<pid>:<n>)
+ * @return 0 on success or -1 if the address is not an address of an emulated socket
+ */
+int db_emu_parse_endpoint_address(const struct sockaddr_un *addr, socklen_t addr_len, char ifname[IFNAMSIZ]) {
+    char name[sizeof(addr->sun_path)];
+    size_t name_length = addr_len - offsetof(struct sockaddr_un, sun_path);
+    if (addr_len <= offsetof(struct sockaddr_un, sun_path) + 1 || addr->sun_path[0] != '\0') return -1;
+    memcpy(name, addr->sun_path + 1, name_length - 1);
+    name[name_length - 1] = '\0';
+    char *hub = strchr(name, ':');
+    if (hub == NULL || strncmp(name, DB_EMU_ADDR_PREFIX, strlen(DB_EMU_ADDR_PREFIX)) != 0) return -1;
+    char *interface = strchr(hub + 1, ':');
+    if (interface == NULL) return -1;
+    char *end = strchr(interface + 1, ':');
+    if (end == NULL || end - (interface + 1) >= IFNAMSIZ) return -1;
+    memset(ifname, 0, IFNAMSIZ);
+    memcpy(ifname, interface + 1, (size_t) (end - (interface + 1)));
+    return 0;
+}
+
+/**
+ * Opens an emulated DroneBridge socket and registers it with the link emulator hub. Frames get sent with
+ * sendto(hub_addr) and are received from the hub like from a real adapter (synthetic radiotap header + frame).
+ *
+ * @param ifname Name of the emulated interface. All sockets with the same name belong to the same emulated adapter
+ * @param hub_addr Filled with the address frames must be sent to
+ * @param hub_addr_len Filled with the length of hub_addr
+ * @return The socket file descriptor or -1 if the hub is not running
+ */
+int db_emu_open(const char *ifname, struct sockaddr_un *hub_addr, socklen_t *hub_addr_len) {
+    static int socket_cnt = 0;
+    struct sockaddr_un local_addr;
+    char name[sizeof(local_addr.sun_path)];
+    const char *hub_name = db_emu_hub_name();
+    int rcvbuf = EMU_RCVBUF_SIZE;
+
+    int sockfd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        perror("DroneBridgeCommon: Emulator socket ");
+        return -1;
+    }
+    snprintf(name, sizeof(name), DB_EMU_ADDR_PREFIX ":%s:%s:%d:%d", hub_name, ifname, getpid(), socket_cnt++);
+    socklen_t local_addr_len = emu_abstract_address(&local_addr, name);
+    if (bind(sockfd, (struct sockaddr *) &local_addr, local_addr_len) < 0) {
+        perror("DroneBridgeCommon: Emulator bind ");
+        close(sockfd);
+        return -1;
+    }
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    *hub_addr_len = db_emu_hub_address(hub_addr, hub_name);
+    // an empty datagram registers the socket with the hub
+    if (sendto(sockfd, NULL, 0, 0, (struct sockaddr *) hub_addr, *hub_addr_len) < 0) {
+        LOG_SYS_STD(LOG_ERR, "DroneBridgeCommon: Link emulator hub '%s' not reachable (%s). Start db_link_emu -s %s\n",
+                    hub_name, strerror(errno), hub_name);
+        close(sockfd);
+        return -1;
+    }
+    LOG_SYS_STD(LOG_NOTICE, "DroneBridgeCommon: %s is an emulated adapter (hub '%s')\n", ifname, hub_name);
+    return sockfd;
+}
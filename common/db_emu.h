@@ -0,0 +1,49 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DRONEBRIDGE_DB_EMU_H
+#define DRONEBRIDGE_DB_EMU_H
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <net/if.h>
+
+/*
+ * Emulated long range link. Instead of a monitor mode adapter an emulated DroneBridge socket is an AF_UNIX datagram
+ * socket connected to the link emulator hub (link_emu/db_link_emu). The hub forwards every frame to the sockets of all
+ * other emulated adapters and replaces the radiotap header with a synthetic RX radiotap header. Loss, bad FCS, RSSI,
+ * latency, reordering and rate limits are applied by the hub. The frames and BPF filters are the same as on a real
+ * adapter, so all modules run unchanged.
+ */
+#define DB_EMU_ENV          "DB_EMU"        // set to a hub name to emulate all interfaces of the process
+#define DB_EMU_IF_PREFIX    "emu"           // interfaces with this prefix are always emulated (e.g. -n emu0)
+#define DB_EMU_DEFAULT_HUB  "dronebridge"   // hub used for emu* interfaces if DB_EMU is not set
+#define DB_EMU_ADDR_PREFIX  "dbemu"
+
+int db_emu_is_emulated(const char *ifname);
+
+const char *db_emu_hub_name();
+
+socklen_t db_emu_hub_address(struct sockaddr_un *addr, const char *hub_name);
+
+int db_emu_parse_endpoint_address(const struct sockaddr_un *addr, socklen_t addr_len, char ifname[IFNAMSIZ]);
+
+int db_emu_open(const char *ifname, struct sockaddr_un *hub_addr, socklen_t *hub_addr_len);
+
+#endif //DRONEBRIDGE_DB_EMU_H
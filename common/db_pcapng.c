@@ -0,0 +1,282 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "db_pcapng.h"
+#include "db_common.h"
+
+#define PCAPNG_BLOCK_SHB        0x0A0D0D0A
+#define PCAPNG_BLOCK_IDB        0x00000001
+#define PCAPNG_BLOCK_EPB        0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_OPT_END          0
+#define PCAPNG_OPT_IF_NAME      2
+#define PCAPNG_OPT_IF_TSRESOL   9
+#define PCAPNG_MAX_BLOCK_SIZE   (1 << 20)
+#define CAPTURE_FLUSH_INTERVAL_NS 1000000000ULL  // captures survive a crash/kill up to the last second
+
+#define PCAPNG_PAD4(x) (((x) + 3u) & ~3u)
+
+// capture of the process. All sockets share one file, each socket is one pcapng interface
+static struct {
+    FILE *file;
+    pthread_mutex_t lock;
+    int num_sockets;
+    int sockets[DB_PCAPNG_MAX_INTERFACES];
+    uint64_t last_flush_ns;
+} capture = {NULL, PTHREAD_MUTEX_INITIALIZER, 0, {0}, 0};
+
+static uint64_t timespec_to_ns(const struct timespec *ts) {
+    return (uint64_t) ts->tv_sec * 1000000000ULL + (uint64_t) ts->tv_nsec;
+}
+
+static void write_option(FILE *file, uint16_t code, const void *value, uint16_t length) {
+    static const uint8_t padding[4] = {0};
+    fwrite(&code, sizeof(code), 1, file);
+    fwrite(&length, sizeof(length), 1, file);
+    if (length > 0) fwrite(value, 1, length, file);
+    fwrite(padding, 1, PCAPNG_PAD4(length) - length, file);
+}
+
+/**
+ * Opens the capture file if DB_CAPTURE is set. Called by open_db_socket(), only opens the file once per process.
+ * @return 1 if capturing is enabled, 0 if not
+ */
+int db_capture_init_from_env(void) {
+    static int initialised = 0;
+    if (initialised) return capture.file != NULL;
+    initialised = 1;
+    const char *path = getenv(DB_CAPTURE_ENV);
+    if (path == NULL || path[0] == '\0') return 0;
+    size_t path_length = strlen(path);
+    if (path_length > 7 && strcmp(path + path_length - 7, ".pcapng") == 0) return db_capture_open(path) == 0;
+    char file_path[512];
+    mkdir(path, 0755);
+    snprintf(file_path, sizeof(file_path), "%s/%s_%d.pcapng", path, program_invocation_short_name, getpid());
+    return db_capture_open(file_path) == 0;
+}
+
+/**
+ * Starts a capture. Writes the pcapng section header.
+ * @param path File the frames get written to. Gets overwritten
+ * @return 0 on success, -1 on error
+ */
+int db_capture_open(const char *path) {
+    pthread_mutex_lock(&capture.lock);
+    if (capture.file != NULL) fclose(capture.file);
+    capture.file = fopen(path, "wb");
+    capture.num_sockets = 0;
+    if (capture.file == NULL) {
+        pthread_mutex_unlock(&capture.lock);
+        LOG_SYS_STD(LOG_ERR, "DroneBridgeCommon: Could not open capture file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    setvbuf(capture.file, NULL, _IOFBF, 1 << 16);
+    uint32_t shb[7] = {PCAPNG_BLOCK_SHB, 28, PCAPNG_BYTE_ORDER_MAGIC, 0x00000001, 0xffffffff, 0xffffffff, 28};
+    fwrite(shb, sizeof(shb), 1, capture.file);
+    pthread_mutex_unlock(&capture.lock);
+    LOG_SYS_STD(LOG_NOTICE, "DroneBridgeCommon: Capturing received frames to %s\n", path);
+    return 0;
+}
+
+/**
+ * Adds a socket to the capture (pcapng interface description block). Frames of sockets that were not added are not
+ * captured.
+ *
+ * @param sockfd Socket the frames get received on
+ * @param ifname Name of the interface, stored in the capture. Used by the replay to map frames to adapters
+ * @return 0 on success, -1 if capturing is disabled or the max. number of interfaces is reached
+ */
+int db_capture_add_socket(int sockfd, const char *ifname) {
+    pthread_mutex_lock(&capture.lock);
+    if (capture.file == NULL || capture.num_sockets >= DB_PCAPNG_MAX_INTERFACES) {
+        pthread_mutex_unlock(&capture.lock);
+        return -1;
+    }
+    uint16_t name_length = (uint16_t) strnlen(ifname, IFNAMSIZ);
+    uint8_t ts_resolution = 9; // ns
+    uint32_t block_length = 20 + 4 + PCAPNG_PAD4(name_length) + 4 + 4 + 4;
+    // link type + reserved, snap length 0 (unlimited)
+    uint32_t header[4] = {PCAPNG_BLOCK_IDB, block_length, DB_PCAPNG_LINKTYPE_RADIOTAP, 0};
+    fwrite(header, sizeof(header), 1, capture.file);
+    write_option(capture.file, PCAPNG_OPT_IF_NAME, ifname, name_length);
+    write_option(capture.file, PCAPNG_OPT_IF_TSRESOL, &ts_resolution, 1);
+    write_option(capture.file, PCAPNG_OPT_END, NULL, 0);
+    fwrite(&block_length, sizeof(block_length), 1, capture.file);
+    capture.sockets[capture.num_sockets++] = sockfd;
+    pthread_mutex_unlock(&capture.lock);
+    return 0;
+}
+
+/**
+ * @return 1 if frames get captured
+ */
+int db_capture_enabled(void) {
+    return capture.file != NULL;
+}
+
+/**
+ * Writes a received frame to the capture (pcapng enhanced packet block)
+ *
+ * @param sockfd Socket the frame was received on
+ * @param frame Frame starting with the radiotap header
+ * @param length Length of the frame
+ * @param timestamp Receive time (CLOCK_REALTIME). Current time is used if NULL
+ */
+void db_capture_frame(int sockfd, const uint8_t *frame, uint32_t length, const struct timespec *timestamp) {
+    static const uint8_t padding[4] = {0};
+    if (capture.file == NULL) return;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t ts_ns = timespec_to_ns(timestamp != NULL ? timestamp : &now);
+    pthread_mutex_lock(&capture.lock);
+    int interface_id = -1;
+    for (int i = 0; i < capture.num_sockets; i++) {
+        if (capture.sockets[i] == sockfd) {
+            interface_id = i;
+            break;
+        }
+    }
+    if (capture.file != NULL && interface_id >= 0) {
+        uint32_t block_length = 28 + PCAPNG_PAD4(length) + 4;
+        uint32_t header[7] = {PCAPNG_BLOCK_EPB, block_length, (uint32_t) interface_id, (uint32_t) (ts_ns >> 32),
+                              (uint32_t) ts_ns, length, length};
+        fwrite(header, sizeof(header), 1, capture.file);
+        fwrite(frame, 1, length, capture.file);
+        fwrite(padding, 1, PCAPNG_PAD4(length) - length, capture.file);
+        fwrite(&block_length, sizeof(block_length), 1, capture.file);
+        uint64_t now_ns = timespec_to_ns(&now);
+        if (now_ns - capture.last_flush_ns > CAPTURE_FLUSH_INTERVAL_NS) {
+            fflush(capture.file);
+            capture.last_flush_ns = now_ns;
+        }
+    }
+    pthread_mutex_unlock(&capture.lock);
+}
+
+void db_capture_close(void) {
+    pthread_mutex_lock(&capture.lock);
+    if (capture.file != NULL) fclose(capture.file);
+    capture.file = NULL;
+    capture.num_sockets = 0;
+    pthread_mutex_unlock(&capture.lock);
+}
+
+/**
+ * Opens a pcapng file for reading. Only little endian sections (as written by db_capture_*) are supported.
+ * @return 0 on success, -1 on error
+ */
+int db_pcapng_open(db_pcapng_reader_t *reader, const char *path) {
+    memset(reader, 0, sizeof(db_pcapng_reader_t));
+    reader->file = fopen(path, "rb");
+    if (reader->file == NULL) {
+        LOG_SYS_STD(LOG_ERR, "DroneBridgeCommon: Could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    uint32_t shb[3];
+    if (fread(shb, sizeof(shb), 1, reader->file) != 1 || shb[0] != PCAPNG_BLOCK_SHB ||
+        shb[2] != PCAPNG_BYTE_ORDER_MAGIC) {
+        LOG_SYS_STD(LOG_ERR, "DroneBridgeCommon: %s is not a (little endian) pcapng file\n", path);
+        fclose(reader->file);
+        reader->file = NULL;
+        return -1;
+    }
+    fseek(reader->file, 0, SEEK_SET);
+    return 0;
+}
+
+static void parse_idb(db_pcapng_reader_t *reader, const uint8_t *block, uint32_t block_length) {
+    if (reader->num_interfaces >= DB_PCAPNG_MAX_INTERFACES) return;
+    int id = reader->num_interfaces++;
+    reader->link_type[id] = (uint16_t) (block[8] | (block[9] << 8));
+    reader->ts_units_per_s[id] = 1000000; // default resolution: us
+    snprintf(reader->if_name[id], IFNAMSIZ, "if%i", id);
+    uint32_t pos = 16;
+    while (pos + 4 <= block_length - 4) {
+        uint16_t code, length;
+        memcpy(&code, block + pos, 2);
+        memcpy(&length, block + pos + 2, 2);
+        pos += 4;
+        if (code == PCAPNG_OPT_END || pos + length > block_length - 4) break;
+        if (code == PCAPNG_OPT_IF_NAME) {
+            memset(reader->if_name[id], 0, IFNAMSIZ);
+            memcpy(reader->if_name[id], block + pos, length < IFNAMSIZ ? length : IFNAMSIZ - 1);
+        } else if (code == PCAPNG_OPT_IF_TSRESOL && length == 1) {
+            uint8_t resolution = block[pos];
+            int base = (resolution & 0x80) ? 2 : 10, exponent = resolution & 0x7f;
+            // finer resolutions than ns would overflow the conversion to ns: keep the default
+            if (exponent <= (base == 2 ? 30 : 9)) {
+                uint64_t units = 1;
+                for (int i = 0; i < exponent; i++) units *= base;
+                reader->ts_units_per_s[id] = units;
+            }
+        }
+        pos += PCAPNG_PAD4(length);
+    }
+}
+
+/**
+ * Reads the next captured frame. Interface descriptions are collected on the way (reader->if_name)
+ * @return 1 if a frame was returned, 0 at the end of the file, -1 on a corrupt file
+ */
+int db_pcapng_next(db_pcapng_reader_t *reader, db_pcapng_frame_t *frame) {
+    uint32_t header[2];
+    while (fread(header, sizeof(header), 1, reader->file) == 1) {
+        uint32_t block_length = header[1];
+        if (block_length < 12 || block_length > PCAPNG_MAX_BLOCK_SIZE || block_length % 4 != 0) return -1;
+        if (block_length > reader->block_size) {
+            uint8_t *block = realloc(reader->block, block_length);
+            if (block == NULL) return -1;
+            reader->block = block;
+            reader->block_size = block_length;
+        }
+        memcpy(reader->block, header, sizeof(header));
+        if (fread(reader->block + 8, block_length - 8, 1, reader->file) != 1) return -1;
+        if (header[0] == PCAPNG_BLOCK_SHB) {
+            reader->num_interfaces = 0; // interface ids are per section
+        } else if (header[0] == PCAPNG_BLOCK_IDB && block_length >= 20) {
+            parse_idb(reader, reader->block, block_length);
+        } else if (header[0] == PCAPNG_BLOCK_EPB && block_length >= 32) {
+            uint32_t fields[5];
+            memcpy(fields, reader->block + 8, sizeof(fields));
+            if (fields[0] >= (uint32_t) reader->num_interfaces || fields[3] > block_length - 32) return -1;
+            uint64_t ts = ((uint64_t) fields[1] << 32) | fields[2];
+            uint64_t units = reader->ts_units_per_s[fields[0]];
+            frame->interface_id = (int) fields[0];
+            frame->timestamp_ns = units == 1000000000ULL ? ts : ts / units * 1000000000ULL +
+                                                                (ts % units) * 1000000000ULL / units;
+            frame->length = fields[3];
+            frame->data = reader->block + 28;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void db_pcapng_close(db_pcapng_reader_t *reader) {
+    if (reader->file != NULL) fclose(reader->file);
+    free(reader->block);
+    reader->file = NULL;
+    reader->block = NULL;
+}
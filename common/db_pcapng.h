@@ -0,0 +1,74 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DRONEBRIDGE_DB_PCAPNG_H
+#define DRONEBRIDGE_DB_PCAPNG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <net/if.h>
+
+/*
+ * Capture of received DroneBridge raw frames (radiotap header + frame) to pcapng files that can be opened with
+ * Wireshark and replayed with link_emu/db_pcap_replay. Capturing is enabled for all sockets opened with
+ * open_db_socket() by setting DB_CAPTURE to a file (*.pcapng) or a directory. For a directory every process writes
+ * <dir>/<program>_<pid>.pcapng. Frames must be received with db_recv() or db_rx_ring_next() to be captured.
+ */
+#define DB_CAPTURE_ENV              "DB_CAPTURE"
+#define DB_PCAPNG_LINKTYPE_RADIOTAP 127
+#define DB_PCAPNG_MAX_INTERFACES    16
+
+typedef struct {
+    FILE *file;
+    int num_interfaces;
+    char if_name[DB_PCAPNG_MAX_INTERFACES][IFNAMSIZ];
+    uint16_t link_type[DB_PCAPNG_MAX_INTERFACES];
+    uint64_t ts_units_per_s[DB_PCAPNG_MAX_INTERFACES];
+    uint8_t *block;
+    uint32_t block_size;
+} db_pcapng_reader_t;
+
+// One captured frame returned by db_pcapng_next(). data stays valid until the next call
+typedef struct {
+    int interface_id;
+    uint64_t timestamp_ns;
+    uint32_t length;
+    uint8_t *data;
+} db_pcapng_frame_t;
+
+int db_capture_init_from_env(void);
+
+int db_capture_open(const char *path);
+
+int db_capture_add_socket(int sockfd, const char *ifname);
+
+void db_capture_frame(int sockfd, const uint8_t *frame, uint32_t length, const struct timespec *timestamp);
+
+void db_capture_close(void);
+
+int db_capture_enabled(void);
+
+int db_pcapng_open(db_pcapng_reader_t *reader, const char *path);
+
+int db_pcapng_next(db_pcapng_reader_t *reader, db_pcapng_frame_t *frame);
+
+void db_pcapng_close(db_pcapng_reader_t *reader);
+
+#endif //DRONEBRIDGE_DB_PCAPNG_H
@@ -41,6 +41,13 @@ typedef u32 __le32;
 
 #define RADIOTAP_LENGTH         13
 #define DB_RAW_V2_HEADER_LENGTH 10
+#define DB_RAW_V3_HEADER_LENGTH 12
+#define DB_RAW_HEADER_MAX_LENGTH DB_RAW_V3_HEADER_LENGTH
+#define DB_RAW_V3_FLAG          0x80    // set in the direction byte of v3 frames. Ignored by the BPF direction check
+#define DB_RAW_FLAG_RC          0x01    // v3 flags: sent by the RC module. It shares the controller port with the
+                                        // proxy, receivers keep the sequence numbers of both senders apart
+#define DB_RAW_DEFAULT_VERSION  2       // raw protocol version used by new sockets. Receivers accept v2 and v3. Older
+                                        // DroneBridge versions only receive v2, select v3 via db_socket_set_version()
 #define DB_MAX_ADAPTERS 4
 
 #define MSP_DATA_LENTH          34      // size of MSP v1
@@ -48,7 +55,7 @@ typedef u32 __le32;
 #define DB_RC_DATA_LENGTH		16		// size of DB_RC frame
 #define DATA_UNI_LENGTH         2048	// max payload length for raw protocol
 #define DB_RAW_OFFSET			14      // when adhering the 802.11 header the payload is offset to not be overwritten by SQN
-#define MAX_DB_DATA_LENGTH		(RADIOTAP_LENGTH + DB_RAW_V2_HEADER_LENGTH + DATA_UNI_LENGTH) // max length of a db raw packet
+#define MAX_DB_DATA_LENGTH		(RADIOTAP_LENGTH + DB_RAW_HEADER_MAX_LENGTH + DATA_UNI_LENGTH) // max length of a db raw packet
 #define ETHER_TYPE              0x88ab
 
 #define DEFAULT_DB_MODE         'm'
@@ -121,6 +128,19 @@ struct db_raw_v2_header_t {
 	uint8_t seq_num;
 };
 
+// DroneBridge raw protocol v3 header. v2 header extended by the upper byte of a 16bit sequence number and a flags byte.
+// v3 frames have DB_RAW_V3_FLAG set in the direction byte
+struct db_raw_v3_header_t {
+	uint8_t fcf_duration[4];
+	uint8_t direction;
+	uint8_t comm_id;
+	uint8_t port;
+	uint8_t payload_length[2];
+	uint8_t seq_num;	// lower byte of the sequence number
+	uint8_t seq_num_hi;	// upper byte of the sequence number
+	uint8_t flags;		// DB_RAW_FLAG_*, other bits reserved and set to 0
+};
+
 typedef struct {
 	uint8_t ident[2];
 	uint8_t message_id;
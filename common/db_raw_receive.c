@@ -30,14 +30,19 @@
 #include <arpa/inet.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <time.h>
 #include "db_protocol.h"
+#include "db_raw_receive.h"
 #include "radiotap/radiotap_iter.h"
+#include "db_pcapng.h"
 
 #define ARRAY_SIZE(arr) (sizeof(arr)/sizeof((arr)[0]))
 int expected_seq_num;
 
 /**
- * Set a BPF filter on the socket (DroneBridge raw protocol v2)
+ * Set a BPF filter on the socket (DroneBridge raw protocol v2 & v3). The version flag of the direction byte is masked,
+ * so frames of both protocol versions pass the filter.
  *
  * @param newsocket The socket file descriptor on which the BPF filter should be set
  * @param new_comm_id The communication ID that we filter for
@@ -57,8 +62,9 @@ int setBPF(int newsocket, const uint8_t new_comm_id, uint8_t direction, uint8_t
                     {0x07, 0, 0, 0000000000},
                     {0x48, 0, 0, 0000000000},
                     {0x45, 1, 0, 0x0000b400},   // allow rts frames
-                    {0x45, 0, 5, 0x00000800},   // allow data frames
+                    {0x45, 0, 6, 0x00000800},   // allow data frames
                     {0x48, 0, 0, 0x00000004},
+                    {0x54, 0, 0, 0x00007fff},   // mask DB_RAW_V3_FLAG of direction
                     {0x15, 0, 3, 0x00000301},   // <direction><comm id>
                     {0x50, 0, 0, 0x00000006},
                     {0x15, 0, 1, 0x00000005},   // <port>
@@ -67,8 +73,8 @@ int setBPF(int newsocket, const uint8_t new_comm_id, uint8_t direction, uint8_t
             };
 
     // override some of the filter settings
-    dest_filter[11].k = (uint32_t) ((0x00 << 24) | (0x00 << 16) | (direction << 8) | new_comm_id);
-    dest_filter[13].k = (uint32_t) port;
+    dest_filter[12].k = (uint32_t) ((0x00 << 24) | (0x00 << 16) | (direction << 8) | new_comm_id);
+    dest_filter[14].k = (uint32_t) port;
 
     struct sock_fprog bpf =
             {
@@ -163,48 +169,330 @@ uint8_t count_lost_packets(uint8_t last_seq_num, uint8_t received_seq_num) {
 }
 
 /**
- * Gets the payload from a received packet buffer of a raw socket (DB raw socket)
+ * Parses a received DroneBridge raw frame (v2 or v3) in place. Validates that radiotap header, DroneBridge header and
+ * payload fit into the received frame and detects if the payload was sent with DB_RAW_OFFSET.
+ *
+ * @param receive_buffer: The buffer filled by the raw socket during recv() or a frame of the RX ring
+ * @param receive_length: The length of the received raw packet (return value of recv())
+ * @param view: Filled with pointers into receive_buffer. Only valid as long as receive_buffer is not reused
+ * @return 0 on success or -1 if the frame is malformed (view is undefined then)
+ */
+int db_parse_frame(uint8_t *receive_buffer, ssize_t receive_length, db_frame_view_t *view) {
+    if (receive_length < 4) return -1;
+    view->radiotap_length = receive_buffer[2] | (receive_buffer[3] << 8);
+    if (view->radiotap_length + DB_RAW_V2_HEADER_LENGTH > receive_length) return -1;
+    view->header = (struct db_raw_v2_header_t *) (receive_buffer + view->radiotap_length);
+    int raw_header_length = DB_RAW_V2_HEADER_LENGTH;
+    view->seq_num = view->header->seq_num;
+    view->version = 2;
+    view->flags = 0;
+    if (view->header->direction & DB_RAW_V3_FLAG) {
+        if (view->radiotap_length + DB_RAW_V3_HEADER_LENGTH > receive_length) return -1;
+        struct db_raw_v3_header_t *v3_header = (struct db_raw_v3_header_t *) view->header;
+        raw_header_length = DB_RAW_V3_HEADER_LENGTH;
+        view->seq_num |= (uint16_t) (v3_header->seq_num_hi << 8);
+        view->version = 3;
+        view->flags = v3_header->flags;
+    }
+    view->payload_length = view->header->payload_length[0] | (view->header->payload_length[1] << 8);
+    if (view->payload_length > DATA_UNI_LENGTH) return -1;
+    // estimate if the packet was sent with offset payload. 4 FCS bytes may or may not be supplied at end of frame.
+    ssize_t available = receive_length - view->radiotap_length - raw_header_length;
+    view->offset_mode = (uint8_t) (available > (view->payload_length + 4));
+    if (view->offset_mode) available -= DB_RAW_OFFSET;
+    if (view->payload_length > available) return -1;
+    view->payload = receive_buffer + view->radiotap_length + raw_header_length +
+                    (view->offset_mode ? DB_RAW_OFFSET : 0);
+    return 0;
+}
+
+/**
+ * Gets the payload from a received packet buffer of a raw socket (DB raw socket). Copies the payload. Use
+ * db_parse_frame() to access the payload without a copy.
  *
  * @param receive_buffer: The buffer filled by the raw socket during recv()
  * @param receive_length: The length of the received raw packet (return value of recv())
  * @param payload_buffer: The buffer we write the DroneBridge payload into.
  * @param seq_num: A pointer to the variable where we write the sequence number of the packet into
  * @param radiotap_length: A pointer to the variable where we write the radiotap header length into
+ * @return The length of the payload or 0 if the frame is malformed
  */
 uint16_t get_db_payload(uint8_t *receive_buffer, ssize_t receive_length, uint8_t *payload_buffer, uint8_t *seq_num,
                         uint16_t *radiotap_length) {
-    *radiotap_length = receive_buffer[2] | (receive_buffer[3] << 8);
-    *seq_num = receive_buffer[*radiotap_length + 9];
-    uint16_t payload_length =
-            receive_buffer[*radiotap_length + 7] | (receive_buffer[*radiotap_length + 8] << 8); // DB_v2
-    // estimate if the packet was sent with offset payload. 4 FCS bytes may or may not be supplied at end of frame.
-    if ((receive_length - *radiotap_length - DB_RAW_V2_HEADER_LENGTH) <= (payload_length + 4))
-        memcpy(payload_buffer, &receive_buffer[*radiotap_length + DB_RAW_V2_HEADER_LENGTH], payload_length);
-    else if (payload_length <= DATA_UNI_LENGTH)
-        memcpy(payload_buffer, &receive_buffer[*radiotap_length + DB_RAW_V2_HEADER_LENGTH + DB_RAW_OFFSET],
-               payload_length);
-    return payload_length;
+    db_frame_view_t view;
+    if (db_parse_frame(receive_buffer, receive_length, &view) != 0) return 0;
+    *radiotap_length = view.radiotap_length;
+    *seq_num = (uint8_t) view.seq_num;
+    memcpy(payload_buffer, view.payload, view.payload_length);
+    return view.payload_length;
 }
 
 /**
- * Extract RSSI value from radiotap header
- * 
- * @param payload_buffer Buffer containing the received packet data including radiotap header
- * @param radiotap_length Length of radiotap header
- * @return RSSI of received packet
+ * Receives a frame from a DroneBridge socket. Same as recv() but the frame gets captured if DB_CAPTURE is set.
+ *
+ * @param sockfd The DroneBridge socket (db_socket_t.db_socket)
+ * @param receive_buffer Filled with the frame (radiotap header + DroneBridge raw frame)
+ * @param buffer_length Size of receive_buffer
+ * @param flags Flags of recv()
+ * @return Return value of recv()
  */
-int8_t get_rssi(uint8_t *payload_buffer, int radiotap_length) {
+ssize_t db_recv(int sockfd, uint8_t *receive_buffer, size_t buffer_length, int flags) {
+    ssize_t length = recv(sockfd, receive_buffer, buffer_length, flags);
+    if (length > 0 && db_capture_enabled())
+        db_capture_frame(sockfd, receive_buffer, (uint32_t) length, NULL);
+    return length;
+}
+
+/**
+ * Sets up a TPACKET_V3 receive ring on a (bound) raw socket. Afterwards frames must be read with db_rx_ring_next()
+ * instead of recv(). The socket stays selectable: it becomes readable as soon as the kernel retired a block.
+ *
+ * @param ring The ring to initialise
+ * @param sockfd The raw socket (e.g. db_socket_t.db_socket)
+ * @param block_size Size of one block in bytes. Must be a multiple of the page size
+ * @param block_nr Number of blocks inside the ring
+ * @param block_timeout_ms Partially filled blocks are handed to user space after this timeout. Limits the latency
+ * @return 0 on success or -1 if the kernel does not support the ring. Socket can still be used with recv() then
+ */
+int db_rx_ring_open(db_rx_ring_t *ring, int sockfd, uint32_t block_size, uint32_t block_nr,
+                    uint32_t block_timeout_ms) {
+    int version = TPACKET_V3;
+    struct tpacket_req3 req;
+    memset(ring, 0, sizeof(db_rx_ring_t));
+    ring->fd = sockfd;
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        perror("DB_RECEIVE: RX ring: PACKET_VERSION ");
+        return -1;
+    }
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = block_size;
+    req.tp_block_nr = block_nr;
+    req.tp_frame_size = TPACKET_ALIGN(TPACKET3_HDRLEN + MAX_DB_DATA_LENGTH); // only used for sanity checks with V3
+    req.tp_frame_nr = (block_size / req.tp_frame_size) * block_nr;
+    req.tp_retire_blk_tov = block_timeout_ms;
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        perror("DB_RECEIVE: RX ring: PACKET_RX_RING ");
+        return -1;
+    }
+    ring->map_size = (size_t) block_size * block_nr;
+    ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, sockfd, 0);
+    if (ring->map == MAP_FAILED) // MAP_LOCKED may fail due to RLIMIT_MEMLOCK
+        ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, sockfd, 0);
+    if (ring->map == MAP_FAILED) {
+        perror("DB_RECEIVE: RX ring: mmap ");
+        // remove the ring again, otherwise the kernel would keep on filling it instead of the socket queue
+        memset(&req, 0, sizeof(req));
+        setsockopt(sockfd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+        ring->map = NULL;
+        return -1;
+    }
+    ring->block_size = block_size;
+    ring->block_nr = block_nr;
+    return 0;
+}
+
+/**
+ * Returns the next received frame from the ring. Does not block and does not do a syscall. Frames are returned block
+ * by block. A block is given back to the kernel with the first call after its last frame was returned, so a frame
+ * stays valid until the next call of this function.
+ *
+ * @param ring An opened ring
+ * @param frame Set to the start of the frame (radiotap header) inside the ring
+ * @param frame_length Set to the length of the frame
+ * @return 1 if a frame was returned or 0 if no more frames are available (wait for the socket to become readable)
+ */
+int db_rx_ring_next(db_rx_ring_t *ring, uint8_t **frame, uint32_t *frame_length) {
+    while (ring->frames_left == 0) {
+        struct tpacket_block_desc *block = (struct tpacket_block_desc *) (ring->map +
+                                                                          ring->block_idx * ring->block_size);
+        if (ring->block_held) {
+            // all frames of the block were processed. Hand it back to the kernel
+            __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+            ring->block_held = 0;
+            ring->block_idx = (ring->block_idx + 1) % ring->block_nr;
+            continue;
+        }
+        if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0)
+            return 0;
+        ring->block_held = 1;
+        ring->frames_left = block->hdr.bh1.num_pkts;
+        ring->next_frame = (uint8_t *) block + block->hdr.bh1.offset_to_first_pkt;
+    }
+    struct tpacket3_hdr *hdr = (struct tpacket3_hdr *) ring->next_frame;
+    *frame = ring->next_frame + hdr->tp_mac;
+    *frame_length = hdr->tp_snaplen;
+    if (db_capture_enabled()) {
+        struct timespec timestamp = {.tv_sec = hdr->tp_sec, .tv_nsec = hdr->tp_nsec};
+        db_capture_frame(ring->fd, *frame, *frame_length, &timestamp);
+    }
+    ring->next_frame += hdr->tp_next_offset;
+    ring->frames_left--;
+    return 1;
+}
+
+/**
+ * Unmaps the receive ring. Does not close the socket.
+ */
+void db_rx_ring_close(db_rx_ring_t *ring) {
+    if (ring->map) munmap(ring->map, ring->map_size);
+    ring->map = NULL;
+}
+
+void db_dedup_init(db_dedup_t *dedup) {
+    memset(dedup, 0, sizeof(db_dedup_t));
+}
+
+/**
+ * Checks if a frame was already received. v2 frames only carry 8bit sequence numbers, they get extended to 16bit
+ * relative to the highest sequence number received so far: up to DB_DEDUP_V2_LOOKBACK behind it is a copy or a
+ * reordered frame, everything else is ahead of it (frames got lost in between).
+ * The filter starts over if a frame is further behind than the window or if the stream paused for more than
+ * DB_DEDUP_TIMEOUT_MS. Copies arrive within milliseconds, a pause means lost frames or a restarted sender whose
+ * sequence numbers are unrelated to the old ones.
+ *
+ * @param dedup The duplicate filter of the stream
+ * @param view The parsed frame
+ * @return 1 if the frame is new and should be processed, 0 if it is a duplicate
+ */
+int db_dedup_check(db_dedup_t *dedup, const db_frame_view_t *view) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t now_ms = (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+    int timed_out = now_ms - dedup->last_frame_ms > DB_DEDUP_TIMEOUT_MS;
+    dedup->last_frame_ms = now_ms;
+
+    uint16_t seq_num = view->seq_num;
+    if (view->version == 2) {
+        uint8_t ahead = (uint8_t) ((uint8_t) seq_num - (uint8_t) dedup->highest_seq_num);
+        if (ahead > UINT8_MAX - DB_DEDUP_V2_LOOKBACK)
+            seq_num = (uint16_t) (dedup->highest_seq_num - (UINT8_MAX + 1 - ahead));
+        else
+            seq_num = (uint16_t) (dedup->highest_seq_num + ahead);
+    }
+    int diff = (int16_t) (seq_num - dedup->highest_seq_num);
+    if (!dedup->initialised || timed_out || diff <= -DB_DEDUP_WINDOW) {
+        // first frame, the sender restarted or the link was gone: start over
+        memset(dedup->received, 0, sizeof(dedup->received));
+        dedup->initialised = 1;
+        diff = 1;
+        dedup->highest_seq_num = (uint16_t) (seq_num - 1);
+    }
+    if (diff > 0) {
+        // new highest sequence number: move the window
+        if (diff >= DB_DEDUP_WINDOW) {
+            memset(dedup->received, 0, sizeof(dedup->received));
+        } else {
+            int words = diff / 64, bits = diff % 64;
+            for (int i = DB_DEDUP_WINDOW / 64 - 1; i >= 0; i--) {
+                uint64_t shifted = (i - words >= 0) ? dedup->received[i - words] << bits : 0;
+                if (bits && i - words - 1 >= 0) shifted |= dedup->received[i - words - 1] >> (64 - bits);
+                dedup->received[i] = shifted;
+            }
+        }
+        dedup->highest_seq_num = seq_num;
+        dedup->received[0] |= 1;
+        return 1;
+    }
+    int age = -diff;
+    uint64_t mask = (uint64_t) 1 << (age % 64);
+    if (dedup->received[age / 64] & mask) return 0;
+    dedup->received[age / 64] |= mask;
+    return 1;
+}
+
+static inline uint32_t radiotap_le32(const uint8_t *bytes) {
+    return (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8) | ((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+/**
+ * Runs the radiotap iterator once and stores the offsets of all fields DroneBridge reads
+ * @return 0 on success or -1 if the radiotap header is invalid
+ */
+static int radiotap_compile_layout(db_radiotap_layout_t *layout, uint8_t *radiotap_header, uint16_t radiotap_length) {
     struct ieee80211_radiotap_iterator rti;
-    if (ieee80211_radiotap_iterator_init(&rti, (struct ieee80211_radiotap_header *) payload_buffer, radiotap_length,
-                                         NULL) < 0)
-        return 0;
-    while ((ieee80211_radiotap_iterator_next(&rti)) == 0) {
+    if (ieee80211_radiotap_iterator_init(&rti, (struct ieee80211_radiotap_header *) radiotap_header, radiotap_length,
+                                         NULL) != 0)
+        return -1;
+    layout->num_fields = 0;
+    while ((ieee80211_radiotap_iterator_next(&rti)) == 0 && layout->num_fields < DB_RADIOTAP_MAX_FIELDS) {
         switch (rti.this_arg_index) {
+            case IEEE80211_RADIOTAP_RATE:
+            case IEEE80211_RADIOTAP_ANTENNA:
+            case IEEE80211_RADIOTAP_FLAGS:
+            case IEEE80211_RADIOTAP_LOCK_QUALITY:
             case IEEE80211_RADIOTAP_DBM_ANTSIGNAL:
-                return (int8_t) (*rti.this_arg);
+                layout->fields[layout->num_fields].index = (uint8_t) rti.this_arg_index;
+                layout->fields[layout->num_fields].offset = (uint16_t) (rti.this_arg - radiotap_header);
+                layout->num_fields++;
+                break;
             default:
                 break;
         }
     }
+    layout->radiotap_length = radiotap_length;
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * Returns the layout of a radiotap header. Only the first header with a given set of present bitmap words gets parsed
+ * with the radiotap iterator, all following headers with the same bitmap words are looked up in the cache. Read the
+ * fields directly via radiotap_header + layout->fields[i].offset
+ *
+ * @param cache Layout cache of the adapter that received the frame
+ * @param radiotap_header Start of the received frame
+ * @param radiotap_length Length of the radiotap header (max. bytes to parse)
+ * @return The layout or NULL if the radiotap header is invalid. Valid until the next call with the same cache
+ */
+const db_radiotap_layout_t *db_radiotap_get_layout(db_radiotap_cache_t *cache, uint8_t *radiotap_header,
+                                                   int radiotap_length) {
+    uint32_t present[DB_RADIOTAP_MAX_PRESENT_WORDS];
+    int num_present = 0;
+    uint32_t word;
+    if (radiotap_length < 8) return NULL;
+    uint16_t it_len = (uint16_t) (radiotap_header[2] | (radiotap_header[3] << 8));
+    if (it_len > radiotap_length) return NULL;
+    // present bitmap words are chained via the EXT bit
+    do {
+        if (4 + 4 * (num_present + 1) > it_len) return NULL;
+        if (num_present == DB_RADIOTAP_MAX_PRESENT_WORDS) {
+            // too many words to be used as cache key
+            return radiotap_compile_layout(&cache->uncached, radiotap_header, it_len) == 0 ? &cache->uncached : NULL;
+        }
+        word = radiotap_le32(radiotap_header + 4 + 4 * num_present);
+        present[num_present++] = word;
+    } while (word & (1U << IEEE80211_RADIOTAP_EXT));
+
+    for (int i = 0; i < cache->num_layouts; i++) {
+        db_radiotap_layout_t *layout = &cache->layouts[i];
+        if (layout->radiotap_length == it_len && layout->num_present == num_present &&
+            memcmp(layout->present, present, num_present * sizeof(uint32_t)) == 0)
+            return layout;
+    }
+    // cache miss: compile the new layout, replace the oldest one if the cache is full
+    db_radiotap_layout_t *layout = &cache->layouts[cache->next_replace];
+    if (radiotap_compile_layout(layout, radiotap_header, it_len) != 0) return NULL;
+    layout->num_present = (uint8_t) num_present;
+    memcpy(layout->present, present, num_present * sizeof(uint32_t));
+    cache->next_replace = (cache->next_replace + 1) % DB_RADIOTAP_CACHE_SIZE;
+    if (cache->num_layouts < DB_RADIOTAP_CACHE_SIZE) cache->num_layouts++;
+    return layout;
+}
+
+/**
+ * Extract RSSI value from radiotap header. Uses one layout cache for all adapters of the process, so it must not be
+ * called from multiple threads.
+ * 
+ * @param payload_buffer Buffer containing the received packet data including radiotap header
+ * @param radiotap_length Length of radiotap header
+ * @return RSSI of received packet
+ */
+int8_t get_rssi(uint8_t *payload_buffer, int radiotap_length) {
+    static db_radiotap_cache_t rssi_layout_cache;
+    const db_radiotap_layout_t *layout = db_radiotap_get_layout(&rssi_layout_cache, payload_buffer, radiotap_length);
+    if (layout == NULL) return 0;
+    for (int i = 0; i < layout->num_fields; i++) {
+        if (layout->fields[i].index == IEEE80211_RADIOTAP_DBM_ANTSIGNAL)
+            return (int8_t) payload_buffer[layout->fields[i].offset];
+    }
+    return 0;
+}
@@ -21,15 +21,105 @@
 #define STATUS_DB_RECEIVE_H
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <net/if.h>
+#include "db_protocol.h"
+
+// Parsed DroneBridge raw v2/v3 frame. All pointers point into the receive buffer, nothing gets copied
+typedef struct {
+    struct db_raw_v2_header_t *header;  // v3 frames: cast to struct db_raw_v3_header_t
+    uint8_t *payload;
+    uint16_t payload_length;
+    uint16_t seq_num;       // v2 frames only carry the lower 8 bits
+    uint8_t version;        // 2 or 3
+    uint8_t flags;          // v3 flags byte, 0 for v2 frames
+    uint16_t radiotap_length;
+    uint8_t offset_mode;    // 1 if the payload was sent with DB_RAW_OFFSET (adhere_80211_header)
+} db_frame_view_t;
+
+#define DB_DEDUP_WINDOW 256 // number of sequence numbers remembered by the duplicate filter
+#define DB_DEDUP_V2_LOOKBACK 32 // v2 frames further behind are taken as new frames (after a loss gap)
+#define DB_DEDUP_TIMEOUT_MS 250 // a stream without frames for this long starts over (e.g. sender restarted)
+
+/*
+ * Sliding window duplicate filter. Remembers which of the last DB_DEDUP_WINDOW sequence numbers were received, so
+ * copies of a frame received via other adapters (diversity) or retransmissions get dropped even if they arrive out of
+ * order. Use one per port/stream.
+ */
+typedef struct {
+    int initialised;
+    uint16_t highest_seq_num;               // highest sequence number received so far
+    uint64_t last_frame_ms;                 // CLOCK_MONOTONIC time of the last frame
+    uint64_t received[DB_DEDUP_WINDOW / 64];  // bit n: highest_seq_num - n was received
+} db_dedup_t;
+
+/*
+ * Memory mapped receive ring (PACKET_RX_RING, TPACKET_V3). The kernel fills whole blocks of frames and hands them to
+ * user space once a block is full or its timeout expired. All frames of a block are read without a syscall and without
+ * copying them out of the ring.
+ */
+typedef struct {
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    uint32_t block_size;
+    uint32_t block_nr;
+    uint32_t block_idx;     // block that is read next/currently held by user space
+    int block_held;         // block at block_idx was handed to us by the kernel and is not yet released
+    uint32_t frames_left;   // frames of the held block not yet returned by db_rx_ring_next()
+    uint8_t *next_frame;
+} db_rx_ring_t;
+
+#define DB_RADIOTAP_MAX_PRESENT_WORDS 8
+#define DB_RADIOTAP_MAX_FIELDS 32
+#define DB_RADIOTAP_CACHE_SIZE 4
+
+// Position of one radiotap field inside the radiotap header
+typedef struct {
+    uint8_t index;      // IEEE80211_RADIOTAP_* field
+    uint16_t offset;    // from the start of the radiotap header
+} db_radiotap_field_t;
+
+/*
+ * Precompiled radiotap header layout. The offsets of all fields only depend on the present bitmap words (and vendor
+ * namespace lengths, covered by the header length), which are constant for frames of one adapter/driver. Lists the
+ * fields DroneBridge reads (rate, flags, antenna, lock quality, dBm signal) in the order the iterator returns them.
+ */
+typedef struct {
+    uint16_t radiotap_length;
+    uint8_t num_present;
+    uint8_t num_fields;
+    uint32_t present[DB_RADIOTAP_MAX_PRESENT_WORDS];
+    db_radiotap_field_t fields[DB_RADIOTAP_MAX_FIELDS];
+} db_radiotap_layout_t;
+
+// Small cache of radiotap layouts. Keep one per adapter (or receiving thread)
+typedef struct {
+    int num_layouts;
+    int next_replace;
+    db_radiotap_layout_t layouts[DB_RADIOTAP_CACHE_SIZE];
+    db_radiotap_layout_t uncached; // used for headers with more present words than the cache supports
+} db_radiotap_cache_t;
 
 int setBPF(int newsocket, uint8_t new_comm_id, uint8_t direction, uint8_t port);
 int bindsocket(int newsocket, char the_mode, char new_ifname[IFNAMSIZ]);
 int set_socket_nonblocking(int the_socket);
 int set_socket_timeout(int the_socketfd, int time_out_s ,int time_out_us);
+int db_parse_frame(uint8_t *receive_buffer, ssize_t receive_length, db_frame_view_t *view);
 uint16_t get_db_payload(uint8_t *receive_buffer, ssize_t receive_length, uint8_t *payload_buffer, uint8_t *seq_num,
         uint16_t *radiotap_length);
+ssize_t db_recv(int sockfd, uint8_t *receive_buffer, size_t buffer_length, int flags);
+
+int db_rx_ring_open(db_rx_ring_t *ring, int sockfd, uint32_t block_size, uint32_t block_nr,
+                    uint32_t block_timeout_ms);
+int db_rx_ring_next(db_rx_ring_t *ring, uint8_t **frame, uint32_t *frame_length);
+void db_rx_ring_close(db_rx_ring_t *ring);
+
+void db_dedup_init(db_dedup_t *dedup);
+int db_dedup_check(db_dedup_t *dedup, const db_frame_view_t *view);
 
+const db_radiotap_layout_t *db_radiotap_get_layout(db_radiotap_cache_t *cache, uint8_t *radiotap_header,
+                                                   int radiotap_length);
 int8_t get_rssi(uint8_t *payload_buffer, int radiotap_length);
 uint8_t count_lost_packets(uint8_t last_seq_num, uint8_t received_seq_num);
 
@@ -28,11 +28,14 @@
 #include <linux/if_packet.h>
 #include <errno.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include "db_protocol.h"
 #include "db_raw_send_receive.h"
 #include "db_raw_receive.h"
 #include "db_common.h"
 #include "db_utils.h"
+#include "db_emu.h"
+#include "db_pcapng.h"
 
 uint8_t radiotap_header_pre[] = {
         0x00, 0x00, // <-- radiotap version
@@ -57,25 +60,48 @@ const uint8_t frame_control_pre_beacon[] =
                 0x80, 0x00, 0x00, 0x00
         };
 
-struct ifreq raw_if_idx;
-struct ifreq raw_if_mac;
-char interfaceName[IFNAMSIZ];
-struct sockaddr_ll socket_address;
-char mode = 'm';
-int db_raw_offset = 0; // offset between payload and DB raw header. Needed when drivers overwrite payload with 802.11 SQN
+// destination of sendto()/sendmmsg(): the interface of the raw socket or the hub of the link emulator
+static inline struct sockaddr *get_dest_addr(db_socket_t *a_db_socket) {
+    return a_db_socket->emulated ? (struct sockaddr *) &a_db_socket->emu_hub_addr
+                                 : (struct sockaddr *) &a_db_socket->db_socket_addr;
+}
+
+static inline socklen_t get_dest_addr_len(db_socket_t *a_db_socket) {
+    return a_db_socket->emulated ? a_db_socket->emu_hub_addr_len : (socklen_t) sizeof(struct sockaddr_ll);
+}
+
+static inline struct radiotap_header *get_rth(db_socket_t *a_db_socket) {
+    return (struct radiotap_header *) a_db_socket->monitor_framebuffer;
+}
+
+static inline struct db_raw_v3_header_t *get_db_raw_header(db_socket_t *a_db_socket) {
+    return (struct db_raw_v3_header_t *) (a_db_socket->monitor_framebuffer + RADIOTAP_LENGTH);
+}
 
-// init packet structure
-uint8_t monitor_framebuffer[RADIOTAP_LENGTH + DB_RAW_V2_HEADER_LENGTH + DATA_UNI_LENGTH] = {0};
-struct radiotap_header *rth = (struct radiotap_header *) monitor_framebuffer;
-struct db_raw_v2_header_t *db_raw_header = (struct db_raw_v2_header_t *) (monitor_framebuffer + RADIOTAP_LENGTH);
+/**
+ * Fills the per packet fields of a DroneBridge raw header (v2 or v3). The upper sequence number byte is only written
+ * for v3 headers, v2 headers carry the lower 8 bits only.
+ */
+static inline void set_raw_header_fields(uint8_t *raw_header, uint8_t raw_header_length, uint8_t dest_port,
+                                         uint16_t payload_length, uint16_t new_seq_num) {
+    struct db_raw_v3_header_t *header = (struct db_raw_v3_header_t *) raw_header;
+    header->payload_length[0] = (uint8_t) (payload_length & (uint8_t) 0xFF);
+    header->payload_length[1] = (uint8_t) ((payload_length >> (uint8_t) 8) & (uint8_t) 0xFF);
+    header->port = dest_port;
+    header->seq_num = (uint8_t) (new_seq_num & 0xFF);
+    if (raw_header_length == DB_RAW_V3_HEADER_LENGTH)
+        header->seq_num_hi = (uint8_t) (new_seq_num >> 8);
+}
 
 /**
- * Set the transmission bit rate in the radiotap header. Only works with ralink cards.
+ * Set the transmission bit rate in the radiotap header of the socket. Only works with ralink cards.
  * Can be used to change the bitrate before every transmission.
- * 
+ *
+ * @param a_db_socket The socket whose frames get sent with the new bit rate
  * @param bitrate_option Bit rate in Mbps
  */
-void set_bitrate(int bitrate_option) {
+void set_bitrate(db_socket_t *a_db_socket, int bitrate_option) {
+    struct radiotap_header *rth = get_rth(a_db_socket);
     switch (bitrate_option) {
         case 1:
             rth->bytes[8] = 0x02;
@@ -121,20 +147,23 @@ void set_bitrate(int bitrate_option) {
 
 
 /**
- * Setup of the the DroneBridge raw protocol v2 header
- * 
+ * Setup of the the DroneBridge raw protocol header template of the socket
+ *
+ * @param new_socket The socket whose frame buffer gets initialised
+ * @param sockfd
+ * @param ifName Name of the network interface the socket is bound to
  * @param comm_id
  * @param bitrate_option
- * @param frame_type
  * @param send_direction
  * @param frame_type The type of raw frame being sent: 1=RTS, 2=DATA
  * @return The socket file descriptor in case of a success or -1 if we screwed up
  */
-int conf_monitor(int sockfd, uint8_t comm_id, int bitrate_option, uint8_t send_direction, uint8_t new_port,
-                 uint8_t frame_type) {
-    memset(monitor_framebuffer, 0, (RADIOTAP_LENGTH + DB_RAW_V2_HEADER_LENGTH + DATA_UNI_LENGTH));
-    memcpy(rth->bytes, radiotap_header_pre, RADIOTAP_LENGTH);
-    set_bitrate(bitrate_option);
+int conf_monitor(db_socket_t *new_socket, int sockfd, char *ifName, uint8_t comm_id, int bitrate_option,
+                 uint8_t send_direction, uint8_t new_port, uint8_t frame_type) {
+    struct db_raw_v3_header_t *db_raw_header = get_db_raw_header(new_socket);
+    memset(new_socket->monitor_framebuffer, 0, (RADIOTAP_LENGTH + DB_RAW_HEADER_MAX_LENGTH + DATA_UNI_LENGTH));
+    memcpy(get_rth(new_socket)->bytes, radiotap_header_pre, RADIOTAP_LENGTH);
+    set_bitrate(new_socket, bitrate_option);
     // build custom DroneBridge v2 header
     switch (frame_type) {
         case DB_FRAMETYPE_RTS:
@@ -151,17 +180,17 @@ int conf_monitor(int sockfd, uint8_t comm_id, int bitrate_option, uint8_t send_d
     }
     db_raw_header->direction = send_direction;
     db_raw_header->comm_id = comm_id;
-    if (setsockopt(sockfd, SOL_SOCKET, SO_BINDTODEVICE, interfaceName, IFNAMSIZ) < 0) {
+    db_socket_set_version(new_socket, DB_RAW_DEFAULT_VERSION);
+    if (!new_socket->emulated && setsockopt(sockfd, SOL_SOCKET, SO_BINDTODEVICE, ifName, IFNAMSIZ) < 0) {
         LOG_SYS_STD(LOG_ERR,
                     "DroneBridgeCommon: Error binding monitor socket to interface. Closing socket. Please restart.\n");
         close(sockfd);
         return -1;
     }
-    /* Index of the network device */
-    socket_address.sll_ifindex = raw_if_idx.ifr_ifindex;
     uint8_t recv_direction = (uint8_t) ((send_direction == DB_DIREC_DRONE) ? DB_DIREC_GROUND : DB_DIREC_DRONE);
     sockfd = setBPF(sockfd, comm_id, recv_direction, new_port);
     clear_socket_buffer(sockfd);
+    if (db_capture_init_from_env()) db_capture_add_socket(sockfd, ifName);
     return sockfd;
 }
 
@@ -180,10 +209,22 @@ int conf_monitor(int sockfd, uint8_t comm_id, int bitrate_option, uint8_t send_d
  */
 db_socket_t open_db_socket(char *ifName, uint8_t comm_id, char trans_mode, int bitrate_option,
                            uint8_t send_direction, uint8_t receive_new_port, uint8_t frame_type) {
-    mode = trans_mode;
-    db_socket_t new_socket;
+    db_socket_t new_socket = {0};
+    struct ifreq raw_if_idx;
+    struct ifreq raw_if_mac;
     int socket_fd;
-    if (mode == 'w') {
+    if (db_emu_is_emulated(ifName)) {
+        new_socket.emulated = 1;
+        socket_fd = db_emu_open(ifName, &new_socket.emu_hub_addr, &new_socket.emu_hub_addr_len);
+        if (socket_fd < 0) {
+            new_socket.db_socket = -1;
+            return new_socket;
+        }
+        new_socket.db_socket = conf_monitor(&new_socket, socket_fd, ifName, comm_id, bitrate_option, send_direction,
+                                            receive_new_port, frame_type);
+        return new_socket;
+    }
+    if (trans_mode == 'w') {
         // TODO: ignore for now. I will be UDP in future.
         if ((socket_fd = socket(AF_PACKET, SOCK_RAW, IPPROTO_RAW)) == -1) {
             perror("Error opening raw interface for WiFi mode ");
@@ -222,13 +263,103 @@ db_socket_t open_db_socket(char *ifName, uint8_t comm_id, char trans_mode, int b
         return new_socket;
         //return conf_ethernet(dest_mac);
     } else {
-        new_socket.db_socket = conf_monitor(socket_fd, comm_id, bitrate_option, send_direction, receive_new_port,
-                                            frame_type);
-        new_socket.db_socket_addr = socket_address;
+        /* Index of the network device */
+        new_socket.db_socket_addr.sll_family = AF_PACKET;
+        new_socket.db_socket_addr.sll_ifindex = raw_if_idx.ifr_ifindex;
+        new_socket.db_socket = conf_monitor(&new_socket, socket_fd, ifName, comm_id, bitrate_option, send_direction,
+                                            receive_new_port, frame_type);
         return new_socket;
     }
 }
 
+/**
+ * Selects the DroneBridge raw protocol version of the frames sent via the socket. v3 frames carry a 16bit sequence
+ * number, v2 frames only the lower 8 bits. Receivers accept both versions, use v2 when talking to older versions of
+ * DroneBridge. Call before get_hp_raw_buffer() since the payload position depends on the header length.
+ *
+ * @param a_db_socket An opened DroneBridge socket
+ * @param version 2 or 3
+ * @return 0 on success or -1 if the version is not supported
+ */
+int db_socket_set_version(db_socket_t *a_db_socket, int version) {
+    struct db_raw_v3_header_t *db_raw_header = get_db_raw_header(a_db_socket);
+    if (version == 2) {
+        db_raw_header->direction &= (uint8_t) ~DB_RAW_V3_FLAG;
+        a_db_socket->raw_header_length = DB_RAW_V2_HEADER_LENGTH;
+    } else if (version == 3) {
+        db_raw_header->direction |= DB_RAW_V3_FLAG;
+        db_raw_header->seq_num_hi = 0;
+        db_raw_header->flags = a_db_socket->raw_flags;
+        a_db_socket->raw_header_length = DB_RAW_V3_HEADER_LENGTH;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Sets the flags byte of the frames sent via the socket. Only v3 frames carry flags, the flags are kept for the case
+ * that the socket gets switched to v3 later on.
+ *
+ * @param a_db_socket An opened DroneBridge socket
+ * @param flags DB_RAW_FLAG_*
+ */
+void db_socket_set_flags(db_socket_t *a_db_socket, uint8_t flags) {
+    a_db_socket->raw_flags = flags;
+    if (a_db_socket->raw_header_length == DB_RAW_V3_HEADER_LENGTH)
+        get_db_raw_header(a_db_socket)->flags = flags;
+}
+
+/**
+ * Sets up a memory mapped PACKET_TX_RING (TPACKET_V2) for a monitor mode socket. Frames get built directly inside the
+ * ring shared with the kernel and are handed to the driver with a single syscall per flush. The qdisc layer is
+ * bypassed (PACKET_QDISC_BYPASS). Once enabled all send functions of this socket use the ring.
+ * If the ring can not be set up the socket keeps on working with regular sendto/sendmmsg calls.
+ *
+ * @param a_db_socket An opened DroneBridge socket
+ * @param num_frames Number of frames inside the ring. That is the max number of frames between two flushes
+ * @return 0 on success or -1 if the ring is not available (socket still usable without it)
+ */
+int db_socket_enable_tx_ring(db_socket_t *a_db_socket, uint32_t num_frames) {
+    int version = TPACKET_V2, bypass = 1;
+    struct tpacket_req req;
+    if (a_db_socket->db_socket < 0 || a_db_socket->tx_ring != NULL || a_db_socket->emulated) return -1;
+    if (setsockopt(a_db_socket->db_socket, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        LOG_SYS_STD(LOG_WARNING, "DroneBridgeCommon: TX ring: PACKET_VERSION failed: %s\n", strerror(errno));
+        return -1;
+    }
+    if (setsockopt(a_db_socket->db_socket, SOL_PACKET, PACKET_QDISC_BYPASS, &bypass, sizeof(bypass)) < 0)
+        LOG_SYS_STD(LOG_WARNING, "DroneBridgeCommon: TX ring: PACKET_QDISC_BYPASS not supported: %s\n",
+                    strerror(errno));
+    // one frame per block, frame must fit the TPACKET header and the largest DB raw frame
+    uint32_t frame_size = (uint32_t) getpagesize();
+    while (frame_size < TPACKET2_HDRLEN + MAX_DB_DATA_LENGTH + DB_RAW_OFFSET) frame_size <<= 1;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = frame_size;
+    req.tp_frame_size = frame_size;
+    req.tp_block_nr = num_frames;
+    req.tp_frame_nr = num_frames;
+    if (setsockopt(a_db_socket->db_socket, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+        LOG_SYS_STD(LOG_WARNING, "DroneBridgeCommon: TX ring: PACKET_TX_RING failed: %s\n", strerror(errno));
+        return -1;
+    }
+    void *ring = mmap(NULL, frame_size * num_frames, PROT_READ | PROT_WRITE, MAP_SHARED, a_db_socket->db_socket, 0);
+    if (ring == MAP_FAILED) {
+        LOG_SYS_STD(LOG_WARNING, "DroneBridgeCommon: TX ring: mmap failed: %s\n", strerror(errno));
+        // with a configured ring the kernel would send from the (unmapped) ring instead of the sendto() buffer
+        req.tp_block_nr = 0, req.tp_frame_nr = 0;
+        setsockopt(a_db_socket->db_socket, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req));
+        return -1;
+    }
+    a_db_socket->tx_ring = ring;
+    a_db_socket->tx_ring_size = frame_size * num_frames;
+    a_db_socket->tx_frame_size = frame_size;
+    a_db_socket->tx_frame_nr = num_frames;
+    a_db_socket->tx_frame_idx = 0;
+    a_db_socket->tx_pending = 0;
+    return 0;
+}
+
 /**
  * Increases/Updates an existing sequence number so that it can be used to send a new packet over long range socket.
  * Sequence numbers range from 0-255
@@ -241,24 +372,36 @@ uint8_t update_seq_num(uint8_t *old_seq_num) {
 }
 
 /**
- * Returns a pointer to the buffer that gets sent when calling send_packet_hp(..) or send_packet_hp_div(...)
+ * 16bit version of update_seq_num() for the DroneBridge raw protocol v3. Send all copies of a message (diversity,
+ * retransmissions) with the same sequence number so that receivers can drop the duplicates.
+ * @param old_seq_num A pointer to the sequence number
+ * @return The updated sequence number
+ */
+uint16_t update_seq_num16(uint16_t *old_seq_num) {
+    (*old_seq_num)++;
+    return *old_seq_num;
+}
+
+/**
+ * Returns a pointer to the payload section of the sockets frame buffer. That buffer gets sent when calling
+ * db_send_hp_div(...) with the same socket. Every socket has its own buffer, so sockets can be used from different
+ * threads as long as each socket is only used by one thread at a time.
+ * @param a_db_socket The socket whose buffer is returned
  * @param adhere_to_80211_header: Set to 1 to enable. Offsets the payload by some bytes so that it sits outside the
  * 802.11 header. This is required since some drivers (Ubuntu Atheros drivers) write a sequence number to the 802.11
  * header on receive. Without offsetting the payload this sequence number would overwrite 2 bytes of the payload and
  * corrupt it. The receiver will be able to auto detect the offset. Set this to 1 if you are using a non DB-Rasp Kernel!
  * This will make the packet longer!
- * @return: A pointer to the buffer that gets sent when calling send_packet_hp(..) or send_packet_hp_div(...)
+ * @return: A pointer to the payload section of the buffer that gets sent when calling db_send_hp_div(...)
  */
-struct data_uni *get_hp_raw_buffer(int adhere_to_80211_header) {
-    if (adhere_to_80211_header) {
-        db_raw_offset = DB_RAW_OFFSET;
-        return (struct data_uni *) (monitor_framebuffer + RADIOTAP_LENGTH + DB_RAW_V2_HEADER_LENGTH + DB_RAW_OFFSET);
-    } else
-        return (struct data_uni *) (monitor_framebuffer + RADIOTAP_LENGTH + DB_RAW_V2_HEADER_LENGTH);
+struct data_uni *get_hp_raw_buffer(db_socket_t *a_db_socket, int adhere_to_80211_header) {
+    a_db_socket->db_raw_offset = adhere_to_80211_header ? DB_RAW_OFFSET : 0;
+    return (struct data_uni *) (a_db_socket->monitor_framebuffer + RADIOTAP_LENGTH + a_db_socket->raw_header_length +
+                                a_db_socket->db_raw_offset);
 }
 
-static inline void check_payload_length(const uint16_t *payload_length) {
-    if (*payload_length < DB_MIN_PAYLOAD_LENGTH_RTS && db_raw_header->fcf_duration[0] == 0xb4)
+static inline void check_payload_length(db_socket_t *a_db_socket, const uint16_t *payload_length) {
+    if (*payload_length < DB_MIN_PAYLOAD_LENGTH_RTS && get_db_raw_header(a_db_socket)->fcf_duration[0] == 0xb4)
         LOG_SYS_STD(LOG_ERR, "DroneBridgeCommon: Payload too short (<%i) for specified frame type\n",
                     DB_MIN_PAYLOAD_LENGTH_RTS);
     else if (*payload_length <
@@ -267,10 +410,140 @@ static inline void check_payload_length(const uint16_t *payload_length) {
                     DB_MIN_PAYLOAD_LENGTH_DATA_BEACON);
 }
 
+// TX ring frames carry their packet data right after the (aligned) TPACKET_V2 header
+#define TX_RING_DATA_OFFSET (TPACKET2_HDRLEN - sizeof(struct sockaddr_ll))
+
+static inline struct tpacket2_hdr *tx_ring_frame(db_socket_t *a_db_socket, uint32_t frame_idx) {
+    return (struct tpacket2_hdr *) (a_db_socket->tx_ring +
+                                    (frame_idx % a_db_socket->tx_frame_nr) * a_db_socket->tx_frame_size);
+}
+
+/**
+ * Hands all committed ring frames to the driver and waits until the kernel is done with them.
+ * @param frame_failed Optional. Set to 1 for every frame (counted from the first pending frame) the kernel rejected
+ */
+static void tx_ring_send_pending(db_socket_t *a_db_socket, int *frame_failed) {
+    uint32_t first = a_db_socket->tx_frame_idx - a_db_socket->tx_pending, done = 0;
+    while (a_db_socket->tx_pending > 0) {
+        // blocking: returns once the kernel processed all frames or hit a frame it could not send
+        int sent = (int) sendto(a_db_socket->db_socket, NULL, 0, 0, (struct sockaddr *) &a_db_socket->db_socket_addr,
+                                sizeof(struct sockaddr_ll));
+        int send_errno = errno;
+        uint32_t pending = 0;
+        for (uint32_t i = first + done; i != a_db_socket->tx_frame_idx; i++) {
+            struct tpacket2_hdr *hdr = tx_ring_frame(a_db_socket, i);
+            uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+            if (status & TP_STATUS_WRONG_FORMAT) {
+                __atomic_store_n(&hdr->tp_status, TP_STATUS_AVAILABLE, __ATOMIC_RELEASE);
+                a_db_socket->tx_failed++;
+                if (frame_failed) frame_failed[i - first] = 1;
+            } else if (status != TP_STATUS_AVAILABLE) {
+                pending++;
+            }
+        }
+        // frames are processed in order, so the ones still pending are always the last ones
+        int progress = pending < a_db_socket->tx_pending;
+        done += a_db_socket->tx_pending - pending;
+        a_db_socket->tx_pending = pending;
+        if (sent == -1 && send_errno != EINTR) {
+            LOG_SYS_STD(LOG_ERR, "DroneBridgeCommon: Send failed (TX ring): %s\n", strerror(send_errno));
+            if (!progress) {
+                // driver does not take the frames. Drop them so that the ring does not stall
+                for (uint32_t i = first + done; i != a_db_socket->tx_frame_idx; i++) {
+                    __atomic_store_n(&tx_ring_frame(a_db_socket, i)->tp_status, TP_STATUS_AVAILABLE,
+                                     __ATOMIC_RELEASE);
+                    if (frame_failed) frame_failed[i - first] = 1;
+                }
+                a_db_socket->tx_failed += pending;
+                a_db_socket->tx_pending = 0;
+            }
+        }
+    }
+}
+
+/**
+ * Returns the start of the next free TX ring frame. Flushes the ring if it is full.
+ */
+static uint8_t *tx_ring_next_frame(db_socket_t *a_db_socket) {
+    if (a_db_socket->tx_pending == a_db_socket->tx_frame_nr) tx_ring_send_pending(a_db_socket, NULL);
+    return (uint8_t *) tx_ring_frame(a_db_socket, a_db_socket->tx_frame_idx) + TX_RING_DATA_OFFSET;
+}
+
+/**
+ * Marks the current TX ring frame as ready to be sent. Gets sent with the next flush.
+ */
+static void tx_ring_submit_frame(db_socket_t *a_db_socket, uint32_t frame_length) {
+    struct tpacket2_hdr *hdr = tx_ring_frame(a_db_socket, a_db_socket->tx_frame_idx);
+    hdr->tp_len = frame_length;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    a_db_socket->tx_frame_idx++;
+    a_db_socket->tx_pending++;
+}
+
+/**
+ * Writes radiotap + DroneBridge raw header into a TX ring frame
+ * @return Length of the written header
+ */
+static uint32_t tx_ring_write_header(db_socket_t *a_db_socket, uint8_t *frame, uint8_t dest_port,
+                                     uint16_t payload_length, uint16_t new_seq_num, int adhere_80211_header) {
+    uint32_t header_length = RADIOTAP_LENGTH + a_db_socket->raw_header_length;
+    memcpy(frame, a_db_socket->monitor_framebuffer, header_length);
+    set_raw_header_fields(frame + RADIOTAP_LENGTH, a_db_socket->raw_header_length, dest_port, payload_length,
+                          new_seq_num);
+    if (adhere_80211_header) {
+        memset(frame + header_length, 0, DB_RAW_OFFSET);
+        return header_length + DB_RAW_OFFSET;
+    }
+    return header_length;
+}
+
+/**
+ * TX ring version of get_hp_raw_buffer(). Returns a pointer to the payload section of the next free frame of the
+ * sockets TX ring. Write the payload there and call db_tx_ring_commit(). No copy of the payload is needed.
+ * Only valid if db_socket_enable_tx_ring() succeeded.
+ * @param adhere_80211_header Must be the same value as passed to db_tx_ring_commit()
+ * @return Pointer to the payload section of the next frame inside the TX ring
+ */
+struct data_uni *db_tx_ring_get_buffer(db_socket_t *a_db_socket, int adhere_80211_header) {
+    uint8_t *frame = tx_ring_next_frame(a_db_socket);
+    return (struct data_uni *) (frame + RADIOTAP_LENGTH + a_db_socket->raw_header_length +
+                                (adhere_80211_header ? DB_RAW_OFFSET : 0));
+}
+
+/**
+ * Completes the frame returned by db_tx_ring_get_buffer() with the radiotap and DroneBridge raw header and queues it
+ * for sending. Nothing is sent before db_tx_ring_flush() gets called, so commit all frames of a block and flush once.
+ * @param dest_port The DroneBridge destination port of the message (see db_protocol.h)
+ * @param payload_length The length of the payload in bytes
+ * @param new_seq_num Specify the sequence number of the packet
+ * @param adhere_80211_header Must be the same value as passed to db_tx_ring_get_buffer()
+ * @return 0 on success
+ */
+int db_tx_ring_commit(db_socket_t *a_db_socket, uint8_t dest_port, uint16_t payload_length, uint16_t new_seq_num,
+                      int adhere_80211_header) {
+    check_payload_length(a_db_socket, &payload_length);
+    uint8_t *frame = (uint8_t *) tx_ring_frame(a_db_socket, a_db_socket->tx_frame_idx) + TX_RING_DATA_OFFSET;
+    uint32_t header_length = tx_ring_write_header(a_db_socket, frame, dest_port, payload_length, new_seq_num,
+                                                  adhere_80211_header);
+    tx_ring_submit_frame(a_db_socket, header_length + payload_length);
+    return 0;
+}
+
+/**
+ * Sends all frames committed to the TX ring with a single syscall
+ * @return Number of frames that could not be sent since the last flush
+ */
+int db_tx_ring_flush(db_socket_t *a_db_socket) {
+    tx_ring_send_pending(a_db_socket, NULL);
+    int failed = (int) a_db_socket->tx_failed;
+    a_db_socket->tx_failed = 0;
+    return failed;
+}
+
 /**
  * This function works the same as send_packet with the difference that it allows for soft. diversity transmission.
  * You can specify a socket (bound to an interface) that should be used to send the packet.
- * Overwrites payload set inside monitor_framebuffer with the provided payload.
+ * Overwrites payload set inside the frame buffer of the socket with the provided payload.
  * @param payload: The payload bytes of the message to be sent. Does use memcpy to write payload into buffer.
  * @param dest_port: The DroneBridge destination port of the message (see db_protocol.h)
  * @param payload_length: The length of the payload in bytes
@@ -280,17 +553,21 @@ static inline void check_payload_length(const uint16_t *payload_length) {
  * @return: 0 on success or -1 on failure
  */
 int db_send_div(db_socket_t *a_db_socket, uint8_t *payload, uint8_t dest_port, uint16_t payload_length,
-                uint8_t new_seq_num, int adhere_80211_header) {
-    check_payload_length(&payload_length);
-    db_raw_header->payload_length[0] = (uint8_t) (payload_length & (uint8_t) 0xFF);
-    db_raw_header->payload_length[1] = (uint8_t) ((payload_length >> (uint8_t) 8) & (uint8_t) 0xFF);
-    db_raw_header->port = dest_port;
-    db_raw_header->seq_num = new_seq_num;
-    struct data_uni *monitor_databuffer_internal = get_hp_raw_buffer(adhere_80211_header);
+                uint16_t new_seq_num, int adhere_80211_header) {
+    if (a_db_socket->tx_ring) {
+        memcpy(db_tx_ring_get_buffer(a_db_socket, adhere_80211_header)->bytes, payload, payload_length);
+        db_tx_ring_commit(a_db_socket, dest_port, payload_length, new_seq_num, adhere_80211_header);
+        return db_tx_ring_flush(a_db_socket) ? -1 : 0;
+    }
+    check_payload_length(a_db_socket, &payload_length);
+    set_raw_header_fields(a_db_socket->monitor_framebuffer + RADIOTAP_LENGTH, a_db_socket->raw_header_length, dest_port,
+                          payload_length, new_seq_num);
+    struct data_uni *monitor_databuffer_internal = get_hp_raw_buffer(a_db_socket, adhere_80211_header);
     memcpy(monitor_databuffer_internal->bytes, payload, payload_length);
-    if (sendto(a_db_socket->db_socket, monitor_framebuffer, (size_t) (RADIOTAP_LENGTH + DB_RAW_V2_HEADER_LENGTH +
-                                                                      payload_length + db_raw_offset), 0,
-               (struct sockaddr *) &a_db_socket->db_socket_addr, sizeof(struct sockaddr_ll)) <= 0) {
+    if (sendto(a_db_socket->db_socket, a_db_socket->monitor_framebuffer,
+               (size_t) (RADIOTAP_LENGTH + a_db_socket->raw_header_length + payload_length +
+                         a_db_socket->db_raw_offset), 0,
+               get_dest_addr(a_db_socket), get_dest_addr_len(a_db_socket)) <= 0) {
         LOG_SYS_STD(LOG_ERR, "DroneBridgeCommon: Send failed (monitor): %s\n", strerror(errno));
         return -1;
     }
@@ -300,13 +577,12 @@ int db_send_div(db_socket_t *a_db_socket, uint8_t *payload, uint8_t dest_port, u
 /**
  * This function works the same as send_packet_hp with the difference that it allows for soft. diversity transmission.
  * You can specify a socket (bound to an interface) that should be used to send the packet.
- * Use this function for maximum performance. No memcpy used. Create a pointer directly pointing inside the
- * monitor_framebuffer array in your script. Fill that with your payload and call this function.
- * This function only sends the monitor_framebuffer. You need to make sure you get the payload inside it.
+ * Use this function for maximum performance. No memcpy used. Get a pointer directly pointing inside the
+ * frame buffer of the socket using get_hp_raw_buffer(). Fill that with your payload and call this function.
+ * This function only sends the frame buffer of the socket. You need to make sure you get the payload inside it.
  * E.g. This will create such a pointer structure:
  *
- *     struct data_uni *data_uni_to_ground = (struct data_uni *)
- *           (monitor_framebuffer + RADIOTAP_LENGTH + DB_RAW_V2_HEADER_LENGTH);
+ *     struct data_uni *data_uni_to_ground = get_hp_raw_buffer(&db_socket, adhere_80211_header);
  *     memset(data_uni_to_ground->bytes, 0xff, DATA_UNI_LENGTH); // set some payload
  *
  * Make sure you update your data every time before sending.
@@ -315,17 +591,145 @@ int db_send_div(db_socket_t *a_db_socket, uint8_t *payload, uint8_t dest_port, u
  * @param new_seq_num Specify the sequence number of the packet
  * @return 0 on success or -1 on failure
  */
-int db_send_hp_div(db_socket_t *a_db_socket, uint8_t dest_port, uint16_t payload_length, uint8_t new_seq_num) {
-    check_payload_length(&payload_length);
-    db_raw_header->payload_length[0] = (uint8_t) (payload_length & (uint8_t) 0xFF);
-    db_raw_header->payload_length[1] = (uint8_t) ((payload_length >> (uint8_t) 8) & (uint8_t) 0xFF);
-    db_raw_header->port = dest_port;
-    db_raw_header->seq_num = new_seq_num;
-    if (sendto(a_db_socket->db_socket, monitor_framebuffer,
-               (size_t) (RADIOTAP_LENGTH + DB_RAW_V2_HEADER_LENGTH + payload_length + db_raw_offset), 0,
-               (struct sockaddr *) &a_db_socket->db_socket_addr, sizeof(struct sockaddr_ll)) <= 0) {
+int db_send_hp_div(db_socket_t *a_db_socket, uint8_t dest_port, uint16_t payload_length, uint16_t new_seq_num) {
+    if (a_db_socket->tx_ring) {
+        // payload was already written to the frame buffer of the socket, copy it into the ring
+        int adhere_80211_header = a_db_socket->db_raw_offset != 0;
+        memcpy(db_tx_ring_get_buffer(a_db_socket, adhere_80211_header)->bytes,
+               get_hp_raw_buffer(a_db_socket, adhere_80211_header)->bytes, payload_length);
+        db_tx_ring_commit(a_db_socket, dest_port, payload_length, new_seq_num, adhere_80211_header);
+        return db_tx_ring_flush(a_db_socket) ? -1 : 0;
+    }
+    check_payload_length(a_db_socket, &payload_length);
+    set_raw_header_fields(a_db_socket->monitor_framebuffer + RADIOTAP_LENGTH, a_db_socket->raw_header_length, dest_port,
+                          payload_length, new_seq_num);
+    if (sendto(a_db_socket->db_socket, a_db_socket->monitor_framebuffer,
+               (size_t) (RADIOTAP_LENGTH + a_db_socket->raw_header_length + payload_length +
+                         a_db_socket->db_raw_offset), 0,
+               get_dest_addr(a_db_socket), get_dest_addr_len(a_db_socket)) <= 0) {
         LOG_SYS_STD(LOG_ERR, "DroneBridgeCommon: Send failed (monitor): %s\n", strerror(errno));
         return -1;
     }
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * Empties a batch so that it can be filled with new frames
+ * @param batch The batch to reset
+ */
+void db_batch_reset(db_send_batch_t *batch) {
+    batch->num_frames = 0;
+}
+
+/**
+ * Adds a frame to a batch. The DroneBridge raw header gets built from the socket settings (same as db_send_hp_div) and
+ * is stored inside the batch. The payload is not copied. It must stay valid until db_send_batch() returned.
+ * @param batch The batch the frame gets added to
+ * @param a_db_socket The socket whose radiotap and DroneBridge raw header template is used
+ * @param dest_port The DroneBridge destination port of the message (see db_protocol.h)
+ * @param payload Payload fragments. They get sent back to back as the payload of the frame
+ * @param num_payload_iov Number of payload fragments (max DB_BATCH_MAX_PAYLOAD_IOV)
+ * @param new_seq_num Specify the sequence number of the packet
+ * @param adhere_80211_header Set to 1 to enable. Offsets the payload by some bytes so that it sits outside the
+ *                               802.11 header. Set this to 1 if you are using a non DB-Rasp Kernel!
+ * @return 0 on success or -1 if the batch is full, the frame has too many payload fragments or the payload is too long
+ */
+int db_batch_add(db_send_batch_t *batch, db_socket_t *a_db_socket, uint8_t dest_port, const struct iovec *payload,
+                 int num_payload_iov, uint16_t new_seq_num, int adhere_80211_header) {
+    if (batch->num_frames >= DB_BATCH_MAX_FRAMES || num_payload_iov > DB_BATCH_MAX_PAYLOAD_IOV) return -1;
+    db_batch_frame_t *frame = &batch->frames[batch->num_frames];
+    size_t total_length = 0;
+    for (int i = 0; i < num_payload_iov; i++) {
+        frame->iov[i + 1] = payload[i];
+        total_length += payload[i].iov_len;
+    }
+    if (total_length > DATA_UNI_LENGTH) return -1;
+    uint16_t payload_length = (uint16_t) total_length;
+    check_payload_length(a_db_socket, &payload_length);
+    size_t header_length = RADIOTAP_LENGTH + a_db_socket->raw_header_length;
+    memcpy(frame->header, a_db_socket->monitor_framebuffer, header_length);
+    set_raw_header_fields(frame->header + RADIOTAP_LENGTH, a_db_socket->raw_header_length, dest_port, payload_length,
+                          new_seq_num);
+    if (adhere_80211_header) {
+        memset(frame->header + header_length, 0, DB_RAW_OFFSET);
+        header_length += DB_RAW_OFFSET;
+    }
+    frame->iov[0].iov_base = frame->header;
+    frame->iov[0].iov_len = header_length;
+    frame->sent = 0;
+
+    struct msghdr *msg = &batch->msgs[batch->num_frames].msg_hdr;
+    memset(msg, 0, sizeof(struct msghdr));
+    msg->msg_iov = frame->iov;
+    msg->msg_iovlen = (size_t) (1 + num_payload_iov);
+    batch->num_frames++;
+    return 0;
+}
+
+/**
+ * Copies the frames of a batch into the TX ring of the socket and sends them with one syscall (or one per ring size)
+ * @return Number of frames that could not be sent
+ */
+static int tx_ring_send_batch(db_socket_t *a_db_socket, db_send_batch_t *batch) {
+    int frame_failed[DB_BATCH_MAX_FRAMES] = {0};
+    int failed = 0, chunk_start = 0;
+    if (a_db_socket->tx_pending > 0) tx_ring_send_pending(a_db_socket, NULL);
+    uint32_t failed_before = a_db_socket->tx_failed; // batch failures are reported by the return value only
+    for (int i = 0; i < batch->num_frames; i++) {
+        if (a_db_socket->tx_pending == a_db_socket->tx_frame_nr) {
+            tx_ring_send_pending(a_db_socket, &frame_failed[chunk_start]);
+            chunk_start = i;
+        }
+        uint8_t *frame = tx_ring_next_frame(a_db_socket);
+        // db_batch_add() makes sure that every frame fits into a ring frame
+        size_t frame_length = 0;
+        struct msghdr *msg = &batch->msgs[i].msg_hdr;
+        for (size_t k = 0; k < msg->msg_iovlen; k++) {
+            memcpy(frame + frame_length, msg->msg_iov[k].iov_base, msg->msg_iov[k].iov_len);
+            frame_length += msg->msg_iov[k].iov_len;
+        }
+        tx_ring_submit_frame(a_db_socket, (uint32_t) frame_length);
+    }
+    tx_ring_send_pending(a_db_socket, &frame_failed[chunk_start]);
+    a_db_socket->tx_failed = failed_before;
+    for (int i = 0; i < batch->num_frames; i++) {
+        batch->frames[i].sent = !frame_failed[i];
+        failed += frame_failed[i];
+    }
+    return failed;
+}
+
+/**
+ * Sends all frames of a batch via the specified socket using sendmmsg or the TX ring of the socket if enabled. A failing
+ * frame does not stop the rest of the batch from being sent. Check db_batch_frame_t.sent to see which frames made it.
+ * @param a_db_socket The socket (bound to an interface) used to send the frames
+ * @param batch The filled batch. It stays unchanged, so it can be sent via multiple sockets
+ * @return Number of frames that could not be sent
+ */
+int db_send_batch(db_socket_t *a_db_socket, db_send_batch_t *batch) {
+    if (a_db_socket->tx_ring) return tx_ring_send_batch(a_db_socket, batch);
+    int failed = 0, next = 0;
+    for (int i = 0; i < batch->num_frames; i++) {
+        batch->msgs[i].msg_hdr.msg_name = get_dest_addr(a_db_socket);
+        batch->msgs[i].msg_hdr.msg_namelen = get_dest_addr_len(a_db_socket);
+    }
+    while (next < batch->num_frames) {
+        int sent = sendmmsg(a_db_socket->db_socket, &batch->msgs[next], (unsigned int) (batch->num_frames - next), 0);
+        if (sent > 0) {
+            for (int i = next; i < next + sent; i++)
+                batch->frames[i].sent = batch->msgs[i].msg_len > 0;
+            next += sent;
+        } else if (sent == -1 && errno == EINTR) {
+            continue;
+        } else {
+            // sendmmsg stops at the first frame that fails. Skip it and carry on with the rest of the batch
+            LOG_SYS_STD(LOG_ERR, "DroneBridgeCommon: Send failed (monitor): %s\n", strerror(errno));
+            batch->frames[next].sent = 0;
+            next++;
+        }
+    }
+    for (int i = 0; i < batch->num_frames; i++) {
+        if (!batch->frames[i].sent) failed++;
+    }
+    return failed;
+}
@@ -22,30 +22,87 @@
 
 #include "db_protocol.h"
 #include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <linux/if_packet.h>
 
-// That is the buffer that will be sent over the socket. Create a pointer to a part of this array and fill it with your
-// data, like e.g.:
-// struct uav_rc_status_update_message_t *rc_status_update_data = (struct uav_rc_status_update_message_t *) (monitor_framebuffer + RADIOTAP_LENGTH + DB_RAW_V2_HEADER_LENGTH);
-extern uint8_t monitor_framebuffer[RADIOTAP_LENGTH + DB_RAW_V2_HEADER_LENGTH + DATA_UNI_LENGTH];
-
 typedef struct {
     int db_socket;  // socket file descriptor
     struct sockaddr_ll db_socket_addr;
+    // radiotap + DroneBridge raw header template of this socket followed by the payload sent by db_send_hp_div().
+    // Get a pointer to the payload section with get_hp_raw_buffer(), e.g.:
+    // struct uav_rc_status_update_message_t *rc_status_update_data = (struct uav_rc_status_update_message_t *) get_hp_raw_buffer(&db_socket, 0);
+    uint8_t monitor_framebuffer[RADIOTAP_LENGTH + DB_RAW_HEADER_MAX_LENGTH + DATA_UNI_LENGTH];
+    uint8_t raw_header_length;  // DB_RAW_V2_HEADER_LENGTH or DB_RAW_V3_HEADER_LENGTH, see db_socket_set_version()
+    uint8_t raw_flags;  // DB_RAW_FLAG_* sent with v3 frames, see db_socket_set_flags()
+    int db_raw_offset;  // offset between payload and DB raw header. Needed when drivers overwrite payload with 802.11 SQN
+    // emulated adapter (see db_emu.h): frames are sent to the link emulator hub instead of db_socket_addr
+    int emulated;
+    struct sockaddr_un emu_hub_addr;
+    socklen_t emu_hub_addr_len;
+    // optional memory mapped PACKET_TX_RING (see db_socket_enable_tx_ring). tx_ring is NULL if not enabled
+    uint8_t *tx_ring;
+    uint32_t tx_ring_size;
+    uint32_t tx_frame_size;
+    uint32_t tx_frame_nr;
+    uint32_t tx_frame_idx;  // next ring frame to fill
+    uint32_t tx_pending;    // frames committed to the ring since the last flush
+    uint32_t tx_failed;     // frames the kernel rejected since the last db_tx_ring_flush()
 } db_socket_t;
 
-void set_bitrate(int bitrate_option);
+#define DB_BATCH_MAX_FRAMES      64  // max frames submitted with one sendmmsg call
+#define DB_BATCH_MAX_PAYLOAD_IOV 4   // max payload fragments per frame
+#define DB_FRAME_HEADER_MAX_LENGTH (RADIOTAP_LENGTH + DB_RAW_HEADER_MAX_LENGTH + DB_RAW_OFFSET)
+
+// One frame of a send batch. The radiotap + DroneBridge raw header is kept per frame, the payload is referenced
+typedef struct {
+    uint8_t header[DB_FRAME_HEADER_MAX_LENGTH];
+    struct iovec iov[1 + DB_BATCH_MAX_PAYLOAD_IOV]; // iov[0] is the header
+    int sent; // set by db_send_batch(): 1 if the frame was handed to the driver, 0 if it failed
+} db_batch_frame_t;
+
+// Vector of frames that gets sent with as few syscalls as possible (sendmmsg)
+typedef struct {
+    int num_frames;
+    db_batch_frame_t frames[DB_BATCH_MAX_FRAMES];
+    struct mmsghdr msgs[DB_BATCH_MAX_FRAMES];
+} db_send_batch_t;
+
+void set_bitrate(db_socket_t *a_db_socket, int bitrate_option);
 
 db_socket_t open_db_socket(char *ifName, uint8_t comm_id, char trans_mode, int bitrate_option,
                            uint8_t send_direction, uint8_t receive_new_port, uint8_t frame_type);
 
+int db_socket_set_version(db_socket_t *a_db_socket, int version);
+
+void db_socket_set_flags(db_socket_t *a_db_socket, uint8_t flags);
+
+int db_socket_enable_tx_ring(db_socket_t *a_db_socket, uint32_t num_frames);
+
 uint8_t update_seq_num(uint8_t *old_seq_num);
 
-struct data_uni *get_hp_raw_buffer(int adhere_to_80211_header);
+uint16_t update_seq_num16(uint16_t *old_seq_num);
+
+struct data_uni *get_hp_raw_buffer(db_socket_t *a_db_socket, int adhere_to_80211_header);
 
 int db_send_div(db_socket_t *a_db_socket, uint8_t *payload, uint8_t dest_port, uint16_t payload_length,
-                uint8_t new_seq_num, int adhere_80211_header);
+                uint16_t new_seq_num, int adhere_80211_header);
+
+int db_send_hp_div(db_socket_t *a_db_socket, uint8_t dest_port, uint16_t payload_length, uint16_t new_seq_num);
+
+struct data_uni *db_tx_ring_get_buffer(db_socket_t *a_db_socket, int adhere_80211_header);
+
+int db_tx_ring_commit(db_socket_t *a_db_socket, uint8_t dest_port, uint16_t payload_length, uint16_t new_seq_num,
+                      int adhere_80211_header);
+
+int db_tx_ring_flush(db_socket_t *a_db_socket);
+
+void db_batch_reset(db_send_batch_t *batch);
+
+int db_batch_add(db_send_batch_t *batch, db_socket_t *a_db_socket, uint8_t dest_port, const struct iovec *payload,
+                 int num_payload_iov, uint16_t new_seq_num, int adhere_80211_header);
 
-int db_send_hp_div(db_socket_t *a_db_socket, uint8_t dest_port, uint16_t payload_length, uint8_t new_seq_num);
+int db_send_batch(db_socket_t *a_db_socket, db_send_batch_t *batch);
 
 #endif //CONTROL_DB_RAW_SEND_H
\ No newline at end of file
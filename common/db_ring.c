@@ -0,0 +1,134 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include "db_ring.h"
+
+/**
+ * Initialises an empty ring
+ *
+ * @param ring The ring to initialise
+ * @param capacity Maximum number of items inside the ring. Gets rounded up to the next power of two.
+ * @param shared_items Semaphore shared with other rings of the same consumer or NULL if the ring has its own one.
+ *                     Must be initialised to 0 by the caller.
+ * @return 0 on success or -1 on failure
+ */
+int db_ring_init(db_ring_t *ring, uint32_t capacity, sem_t *shared_items) {
+    uint32_t size = 1;
+    while (size < capacity) size <<= 1;
+    ring->slots = calloc(size, sizeof(void *));
+    if (ring->slots == NULL) return -1;
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    if (shared_items) {
+        ring->items = shared_items;
+    } else {
+        if (sem_init(&ring->own_items, 0, 0) == -1) {
+            free(ring->slots);
+            return -1;
+        }
+        ring->items = &ring->own_items;
+    }
+    return 0;
+}
+
+void db_ring_destroy(db_ring_t *ring) {
+    if (ring->items == &ring->own_items) sem_destroy(&ring->own_items);
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+/**
+ * Adds an item to the ring. Must only be called by the producer thread of this ring.
+ *
+ * @param ring The ring
+ * @param item Pointer to pass to the consumer
+ * @return 0 on success or -1 if the ring is full
+ */
+int db_ring_push(db_ring_t *ring, void *item) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) > ring->mask) return -1;
+    ring->slots[head & ring->mask] = item;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    sem_post(ring->items);
+    return 0;
+}
+
+static void *db_ring_pop(db_ring_t *ring) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&ring->head, memory_order_acquire)) return NULL;
+    void *item = ring->slots[tail & ring->mask];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return item;
+}
+
+static int db_ring_wait(sem_t *items, int timeout_ms) {
+    struct timespec deadline;
+    if (timeout_ms < 0) {
+        while (sem_wait(items) == -1) {
+            if (errno != EINTR) return -1;
+        }
+        return 0;
+    }
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while (sem_timedwait(items, &deadline) == -1) {
+        if (errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Takes the oldest item from the ring. Sleeps if the ring is empty. Must only be called by the consumer thread.
+ *
+ * @param ring The ring. Must not share its semaphore with other rings.
+ * @param timeout_ms Maximum time to wait for an item or -1 to wait forever
+ * @return The item or NULL on timeout
+ */
+void *db_ring_pop_wait(db_ring_t *ring, int timeout_ms) {
+    if (db_ring_wait(ring->items, timeout_ms) == -1) return NULL;
+    return db_ring_pop(ring);
+}
+
+/**
+ * Takes one item from the first non-empty ring of a group of rings sharing one semaphore. Sleeps if all rings are
+ * empty. Must only be called by the consumer thread of the rings.
+ *
+ * @param rings Array of rings with a shared semaphore
+ * @param num_rings Number of rings in the array
+ * @param timeout_ms Maximum time to wait for an item or -1 to wait forever
+ * @return The item or NULL on timeout
+ */
+void *db_ring_pop_any(db_ring_t *rings, int num_rings, int timeout_ms) {
+    if (db_ring_wait(rings[0].items, timeout_ms) == -1) return NULL;
+    // the semaphore counts the items of all rings, so one of them must hold an item now
+    for (int i = 0; i < num_rings; i++) {
+        void *item = db_ring_pop(&rings[i]);
+        if (item) return item;
+    }
+    return NULL;
+}
@@ -0,0 +1,52 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DRONEBRIDGE_DB_RING_H
+#define DRONEBRIDGE_DB_RING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
+/*
+ * Lock-free single producer/single consumer ring of pointers, used to hand preallocated buffers from one pipeline
+ * thread to the next. Push and pop never take a lock. A consumer that runs out of work can sleep on the ring's
+ * semaphore, which counts the items inside the ring(s) it belongs to. Several rings with the same consumer can share
+ * one semaphore, so that the consumer waits for any of them (see db_ring_pop_any()).
+ */
+typedef struct {
+    void **slots;
+    uint32_t mask;              // capacity - 1, capacity is a power of two
+    _Atomic uint32_t head;      // next slot to write, only modified by the producer
+    _Atomic uint32_t tail;      // next slot to read, only modified by the consumer
+    sem_t *items;               // posted once per push
+    sem_t own_items;
+} db_ring_t;
+
+int db_ring_init(db_ring_t *ring, uint32_t capacity, sem_t *shared_items);
+
+void db_ring_destroy(db_ring_t *ring);
+
+int db_ring_push(db_ring_t *ring, void *item);
+
+void *db_ring_pop_wait(db_ring_t *ring, int timeout_ms);
+
+void *db_ring_pop_any(db_ring_t *rings, int num_rings, int timeout_ms);
+
+#endif //DRONEBRIDGE_DB_RING_H
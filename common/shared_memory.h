@@ -45,6 +45,29 @@ typedef struct {
     char name[IFNAMSIZ];
 } __attribute__((packed)) db_adapter_status;
 
+#define DB_GND_MAX_SINKS 8
+#define DB_GND_MAX_VIDEO_CLIENTS 8
+
+// an output of the decoded video stream (stdout, usbbridge, recorder, UDP client)
+typedef struct {
+    char name[8];
+    uint32_t lag; // packets waiting in the output ring for this output
+    uint32_t drop_cnt; // packets dropped by the overflow policy of this output
+    uint32_t sent_cnt;
+    uint64_t sent_bytes;
+} __attribute__((packed)) db_sink_status_t;
+
+// a destination of the decoded video stream via UDP
+typedef struct {
+    uint8_t active; // 0 if the entry is unused
+    uint8_t type; // 0 = registered via video destination hint (lease), 1 = static (-i/default), 2 = multicast
+    uint8_t format; // 0 = raw H.264 byte stream, 1 = RTP (RFC 6184)
+    uint32_t ip; // network byte order
+    uint16_t port;
+    time_t last_hint; // 0 for static destinations
+    db_sink_status_t stats;
+} __attribute__((packed)) db_video_client_status_t;
+
 typedef struct {
     time_t last_update; // video stream
     uint32_t received_block_cnt; // video stream
@@ -56,6 +79,14 @@ typedef struct {
     uint32_t kbitrate; // video stream
     uint32_t wifi_adapter_cnt; // video stream
     db_adapter_status adapter[8];
+    uint32_t decode_time_us; // video stream: FEC decode time of the last block
+    uint32_t decode_latency_us; // video stream: last block, from leaving the reorder window until it got published
+    uint32_t decode_latency_max_us; // video stream
+    uint32_t decode_overflow_cnt; // video stream: packets dropped because all block buffers were in use
+    uint32_t sink_cnt; // video stream
+    db_sink_status_t sink[DB_GND_MAX_SINKS]; // video stream
+    uint32_t video_client_cnt; // video stream: active entries of video_client
+    db_video_client_status_t video_client[DB_GND_MAX_VIDEO_CLIENTS]; // video stream
 } __attribute__((packed)) db_gnd_status_t;
 
 typedef struct {
@@ -86,6 +117,7 @@ typedef struct {
     uint8_t undervolt; // 1 = too low voltage
     uint32_t wifi_adapter_cnt; // video stream
     db_adapter_status adapter[8];
+    uint32_t short_block_cnt; // video stream: blocks sent before they were full (max block age, frame end)
 } __attribute__((packed)) db_uav_status_t;
 
 
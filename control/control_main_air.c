@@ -85,7 +85,7 @@ speed_t interpret_baud(int user_baud) {
  * @param proxy_seq_number
  * @param raw_interfaces_telem
  */
-void send_buffered_mavlink(int length_message, mavlink_message_t *mav_message, uint8_t *proxy_seq_number,
+void send_buffered_mavlink(int length_message, mavlink_message_t *mav_message, uint16_t *proxy_seq_number,
                            db_socket_t *raw_interfaces_telem) {
     mav_tel_message_counter++;  // Number of messages in buffer
     mavlink_msg_to_send_buffer(mavlink_message_buf, mav_message);   // Get over the wire representation of message
@@ -93,10 +93,10 @@ void send_buffered_mavlink(int length_message, mavlink_message_t *mav_message, u
     memcpy(&mavlink_telemetry_buf[mav_tel_buf_length], mavlink_message_buf, (size_t) length_message);
     mav_tel_buf_length += length_message;   // Overall length of buffer
     if (mav_tel_message_counter == 5) {
+        uint16_t seq_num = update_seq_num16(proxy_seq_number);
         for (int i = 0; i < num_inf; i++) {
             db_send_div(&raw_interfaces_telem[i], mavlink_telemetry_buf, DB_PORT_PROXY,
-                        (u_int16_t) mav_tel_buf_length, update_seq_num(proxy_seq_number),
-                        cont_adhere_80211);
+                        (u_int16_t) mav_tel_buf_length, seq_num, cont_adhere_80211);
         }
         mav_tel_message_counter = 0;
         mav_tel_buf_length = 0;
@@ -152,7 +152,7 @@ uint8_t get_cpu_temp() {
  * @param rc_status_update_data
  * @return
  */
-uint8_t send_status_update(uint8_t *status_seq_number, db_socket_t *raw_interfaces_telem, int8_t rssi, long *start,
+uint8_t send_status_update(uint16_t *status_seq_number, db_socket_t *raw_interfaces_telem, int8_t rssi, long *start,
                            long *start_rc, uint8_t *rc_packets_tmp, uint8_t rc_packets_cnt,
                            struct uav_rc_status_update_message_t *rc_status_update_data, const long *rightnow) {
     struct timeval time_check;
@@ -169,9 +169,10 @@ uint8_t send_status_update(uint8_t *status_seq_number, db_socket_t *raw_interfac
         rc_status_update_data->cpu_usage_uav = get_cpu_usage();
         rc_status_update_data->cpu_temp_uav = get_cpu_temp();
         rc_status_update_data->uav_is_low_V = get_undervolt();
+        uint16_t seq_num = update_seq_num16(status_seq_number);
         for (int i = 0; i < num_inf; i++) {
-            db_send_hp_div(&raw_interfaces_telem[i], DB_PORT_STATUS,
-                           (u_int16_t) 14, update_seq_num(status_seq_number));
+            db_send_div(&raw_interfaces_telem[i], (uint8_t *) rc_status_update_data, DB_PORT_STATUS,
+                        (u_int16_t) 14, seq_num, cont_adhere_80211);
         }
 
         gettimeofday(&time_check, NULL);
@@ -253,9 +254,11 @@ int main(int argc, char *argv[]) {
     char sumd_interface[IFNAMSIZ];
     char telem_inf[IFNAMSIZ];
     uint8_t comm_id = DEFAULT_V2_COMMID, frame_type = DB_FRAMETYPE_DEFAULT;
-    uint8_t status_seq_number = 0, proxy_seq_number = 0, serial_byte;
+    uint16_t status_seq_number = 0, proxy_seq_number = 0;
+    uint8_t serial_byte;
     char db_mode = 'm';
     char adapters[DB_MAX_ADAPTERS][IFNAMSIZ];
+    int raw_version = DB_RAW_DEFAULT_VERSION;
 
 // -------------------------------
 // Processing command line arguments
@@ -264,7 +267,7 @@ int main(int argc, char *argv[]) {
     strcpy(sumd_interface, UART_IF);
     cont_adhere_80211 = 0;
     opterr = 0;
-    while ((c = getopt(argc, argv, "n:u:m:c:b:v:l:e:s:r:t:a:")) != -1) {
+    while ((c = getopt(argc, argv, "n:u:m:c:b:v:l:e:s:r:t:a:P:")) != -1) {
         switch (c) {
             case 'n':
                 if (num_inf < DB_MAX_ADAPTERS) {
@@ -302,6 +305,9 @@ int main(int argc, char *argv[]) {
             case 't':
                 frame_type = (uint8_t) strtol(optarg, NULL, 10);
                 break;
+            case 'P':
+                raw_version = (int) strtol(optarg, NULL, 10);
+                break;
             case 'a':
                 cont_adhere_80211 = (int) strtol(optarg, NULL, 10);
             case '?':
@@ -328,13 +334,20 @@ int main(int argc, char *argv[]) {
                        "\n\t-b bit rate:\tin Mbps (1|2|5|6|9|11|12|18|24|36|48|54)\n\t\t(bitrate option only "
                        "supported with Ralink chipsets)"
                        "\n\t-a [0|1] to disable/enable. Offsets the payload by some bytes so that it sits outside "
-                       "then 802.11 header. Set this to 1 if you are using a non DB-Rasp Kernel!",
-                       chucksize, baud_rate);
+                       "then 802.11 header. Set this to 1 if you are using a non DB-Rasp Kernel!"
+                       "\n\t-P [2|3] DroneBridge raw protocol version of sent frames (default: %i). v3 requires v3 "
+                       "support on the ground station",
+                       chucksize, baud_rate, DB_RAW_DEFAULT_VERSION);
                 break;
             default:
                 abort();
         }
     }
+    if (raw_version != 2 && raw_version != 3) {
+        LOG_SYS_STD(LOG_ERR, "DB_CONTROL_AIR: Unsupported raw protocol version %i. Using v%i\n", raw_version,
+                    DB_RAW_DEFAULT_VERSION);
+        raw_version = DB_RAW_DEFAULT_VERSION;
+    }
     conf_rc_serial_protocol_air(serial_protocol_control, use_sumd);
     open_rc_rx_shm(); // open/init shared memory to write RC values into it
 
@@ -348,6 +361,7 @@ int main(int argc, char *argv[]) {
                                               frame_type);
         raw_interfaces_telem[i] = open_db_socket(adapters[i], comm_id, db_mode, bitrate_op, DB_DIREC_GROUND,
                                                  DB_PORT_CONTROLLER, frame_type);
+        db_socket_set_version(&raw_interfaces_telem[i], raw_version);
     }
 
 // -------------------------------
@@ -370,11 +384,17 @@ int main(int argc, char *argv[]) {
     int sentbytes = 0, command_length = 0, errsv, select_return, continue_reading, chunck_left = chucksize,
             serial_read_bytes = 0, max_sd = 0;
     uint8_t serial_bytes[DB_TRANSPARENT_READBUF];
-    int8_t rssi = -128, last_recv_rc_seq_num = 0, last_recv_cont_seq_num = 0;
+    int8_t rssi = -128;
+    // the controller port is shared by the proxy and the RC module, each one counts its own sequence numbers
+    db_dedup_t rc_dedup, cont_dedup[2];
+    int last_cont_v2_seq_num = -1, cont_is_new;
+    db_dedup_init(&rc_dedup);
+    db_dedup_init(&cont_dedup[0]);
+    db_dedup_init(&cont_dedup[1]);
     long start; // start time for status report update
     long start_rc; // start time for measuring the recv RC packets/second
 
-    uint8_t rc_packets_tmp = 0, rc_packets_cnt = 0, seq_num_rc = 0, seq_num_cont = 0;
+    uint8_t rc_packets_tmp = 0, rc_packets_cnt = 0;
     mavlink_message_t mavlink_message;
     mavlink_status_t mavlink_status;
     mspPort_t db_msp_port;
@@ -387,20 +407,20 @@ int main(int argc, char *argv[]) {
 
     ssize_t length;
     signal(SIGINT, intHandler);
-    uint8_t commandBuf[COMMAND_BUF_SIZE];
+    db_frame_view_t frame_view;
     struct timeval timecheck;
 
-    // create our data pointer directly inside the buffer (monitor_framebuffer) that is sent over the socket
-    struct data_uni *raw_buffer = get_hp_raw_buffer(cont_adhere_80211);
-    struct uav_rc_status_update_message_t *rc_status_update_data = (struct uav_rc_status_update_message_t *) raw_buffer;
-    memset(raw_buffer->bytes, 0, DATA_UNI_LENGTH);
+    // telemetry and status messages get their own buffers, so a status update can not overwrite a pending message
+    struct data_uni telem_buffer = {0};
+    struct data_uni *raw_buffer = &telem_buffer;
+    struct uav_rc_status_update_message_t status_update_message = {0};
+    struct uav_rc_status_update_message_t *rc_status_update_data = &status_update_message;
 
     LOG_SYS_STD(LOG_INFO, "DB_CONTROL_AIR: Ready for data! Enabled diversity on %i adapters\n", num_inf);
     gettimeofday(&timecheck, NULL);
     start = (long) timecheck.tv_sec * 1000 + (long) timecheck.tv_usec / 1000; // [ms]
     long last_serial_telem_reconnect_try = start; // [ms]
     start_rc = start;
-    uint16_t radiotap_lenght;
     while (keep_running) {
         socket_timeout.tv_sec = 0;
         socket_timeout.tv_usec = STATUS_UPDATE_TIME * 1000;
@@ -435,14 +455,13 @@ int main(int argc, char *argv[]) {
                     // --------------------------------
                     // DB_RC_PORT for DroneBridge RC packets
                     // --------------------------------
-                    length = recv(raw_interfaces_rc[i].db_socket, buf, BUF_SIZ, 0);
+                    length = db_recv(raw_interfaces_rc[i].db_socket, buf, BUF_SIZ, 0);
                     if (length > 0) {
                         rc_packets_cnt++;
-                        get_db_payload(buf, length, commandBuf, &seq_num_rc, &radiotap_lenght);
-                        rssi = get_rssi(buf, radiotap_lenght);
-                        if (last_recv_rc_seq_num != seq_num_rc) {  // diversity duplicate protection
-                            last_recv_rc_seq_num = seq_num_rc;
-                            command_length = generate_rc_serial_message(commandBuf);
+                        if (db_parse_frame(buf, length, &frame_view) != 0) continue;
+                        rssi = get_rssi(buf, frame_view.radiotap_length);
+                        if (db_dedup_check(&rc_dedup, &frame_view)) {  // diversity duplicate protection
+                            command_length = generate_rc_serial_message(frame_view.payload);
                             if (command_length > 0 && rc_serial_socket > 0) {
                                 sentbytes = (int) write(rc_serial_socket, serial_data_buffer, (size_t) command_length);
                                 errsv = errno;
@@ -464,14 +483,23 @@ int main(int argc, char *argv[]) {
                     // --------------------------------
                     // DB_CONTROL_PORT for incoming MSP/MAVLink
                     // --------------------------------
-                    length = recv(raw_interfaces_telem[i].db_socket, buf, BUF_SIZ, 0);
+                    length = db_recv(raw_interfaces_telem[i].db_socket, buf, BUF_SIZ, 0);
                     if (length > 0) {
-                        rssi = get_rssi(buf, buf[2]);
-                        if (last_recv_cont_seq_num != seq_num_cont) {  // diversity duplicate protection
-                            last_recv_cont_seq_num = seq_num_cont;
-                            command_length = get_db_payload(buf, length, commandBuf, &seq_num_cont, &radiotap_lenght);
+                        if (db_parse_frame(buf, length, &frame_view) != 0) continue;
+                        rssi = get_rssi(buf, frame_view.radiotap_length);
+                        // diversity duplicate protection
+                        if (frame_view.version == 2) {
+                            // v2 frames do not tell the senders apart: only drop back to back copies
+                            cont_is_new = frame_view.seq_num != last_cont_v2_seq_num;
+                            last_cont_v2_seq_num = frame_view.seq_num;
+                        } else {
+                            cont_is_new = db_dedup_check(&cont_dedup[(frame_view.flags & DB_RAW_FLAG_RC) ? 1 : 0],
+                                                         &frame_view);
+                        }
+                        if (cont_is_new) {
+                            command_length = frame_view.payload_length;
                             if (socket_control_serial > 0) {
-                                sentbytes = (int) write(socket_control_serial, commandBuf, (size_t) command_length);
+                                sentbytes = (int) write(socket_control_serial, frame_view.payload, (size_t) command_length);
                                 errsv = errno;
                                 tcdrain(socket_control_serial);
                                 if (sentbytes < command_length) {
@@ -509,10 +537,10 @@ int main(int argc, char *argv[]) {
                                     raw_buffer->bytes[(serial_read_bytes - 1)] = serial_byte;
                                     if (db_msp_port.c_state == MSP_COMMAND_RECEIVED) {
                                         continue_reading = 0; // stop reading from serial port --> got a complete message!
+                                        uint16_t seq_num = update_seq_num16(&proxy_seq_number);
                                         for (int i = 0; i < num_inf; i++) {
-                                            db_send_hp_div(&raw_interfaces_telem[i], DB_PORT_PROXY,
-                                                           (u_int16_t) serial_read_bytes,
-                                                           update_seq_num(&proxy_seq_number));
+                                            db_send_div(&raw_interfaces_telem[i], raw_buffer->bytes, DB_PORT_PROXY,
+                                                        (u_int16_t) serial_read_bytes, seq_num, cont_adhere_80211);
                                         }
                                     }
                                 } else {
@@ -539,9 +567,10 @@ int main(int argc, char *argv[]) {
                                                        &mavlink_status)) {
                                     continue_reading = 0; // stop reading from serial port --> got a complete message!
                                     mavlink_msg_to_send_buffer(raw_buffer->bytes, &mavlink_message);
+                                    uint16_t seq_num = update_seq_num16(&proxy_seq_number);
                                     for (int i = 0; i < num_inf; i++) {
-                                        db_send_hp_div(&raw_interfaces_telem[i], DB_PORT_PROXY,
-                                                       (u_int16_t) chucksize, update_seq_num(&proxy_seq_number));
+                                        db_send_div(&raw_interfaces_telem[i], raw_buffer->bytes, DB_PORT_PROXY,
+                                                    (u_int16_t) chucksize, seq_num, cont_adhere_80211);
                                     }
                                 }
                             }
@@ -554,13 +583,14 @@ int main(int argc, char *argv[]) {
                             memcpy(&transparent_buffer[serial_read_bytes], &serial_bytes, read_bytes);
                             serial_read_bytes += read_bytes;
                             if (serial_read_bytes >= chucksize) {
+                                // retransmissions share the sequence number, the receiver only delivers one copy
+                                uint16_t seq_num = update_seq_num16(&proxy_seq_number);
                                 for (int i = 0; i < num_inf; i++) {
                                     //LOG_SYS_STD(LOG_DEBUG, "DB_CONTROL_AIR: Sending transparent packet %i\n",
                                     //            serial_read_bytes);
                                     for (int r = 0; r < RETRANSMISSION_RATE; r++)
                                         db_send_div(&raw_interfaces_telem[i], transparent_buffer, DB_PORT_PROXY,
-                                                    serial_read_bytes, update_seq_num(&proxy_seq_number),
-                                                    cont_adhere_80211);
+                                                    serial_read_bytes, seq_num, cont_adhere_80211);
                                 }
                                 serial_read_bytes = 0;
                             }
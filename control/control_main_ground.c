@@ -52,10 +52,10 @@ int main(int argc, char *argv[]) {
     char RC_name[128];
     char calibrate_comm[CALI_COMM_SIZE] = {'\0'};
     uint8_t comm_id, frame_type;
-    int rc_int_indx, c, bitrate_op, rc_protocol, adhere_80211;
+    int rc_int_indx, c, bitrate_op, rc_protocol, adhere_80211, use_tx_ring;
     char db_mode = 'm';
     char allow_rc_overwrite = 'N';
-    int num_inf_rc = 0, rc_frequency = DB_DEFAULT_RC_FREQUENCY;
+    int num_inf_rc = 0, rc_frequency = DB_DEFAULT_RC_FREQUENCY, raw_version = DB_RAW_DEFAULT_VERSION;
     char adapters[DB_MAX_ADAPTERS][IFNAMSIZ];
 
     // Command Line processing
@@ -63,10 +63,11 @@ int main(int argc, char *argv[]) {
     rc_protocol = 5;
     bitrate_op = 1;
     adhere_80211 = 0;
+    use_tx_ring = 0;
     comm_id = DEFAULT_V2_COMMID;
     frame_type = DB_FRAMETYPE_DEFAULT;
     opterr = 0;
-    while ((c = getopt(argc, argv, "n:j:m:b:g:v:o:t:c:a:")) != -1) {
+    while ((c = getopt(argc, argv, "n:j:m:b:g:v:o:t:c:a:z:P:")) != -1) {
         switch (c) {
             case 'n':
                 if (num_inf_rc < DB_MAX_ADAPTERS) {
@@ -98,9 +99,15 @@ int main(int argc, char *argv[]) {
             case 'a':
                 adhere_80211 = (int) strtol(optarg, NULL, 10);
                 break;
+            case 'z':
+                use_tx_ring = (int) strtol(optarg, NULL, 10);
+                break;
             case 'r':
                 rc_frequency = (int) strtol(optarg, NULL, 10);
                 break;
+            case 'P':
+                raw_version = (int) strtol(optarg, NULL, 10);
+                break;
             case '?':
                 printf("12ch RC via the DB-RC option (-v 5)\n");
                 printf("14ch RC using FC serial protocol (-v 1|2|4)\n");
@@ -117,15 +124,23 @@ int main(int argc, char *argv[]) {
                        "\n\t-b Bit rate in Mbps: (1|2|5|6|9|11|12|18|24|36|48|54)\n\t\t(bitrate option only "
                        "supported with Ralink chipsets), default is %i Mbps."
                        "\n\t-a <0|1> to enable/disable. Offsets the payload by some bytes so that it sits outside "
-                       "then 802.11 header.\n\t\t Set this to 1 if you are using a non DB-Rasp Kernel!\n",
-                       DB_DEFAULT_RC_FREQUENCY, bitrate_op);
+                       "then 802.11 header.\n\t\t Set this to 1 if you are using a non DB-Rasp Kernel!"
+                       "\n\t-z <0|1> to enable/disable injection via a memory mapped TX ring (PACKET_TX_RING)"
+                       "\n\t-P <2|3> DroneBridge raw protocol version of sent frames (default: %i). v3 requires v3 "
+                       "support on the UAV\n",
+                       DB_DEFAULT_RC_FREQUENCY, bitrate_op, DB_RAW_DEFAULT_VERSION);
                 exit(0);
             default:
                 abort();
         }
     }
+    if (raw_version != 2 && raw_version != 3) {
+        LOG_SYS_STD(LOG_ERR, "DB_CONTROL_GND: Unsupported raw protocol version %i. Using v%i\n", raw_version,
+                    DB_RAW_DEFAULT_VERSION);
+        raw_version = DB_RAW_DEFAULT_VERSION;
+    }
     conf_rc(adapters, num_inf_rc, comm_id, db_mode, bitrate_op, frame_type, rc_protocol, allow_rc_overwrite,
-            adhere_80211);
+            adhere_80211, use_tx_ring, raw_version);
 
     open_rc_shm();
 
@@ -28,7 +28,8 @@
 
 
 int rc_protocol;
-uint8_t crc_mspv2, crc8, rc_seq_number = 0;
+uint8_t crc_mspv2, crc8;
+uint16_t rc_seq_number = 0;
 crc_t crc_rc;
 int i_crc, i_rc, num_interfaces = 0;
 unsigned int rc_crc_tbl_idx, mspv2_tbl_idx;
@@ -36,9 +37,11 @@ db_rc_values_t *shm_rc_values = NULL;
 db_rc_overwrite_values_t *shm_rc_overwrite = NULL;
 struct timespec timestamp;
 bool en_rc_overwrite = false;
+int rc_adhere_80211 = 0;
 
-// pointing right into the sockets send buffer for max performance
-struct data_uni *monitor_databuffer;
+// RC message gets built once and is then sent via the frame buffer of every RC socket
+struct data_uni rc_databuffer;
+struct data_uni *monitor_databuffer = &rc_databuffer;
 
 // DroneBridge raw interfaces. One per adapter
 db_socket_t raw_interfaces_rc[DB_MAX_ADAPTERS] = {0};
@@ -244,16 +247,22 @@ void do_calibration(char *calibrate_comm, int joy_interface_indx) {
  * Sets the desired RC protocol. Opens DroneBridge raw protocol sockets for transmission
  * @param new_rc_protocol 1:MSPv1, 2:MSPv2, 3:MAVLink v1, 4:MAVLink v2, 5:DB-RC
  * @param allow_rc_overwrite Set to 'Y' if you want to allow the overwrite of RC channels via a shm/external app
+ * @param use_tx_ring Set to 1 to send via a memory mapped TX ring (PACKET_TX_RING) if supported by the kernel
+ * @param raw_version DroneBridge raw protocol version of the sent frames (2 or 3)
  * @return
  */
 int conf_rc(char adapters[DB_MAX_ADAPTERS][IFNAMSIZ], int num_inf_rc, int comm_id, char db_mode, int bitrate_op,
-            int frame_type, int new_rc_protocol, char allow_rc_overwrite, int adhere_80211) {
+            int frame_type, int new_rc_protocol, char allow_rc_overwrite, int adhere_80211, int use_tx_ring,
+            int raw_version) {
     rc_protocol = new_rc_protocol;
     en_rc_overwrite = allow_rc_overwrite == 'Y' ? true : false;
-    monitor_databuffer = get_hp_raw_buffer(adhere_80211);
+    rc_adhere_80211 = adhere_80211;
     for (int i = 0; i < num_inf_rc; i++) {
         raw_interfaces_rc[i] = open_db_socket(adapters[i], comm_id, db_mode, bitrate_op, DB_DIREC_DRONE,
                                               DB_PORT_CONTROLLER, frame_type);
+        db_socket_set_flags(&raw_interfaces_rc[i], DB_RAW_FLAG_RC);
+        db_socket_set_version(&raw_interfaces_rc[i], raw_version);
+        if (use_tx_ring) db_socket_enable_tx_ring(&raw_interfaces_rc[i], 4);
     }
     num_interfaces = num_inf_rc;
 }
@@ -290,27 +299,31 @@ int send_rc_packet(uint16_t channel_data[]) {
         shm_rc_values->ch[i_rc] = channel_data[i_rc];
     }
 
+    // all adapters send the message with the same sequence number so that the receiver drops the diversity copies
+    uint16_t seq_num = update_seq_num16(&rc_seq_number);
     if (rc_protocol == 1) {
         generate_msp(channel_data);
         for (int i = 0; i < num_interfaces; i++) {
-            db_send_hp_div(&raw_interfaces_rc[i], DB_PORT_CONTROLLER, MSP_DATA_LENTH,
-                           update_seq_num(&rc_seq_number));
+            db_send_div(&raw_interfaces_rc[i], monitor_databuffer->bytes, DB_PORT_CONTROLLER, MSP_DATA_LENTH, seq_num,
+                        rc_adhere_80211);
         }
     } else if (rc_protocol == 2) {
         generate_mspv2(channel_data);
         for (int i = 0; i < num_interfaces; i++) {
-            db_send_hp_div(&raw_interfaces_rc[i], DB_PORT_CONTROLLER, MSP_V2_DATA_LENGTH,
-                           update_seq_num(&rc_seq_number));
+            db_send_div(&raw_interfaces_rc[i], monitor_databuffer->bytes, DB_PORT_CONTROLLER, MSP_V2_DATA_LENGTH,
+                        seq_num, rc_adhere_80211);
         }
     } else if (rc_protocol == 4) {
+        uint16_t mavlink_length = generate_mavlinkv2_rc_overwrite(channel_data);
         for (int i = 0; i < num_interfaces; i++) {
-            db_send_hp_div(&raw_interfaces_rc[i], DB_PORT_CONTROLLER, generate_mavlinkv2_rc_overwrite(channel_data),
-                           update_seq_num(&rc_seq_number));
+            db_send_div(&raw_interfaces_rc[i], monitor_databuffer->bytes, DB_PORT_CONTROLLER, mavlink_length,
+                        seq_num, rc_adhere_80211);
         }
     } else if (rc_protocol == 5) {
         generate_db_rc_message(channel_data);
         for (int i = 0; i < num_interfaces; i++) {
-            db_send_hp_div(&raw_interfaces_rc[i], DB_PORT_RC, DB_RC_DATA_LENGTH, update_seq_num(&rc_seq_number));
+            db_send_div(&raw_interfaces_rc[i], monitor_databuffer->bytes, DB_PORT_RC, DB_RC_DATA_LENGTH, seq_num,
+                        rc_adhere_80211);
         }
     }
     return 0;
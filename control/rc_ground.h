@@ -29,7 +29,8 @@ void get_joy_interface_path(char *dst_joy_interface_path, int joy_interface_indx
 void do_calibration(char *calibrate_comm, int joy_interface_indx);
 
 int conf_rc(char adapters[DB_MAX_ADAPTERS][IFNAMSIZ], int num_inf_rc, int comm_id, char db_mode, int bitrate_op,
-            int frame_type, int new_rc_protocol, char allow_rc_overwrite, int adhere_80211);
+            int frame_type, int new_rc_protocol, char allow_rc_overwrite, int adhere_80211, int use_tx_ring,
+            int raw_version);
 
 void open_rc_shm();
 
@@ -49,6 +49,9 @@
 
 #include <assert.h>
 #include "fec.h"
+#include "fec_simd.h"
+#include "fec_bitslice.h"
+#include "fec_tables.h"
 
 /*
  * stuff used for testing purposes only
@@ -104,63 +107,12 @@ typedef unsigned char gf;
 #define	GF_SIZE ((1 << GF_BITS) - 1)	/* powers of \alpha */
 
 /*
- * Primitive polynomials - see Lin & Costello, Appendix A,
- * and  Lee & Messerschmitt, p. 453.
- */
-static char *allPp[] = {    /* GF_BITS	polynomial		*/
-    NULL,		    /*  0	no code			*/
-    NULL,		    /*  1	no code			*/
-    "111",		    /*  2	1+x+x^2			*/
-    "1101",		    /*  3	1+x+x^3			*/
-    "11001",		    /*  4	1+x+x^4			*/
-    "101001",		    /*  5	1+x^2+x^5		*/
-    "1100001",		    /*  6	1+x+x^6			*/
-    "10010001",		    /*  7	1 + x^3 + x^7		*/
-    "101110001",	    /*  8	1+x^2+x^3+x^4+x^8	*/
-    "1000100001",	    /*  9	1+x^4+x^9		*/
-    "10010000001",	    /* 10	1+x^3+x^10		*/
-    "101000000001",	    /* 11	1+x^2+x^11		*/
-    "1100101000001",	    /* 12	1+x+x^4+x^6+x^12	*/
-    "11011000000001",	    /* 13	1+x+x^3+x^4+x^13	*/
-    "110000100010001",	    /* 14	1+x+x^6+x^10+x^14	*/
-    "1100000000000001",	    /* 15	1+x+x^15		*/
-    "11010000000010001"	    /* 16	1+x+x^3+x^12+x^16	*/
-};
-
-
-/*
- * To speed up computations, we have tables for logarithm, exponent
- * and inverse of a number. If GF_BITS <= 8, we use a table for
- * multiplication as well (it takes 64K, no big deal even on a PDA,
- * especially because it can be pre-initialized an put into a ROM!),
- * otherwhise we use a table of logarithms.
- * In any case the macro gf_mul(x,y) takes care of multiplications.
- */
-
-static gf gf_exp[2*GF_SIZE];	/* index->poly form conversion table	*/
-static int gf_log[GF_SIZE + 1];	/* Poly->index form conversion table	*/
-static gf inverse[GF_SIZE+1];	/* inverse of field elem.		*/
-				/* inv[\alpha**i]=\alpha**(GF_SIZE-i-1)	*/
-
-/*
- * modnn(x) computes x % GF_SIZE, where GF_SIZE is 2**GF_BITS - 1,
- * without a slow divide.
- */
-static inline gf
-modnn(int x)
-{
-    while (x >= GF_SIZE) {
-	x -= GF_SIZE;
-	x = (x >> GF_BITS) + (x & GF_SIZE);
-    }
-    return x;
-}
-
-#define SWAP(a,b,t) {t tmp; tmp=a; a=b; b=tmp;}
-
-/*
- * gf_mul(x,y) multiplies two numbers. If GF_BITS<=8, it is much
- * faster to use a multiplication table.
+ * The field tables (inverses, the 64K multiplication table and the tables of
+ * the SIMD and bitslice kernels) are generated at build time by
+ * fec_gen_tables.c from the polynomial 1+x^2+x^3+x^4+x^8. They are constant,
+ * live in .rodata and are shared by all encoder/decoder contexts.
+ *
+ * gf_mul(x,y) multiplies two numbers using the multiplication table.
  *
  * USE_GF_MULC, GF_MULC0(c) and GF_ADDMULC(x) can be used when multiplying
  * many numbers by the same constant. In this case the first
@@ -168,112 +120,15 @@ modnn(int x)
  * A value related to the multiplication is held in a local variable
  * declared with USE_GF_MULC . See usage in addmul1().
  */
-static gf gf_mul_table[(GF_SIZE + 1)*(GF_SIZE + 1)] 
-#ifdef WINDOWS
-__attribute__((aligned (16)))
-#else
-__attribute__((aligned (256)))
-#endif
-;
+#define gf_mul(x,y) gf_mul_table[((x)<<8)+(y)]
 
-#define gf_mul(x,y) gf_mul_table[(x<<8)+y]
+#define SWAP(a,b,t) {t tmp; tmp=a; a=b; b=tmp;}
 
-#define USE_GF_MULC register gf * __gf_mulc_
+#define USE_GF_MULC register const gf * __gf_mulc_
 #define GF_MULC0(c) __gf_mulc_ = &gf_mul_table[(c)<<8]
 #define GF_ADDMULC(dst, x) dst ^= __gf_mulc_[x]
 #define GF_MULC(dst, x) dst = __gf_mulc_[x]
 
-static void
-init_mul_table(void)
-{
-    int i, j;
-    for (i=0; i< GF_SIZE+1; i++)
-	for (j=0; j< GF_SIZE+1; j++)
-	    gf_mul_table[(i<<8)+j] = gf_exp[modnn(gf_log[i] + gf_log[j]) ] ;
-
-    for (j=0; j< GF_SIZE+1; j++)
-	gf_mul_table[j] = gf_mul_table[j<<8] = 0;
-}
-
-/*
- * Generate GF(2**m) from the irreducible polynomial p(X) in p[0]..p[m]
- * Lookup tables:
- *     index->polynomial form		gf_exp[] contains j= \alpha^i;
- *     polynomial form -> index form	gf_log[ j = \alpha^i ] = i
- * \alpha=x is the primitive element of GF(2^m)
- *
- * For efficiency, gf_exp[] has size 2*GF_SIZE, so that a simple
- * multiplication of two numbers can be resolved without calling modnn
- */
-
-
-
-/*
- * initialize the data structures used for computations in GF.
- */
-static void
-generate_gf(void)
-{
-    int i;
-    gf mask;
-    char *Pp =  allPp[GF_BITS] ;
-
-    mask = 1;	/* x ** 0 = 1 */
-    gf_exp[GF_BITS] = 0; /* will be updated at the end of the 1st loop */
-    /*
-     * first, generate the (polynomial representation of) powers of \alpha,
-     * which are stored in gf_exp[i] = \alpha ** i .
-     * At the same time build gf_log[gf_exp[i]] = i .
-     * The first GF_BITS powers are simply bits shifted to the left.
-     */
-    for (i = 0; i < GF_BITS; i++, mask <<= 1 ) {
-	gf_exp[i] = mask;
-	gf_log[gf_exp[i]] = i;
-	/*
-	 * If Pp[i] == 1 then \alpha ** i occurs in poly-repr
-	 * gf_exp[GF_BITS] = \alpha ** GF_BITS
-	 */
-	if ( Pp[i] == '1' )
-	    gf_exp[GF_BITS] ^= mask;
-    }
-    /*
-     * now gf_exp[GF_BITS] = \alpha ** GF_BITS is complete, so can als
-     * compute its inverse.
-     */
-    gf_log[gf_exp[GF_BITS]] = GF_BITS;
-    /*
-     * Poly-repr of \alpha ** (i+1) is given by poly-repr of
-     * \alpha ** i shifted left one-bit and accounting for any
-     * \alpha ** GF_BITS term that may occur when poly-repr of
-     * \alpha ** i is shifted.
-     */
-    mask = 1 << (GF_BITS - 1 ) ;
-    for (i = GF_BITS + 1; i < GF_SIZE; i++) {
-	if (gf_exp[i - 1] >= mask)
-	    gf_exp[i] = gf_exp[GF_BITS] ^ ((gf_exp[i - 1] ^ mask) << 1);
-	else
-	    gf_exp[i] = gf_exp[i - 1] << 1;
-	gf_log[gf_exp[i]] = i;
-    }
-    /*
-     * log(0) is not defined, so use a special value
-     */
-    gf_log[0] =	GF_SIZE ;
-    /* set the extended gf_exp values for fast multiply */
-    for (i = 0 ; i < GF_SIZE ; i++)
-	gf_exp[i + GF_SIZE] = gf_exp[i] ;
-
-    /*
-     * again special cases. 0 has no inverse. This used to
-     * be initialized to GF_SIZE, but it should make no difference
-     * since noone is supposed to read from here.
-     */
-    inverse[0] = 0 ;
-    inverse[1] = 1;
-    for (i=2; i<=GF_SIZE; i++)
-	inverse[i] = gf_exp[GF_SIZE-gf_log[i]];
-}
-
 /*
  * Various linear algebra operations that i use often.
  */
@@ -401,9 +256,10 @@ addmul1(gf *dst1, gf *src1, gf c, int sz)
 # define addmul1 slow_addmul1
 #endif
 
-static void addmul(gf *dst, gf *src, gf c, int sz) {
+/* region kernels are taken from the context, see fec_ctx_init() */
+static inline void addmul(const fec_ctx_t *ctx, gf *dst, gf *src, gf c, int sz) {
     // fprintf(stderr, "Dst=%p Src=%p, gf=%02x sz=%d\n", dst, src, c, sz);
-    if (c != 0) addmul1(dst, src, c, sz);
+    if (c != 0) ctx->addmul(dst, src, c, sz);
 }
 
 /*
@@ -527,9 +383,9 @@ mul1(gf *dst1, gf *src1, gf c, int sz)
 # define mul1 slow_mul1
 #endif
 
-static inline void mul(gf *dst, gf *src, gf c, int sz) {
+static inline void mul(const fec_ctx_t *ctx, gf *dst, gf *src, gf c, int sz) {
     /*fprintf(stderr, "%p = %02x * %p\n", dst, c, src);*/
-    if (c != 0) mul1(dst, src, c, sz); else memset(dst, 0, sz);
+    if (c != 0) ctx->mul(dst, src, c, sz); else memset(dst, 0, sz);
 }
 
 /*
@@ -540,18 +396,20 @@ static inline void mul(gf *dst, gf *src, gf c, int sz) {
  */
 DEB( int pivloops=0; int pivswaps=0 ; /* diagnostic */)
     static int
-invert_mat(gf *src, int k)
+invert_mat(const fec_ctx_t *ctx, gf *src, int k)
 {
     gf c, *p ;
     int irow, icol, row, col, i, ix ;
 
     int error = 1 ;
+    if (k <= 0) /* nothing to invert */
+	return 0 ;
     int indxc[k];
     int indxr[k];
     int ipiv[k];
     gf id_row[k];
 
-    memset(id_row, 0, k*sizeof(gf));
+    memset(id_row, 0, (size_t) k * sizeof(gf));
     DEB( pivloops=0; pivswaps=0 ; /* diagnostic */ )
 	/*
 	 * ipiv marks elements already used as pivots.
@@ -618,7 +476,7 @@ invert_mat(gf *src, int k)
 	     * fruitful, at least in the obvious ways (unrolling)
 	     */
 	    DEB( pivswaps++ ; )
-		c = inverse[ c ] ;
+		c = gf_inverse[ c ] ;
 	    pivot_row[icol] = 1 ;
 	    for (ix = 0 ; ix < k ; ix++ )
 		pivot_row[ix] = gf_mul(c, pivot_row[ix] );
@@ -636,7 +494,7 @@ invert_mat(gf *src, int k)
 		if (ix != icol) {
 		    c = p[icol] ;
 		    p[icol] = 0 ;
-		    addmul(p, pivot_row, c, k );
+		    addmul(ctx, p, pivot_row, c, k );
 		}
 	    }
 	}
@@ -660,19 +518,109 @@ invert_mat(gf *src, int k)
 }
 
 
-static int fec_initialized = 0 ;
+/*
+ * Context used by the non-reentrant wrappers fec_encode()/fec_decode(). It
+ * starts out with the scalar kernel, fec_init() upgrades it to the fastest one.
+ */
+static fec_ctx_t default_ctx = {FEC_KERNEL_SCALAR, addmul1, mul1};
+
+/**
+ * Sets up an encoder/decoder context. The GF tables are constant, so contexts
+ * are cheap and independent: each thread or stream may use its own one.
+ * @param ctx Context to initialise
+ * @param kernel Region multiplication kernel, FEC_KERNEL_AUTO picks the fastest one supported by this CPU
+ * @return 0 on success or -1 if the requested kernel is not available (ctx is left unchanged)
+ */
+int fec_ctx_init(fec_ctx_t *ctx, fec_kernel_t kernel)
+{
+    if (kernel == FEC_KERNEL_AUTO) {
+#ifdef FEC_HAVE_X86_SIMD
+	if (fec_ctx_init(ctx, FEC_KERNEL_AVX2) == 0 || fec_ctx_init(ctx, FEC_KERNEL_SSSE3) == 0)
+	    return 0;
+#endif
+#ifdef FEC_HAVE_NEON
+	if (fec_ctx_init(ctx, FEC_KERNEL_NEON) == 0)
+	    return 0;
+#endif
+	/* no byte shuffles (e.g. ARMv6): XORs on bit sliced blocks beat table lookups */
+	return fec_ctx_init(ctx, FEC_KERNEL_BITSLICE);
+    }
+
+    switch (kernel) {
+    case FEC_KERNEL_SCALAR:
+    case FEC_KERNEL_BITSLICE:
+	/* the bit sliced kernel works on whole matrices, see fec_ctx_encode() */
+	ctx->addmul = addmul1;
+	ctx->mul = mul1;
+	break;
+#ifdef FEC_HAVE_X86_SIMD
+    case FEC_KERNEL_SSSE3:
+	if (!fec_cpu_has_ssse3())
+	    return -1;
+	ctx->addmul = addmul1_ssse3;
+	ctx->mul = mul1_ssse3;
+	break;
+    case FEC_KERNEL_AVX2:
+	if (!fec_cpu_has_avx2())
+	    return -1;
+	ctx->addmul = addmul1_avx2;
+	ctx->mul = mul1_avx2;
+	break;
+#endif
+#ifdef FEC_HAVE_NEON
+    case FEC_KERNEL_NEON:
+	if (!fec_cpu_has_neon())
+	    return -1;
+	ctx->addmul = addmul1_neon;
+	ctx->mul = mul1_neon;
+	break;
+#endif
+    default:
+	return -1;
+    }
+    ctx->kernel = kernel;
+    return 0;
+}
 
+const char *fec_ctx_kernel_name(const fec_ctx_t *ctx)
+{
+    switch (ctx->kernel) {
+    case FEC_KERNEL_SSSE3:
+	return "ssse3";
+    case FEC_KERNEL_AVX2:
+	return "avx2";
+    case FEC_KERNEL_NEON:
+	return "neon";
+    case FEC_KERNEL_BITSLICE:
+	return "bitslice";
+    case FEC_KERNEL_SCALAR:
+    default:
+	return "scalar";
+    }
+}
+
+/*
+ * Selects the fastest kernel for the default context. The tables no longer
+ * need to be initialised, so calling this is optional.
+ */
 void fec_init(void)
 {
-    TICK(ticks[0]);
-    generate_gf();
-    TOCK(ticks[0]);
-    DDB(fprintf(stderr, "generate_gf took %ldus\n", ticks[0]);)
-	TICK(ticks[0]);
-    init_mul_table();
-    TOCK(ticks[0]);
-    DDB(fprintf(stderr, "init_mul_table took %ldus\n", ticks[0]);)
-	fec_initialized = 1 ;
+    fec_ctx_init(&default_ctx, FEC_KERNEL_AUTO);
+}
+
+/*
+ * Selects the region multiplication kernel of the default context used by
+ * fec_encode() and fec_decode(). Not thread safe, use fec_ctx_init() for that.
+ * Returns 0 on success or -1 if the requested kernel is not available.
+ */
+int fec_set_kernel(fec_kernel_t kernel)
+{
+    return fec_ctx_init(&default_ctx, kernel);
+}
+
+const char *fec_kernel_name(void)
+{
+    return fec_ctx_kernel_name(&default_ctx);
 }
 
 
@@ -771,30 +719,39 @@ void fec_init(void)
  * few (typically, 4 or 8) that they will fit easily in the cache (even
  * in the L2 cache...)
  */
-void fec_encode(unsigned int blockSize,
-		unsigned char **data_blocks,
-		unsigned int nrDataBlocks,
-		unsigned char **fec_blocks,
-		unsigned int nrFecBlocks)
-
+void fec_ctx_encode(const fec_ctx_t *ctx,
+		    unsigned int blockSize,
+		    unsigned char **data_blocks,
+		    unsigned int nrDataBlocks,
+		    unsigned char **fec_blocks,
+		    unsigned int nrFecBlocks)
 {
     unsigned int blockNo; /* loop for block counter */
     unsigned int row, col;
 
-    assert(fec_initialized);    
     assert(nrDataBlocks <= 128);    
     assert(nrFecBlocks <= 128);
 
     if(!nrDataBlocks)
 	return;
 
+    if (ctx->kernel == FEC_KERNEL_BITSLICE) {
+	gf coefs[nrFecBlocks * nrDataBlocks];
+	for(row=0; row < nrFecBlocks; row++)
+	    for(col=128, blockNo=0; blockNo < nrDataBlocks; col++, blockNo++)
+		coefs[row * nrDataBlocks + blockNo] = gf_inverse[row ^ col];
+	fec_bitslice_matmul(blockSize, data_blocks, nrDataBlocks,
+			    fec_blocks, nrFecBlocks, coefs, 0);
+	return;
+    }
+
     for(row=0; row < nrFecBlocks; row++)
-	mul(fec_blocks[row], data_blocks[0], inverse[128 ^ row], blockSize);
+	mul(ctx, fec_blocks[row], data_blocks[0], gf_inverse[128 ^ row], blockSize);
     
     for(col=129, blockNo=1; blockNo < nrDataBlocks; col++, blockNo ++) {
 	for(row=0; row < nrFecBlocks; row++)
-	    addmul(fec_blocks[row], data_blocks[blockNo],
-		   inverse[row ^ col],
+	    addmul(ctx, fec_blocks[row], data_blocks[blockNo],
+		   gf_inverse[row ^ col],
 		   blockSize);
     }
 }
@@ -805,7 +762,8 @@ void fec_encode(unsigned int blockSize,
  * (with size being number of blocks lost, rather than number of data blocks
  * + fec)
  */
-static inline void reduce(unsigned int blockSize,
+static inline void reduce(const fec_ctx_t *ctx,
+			  unsigned int blockSize,
 			  unsigned char **data_blocks,
 			  unsigned int nr_data_blocks,
 			  unsigned char **fec_blocks,
@@ -816,6 +774,29 @@ static inline void reduce(unsigned int blockSize,
     int erasedIdx=0;
     unsigned int col;
 
+    if (ctx->kernel == FEC_KERNEL_BITSLICE) {
+	unsigned char *present[nr_data_blocks ? nr_data_blocks : 1];
+	unsigned int present_cols[nr_data_blocks ? nr_data_blocks : 1];
+	gf coefs[nr_fec_blocks * (nr_data_blocks ? nr_data_blocks : 1)];
+	unsigned int nr_present = 0, i;
+	int j;
+	for(col=0; col<nr_data_blocks; col++) {
+	    if(erasedIdx < nr_fec_blocks && erased_blocks[erasedIdx] == col) {
+		erasedIdx++;
+	    } else {
+		present_cols[nr_present] = col;
+		present[nr_present++] = data_blocks[col];
+	    }
+	}
+	assert(nr_fec_blocks == erasedIdx);
+	for(j=0; j < nr_fec_blocks; j++)
+	    for(i=0; i < nr_present; i++)
+		coefs[j * nr_present + i] = gf_inverse[fec_block_nos[j]^present_cols[i]^128];
+	fec_bitslice_matmul(blockSize, present, nr_present,
+			    fec_blocks, nr_fec_blocks, coefs, 1);
+	return;
+    }
+
     /* First we reduce the code vector by substracting all known elements
      * (non-erased data packets) */
     for(col=0; col<nr_data_blocks; col++) {
@@ -826,7 +807,7 @@ static inline void reduce(unsigned int blockSize,
 	    int j;
 	    for(j=0; j < nr_fec_blocks; j++) {
 		int blno = fec_block_nos[j];
-		addmul(fec_blocks[j],src,inverse[blno^col^128],blockSize);
+		addmul(ctx,fec_blocks[j],src,gf_inverse[blno^col^128],blockSize);
 	    }
 	}
     }
@@ -851,7 +832,8 @@ long long invTime =0;
  * Resolves reduced system. Constructs "mini" encoding matrix, inverts
  * it, and multiply reduced vector by it.
  */
-static inline void resolve(int blockSize,
+static inline void resolve(const fec_ctx_t *ctx,
+			   int blockSize,
 			   unsigned char **data_blocks,
 			   unsigned char **fec_blocks,
 			   unsigned int *fec_block_nos,
@@ -877,14 +859,14 @@ static inline void resolve(int blockSize,
 	/*assert(irow < fec_blocks+128);*/
 	for(col = 0; col < nr_fec_blocks; col++, ptr++) {
 	    int icol = erased_blocks[col];
-	    matrix[ptr] = inverse[irow ^ icol];
+	    matrix[ptr] = gf_inverse[irow ^ icol];
 	}
     }
 
 #ifdef PROFILE
     begin = rdtsc();
 #endif
-    r=invert_mat(matrix, nr_fec_blocks);
+    r=invert_mat(ctx, matrix, nr_fec_blocks);
 #ifdef PROFILE
     invTime += rdtsc()-begin;
 #endif
@@ -904,24 +886,32 @@ static inline void resolve(int blockSize,
     }
 
     /* do the multiplication with the reduced code vector */
+    if (ctx->kernel == FEC_KERNEL_BITSLICE) {
+	unsigned char *targets[nr_fec_blocks];
+	for(row = 0; row < nr_fec_blocks; row++)
+	    targets[row] = data_blocks[erased_blocks[row]];
+	fec_bitslice_matmul(blockSize, fec_blocks, nr_fec_blocks,
+			    targets, nr_fec_blocks, matrix, 0);
+	return;
+    }
     for(row = 0, ptr=0; row < nr_fec_blocks; row++) {
 	int col;
 	unsigned char *target = data_blocks[erased_blocks[row]];
-	mul(target,fec_blocks[0],matrix[ptr++],blockSize);
+	mul(ctx,target,fec_blocks[0],matrix[ptr++],blockSize);
 	for(col = 1; col < nr_fec_blocks;  col++,ptr++) {
-	    addmul(target,fec_blocks[col],matrix[ptr],blockSize);
+	    addmul(ctx,target,fec_blocks[col],matrix[ptr],blockSize);
 	}
     }
 }
 
-void fec_decode(unsigned int blockSize,
-
-		unsigned char **data_blocks,
-		unsigned int nr_data_blocks,
-		unsigned char **fec_blocks,
-		unsigned int *fec_block_nos,
-		unsigned int *erased_blocks,
-		unsigned short nr_fec_blocks)
+void fec_ctx_decode(const fec_ctx_t *ctx,
+		    unsigned int blockSize,
+		    unsigned char **data_blocks,
+		    unsigned int nr_data_blocks,
+		    unsigned char **fec_blocks,
+		    unsigned int *fec_block_nos,
+		    unsigned int *erased_blocks,
+		    unsigned short nr_fec_blocks)
 {
 #ifdef PROFILE
     long long begin;
@@ -931,14 +921,14 @@ void fec_decode(unsigned int blockSize,
 #ifdef PROFILE
     begin = rdtsc();
 #endif
-    reduce(blockSize, data_blocks, nr_data_blocks,
+    reduce(ctx, blockSize, data_blocks, nr_data_blocks,
 	   fec_blocks, fec_block_nos,  erased_blocks, nr_fec_blocks);
 #ifdef PROFILE
     end = rdtsc();
     reduceTime += end - begin;
     begin = end;
 #endif
-    resolve(blockSize, data_blocks,
+    resolve(ctx, blockSize, data_blocks,
 	    fec_blocks, fec_block_nos, erased_blocks,
 	    nr_fec_blocks);
 #ifdef PROFILE
@@ -948,6 +938,27 @@ void fec_decode(unsigned int blockSize,
 }
 
 
+void fec_encode(unsigned int blockSize,
+		unsigned char **data_blocks,
+		unsigned int nrDataBlocks,
+		unsigned char **fec_blocks,
+		unsigned int nrFecBlocks)
+{
+    fec_ctx_encode(&default_ctx, blockSize, data_blocks, nrDataBlocks, fec_blocks, nrFecBlocks);
+}
+
+void fec_decode(unsigned int blockSize,
+		unsigned char **data_blocks,
+		unsigned int nr_data_blocks,
+		unsigned char **fec_blocks,
+		unsigned int *fec_block_nos,
+		unsigned int *erased_blocks,
+		unsigned short nr_fec_blocks)
+{
+    fec_ctx_decode(&default_ctx, blockSize, data_blocks, nr_data_blocks, fec_blocks, fec_block_nos,
+		   erased_blocks, nr_fec_blocks);
+}
+
 #ifdef PROFILE
 void printDetail(void) {
     fprintf(stderr, "red=%9lld\nres=%9lld\ninv=%9lld\n",  
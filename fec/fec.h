@@ -0,0 +1,79 @@
+#pragma once
+
+typedef struct fec_parms *fec_code_t;
+
+/*
+ * GF(2^8) region multiplication kernels. fec_init() selects FEC_KERNEL_AUTO,
+ * i.e. the fastest kernel the CPU supports. Without SIMD byte shuffles the
+ * XOR-only bit sliced kernel is used. All kernels produce identical output.
+ */
+typedef enum {
+    FEC_KERNEL_AUTO = 0,
+    FEC_KERNEL_SCALAR,
+    FEC_KERNEL_SSSE3,
+    FEC_KERNEL_AVX2,
+    FEC_KERNEL_NEON,
+    FEC_KERNEL_BITSLICE
+} fec_kernel_t;
+
+typedef void (*fec_region_kernel_t)(unsigned char *dst, unsigned char *src, unsigned char c, int sz);
+
+/*
+ * Encoder/decoder context, set up by fec_ctx_init(). All GF tables are constant
+ * and generated at build time, so any number of contexts can be used from
+ * different threads at the same time.
+ */
+typedef struct {
+    fec_kernel_t kernel;
+    fec_region_kernel_t addmul;
+    fec_region_kernel_t mul;
+} fec_ctx_t;
+
+int fec_ctx_init(fec_ctx_t *ctx, fec_kernel_t kernel);
+
+const char *fec_ctx_kernel_name(const fec_ctx_t *ctx);
+
+void fec_ctx_encode(const fec_ctx_t *ctx,
+		    unsigned int blockSize,
+		    unsigned char **data_blocks,
+		    unsigned int nrDataBlocks,
+		    unsigned char **fec_blocks,
+		    unsigned int nrFecBlocks);
+
+void fec_ctx_decode(const fec_ctx_t *ctx,
+		    unsigned int blockSize,
+		    unsigned char **data_blocks,
+		    unsigned int nr_data_blocks,
+		    unsigned char **fec_blocks,
+		    unsigned int *fec_block_nos,
+		    unsigned int *erased_blocks,
+		    unsigned short nr_fec_blocks);
+
+/*
+ * Non-reentrant interface working on a default context. fec_init() only selects
+ * the fastest kernel for it, the tables need no initialisation.
+ */
+void fec_init(void);
+
+void fec_encode(unsigned int blockSize,
+		unsigned char **data_blocks,
+		unsigned int nrDataBlocks,
+		unsigned char **fec_blocks,
+		unsigned int nrFecBlocks);
+
+void fec_decode(unsigned int blockSize,
+		unsigned char **data_blocks,
+		unsigned int nr_data_blocks,
+		unsigned char **fec_blocks,
+		unsigned int *fec_block_nos,
+		unsigned int *erased_blocks,
+		unsigned short nr_fec_blocks  /* how many blocks per stripe */);
+
+int fec_set_kernel(fec_kernel_t kernel);
+
+const char *fec_kernel_name(void);
+
+void fec_print(fec_code_t code, int width);
+
+void fec_license(void);
+
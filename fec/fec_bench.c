@@ -0,0 +1,367 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2018 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+/*
+ * Micro benchmark for fec_ctx_encode()/fec_ctx_decode(). Sweeps the number of data and FEC packets per block, the
+ * block (packet) size and erasure patterns for every requested kernel and prints one CSV line or JSON object per
+ * configuration to stdout. Every call is timed on its own, so besides the throughput the median and 99th percentile
+ * latency of a whole block are reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <stdint.h>
+#include "fec.h"
+
+#define MAX_LIST 32
+#define MAX_PACKETS 128
+#define MAX_BLOCK_SIZE 4096
+
+typedef enum {
+    PATTERN_BURST,  // the first data packets of the block are lost
+    PATTERN_SPREAD, // lost data packets are evenly spread over the block
+    PATTERN_RANDOM  // random data packets are lost, random FEC packets are used for recovery
+} erasure_pattern_t;
+
+typedef enum {
+    OUTPUT_CSV,
+    OUTPUT_JSON
+} output_format_t;
+
+static const char *pattern_names[] = {"burst", "spread", "random"};
+
+static struct {
+    fec_kernel_t kernels[MAX_LIST];
+    int num_kernels;
+    int data[MAX_LIST], num_data;
+    int fec[MAX_LIST], num_fec;
+    int sizes[MAX_LIST], num_sizes;
+    erasure_pattern_t patterns[MAX_LIST];
+    int num_patterns;
+    int erasures; // 0 = as many as the FEC packets can repair
+    int iterations;
+    output_format_t format;
+} conf;
+
+static int results_printed = 0;
+
+typedef struct {
+    const char *op;
+    const char *kernel;
+    int data, fec, size, erasures;
+    const char *pattern;
+    double mbps, mean_ns, p50_ns, p99_ns;
+} bench_result_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Fills in the throughput and latency figures from the per call timings
+ * @param res Result to fill
+ * @param samples Duration of every call in ns. Gets sorted.
+ * @param n Number of samples
+ * @param bytes Payload bytes processed by one call
+ */
+static void evaluate(bench_result_t *res, uint64_t *samples, int n, size_t bytes) {
+    uint64_t total = 0;
+    for (int i = 0; i < n; i++) total += samples[i];
+    qsort(samples, (size_t) n, sizeof(uint64_t), cmp_u64);
+    res->mean_ns = (double) total / n;
+    res->p50_ns = (double) samples[(n - 1) / 2];
+    res->p99_ns = (double) samples[((n - 1) * 99) / 100];
+    res->mbps = total ? ((double) bytes * n) / ((double) total / 1e9) / 1e6 : 0;
+}
+
+static void print_result(const bench_result_t *res) {
+    if (conf.format == OUTPUT_CSV) {
+        if (results_printed == 0)
+            printf("op,kernel,data,fec,size,erasures,pattern,iterations,mbps,ns_per_block,p50_ns,p99_ns\n");
+        printf("%s,%s,%i,%i,%i,%i,%s,%i,%.2f,%.0f,%.0f,%.0f\n", res->op, res->kernel, res->data, res->fec,
+               res->size, res->erasures, res->pattern, conf.iterations, res->mbps, res->mean_ns, res->p50_ns,
+               res->p99_ns);
+    } else {
+        printf("%s\n  {\"op\": \"%s\", \"kernel\": \"%s\", \"data\": %i, \"fec\": %i, \"size\": %i, \"erasures\": %i, "
+               "\"pattern\": \"%s\", \"iterations\": %i, \"mbps\": %.2f, \"ns_per_block\": %.0f, \"p50_ns\": %.0f, "
+               "\"p99_ns\": %.0f}", results_printed ? "," : "[", res->op, res->kernel, res->data, res->fec,
+               res->size, res->erasures, res->pattern, conf.iterations, res->mbps, res->mean_ns, res->p50_ns,
+               res->p99_ns);
+    }
+    fflush(stdout);
+    results_printed++;
+}
+
+/**
+ * Picks the lost data packets and the FEC packets used for recovery. Both lists are sorted ascending as required
+ * by fec_decode().
+ */
+static void make_erasures(erasure_pattern_t pattern, int k, int m, int e, unsigned int *erased,
+                          unsigned int *fec_nos) {
+    int i, j;
+    switch (pattern) {
+        case PATTERN_BURST:
+            for (i = 0; i < e; i++) erased[i] = (unsigned int) i;
+            for (i = 0; i < e; i++) fec_nos[i] = (unsigned int) i;
+            break;
+        case PATTERN_SPREAD:
+            for (i = 0; i < e; i++) erased[i] = (unsigned int) ((i * k) / e);
+            for (i = 0; i < e; i++) fec_nos[i] = (unsigned int) ((i * m) / e);
+            break;
+        case PATTERN_RANDOM: {
+            // selection sampling keeps the indices sorted
+            int needed = e;
+            for (i = 0, j = 0; i < k && needed > 0; i++) {
+                if (rand() % (k - i) < needed) {
+                    erased[j++] = (unsigned int) i;
+                    needed--;
+                }
+            }
+            needed = e;
+            for (i = 0, j = 0; i < m && needed > 0; i++) {
+                if (rand() % (m - i) < needed) {
+                    fec_nos[j++] = (unsigned int) i;
+                    needed--;
+                }
+            }
+            break;
+        }
+    }
+}
+
+static void bench_config(const fec_ctx_t *ctx, int k, int m, int size, uint64_t *samples,
+                         unsigned char **data, unsigned char **orig, unsigned char **fec, unsigned char **fec_ref) {
+    bench_result_t res = {.kernel = fec_ctx_kernel_name(ctx), .data = k, .fec = m, .size = size};
+    unsigned int erased[MAX_PACKETS], fec_nos[MAX_PACKETS];
+    unsigned char *fec_used[MAX_PACKETS];
+    int i, it, p;
+
+    for (i = 0; i < k; i++)
+        for (int b = 0; b < size; b++) orig[i][b] = (unsigned char) rand();
+
+    // encode
+    for (it = -conf.iterations / 10; it < conf.iterations; it++) { // first 10% are warm up
+        uint64_t start = now_ns();
+        fec_ctx_encode(ctx, (unsigned int) size, orig, (unsigned int) k, fec_ref, (unsigned int) m);
+        if (it >= 0) samples[it] = now_ns() - start;
+    }
+    res.op = "encode", res.erasures = 0, res.pattern = "none";
+    evaluate(&res, samples, conf.iterations, (size_t) k * size);
+    print_result(&res);
+
+    // decode
+    int e = conf.erasures ? conf.erasures : m;
+    if (e > k) e = k;
+    if (e > m) e = m;
+    res.op = "decode", res.erasures = e;
+    for (p = 0; p < conf.num_patterns; p++) {
+        res.pattern = pattern_names[conf.patterns[p]];
+        for (it = -conf.iterations / 10; it < conf.iterations; it++) {
+            make_erasures(conf.patterns[p], k, m, e, erased, fec_nos);
+            for (i = 0; i < k; i++) memcpy(data[i], orig[i], (size_t) size);
+            for (i = 0; i < e; i++) {
+                memset(data[erased[i]], 0, (size_t) size);
+                memcpy(fec[i], fec_ref[fec_nos[i]], (size_t) size); // decoding works in place on the FEC packets
+                fec_used[i] = fec[i];
+            }
+            uint64_t start = now_ns();
+            fec_ctx_decode(ctx, (unsigned int) size, data, (unsigned int) k, fec_used, fec_nos, erased,
+                           (unsigned short) e);
+            if (it >= 0) samples[it] = now_ns() - start;
+            for (i = 0; i < e; i++) {
+                if (memcmp(data[erased[i]], orig[erased[i]], (size_t) size) != 0) {
+                    fprintf(stderr, "FEC_BENCH: %s decode of %i/%i/%i (%s) produced wrong data!\n", res.kernel, k,
+                            m, size, res.pattern);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+        evaluate(&res, samples, conf.iterations, (size_t) k * size);
+        print_result(&res);
+    }
+}
+
+static int parse_int_list(char *arg, int *list, int min, int max) {
+    int n = 0;
+    for (char *tok = strtok(arg, ","); tok != NULL && n < MAX_LIST; tok = strtok(NULL, ",")) {
+        int v = (int) strtol(tok, NULL, 10);
+        if (v < min || v > max) {
+            fprintf(stderr, "FEC_BENCH: %i is out of range [%i, %i]\n", v, min, max);
+            exit(EXIT_FAILURE);
+        }
+        list[n++] = v;
+    }
+    return n;
+}
+
+static const struct {
+    const char *name;
+    fec_kernel_t kernel;
+} kernel_names[] = {{"auto", FEC_KERNEL_AUTO}, {"scalar", FEC_KERNEL_SCALAR}, {"ssse3", FEC_KERNEL_SSSE3},
+                    {"avx2", FEC_KERNEL_AVX2}, {"neon", FEC_KERNEL_NEON}, {"bitslice", FEC_KERNEL_BITSLICE}};
+
+static int parse_kernel(const char *name, fec_kernel_t *kernel) {
+    for (size_t i = 0; i < sizeof(kernel_names) / sizeof(kernel_names[0]); i++) {
+        if (strcmp(name, kernel_names[i].name) == 0) {
+            *kernel = kernel_names[i].kernel;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static const char *kernel_name(fec_kernel_t kernel) {
+    for (size_t i = 0; i < sizeof(kernel_names) / sizeof(kernel_names[0]); i++) {
+        if (kernel_names[i].kernel == kernel) return kernel_names[i].name;
+    }
+    return "unknown";
+}
+
+void process_command_line_args(int argc, char *argv[]) {
+    static const int def_data[] = {4, 8, 16, 32}, def_fec[] = {1, 2, 4, 8, 16}, def_sizes[] = {256, 512, 1024, 1450};
+    int c;
+    conf.num_data = conf.num_fec = conf.num_sizes = conf.num_kernels = conf.num_patterns = 0;
+    conf.erasures = 0, conf.iterations = 1000, conf.format = OUTPUT_CSV;
+    while ((c = getopt(argc, argv, "k:d:r:s:p:e:i:o:")) != -1) {
+        switch (c) {
+            case 'k':
+                for (char *tok = strtok(optarg, ","); tok != NULL && conf.num_kernels < MAX_LIST;
+                     tok = strtok(NULL, ",")) {
+                    if (strcmp(tok, "all") == 0) {
+                        for (fec_kernel_t k = FEC_KERNEL_SCALAR; k <= FEC_KERNEL_BITSLICE; k++)
+                            conf.kernels[conf.num_kernels++] = k;
+                    } else if (parse_kernel(tok, &conf.kernels[conf.num_kernels]) == 0) {
+                        conf.num_kernels++;
+                    } else {
+                        fprintf(stderr, "FEC_BENCH: Unknown kernel %s\n", tok);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                break;
+            case 'd':
+                conf.num_data = parse_int_list(optarg, conf.data, 1, MAX_PACKETS);
+                break;
+            case 'r':
+                conf.num_fec = parse_int_list(optarg, conf.fec, 1, MAX_PACKETS);
+                break;
+            case 's':
+                conf.num_sizes = parse_int_list(optarg, conf.sizes, 1, MAX_BLOCK_SIZE);
+                break;
+            case 'p':
+                for (char *tok = strtok(optarg, ","); tok != NULL && conf.num_patterns < MAX_LIST;
+                     tok = strtok(NULL, ",")) {
+                    int found = 0;
+                    for (int i = 0; i < 3; i++) {
+                        if (strcmp(tok, pattern_names[i]) == 0) {
+                            conf.patterns[conf.num_patterns++] = (erasure_pattern_t) i;
+                            found = 1;
+                        }
+                    }
+                    if (!found) {
+                        fprintf(stderr, "FEC_BENCH: Unknown erasure pattern %s\n", tok);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                break;
+            case 'e':
+                conf.erasures = (int) strtol(optarg, NULL, 10);
+                break;
+            case 'i':
+                conf.iterations = (int) strtol(optarg, NULL, 10);
+                break;
+            case 'o':
+                conf.format = strcmp(optarg, "json") == 0 ? OUTPUT_JSON : OUTPUT_CSV;
+                break;
+            default:
+                printf("Benchmarks the DroneBridge FEC encoder and decoder and prints the results as CSV or JSON"
+                       "\n\n\t-k Comma separated list of kernels: auto|scalar|ssse3|avx2|neon|bitslice|all "
+                       "(default: all). Kernels not supported by this CPU are skipped."
+                       "\n\t-d Comma separated list of data packets per block (default: 4,8,16,32)"
+                       "\n\t-r Comma separated list of FEC packets per block (default: 1,2,4,8,16)"
+                       "\n\t-s Comma separated list of block sizes in bytes (default: 256,512,1024,1450)"
+                       "\n\t-p Comma separated list of erasure patterns: burst|spread|random (default: all)"
+                       "\n\t-e Number of lost data packets per decoded block (default: as many as the FEC can repair)"
+                       "\n\t-i Timed iterations per configuration (default: 1000)"
+                       "\n\t-o Output format: csv|json (default: csv)\n");
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (conf.num_kernels == 0)
+        for (fec_kernel_t k = FEC_KERNEL_SCALAR; k <= FEC_KERNEL_BITSLICE; k++) conf.kernels[conf.num_kernels++] = k;
+    if (conf.num_data == 0)
+        for (; conf.num_data < 4; conf.num_data++) conf.data[conf.num_data] = def_data[conf.num_data];
+    if (conf.num_fec == 0)
+        for (; conf.num_fec < 5; conf.num_fec++) conf.fec[conf.num_fec] = def_fec[conf.num_fec];
+    if (conf.num_sizes == 0)
+        for (; conf.num_sizes < 4; conf.num_sizes++) conf.sizes[conf.num_sizes] = def_sizes[conf.num_sizes];
+    if (conf.num_patterns == 0)
+        for (; conf.num_patterns < 3; conf.num_patterns++)
+            conf.patterns[conf.num_patterns] = (erasure_pattern_t) conf.num_patterns;
+    if (conf.iterations < 1) conf.iterations = 1;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned char *data[MAX_PACKETS], *orig[MAX_PACKETS], *fec[MAX_PACKETS], *fec_ref[MAX_PACKETS];
+    process_command_line_args(argc, argv);
+    srand(1); // same data and random erasures in every run
+
+    uint64_t *samples = malloc(sizeof(uint64_t) * (size_t) conf.iterations);
+    for (int i = 0; i < MAX_PACKETS; i++) {
+        data[i] = malloc(MAX_BLOCK_SIZE), orig[i] = malloc(MAX_BLOCK_SIZE);
+        fec[i] = malloc(MAX_BLOCK_SIZE), fec_ref[i] = malloc(MAX_BLOCK_SIZE);
+        if (data[i] == NULL || orig[i] == NULL || fec[i] == NULL || fec_ref[i] == NULL) {
+            perror("FEC_BENCH: malloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (samples == NULL) {
+        perror("FEC_BENCH: malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int kn = 0; kn < conf.num_kernels; kn++) {
+        fec_ctx_t ctx;
+        if (fec_ctx_init(&ctx, conf.kernels[kn]) != 0) {
+            fprintf(stderr, "FEC_BENCH: Kernel %s not supported on this CPU - skipping\n",
+                    kernel_name(conf.kernels[kn]));
+            continue;
+        }
+        for (int d = 0; d < conf.num_data; d++)
+            for (int r = 0; r < conf.num_fec; r++)
+                for (int s = 0; s < conf.num_sizes; s++)
+                    bench_config(&ctx, conf.data[d], conf.fec[r], conf.sizes[s], samples, data, orig, fec, fec_ref);
+    }
+    if (conf.format == OUTPUT_JSON) printf("%s\n", results_printed ? "\n]" : "[]");
+
+    for (int i = 0; i < MAX_PACKETS; i++) {
+        free(data[i]), free(orig[i]), free(fec[i]), free(fec_ref[i]);
+    }
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,232 @@
+/*
+ * fec_bitslice.c -- XOR-only GF(2^8) matrix multiplication for CPUs without vector shuffles
+ *
+ * CPUs like the ARM1176 of the Pi Zero have neither NEON nor any other byte
+ * shuffle, so the split-nibble kernels of fec_simd.c do not apply and the
+ * scalar code is stuck with one table lookup per byte and coefficient.
+ *
+ * Here the blocks are bit sliced instead: a chunk of 8 * BITSLICE_PLANE_WORDS
+ * machine words is transposed so that plane b holds bit b of every byte of the
+ * chunk. Multiplying by a constant c is a linear map over GF(2), so plane i of
+ * c * x is the XOR of the planes j of x selected by gf_bitmatrix[c][i]. All
+ * arithmetic on the planes is done with native 32/64 bit XORs, there are no
+ * lookups of data dependent values.
+ *
+ * The transposition is local to each chunk and undone before the result is
+ * stored, so the bytes on the wire are exactly the ones produced by the
+ * table based code: the encoding matrix (inverse[row ^ col]) is unchanged.
+ * The cost of transposing is amortised over all outputs (inputs are sliced
+ * once per chunk) and all inputs (outputs are un-sliced once per chunk), so the
+ * gain grows with the number of data and FEC blocks.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "fec_bitslice.h"
+
+typedef unsigned long bs_word_t;
+
+#define BITSLICE_PLANE_WORDS 4
+#define BITSLICE_PLANE_BYTES (BITSLICE_PLANE_WORDS * sizeof(bs_word_t))
+#define BITSLICE_CHUNK (8 * BITSLICE_PLANE_BYTES) /* bytes of a block processed at once */
+
+typedef struct {
+    bs_word_t plane[8][BITSLICE_PLANE_WORDS];
+} bs_chunk_t;
+
+/*
+ * Transposes the 8x8 bit matrix held in x (row r = bits 8r..8r+7), i.e. bit b
+ * of byte r becomes bit r of byte b. The transposition is its own inverse.
+ */
+static inline uint64_t
+transpose8(uint64_t x)
+{
+    uint64_t t;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+/*
+ * Transposes the 8x8 byte matrix a[] (row r = a[r]), i.e. byte c of a[r]
+ * becomes byte r of a[c]. Like transpose8() this is its own inverse.
+ */
+static inline void
+transpose8x8_bytes(uint64_t a[8])
+{
+    uint64_t t;
+    unsigned int r;
+    for (r = 0; r < 4; r++) {
+	t = ((a[r] >> 32) ^ a[r + 4]) & 0x00000000FFFFFFFFULL;
+	a[r + 4] ^= t;
+	a[r] ^= t << 32;
+    }
+    for (r = 0; r < 8; r += (r & 1) ? 3 : 1) {
+	t = ((a[r] >> 16) ^ a[r + 2]) & 0x0000FFFF0000FFFFULL;
+	a[r + 2] ^= t;
+	a[r] ^= t << 16;
+    }
+    for (r = 0; r < 8; r += 2) {
+	t = ((a[r] >> 8) ^ a[r + 1]) & 0x00FF00FF00FF00FFULL;
+	a[r + 1] ^= t;
+	a[r] ^= t << 8;
+    }
+}
+
+/*
+ * 64 bytes at a time: the bits of each 8 byte group are transposed, then the
+ * bytes across the 8 groups. Afterwards a[b] holds bit b of all 64 bytes.
+ */
+static void
+slice_chunk(const unsigned char *src, bs_chunk_t *dst)
+{
+    unsigned int n, g, b;
+    for (n = 0; n < BITSLICE_CHUNK / 64; n++) {
+	uint64_t a[8];
+	for (g = 0; g < 8; g++) {
+	    memcpy(&a[g], src + 64 * n + 8 * g, 8);
+	    a[g] = transpose8(a[g]);
+	}
+	transpose8x8_bytes(a);
+	for (b = 0; b < 8; b++) {
+	    if (sizeof(bs_word_t) == 8) {
+		dst->plane[b][n] = (bs_word_t) a[b];
+	    } else {
+		dst->plane[b][2 * n] = (bs_word_t) a[b];
+		dst->plane[b][2 * n + 1] = (bs_word_t) (a[b] >> 32);
+	    }
+	}
+    }
+}
+
+static void
+unslice_chunk(const bs_chunk_t *src, unsigned char *dst)
+{
+    unsigned int n, g, b;
+    for (n = 0; n < BITSLICE_CHUNK / 64; n++) {
+	uint64_t a[8];
+	for (b = 0; b < 8; b++) {
+	    if (sizeof(bs_word_t) == 8)
+		a[b] = src->plane[b][n];
+	    else
+		a[b] = (uint64_t) src->plane[b][2 * n] | ((uint64_t) src->plane[b][2 * n + 1] << 32);
+	}
+	transpose8x8_bytes(a);
+	for (g = 0; g < 8; g++) {
+	    a[g] = transpose8(a[g]);
+	    memcpy(dst + 64 * n + 8 * g, &a[g], 8);
+	}
+    }
+}
+
+static inline void
+load_chunk(const unsigned char *src, unsigned int len, bs_chunk_t *dst)
+{
+    unsigned char tmp[BITSLICE_CHUNK];
+    if (len == BITSLICE_CHUNK) {
+	slice_chunk(src, dst);
+    } else {
+	memcpy(tmp, src, len);
+	memset(tmp + len, 0, BITSLICE_CHUNK - len);
+	slice_chunk(tmp, dst);
+    }
+}
+
+static inline void
+store_chunk(const bs_chunk_t *src, unsigned char *dst, unsigned int len)
+{
+    unsigned char tmp[BITSLICE_CHUNK];
+    if (len == BITSLICE_CHUNK) {
+	unslice_chunk(src, dst);
+    } else {
+	unslice_chunk(src, tmp);
+	memcpy(dst, tmp, len);
+    }
+}
+
+/*
+ * Precomputes the XOR of every subset of the planes 0..3 (lo) and 4..7 (hi)
+ * of x, 15 XORs each. Afterwards any output plane of c * x costs just two
+ * lookups and one XOR, whatever the bit matrix of c looks like ("method of
+ * four Russians"). The tables are shared by all FEC rows of an input chunk.
+ */
+static inline void
+build_combos(const bs_chunk_t *x, bs_word_t lo[16][BITSLICE_PLANE_WORDS],
+	     bs_word_t hi[16][BITSLICE_PLANE_WORDS])
+{
+    unsigned int s, w;
+    for (w = 0; w < BITSLICE_PLANE_WORDS; w++)
+	lo[0][w] = hi[0][w] = 0;
+    for (s = 1; s < 16; s++) {
+	unsigned int j = (unsigned int) __builtin_ctz(s);
+	for (w = 0; w < BITSLICE_PLANE_WORDS; w++) {
+	    lo[s][w] = lo[s & (s - 1)][w] ^ x->plane[j][w];
+	    hi[s][w] = hi[s & (s - 1)][w] ^ x->plane[4 + j][w];
+	}
+    }
+}
+
+/* acc += c * x in the bit sliced domain, x given by its plane combinations */
+static inline void
+addmul_chunk(bs_chunk_t *acc, bs_word_t lo[16][BITSLICE_PLANE_WORDS],
+	     bs_word_t hi[16][BITSLICE_PLANE_WORDS], unsigned char c)
+{
+    unsigned int i, w;
+    for (i = 0; i < 8; i++) {
+	const bs_word_t *l = lo[gf_bitmatrix[c][i] & 0x0f];
+	const bs_word_t *h = hi[gf_bitmatrix[c][i] >> 4];
+	for (w = 0; w < BITSLICE_PLANE_WORDS; w++)
+	    acc->plane[i][w] ^= l[w] ^ h[w];
+    }
+}
+
+/**
+ * Computes out[row] = sum over col of coefs[row * nr_in + col] * in[col] over
+ * GF(2^8) for whole blocks. With accumulate set the products are added to the
+ * current content of the output blocks instead of overwriting it.
+ * Output blocks must not alias input blocks.
+ */
+void fec_bitslice_matmul(unsigned int blockSize,
+			 unsigned char **in_blocks,
+			 unsigned int nr_in,
+			 unsigned char **out_blocks,
+			 unsigned int nr_out,
+			 const unsigned char *coefs,
+			 int accumulate)
+{
+    bs_chunk_t acc[nr_out ? nr_out : 1];
+    bs_chunk_t x;
+    bs_word_t lo[16][BITSLICE_PLANE_WORDS], hi[16][BITSLICE_PLANE_WORDS];
+    unsigned int offset, row, col;
+
+    for (offset = 0; offset < blockSize; offset += BITSLICE_CHUNK) {
+	unsigned int len = blockSize - offset;
+	if (len > BITSLICE_CHUNK)
+	    len = BITSLICE_CHUNK;
+
+	for (row = 0; row < nr_out; row++) {
+	    if (accumulate)
+		load_chunk(out_blocks[row] + offset, len, &acc[row]);
+	    else
+		memset(&acc[row], 0, sizeof(acc[row]));
+	}
+
+	/* input major, so that the plane combinations of a chunk are built once */
+	for (col = 0; col < nr_in; col++) {
+	    load_chunk(in_blocks[col] + offset, len, &x);
+	    build_combos(&x, lo, hi);
+	    for (row = 0; row < nr_out; row++) {
+		unsigned char c = coefs[row * nr_in + col];
+		if (c != 0)
+		    addmul_chunk(&acc[row], lo, hi, c);
+	    }
+	}
+
+	for (row = 0; row < nr_out; row++)
+	    store_chunk(&acc[row], out_blocks[row] + offset, len);
+    }
+}
@@ -0,0 +1,17 @@
+/*
+ * fec_bitslice.h -- XOR-only GF(2^8) matrix multiplication for CPUs without vector shuffles
+ *
+ * This header is internal to the FEC code and not meant for the modules.
+ */
+
+#pragma once
+
+#include "fec_tables.h"
+
+void fec_bitslice_matmul(unsigned int blockSize,
+			 unsigned char **in_blocks,
+			 unsigned int nr_in,
+			 unsigned char **out_blocks,
+			 unsigned int nr_out,
+			 const unsigned char *coefs,
+			 int accumulate);
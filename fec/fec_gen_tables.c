@@ -0,0 +1,159 @@
+/*
+ * fec_gen_tables.c -- build time generator for the GF(2^8) tables used by fec.c
+ *
+ * Computes the field from its primitive polynomial exactly like fec_init() of
+ * the original Rizzo/Knaff code did at runtime and writes all tables as const C
+ * arrays. The generated file is compiled into db_fec, so the tables end up in
+ * .rodata, are shared by all threads and need no initialisation at startup.
+ *
+ * Usage: fec_gen_tables <output.c>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GF_BITS 8
+#define GF_SIZE ((1 << GF_BITS) - 1)
+
+typedef unsigned char gf;
+
+/* 1+x^2+x^3+x^4+x^8, see Lin & Costello, Appendix A */
+static const char *Pp = "101110001";
+
+static gf gf_exp[2 * GF_SIZE];
+static int gf_log[GF_SIZE + 1];
+static gf gf_inverse[GF_SIZE + 1];
+static gf gf_mul_table[(GF_SIZE + 1) * (GF_SIZE + 1)];
+static gf gf_mul_lo[GF_SIZE + 1][16];
+static gf gf_mul_hi[GF_SIZE + 1][16];
+static gf gf_bitmatrix[GF_SIZE + 1][8];
+
+static inline gf
+modnn(int x)
+{
+    while (x >= GF_SIZE) {
+	x -= GF_SIZE;
+	x = (x >> GF_BITS) + (x & GF_SIZE);
+    }
+    return x;
+}
+
+#define gf_mul(x,y) gf_mul_table[((x)<<8)+(y)]
+
+/*
+ * Generate GF(2**m) from the irreducible polynomial p(X) in p[0]..p[m]
+ *     index->polynomial form		gf_exp[] contains j= \alpha^i;
+ *     polynomial form -> index form	gf_log[ j = \alpha^i ] = i
+ * \alpha=x is the primitive element of GF(2^m)
+ */
+static void
+generate_gf(void)
+{
+    int i;
+    gf mask;
+
+    mask = 1;	/* x ** 0 = 1 */
+    gf_exp[GF_BITS] = 0; /* will be updated at the end of the 1st loop */
+    for (i = 0; i < GF_BITS; i++, mask <<= 1 ) {
+	gf_exp[i] = mask;
+	gf_log[gf_exp[i]] = i;
+	if ( Pp[i] == '1' )
+	    gf_exp[GF_BITS] ^= mask;
+    }
+    gf_log[gf_exp[GF_BITS]] = GF_BITS;
+    mask = 1 << (GF_BITS - 1 ) ;
+    for (i = GF_BITS + 1; i < GF_SIZE; i++) {
+	if (gf_exp[i - 1] >= mask)
+	    gf_exp[i] = gf_exp[GF_BITS] ^ ((gf_exp[i - 1] ^ mask) << 1);
+	else
+	    gf_exp[i] = gf_exp[i - 1] << 1;
+	gf_log[gf_exp[i]] = i;
+    }
+    /* log(0) is not defined, so use a special value */
+    gf_log[0] =	GF_SIZE ;
+    for (i = 0 ; i < GF_SIZE ; i++)
+	gf_exp[i + GF_SIZE] = gf_exp[i] ;
+
+    /* 0 has no inverse, noone is supposed to read it */
+    gf_inverse[0] = 0 ;
+    gf_inverse[1] = 1;
+    for (i=2; i<=GF_SIZE; i++)
+	gf_inverse[i] = gf_exp[GF_SIZE-gf_log[i]];
+}
+
+static void
+init_mul_table(void)
+{
+    int i, j, b;
+    for (i=0; i< GF_SIZE+1; i++)
+	for (j=0; j< GF_SIZE+1; j++)
+	    gf_mul_table[(i<<8)+j] = gf_exp[modnn(gf_log[i] + gf_log[j]) ] ;
+
+    for (j=0; j< GF_SIZE+1; j++)
+	gf_mul_table[j] = gf_mul_table[j<<8] = 0;
+
+    for (i=0; i< GF_SIZE+1; i++)
+	for (j=0; j< 16; j++) {
+	    gf_mul_lo[i][j] = gf_mul(i, j);
+	    gf_mul_hi[i][j] = gf_mul(i, j << 4);
+	}
+
+    for (i=0; i< GF_SIZE+1; i++)
+	for (j=0; j< 8; j++) {
+	    gf p = gf_mul(i, 1 << j);
+	    for (b=0; b< 8; b++)
+		if (p & (1 << b))
+		    gf_bitmatrix[i][b] |= 1 << j;
+	}
+}
+
+/*
+ * row_len > 0 prints a two dimensional array with rows of row_len
+ * elements, each row gets its own braces (-Wmissing-braces)
+ */
+static void
+print_array(FILE *f, const char *decl, const gf *data, int len, int row_len)
+{
+    int i;
+    fprintf(f, "%s = {", decl);
+    if (row_len > 0) {
+	for (i = 0; i < len; i++)
+	    fprintf(f, "%s0x%02x%s", (i % row_len) ? ", " : "\n    { ", data[i],
+		    (i % row_len == row_len - 1) ? " }," : "");
+    } else {
+	for (i = 0; i < len; i++)
+	    fprintf(f, "%s0x%02x,", (i % 16) ? " " : "\n    ", data[i]);
+    }
+    fprintf(f, "\n};\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *f;
+    if (argc != 2) {
+	fprintf(stderr, "Usage: %s <output.c>\n", argv[0]);
+	return EXIT_FAILURE;
+    }
+    generate_gf();
+    init_mul_table();
+
+    if ((f = fopen(argv[1], "w")) == NULL) {
+	perror("fec_gen_tables: fopen");
+	return EXIT_FAILURE;
+    }
+    fprintf(f, "/* Generated by fec_gen_tables.c - do not edit */\n\n#include \"fec_tables.h\"\n\n");
+    print_array(f, "const unsigned char gf_inverse[256]", gf_inverse, sizeof(gf_inverse), 0);
+    print_array(f, "const unsigned char gf_mul_table[256 * 256] __attribute__((aligned (256)))",
+		gf_mul_table, sizeof(gf_mul_table), 0);
+    print_array(f, "const unsigned char gf_mul_lo[256][16] __attribute__((aligned (16)))",
+		&gf_mul_lo[0][0], sizeof(gf_mul_lo), 16);
+    print_array(f, "const unsigned char gf_mul_hi[256][16] __attribute__((aligned (16)))",
+		&gf_mul_hi[0][0], sizeof(gf_mul_hi), 16);
+    print_array(f, "const unsigned char gf_bitmatrix[256][8]", &gf_bitmatrix[0][0], sizeof(gf_bitmatrix), 8);
+    if (fclose(f) != 0) {
+	perror("fec_gen_tables: fclose");
+	return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
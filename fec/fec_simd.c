@@ -0,0 +1,241 @@
+/*
+ * fec_simd.c -- vectorised GF(2^8) region multiplication kernels for fec.c
+ *
+ * addmul computes dst[] ^= c * src[], mul computes dst[] = c * src[].
+ * All kernels accept unaligned buffers and any size. Bytes that do not fill a
+ * whole vector are handled with the same split-nibble tables in scalar code.
+ *
+ * The x86 kernels are compiled with function target attributes so that the
+ * rest of the program keeps the baseline instruction set. Which kernel is used
+ * is decided once at runtime by fec_init().
+ *
+ * The NEON kernels on 32bit ARM live in this file so that only this translation
+ * unit needs to be compiled with -mfpu=neon. Availability is checked at runtime
+ * via the auxiliary vector (HWCAP_NEON) since Pi Zero class CPUs lack NEON.
+ */
+
+#include "fec_simd.h"
+
+static inline unsigned char
+nibble_mul(unsigned char c, unsigned char x)
+{
+    return gf_mul_lo[c][x & 0x0f] ^ gf_mul_hi[c][x >> 4];
+}
+
+static inline void
+addmul_tail(unsigned char *dst, const unsigned char *src, unsigned char c, int sz)
+{
+    int i;
+    for (i = 0; i < sz; i++)
+	dst[i] ^= nibble_mul(c, src[i]);
+}
+
+static inline void
+mul_tail(unsigned char *dst, const unsigned char *src, unsigned char c, int sz)
+{
+    int i;
+    for (i = 0; i < sz; i++)
+	dst[i] = nibble_mul(c, src[i]);
+}
+
+#ifdef FEC_HAVE_X86_SIMD
+#include <immintrin.h>
+
+int fec_cpu_has_ssse3(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+}
+
+int fec_cpu_has_avx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i
+mul_ssse3(__m128i tbl_lo, __m128i tbl_hi, __m128i mask, __m128i s)
+{
+    __m128i l = _mm_shuffle_epi8(tbl_lo, _mm_and_si128(s, mask));
+    __m128i h = _mm_shuffle_epi8(tbl_hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask));
+    return _mm_xor_si128(l, h);
+}
+
+__attribute__((target("ssse3")))
+void addmul1_ssse3(unsigned char *dst, unsigned char *src, unsigned char c, int sz)
+{
+    const __m128i tbl_lo = _mm_load_si128((const __m128i *) gf_mul_lo[c]);
+    const __m128i tbl_hi = _mm_load_si128((const __m128i *) gf_mul_hi[c]);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 32 <= sz; i += 32) {
+	__m128i s0 = _mm_loadu_si128((const __m128i *) (src + i));
+	__m128i s1 = _mm_loadu_si128((const __m128i *) (src + i + 16));
+	__m128i d0 = _mm_loadu_si128((const __m128i *) (dst + i));
+	__m128i d1 = _mm_loadu_si128((const __m128i *) (dst + i + 16));
+	d0 = _mm_xor_si128(d0, mul_ssse3(tbl_lo, tbl_hi, mask, s0));
+	d1 = _mm_xor_si128(d1, mul_ssse3(tbl_lo, tbl_hi, mask, s1));
+	_mm_storeu_si128((__m128i *) (dst + i), d0);
+	_mm_storeu_si128((__m128i *) (dst + i + 16), d1);
+    }
+    for (; i + 16 <= sz; i += 16) {
+	__m128i s = _mm_loadu_si128((const __m128i *) (src + i));
+	__m128i d = _mm_loadu_si128((const __m128i *) (dst + i));
+	_mm_storeu_si128((__m128i *) (dst + i), _mm_xor_si128(d, mul_ssse3(tbl_lo, tbl_hi, mask, s)));
+    }
+    addmul_tail(dst + i, src + i, c, sz - i);
+}
+
+__attribute__((target("ssse3")))
+void mul1_ssse3(unsigned char *dst, unsigned char *src, unsigned char c, int sz)
+{
+    const __m128i tbl_lo = _mm_load_si128((const __m128i *) gf_mul_lo[c]);
+    const __m128i tbl_hi = _mm_load_si128((const __m128i *) gf_mul_hi[c]);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 16 <= sz; i += 16) {
+	__m128i s = _mm_loadu_si128((const __m128i *) (src + i));
+	_mm_storeu_si128((__m128i *) (dst + i), mul_ssse3(tbl_lo, tbl_hi, mask, s));
+    }
+    mul_tail(dst + i, src + i, c, sz - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+mul_avx2(__m256i tbl_lo, __m256i tbl_hi, __m256i mask, __m256i s)
+{
+    __m256i l = _mm256_shuffle_epi8(tbl_lo, _mm256_and_si256(s, mask));
+    __m256i h = _mm256_shuffle_epi8(tbl_hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask));
+    return _mm256_xor_si256(l, h);
+}
+
+__attribute__((target("avx2")))
+void addmul1_avx2(unsigned char *dst, unsigned char *src, unsigned char c, int sz)
+{
+    /* vpshufb works per 128bit lane, so both lanes get a copy of the tables */
+    const __m256i tbl_lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) gf_mul_lo[c]));
+    const __m256i tbl_hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) gf_mul_hi[c]));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 64 <= sz; i += 64) {
+	__m256i s0 = _mm256_loadu_si256((const __m256i *) (src + i));
+	__m256i s1 = _mm256_loadu_si256((const __m256i *) (src + i + 32));
+	__m256i d0 = _mm256_loadu_si256((const __m256i *) (dst + i));
+	__m256i d1 = _mm256_loadu_si256((const __m256i *) (dst + i + 32));
+	d0 = _mm256_xor_si256(d0, mul_avx2(tbl_lo, tbl_hi, mask, s0));
+	d1 = _mm256_xor_si256(d1, mul_avx2(tbl_lo, tbl_hi, mask, s1));
+	_mm256_storeu_si256((__m256i *) (dst + i), d0);
+	_mm256_storeu_si256((__m256i *) (dst + i + 32), d1);
+    }
+    for (; i + 32 <= sz; i += 32) {
+	__m256i s = _mm256_loadu_si256((const __m256i *) (src + i));
+	__m256i d = _mm256_loadu_si256((const __m256i *) (dst + i));
+	_mm256_storeu_si256((__m256i *) (dst + i), _mm256_xor_si256(d, mul_avx2(tbl_lo, tbl_hi, mask, s)));
+    }
+    addmul_tail(dst + i, src + i, c, sz - i);
+}
+
+__attribute__((target("avx2")))
+void mul1_avx2(unsigned char *dst, unsigned char *src, unsigned char c, int sz)
+{
+    const __m256i tbl_lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) gf_mul_lo[c]));
+    const __m256i tbl_hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) gf_mul_hi[c]));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 32 <= sz; i += 32) {
+	__m256i s = _mm256_loadu_si256((const __m256i *) (src + i));
+	_mm256_storeu_si256((__m256i *) (dst + i), mul_avx2(tbl_lo, tbl_hi, mask, s));
+    }
+    mul_tail(dst + i, src + i, c, sz - i);
+}
+#endif /* FEC_HAVE_X86_SIMD */
+
+#ifdef FEC_HAVE_NEON
+#include <arm_neon.h>
+
+#if defined(__aarch64__)
+int fec_cpu_has_neon(void)
+{
+    return 1; /* Advanced SIMD is mandatory on ARMv8-A */
+}
+
+static inline uint8x16_t
+mul_neon(uint8x16_t tbl_lo, uint8x16_t tbl_hi, uint8x16_t s)
+{
+    uint8x16_t l = vqtbl1q_u8(tbl_lo, vandq_u8(s, vdupq_n_u8(0x0f)));
+    uint8x16_t h = vqtbl1q_u8(tbl_hi, vshrq_n_u8(s, 4));
+    return veorq_u8(l, h);
+}
+
+#define NEON_TABLE_T uint8x16_t
+#define NEON_LOAD_TABLE(t) vld1q_u8(t)
+#else
+#include <sys/auxv.h>
+#ifndef HWCAP_NEON
+#define HWCAP_NEON (1 << 12)
+#endif
+
+int fec_cpu_has_neon(void)
+{
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+}
+
+/* ARMv7 has no 16 entry table lookup, so two vtbl2 lookups form one */
+static inline uint8x16_t
+mul_neon(uint8x8x2_t tbl_lo, uint8x8x2_t tbl_hi, uint8x16_t s)
+{
+    uint8x16_t idx_lo = vandq_u8(s, vdupq_n_u8(0x0f));
+    uint8x16_t idx_hi = vshrq_n_u8(s, 4);
+    uint8x8_t l0 = vtbl2_u8(tbl_lo, vget_low_u8(idx_lo));
+    uint8x8_t l1 = vtbl2_u8(tbl_lo, vget_high_u8(idx_lo));
+    uint8x8_t h0 = vtbl2_u8(tbl_hi, vget_low_u8(idx_hi));
+    uint8x8_t h1 = vtbl2_u8(tbl_hi, vget_high_u8(idx_hi));
+    return veorq_u8(vcombine_u8(l0, l1), vcombine_u8(h0, h1));
+}
+
+static inline uint8x8x2_t
+neon_load_table(const unsigned char *t)
+{
+    uint8x8x2_t r;
+    r.val[0] = vld1_u8(t);
+    r.val[1] = vld1_u8(t + 8);
+    return r;
+}
+
+#define NEON_TABLE_T uint8x8x2_t
+#define NEON_LOAD_TABLE(t) neon_load_table(t)
+#endif
+
+void addmul1_neon(unsigned char *dst, unsigned char *src, unsigned char c, int sz)
+{
+    const NEON_TABLE_T tbl_lo = NEON_LOAD_TABLE(gf_mul_lo[c]);
+    const NEON_TABLE_T tbl_hi = NEON_LOAD_TABLE(gf_mul_hi[c]);
+    int i = 0;
+
+    for (; i + 32 <= sz; i += 32) {
+	uint8x16_t d0 = veorq_u8(vld1q_u8(dst + i), mul_neon(tbl_lo, tbl_hi, vld1q_u8(src + i)));
+	uint8x16_t d1 = veorq_u8(vld1q_u8(dst + i + 16), mul_neon(tbl_lo, tbl_hi, vld1q_u8(src + i + 16)));
+	vst1q_u8(dst + i, d0);
+	vst1q_u8(dst + i + 16, d1);
+    }
+    for (; i + 16 <= sz; i += 16)
+	vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), mul_neon(tbl_lo, tbl_hi, vld1q_u8(src + i))));
+    addmul_tail(dst + i, src + i, c, sz - i);
+}
+
+void mul1_neon(unsigned char *dst, unsigned char *src, unsigned char c, int sz)
+{
+    const NEON_TABLE_T tbl_lo = NEON_LOAD_TABLE(gf_mul_lo[c]);
+    const NEON_TABLE_T tbl_hi = NEON_LOAD_TABLE(gf_mul_hi[c]);
+    int i = 0;
+
+    for (; i + 16 <= sz; i += 16)
+	vst1q_u8(dst + i, mul_neon(tbl_lo, tbl_hi, vld1q_u8(src + i)));
+    mul_tail(dst + i, src + i, c, sz - i);
+}
+#endif /* FEC_HAVE_NEON */
@@ -0,0 +1,38 @@
+/*
+ * fec_simd.h -- vectorised GF(2^8) region multiplication kernels for fec.c
+ *
+ * The kernels use the split-nibble technique: the product c * x is looked up
+ * as gf_mul_lo[c][x & 0x0f] ^ gf_mul_hi[c][x >> 4], where both tables hold
+ * just 16 entries and therefore fit into a single vector register. A byte
+ * shuffle instruction (pshufb/vtbl) then performs 16 or 32 table lookups at once.
+ *
+ * This header is internal to the FEC code and not meant for the modules.
+ */
+
+#pragma once
+
+/*
+ * FEC_HAVE_NEON is set by the build system when the NEON kernels could be
+ * compiled for the target. The x86 kernels only need GCC/Clang function
+ * target attributes and are always built on x86.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define FEC_HAVE_X86_SIMD
+#endif
+
+#include "fec_tables.h"
+
+#ifdef FEC_HAVE_X86_SIMD
+int fec_cpu_has_ssse3(void);
+int fec_cpu_has_avx2(void);
+void addmul1_ssse3(unsigned char *dst, unsigned char *src, unsigned char c, int sz);
+void mul1_ssse3(unsigned char *dst, unsigned char *src, unsigned char c, int sz);
+void addmul1_avx2(unsigned char *dst, unsigned char *src, unsigned char c, int sz);
+void mul1_avx2(unsigned char *dst, unsigned char *src, unsigned char c, int sz);
+#endif
+
+#ifdef FEC_HAVE_NEON
+int fec_cpu_has_neon(void);
+void addmul1_neon(unsigned char *dst, unsigned char *src, unsigned char c, int sz);
+void mul1_neon(unsigned char *dst, unsigned char *src, unsigned char c, int sz);
+#endif
@@ -0,0 +1,27 @@
+/*
+ * fec_tables.h -- constant GF(2^8) tables, generated at build time by fec_gen_tables.c
+ *
+ * This header is internal to the FEC code and not meant for the modules.
+ */
+
+#pragma once
+
+/* multiplicative inverse of every field element, gf_inverse[0] is unused */
+extern const unsigned char gf_inverse[256];
+
+/* gf_mul_table[(a << 8) + b] = a * b */
+extern const unsigned char gf_mul_table[256 * 256];
+
+/*
+ * Split-nibble multiplication tables used by the SIMD kernels in fec_simd.c:
+ * gf_mul_lo[c][i] = c * i and gf_mul_hi[c][i] = c * (i << 4) for i < 16,
+ * thus c * x = gf_mul_lo[c][x & 0x0f] ^ gf_mul_hi[c][x >> 4]
+ */
+extern const unsigned char gf_mul_lo[256][16];
+extern const unsigned char gf_mul_hi[256][16];
+
+/*
+ * Bit matrices for the XOR-only kernel in fec_bitslice.c: bit j of
+ * gf_bitmatrix[c][i] is set if bit i of c * x depends on bit j of x
+ */
+extern const unsigned char gf_bitmatrix[256][8];
@@ -0,0 +1,583 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+/*
+ * Hub of the emulated long range link. Every emulated DroneBridge socket (see common/db_emu.h) registers here. Frames
+ * sent by one emulated adapter are forwarded to the sockets of all other emulated adapters with a synthetic RX radiotap
+ * header. The link between the adapters gets impaired per receiving adapter (-l): loss (uniform or Gilbert-Elliott
+ * bursts), bad FCS, RSSI, latency with jitter, reordering and a rate cap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../common/db_emu.h"
+#include "../common/db_protocol.h"
+#include "../common/db_raw_receive.h"
+#include "../common/radiotap/radiotap_iter.h"
+#include "../common/db_common.h"
+
+#define EMU_MAX_ADAPTERS        16
+#define EMU_MAX_ENDPOINTS       64
+#define EMU_MAX_RULES           16
+#define EMU_MAX_QUEUED_FRAMES   8192        // frames in flight (delayed) over all adapters
+#define EMU_ENDPOINT_QUEUE_SIZE (1 << 21)   // bytes waiting for a slow endpoint. Like a full socket buffer: drop
+#define EMU_MAX_RATE_BACKLOG_US 100000      // frames waiting longer than this for the rate capped link get dropped
+#define EMU_RX_RADIOTAP_LENGTH  12
+#define EMU_DEFAULT_RATE        0x0c        // 6 Mbit/s in 500 kbit/s units, used if the sender did not set a rate
+#define EMU_HUB_RCVBUF_SIZE     (1 << 22)
+
+// Impairments of the link towards one receiving adapter
+typedef struct {
+    char ifname[IFNAMSIZ];  // "*" matches all adapters without own rule
+    double loss;            // uniform loss probability (good state of the Gilbert-Elliott model)
+    double ge_p;            // probability good -> bad state. 0 disables the burst model
+    double ge_r;            // probability bad -> good state
+    double ge_h;            // loss probability in bad state
+    double fcs;             // probability of a corrupted frame with bad FCS flag
+    int rssi;               // dBm
+    int rssi_var;           // +/- dBm, uniform
+    double delay_ms;
+    double jitter_ms;       // +/- ms, uniform
+    double reorder;         // probability a frame gets held back by reorder_delay_ms
+    double reorder_delay_ms;
+    double rate_mbit;       // 0 = unlimited
+} emu_link_params_t;
+
+typedef struct {
+    char ifname[IFNAMSIZ];
+    const emu_link_params_t *params;
+    bool ge_bad;
+    uint64_t busy_until_us;
+    uint64_t sent, received, lost, fcs_errors, rate_drops, queue_drops;
+} emu_adapter_t;
+
+typedef struct emu_pending {
+    struct emu_pending *next;
+    uint16_t length;
+    uint8_t data[];
+} emu_pending_t;
+
+typedef struct {
+    struct sockaddr_un addr;
+    socklen_t addr_len;
+    int adapter;
+    int fd;                 // connected to the endpoint. One socket each, so a slow endpoint does not stall the others
+    emu_pending_t *pending_head, *pending_tail;
+    size_t pending_bytes;
+} emu_endpoint_t;
+
+typedef struct {
+    uint64_t due_us;
+    uint64_t order;         // keeps frames with the same due time in order
+    int adapter;
+    uint16_t length;
+    uint8_t data[];
+} emu_frame_t;
+
+volatile bool keeprunning = true;
+volatile bool print_stats = false;
+char hub_name[IFNAMSIZ * 4] = DB_EMU_DEFAULT_HUB;
+emu_link_params_t rules[EMU_MAX_RULES];
+int num_rules = 0;
+emu_link_params_t default_params;
+emu_adapter_t adapters[EMU_MAX_ADAPTERS];
+int num_adapters = 0;
+emu_endpoint_t endpoints[EMU_MAX_ENDPOINTS];
+int num_endpoints = 0;
+emu_frame_t *frame_heap[EMU_MAX_QUEUED_FRAMES];
+int num_heap_frames = 0;
+uint64_t frame_order = 0;
+uint64_t rand_state = 0;
+db_radiotap_cache_t radiotap_cache;
+
+void int_handler(int dummy) {
+    keeprunning = false;
+}
+
+void usr1_handler(int dummy) {
+    print_stats = true;
+}
+
+uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+}
+
+/**
+ * xorshift64*. Seeded with -r so impairment patterns are reproducible
+ * @return Uniform random number in [0, 1)
+ */
+double rand_unit() {
+    rand_state ^= rand_state >> 12;
+    rand_state ^= rand_state << 25;
+    rand_state ^= rand_state >> 27;
+    return (double) ((rand_state * 0x2545F4914F6CDD1DULL) >> 11) / (double) (1ULL << 53);
+}
+
+/**
+ * @return Uniform random number in [-range, range]
+ */
+double rand_range(double range) {
+    return (2 * rand_unit() - 1) * range;
+}
+
+void init_link_params(emu_link_params_t *params, const char *ifname) {
+    memset(params, 0, sizeof(emu_link_params_t));
+    strncpy(params->ifname, ifname, IFNAMSIZ - 1);
+    params->ge_h = 1;
+    params->rssi = -50;
+    params->reorder_delay_ms = 5;
+}
+
+/**
+ * Parses a link rule: <ifname|*>,key=value,... e.g. "emu1,loss=0.05,rssi=-70,delay=2,jitter=1,rate=12"
+ * @return 0 on success, -1 on invalid rule
+ */
+int parse_link_rule(char *rule) {
+    char *save_ptr = NULL;
+    char *token = strtok_r(rule, ",", &save_ptr);
+    if (token == NULL || strlen(token) >= IFNAMSIZ) return -1;
+    emu_link_params_t *params = (strcmp(token, "*") == 0) ? &default_params : NULL;
+    if (params == NULL) {
+        if (num_rules >= EMU_MAX_RULES) return -1;
+        params = &rules[num_rules++];
+    }
+    init_link_params(params, token);
+    while ((token = strtok_r(NULL, ",", &save_ptr)) != NULL) {
+        char *value = strchr(token, '=');
+        if (value == NULL) return -1;
+        *value++ = '\0';
+        double v = strtod(value, NULL);
+        if (strcmp(token, "loss") == 0) params->loss = v;
+        else if (strcmp(token, "ge_p") == 0) params->ge_p = v;
+        else if (strcmp(token, "ge_r") == 0) params->ge_r = v;
+        else if (strcmp(token, "ge_h") == 0) params->ge_h = v;
+        else if (strcmp(token, "fcs") == 0) params->fcs = v;
+        else if (strcmp(token, "rssi") == 0) params->rssi = (int) v;
+        else if (strcmp(token, "rssi_var") == 0) params->rssi_var = (int) v;
+        else if (strcmp(token, "delay") == 0) params->delay_ms = v;
+        else if (strcmp(token, "jitter") == 0) params->jitter_ms = v;
+        else if (strcmp(token, "reorder") == 0) params->reorder = v;
+        else if (strcmp(token, "reorder_delay") == 0) params->reorder_delay_ms = v;
+        else if (strcmp(token, "rate") == 0) params->rate_mbit = v;
+        else return -1;
+    }
+    return 0;
+}
+
+void process_command_line_args(int argc, char *argv[]) {
+    int c;
+    rand_state = (uint64_t) time(NULL) ^ ((uint64_t) getpid() << 32);
+    init_link_params(&default_params, "*");
+    while ((c = getopt(argc, argv, "s:l:r:?")) != -1) {
+        switch (c) {
+            case 's':
+                strncpy(hub_name, optarg, sizeof(hub_name) - 1);
+                break;
+            case 'l':
+                if (parse_link_rule(optarg) < 0) {
+                    LOG_SYS_STD(LOG_ERR, "DB_LINK_EMU: Invalid link rule or too many rules\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'r':
+                rand_state = strtoull(optarg, NULL, 10);
+                break;
+            case '?':
+            default:
+                printf("DroneBridge link emulator hub. Forwards the frames of emulated adapters (-n emu<x> or DB_EMU=<hub>)"
+                       " to all other emulated adapters. Use"
+                       "\n\t-s <hub name> default is <" DB_EMU_DEFAULT_HUB ">. Same as DB_EMU of the modules"
+                       "\n\t-l <ifname|*>,<key>=<value>,... Impairments of frames received by the adapter. Keys:"
+                       "\n\t\tloss=<0-1> uniform loss"
+                       "\n\t\tge_p=<0-1>,ge_r=<0-1>,ge_h=<0-1> Gilbert-Elliott burst loss (good->bad, bad->good, "
+                       "loss in bad state)"
+                       "\n\t\tfcs=<0-1> corrupted frames with bad FCS flag"
+                       "\n\t\trssi=<dBm>,rssi_var=<dBm> default rssi is -50"
+                       "\n\t\tdelay=<ms>,jitter=<ms> latency"
+                       "\n\t\treorder=<0-1>,reorder_delay=<ms> frames held back (default 5ms)"
+                       "\n\t\trate=<Mbit/s> rate cap of the link"
+                       "\n\t-r <seed> seed of the random generator for reproducible runs"
+                       "\nSIGUSR1 prints the statistics\n");
+                exit(c == '?' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    if (rand_state == 0) rand_state = 1;
+}
+
+const emu_link_params_t *find_link_params(const char *ifname) {
+    for (int i = 0; i < num_rules; i++) {
+        if (strncmp(rules[i].ifname, ifname, IFNAMSIZ) == 0) return &rules[i];
+    }
+    return &default_params;
+}
+
+int get_adapter(const char *ifname) {
+    for (int i = 0; i < num_adapters; i++) {
+        if (strncmp(adapters[i].ifname, ifname, IFNAMSIZ) == 0) return i;
+    }
+    if (num_adapters >= EMU_MAX_ADAPTERS) return -1;
+    emu_adapter_t *adapter = &adapters[num_adapters];
+    memset(adapter, 0, sizeof(emu_adapter_t));
+    strncpy(adapter->ifname, ifname, IFNAMSIZ - 1);
+    adapter->params = find_link_params(ifname);
+    LOG_SYS_STD(LOG_NOTICE, "DB_LINK_EMU: New adapter %s\n", ifname);
+    return num_adapters++;
+}
+
+void remove_endpoint(int index) {
+    emu_endpoint_t *endpoint = &endpoints[index];
+    close(endpoint->fd);
+    while (endpoint->pending_head != NULL) {
+        emu_pending_t *next = endpoint->pending_head->next;
+        free(endpoint->pending_head);
+        endpoint->pending_head = next;
+    }
+    endpoints[index] = endpoints[--num_endpoints];
+}
+
+/**
+ * Registers the sender of a datagram. Each socket of an emulated adapter is an endpoint
+ * @return Index of the endpoint or -1
+ */
+int get_endpoint(const struct sockaddr_un *addr, socklen_t addr_len) {
+    char ifname[IFNAMSIZ];
+    for (int i = 0; i < num_endpoints; i++) {
+        if (endpoints[i].addr_len == addr_len && memcmp(&endpoints[i].addr, addr, addr_len) == 0) return i;
+    }
+    if (num_endpoints >= EMU_MAX_ENDPOINTS || db_emu_parse_endpoint_address(addr, addr_len, ifname) < 0) return -1;
+    int adapter = get_adapter(ifname);
+    if (adapter < 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("DB_LINK_EMU: socket ");
+        return -1;
+    }
+    if (connect(fd, (const struct sockaddr *) addr, addr_len) < 0 || fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+        perror("DB_LINK_EMU: Could not connect to endpoint ");
+        close(fd);
+        return -1;
+    }
+    emu_endpoint_t *endpoint = &endpoints[num_endpoints];
+    memset(endpoint, 0, sizeof(emu_endpoint_t));
+    memcpy(&endpoint->addr, addr, addr_len);
+    endpoint->addr_len = addr_len;
+    endpoint->adapter = adapter;
+    endpoint->fd = fd;
+    return num_endpoints++;
+}
+
+/**
+ * Sends the frames waiting for an endpoint until its socket is full
+ * @return -1 if the endpoint is gone and got removed
+ */
+int flush_endpoint(int index) {
+    emu_endpoint_t *endpoint = &endpoints[index];
+    while (endpoint->pending_head != NULL) {
+        emu_pending_t *pending = endpoint->pending_head;
+        if (send(endpoint->fd, pending->data, pending->length, 0) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            if (errno == ECONNREFUSED || errno == ENOENT || errno == ENOTCONN) {
+                remove_endpoint(index);
+                return -1;
+            }
+            perror("DB_LINK_EMU: send ");
+        }
+        endpoint->pending_head = pending->next;
+        if (endpoint->pending_head == NULL) endpoint->pending_tail = NULL;
+        endpoint->pending_bytes -= pending->length;
+        free(pending);
+    }
+    return 0;
+}
+
+/**
+ * Delivers a frame to all sockets of the receiving adapter
+ */
+void deliver_frame(emu_frame_t *frame) {
+    for (int i = 0; i < num_endpoints; i++) {
+        emu_endpoint_t *endpoint = &endpoints[i];
+        if (endpoint->adapter != frame->adapter) continue;
+        if (endpoint->pending_bytes + frame->length > EMU_ENDPOINT_QUEUE_SIZE) {
+            adapters[frame->adapter].queue_drops++;
+            continue;
+        }
+        emu_pending_t *pending = malloc(sizeof(emu_pending_t) + frame->length);
+        if (pending == NULL) continue;
+        pending->next = NULL;
+        pending->length = frame->length;
+        memcpy(pending->data, frame->data, frame->length);
+        if (endpoint->pending_tail != NULL) endpoint->pending_tail->next = pending;
+        else endpoint->pending_head = pending;
+        endpoint->pending_tail = pending;
+        endpoint->pending_bytes += frame->length;
+        if (flush_endpoint(i) < 0) i--; // endpoint got replaced by the last one
+    }
+    adapters[frame->adapter].received++;
+}
+
+static bool frame_before(const emu_frame_t *a, const emu_frame_t *b) {
+    return a->due_us < b->due_us || (a->due_us == b->due_us && a->order < b->order);
+}
+
+// min heap of the frames in flight, ordered by due time
+int heap_push(emu_frame_t *frame) {
+    if (num_heap_frames >= EMU_MAX_QUEUED_FRAMES) return -1;
+    int i = num_heap_frames++;
+    while (i > 0 && frame_before(frame, frame_heap[(i - 1) / 2])) {
+        frame_heap[i] = frame_heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    frame_heap[i] = frame;
+    return 0;
+}
+
+emu_frame_t *heap_pop() {
+    emu_frame_t *top = frame_heap[0];
+    emu_frame_t *last = frame_heap[--num_heap_frames];
+    int i = 0;
+    while (2 * i + 1 < num_heap_frames) {
+        int child = 2 * i + 1;
+        if (child + 1 < num_heap_frames && frame_before(frame_heap[child + 1], frame_heap[child])) child++;
+        if (!frame_before(frame_heap[child], last)) break;
+        frame_heap[i] = frame_heap[child];
+        i = child;
+    }
+    frame_heap[i] = last;
+    return top;
+}
+
+/**
+ * Reads the data rate the sender set in the radiotap header of the injected frame
+ */
+uint8_t get_tx_rate(uint8_t *frame, int radiotap_length) {
+    const db_radiotap_layout_t *layout = db_radiotap_get_layout(&radiotap_cache, frame, radiotap_length);
+    if (layout == NULL) return EMU_DEFAULT_RATE;
+    for (int i = 0; i < layout->num_fields; i++) {
+        if (layout->fields[i].index == IEEE80211_RADIOTAP_RATE && frame[layout->fields[i].offset] != 0)
+            return frame[layout->fields[i].offset];
+    }
+    return EMU_DEFAULT_RATE;
+}
+
+/**
+ * Applies the impairments of the link towards the receiving adapter and queues the frame with a synthetic RX radiotap
+ * header (flags, rate, dBm antenna signal, antenna)
+ *
+ * @param adapter_no Receiving adapter
+ * @param payload Frame without the radiotap header of the sender (802.11 header + DroneBridge raw header + payload)
+ * @param payload_length
+ * @param rate Data rate of the frame in 500 kbit/s units
+ * @param now Current time in us
+ */
+void transmit_to_adapter(int adapter_no, const uint8_t *payload, uint16_t payload_length, uint8_t rate, uint64_t now) {
+    emu_adapter_t *adapter = &adapters[adapter_no];
+    const emu_link_params_t *params = adapter->params;
+    double loss = params->loss;
+    if (params->ge_p > 0) {
+        if (adapter->ge_bad) {
+            if (rand_unit() < params->ge_r) adapter->ge_bad = false;
+        } else if (rand_unit() < params->ge_p) {
+            adapter->ge_bad = true;
+        }
+        if (adapter->ge_bad) loss = params->ge_h;
+    }
+    if (loss > 0 && rand_unit() < loss) {
+        adapter->lost++;
+        return;
+    }
+    uint64_t arrival = now;
+    if (params->rate_mbit > 0) {
+        uint64_t start = adapter->busy_until_us > now ? adapter->busy_until_us : now;
+        if (start - now > EMU_MAX_RATE_BACKLOG_US) {
+            adapter->rate_drops++;
+            return;
+        }
+        adapter->busy_until_us = start + (uint64_t) ((payload_length * 8) / params->rate_mbit);
+        arrival = adapter->busy_until_us;
+    }
+    double delay_us = (params->delay_ms + rand_range(params->jitter_ms)) * 1000;
+    if (params->reorder > 0 && rand_unit() < params->reorder) delay_us += params->reorder_delay_ms * 1000;
+    if (delay_us > 0) arrival += (uint64_t) delay_us;
+
+    emu_frame_t *frame = malloc(sizeof(emu_frame_t) + EMU_RX_RADIOTAP_LENGTH + payload_length);
+    if (frame == NULL) return;
+    frame->due_us = arrival;
+    frame->order = frame_order++;
+    frame->adapter = adapter_no;
+    frame->length = (uint16_t) (EMU_RX_RADIOTAP_LENGTH + payload_length);
+    uint8_t *rth = frame->data;
+    int rssi = params->rssi + (int) rand_range(params->rssi_var);
+    if (rssi > 0) rssi = 0;
+    if (rssi < -127) rssi = -127;
+    uint32_t present = (1 << IEEE80211_RADIOTAP_FLAGS) | (1 << IEEE80211_RADIOTAP_RATE) |
+                       (1 << IEEE80211_RADIOTAP_DBM_ANTSIGNAL) | (1 << IEEE80211_RADIOTAP_ANTENNA);
+    rth[0] = 0;
+    rth[1] = 0;
+    rth[2] = EMU_RX_RADIOTAP_LENGTH;
+    rth[3] = 0;
+    rth[4] = (uint8_t) present;
+    rth[5] = (uint8_t) (present >> 8);
+    rth[6] = (uint8_t) (present >> 16);
+    rth[7] = (uint8_t) (present >> 24);
+    rth[8] = 0;
+    rth[9] = rate;
+    rth[10] = (uint8_t) (int8_t) rssi;
+    rth[11] = 0;
+    memcpy(frame->data + EMU_RX_RADIOTAP_LENGTH, payload, payload_length);
+    if (params->fcs > 0 && rand_unit() < params->fcs) {
+        rth[8] |= IEEE80211_RADIOTAP_F_BADFCS;
+        frame->data[EMU_RX_RADIOTAP_LENGTH + (int) (rand_unit() * payload_length)] ^= 0xff;
+        adapter->fcs_errors++;
+    }
+    if (heap_push(frame) < 0) {
+        adapter->queue_drops++;
+        free(frame);
+    }
+}
+
+/**
+ * Receives the frames of the emulated adapters and forwards them to all other adapters
+ */
+void receive_frames(int hub_fd) {
+    uint8_t buffer[MAX_DB_DATA_LENGTH + 256];
+    struct sockaddr_un sender_addr;
+    for (int n = 0; n < 64; n++) {
+        socklen_t sender_addr_len = sizeof(sender_addr);
+        ssize_t length = recvfrom(hub_fd, buffer, sizeof(buffer), 0, (struct sockaddr *) &sender_addr,
+                                  &sender_addr_len);
+        if (length < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("DB_LINK_EMU: recvfrom ");
+            return;
+        }
+        int endpoint = get_endpoint(&sender_addr, sender_addr_len);
+        if (endpoint < 0 || length == 0) continue; // empty datagrams only register the endpoint
+        int sender_adapter = endpoints[endpoint].adapter;
+        if (length < 4) continue;
+        uint16_t radiotap_length = (uint16_t) (buffer[2] | (buffer[3] << 8));
+        if (radiotap_length < 8 || radiotap_length >= length) continue;
+        adapters[sender_adapter].sent++;
+        uint8_t rate = get_tx_rate(buffer, radiotap_length);
+        uint64_t now = now_us();
+        for (int i = 0; i < num_adapters; i++) {
+            if (i != sender_adapter)
+                transmit_to_adapter(i, buffer + radiotap_length, (uint16_t) (length - radiotap_length), rate, now);
+        }
+    }
+}
+
+void print_statistics() {
+    LOG_SYS_STD(LOG_INFO, "DB_LINK_EMU: %-16s %10s %10s %10s %10s %10s %10s\n", "adapter", "sent", "received",
+                "lost", "bad_fcs", "rate_drop", "queue_drop");
+    for (int i = 0; i < num_adapters; i++) {
+        LOG_SYS_STD(LOG_INFO, "DB_LINK_EMU: %-16s %10llu %10llu %10llu %10llu %10llu %10llu\n", adapters[i].ifname,
+                    (unsigned long long) adapters[i].sent, (unsigned long long) adapters[i].received,
+                    (unsigned long long) adapters[i].lost, (unsigned long long) adapters[i].fcs_errors,
+                    (unsigned long long) adapters[i].rate_drops, (unsigned long long) adapters[i].queue_drops);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    process_command_line_args(argc, argv);
+    signal(SIGINT, int_handler);
+    signal(SIGTERM, int_handler);
+    signal(SIGUSR1, usr1_handler);
+    signal(SIGPIPE, SIG_IGN);
+    memset(&radiotap_cache, 0, sizeof(radiotap_cache));
+
+    struct sockaddr_un hub_addr;
+    socklen_t hub_addr_len = db_emu_hub_address(&hub_addr, hub_name);
+    int hub_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (hub_fd < 0) {
+        perror("DB_LINK_EMU: socket ");
+        exit(EXIT_FAILURE);
+    }
+    if (bind(hub_fd, (struct sockaddr *) &hub_addr, hub_addr_len) < 0) {
+        LOG_SYS_STD(LOG_ERR, "DB_LINK_EMU: Could not bind hub '%s' (%s). Already running?\n", hub_name,
+                    strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    int rcvbuf = EMU_HUB_RCVBUF_SIZE;
+    setsockopt(hub_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    fcntl(hub_fd, F_SETFL, O_NONBLOCK);
+    LOG_SYS_STD(LOG_NOTICE, "DB_LINK_EMU: Hub '%s' running\n", hub_name);
+
+    struct pollfd fds[EMU_MAX_ENDPOINTS + 1];
+    int fd_endpoint[EMU_MAX_ENDPOINTS + 1];
+    while (keeprunning) {
+        if (print_stats) {
+            print_stats = false;
+            print_statistics();
+        }
+        int nfds = 0;
+        fds[nfds].fd = hub_fd;
+        fds[nfds++].events = POLLIN;
+        for (int i = 0; i < num_endpoints; i++) {
+            if (endpoints[i].pending_head == NULL) continue;
+            fd_endpoint[nfds] = i;
+            fds[nfds].fd = endpoints[i].fd;
+            fds[nfds++].events = POLLOUT;
+        }
+        struct timespec timeout = {.tv_sec = 1, .tv_nsec = 0};
+        if (num_heap_frames > 0) {
+            uint64_t now = now_us();
+            uint64_t wait_us = frame_heap[0]->due_us > now ? frame_heap[0]->due_us - now : 0;
+            if (wait_us < 1000000) {
+                timeout.tv_sec = 0;
+                timeout.tv_nsec = (long) wait_us * 1000;
+            }
+        }
+        int ret = ppoll(fds, (nfds_t) nfds, &timeout, NULL);
+        if (ret < 0 && errno != EINTR) {
+            perror("DB_LINK_EMU: poll ");
+            break;
+        }
+        if (ret > 0) {
+            // endpoints may get removed while flushing. Flush in reverse so the indices stay valid
+            for (int i = nfds - 1; i > 0; i--) {
+                if (fds[i].revents & (POLLOUT | POLLERR | POLLHUP)) flush_endpoint(fd_endpoint[i]);
+            }
+            if (fds[0].revents & POLLIN) receive_frames(hub_fd);
+        }
+        uint64_t now = now_us();
+        while (num_heap_frames > 0 && frame_heap[0]->due_us <= now) {
+            emu_frame_t *frame = heap_pop();
+            deliver_frame(frame);
+            free(frame);
+        }
+    }
+    print_statistics();
+    for (int i = num_endpoints - 1; i >= 0; i--) remove_endpoint(i);
+    while (num_heap_frames > 0) free(heap_pop());
+    close(hub_fd);
+    return 0;
+}
@@ -0,0 +1,271 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+/*
+ * Replays a capture (DB_CAPTURE, pcapng) into unmodified DroneBridge modules (video_gnd, proxy, status, ...). The
+ * replay takes the place of the link emulator hub: start the modules with DB_EMU=<hub> and the interface names of the
+ * capture. Every frame is delivered byte by byte as captured (incl. radiotap header: RSSI, bad FCS flags) to the sockets
+ * of the adapter with the same name, or to all sockets if no adapter with that name is registered. The BPF filters of
+ * the sockets pick the frames of their port. Replay at recorded pace or as fast as the modules can take the frames.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/sockios.h>
+#include "../common/db_emu.h"
+#include "../common/db_pcapng.h"
+#include "../common/shared_memory.h"
+#include "../common/db_common.h"
+
+#define REPLAY_MAX_ENDPOINTS    32
+#define REPLAY_DEFAULT_HUB      "replay"
+#define REPLAY_DRAIN_TIMEOUT_S  5
+
+typedef struct {
+    struct sockaddr_un addr;
+    socklen_t addr_len;
+    char ifname[IFNAMSIZ];
+    int fd;     // connected, blocking: a full socket of a module slows the replay down instead of dropping frames
+    uint64_t frames;
+    uint64_t timeouts;
+} replay_endpoint_t;
+
+volatile bool keeprunning = true;
+char hub_name[IFNAMSIZ * 4] = REPLAY_DEFAULT_HUB;
+char *capture_path = NULL;
+double speed = 1;           // 1 = recorded pace, 0 = as fast as possible
+int wait_endpoints = 1;
+double wait_timeout_s = 10;
+bool print_gnd_status = false;
+replay_endpoint_t endpoints[REPLAY_MAX_ENDPOINTS];
+int num_endpoints = 0;
+
+void int_handler(int dummy) {
+    keeprunning = false;
+}
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+void process_command_line_args(int argc, char *argv[]) {
+    int c;
+    while ((c = getopt(argc, argv, "s:x:ae:w:g?")) != -1) {
+        switch (c) {
+            case 's':
+                strncpy(hub_name, optarg, sizeof(hub_name) - 1);
+                break;
+            case 'x':
+                speed = strtod(optarg, NULL);
+                break;
+            case 'a':
+                speed = 0;
+                break;
+            case 'e':
+                wait_endpoints = (int) strtol(optarg, NULL, 10);
+                break;
+            case 'w':
+                wait_timeout_s = strtod(optarg, NULL);
+                break;
+            case 'g':
+                print_gnd_status = true;
+                break;
+            case '?':
+            default:
+                printf("Replays a DroneBridge capture (pcapng, see DB_CAPTURE) into DroneBridge modules started with "
+                       "DB_EMU=<hub>. Use\n\tdb_pcap_replay [options] <capture.pcapng>"
+                       "\n\t-s <hub name> default is <" REPLAY_DEFAULT_HUB ">"
+                       "\n\t-x <factor> replay speed relative to the recorded pace, default 1"
+                       "\n\t-a replay as fast as possible (the modules set the pace)"
+                       "\n\t-e <sockets> number of module sockets to wait for before the replay starts, default 1"
+                       "\n\t-w <seconds> max. time to wait for the sockets, default 10"
+                       "\n\t-g print the ground status (video_gnd/status shared memory) after the replay\n");
+                exit(c == '?' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    if (optind >= argc) {
+        LOG_SYS_STD(LOG_ERR, "DB_REPLAY: No capture file given\n");
+        exit(EXIT_FAILURE);
+    }
+    capture_path = argv[optind];
+}
+
+/**
+ * Registers new module sockets. Frames the modules send to the hub are dropped
+ */
+void accept_endpoints(int hub_fd) {
+    uint8_t buffer[MAX_DB_DATA_LENGTH + 256];
+    struct sockaddr_un addr;
+    socklen_t addr_len = sizeof(addr);
+    while (recvfrom(hub_fd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr *) &addr, &addr_len) >= 0) {
+        bool known = false;
+        for (int i = 0; i < num_endpoints; i++) {
+            if (endpoints[i].addr_len == addr_len && memcmp(&endpoints[i].addr, &addr, addr_len) == 0) known = true;
+        }
+        replay_endpoint_t *endpoint = &endpoints[num_endpoints];
+        if (!known && num_endpoints < REPLAY_MAX_ENDPOINTS &&
+            db_emu_parse_endpoint_address(&addr, addr_len, endpoint->ifname) == 0) {
+            endpoint->fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+            struct timeval timeout = {.tv_sec = 1, .tv_usec = 0};
+            setsockopt(endpoint->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            if (endpoint->fd >= 0 && connect(endpoint->fd, (struct sockaddr *) &addr, addr_len) == 0) {
+                memcpy(&endpoint->addr, &addr, addr_len);
+                endpoint->addr_len = addr_len;
+                endpoint->frames = endpoint->timeouts = 0;
+                num_endpoints++;
+                LOG_SYS_STD(LOG_NOTICE, "DB_REPLAY: Module socket on %s registered\n", endpoint->ifname);
+            } else if (endpoint->fd >= 0) {
+                close(endpoint->fd);
+            }
+        }
+        addr_len = sizeof(addr);
+    }
+}
+
+void send_to_endpoint(replay_endpoint_t *endpoint, const db_pcapng_frame_t *frame) {
+    if (endpoint->fd < 0) return;
+    if (send(endpoint->fd, frame->data, frame->length, 0) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            endpoint->timeouts++; // module does not read anymore
+        } else {
+            LOG_SYS_STD(LOG_ERR, "DB_REPLAY: Module socket on %s closed (%s)\n", endpoint->ifname, strerror(errno));
+            close(endpoint->fd);
+            endpoint->fd = -1;
+        }
+        return;
+    }
+    endpoint->frames++;
+}
+
+/**
+ * Waits until the modules read all frames
+ */
+void wait_for_drain() {
+    uint64_t deadline = now_ns() + REPLAY_DRAIN_TIMEOUT_S * 1000000000ULL;
+    for (int i = 0; i < num_endpoints && now_ns() < deadline; i++) {
+        int pending = 0;
+        while (endpoints[i].fd >= 0 && ioctl(endpoints[i].fd, SIOCOUTQ, &pending) == 0 && pending > 0 &&
+               now_ns() < deadline)
+            usleep(200);
+    }
+}
+
+void print_ground_status() {
+    db_gnd_status_t *status = db_gnd_status_memory_open();
+    printf("DB_REPLAY: Ground status: %u packets received, %u damaged blocks, %u lost packets, %u kbit/s, "
+           "%u TX restarts\n", status->received_packet_cnt, status->damaged_block_cnt, status->lost_packet_cnt,
+           status->kbitrate, status->tx_restart_cnt);
+    printf("DB_REPLAY: Block decode: %u us (last), latency %u us (last), %u us (max), %u packets dropped (overflow)\n",
+           status->decode_time_us, status->decode_latency_us, status->decode_latency_max_us,
+           status->decode_overflow_cnt);
+    for (uint32_t a = 0; a < status->wifi_adapter_cnt && a < 8; a++) {
+        printf("DB_REPLAY:\t%s: %u packets, %u bad CRC, %i dBm\n", status->adapter[a].name,
+               status->adapter[a].received_packet_cnt, status->adapter[a].wrong_crc_cnt,
+               status->adapter[a].current_signal_dbm);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    process_command_line_args(argc, argv);
+    signal(SIGINT, int_handler);
+    signal(SIGTERM, int_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    db_pcapng_reader_t reader;
+    if (db_pcapng_open(&reader, capture_path) < 0) exit(EXIT_FAILURE);
+    struct sockaddr_un hub_addr;
+    socklen_t hub_addr_len = db_emu_hub_address(&hub_addr, hub_name);
+    int hub_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (hub_fd < 0 || bind(hub_fd, (struct sockaddr *) &hub_addr, hub_addr_len) < 0) {
+        LOG_SYS_STD(LOG_ERR, "DB_REPLAY: Could not bind hub '%s' (%s)\n", hub_name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    LOG_SYS_STD(LOG_NOTICE, "DB_REPLAY: Waiting for %i module socket(s). Start the modules with DB_EMU=%s\n",
+                wait_endpoints, hub_name);
+    uint64_t wait_end = now_ns() + (uint64_t) (wait_timeout_s * 1e9);
+    while (keeprunning && num_endpoints < wait_endpoints && now_ns() < wait_end) {
+        accept_endpoints(hub_fd);
+        usleep(10000);
+    }
+    if (num_endpoints == 0) {
+        LOG_SYS_STD(LOG_ERR, "DB_REPLAY: No module connected\n");
+        exit(EXIT_FAILURE);
+    }
+    usleep(100000); // modules may still be setting up
+
+    db_pcapng_frame_t frame;
+    uint64_t frames = 0, bytes = 0, first_ts = 0, start = now_ns();
+    int ret = 0;
+    while (keeprunning && (ret = db_pcapng_next(&reader, &frame)) == 1) {
+        if (reader.link_type[frame.interface_id] != DB_PCAPNG_LINKTYPE_RADIOTAP) continue;
+        if (frames == 0) first_ts = frame.timestamp_ns;
+        if (speed > 0 && frame.timestamp_ns > first_ts) {
+            uint64_t due = start + (uint64_t) ((frame.timestamp_ns - first_ts) / speed);
+            uint64_t now = now_ns();
+            if (due > now) {
+                struct timespec ts = {.tv_sec = (time_t) ((due - now) / 1000000000ULL),
+                                      .tv_nsec = (long) ((due - now) % 1000000000ULL)};
+                nanosleep(&ts, NULL);
+            }
+        }
+        if ((frames & 0xff) == 0) accept_endpoints(hub_fd);
+        const char *ifname = reader.if_name[frame.interface_id];
+        bool delivered = false;
+        for (int i = 0; i < num_endpoints; i++) {
+            if (strncmp(endpoints[i].ifname, ifname, IFNAMSIZ) == 0) {
+                send_to_endpoint(&endpoints[i], &frame);
+                delivered = true;
+            }
+        }
+        for (int i = 0; i < num_endpoints && !delivered; i++)
+            send_to_endpoint(&endpoints[i], &frame);
+        frames++;
+        bytes += frame.length;
+    }
+    if (ret < 0) LOG_SYS_STD(LOG_ERR, "DB_REPLAY: Capture is corrupt, stopped after %llu frames\n",
+                             (unsigned long long) frames);
+    wait_for_drain();
+    double seconds = (now_ns() - start) / 1e9;
+    printf("DB_REPLAY: Replayed %llu frames (%.2f MB) in %.3fs: %.0f frames/s, %.2f Mbit/s%s\n",
+           (unsigned long long) frames, bytes / 1e6, seconds, frames / seconds, bytes * 8 / seconds / 1e6,
+           speed > 0 ? "" : " (as fast as possible)");
+    for (int i = 0; i < num_endpoints; i++) {
+        printf("DB_REPLAY:\tsocket on %s: %llu frames delivered, %llu send timeouts\n", endpoints[i].ifname,
+               (unsigned long long) endpoints[i].frames, (unsigned long long) endpoints[i].timeouts);
+        if (endpoints[i].fd >= 0) close(endpoints[i].fd);
+    }
+    if (print_gnd_status) print_ground_status();
+    db_pcapng_close(&reader);
+    close(hub_fd);
+    return 0;
+}
@@ -47,7 +47,7 @@
 bool volatile keeprunning = true;
 char db_mode, write_to_osdfifo;
 uint8_t comm_id = DEFAULT_V2_COMMID, frame_type;
-int bitrate_op, prox_adhere_80211, num_interfaces;
+int bitrate_op, prox_adhere_80211, num_interfaces, raw_version;
 char adapters[DB_MAX_ADAPTERS][IFNAMSIZ];
 char log_path[MAX_PATH_LENGTH];
 uint8_t tel_msg_log_buff[MAVLINK_MAX_PACKET_LEN + sizeof(uint64_t)];
@@ -70,10 +70,11 @@ void process_command_line_args(int argc, char *argv[]) {
     num_interfaces = 0;
     bitrate_op = 1;
     prox_adhere_80211 = 0;
+    raw_version = DB_RAW_DEFAULT_VERSION;
     frame_type = DB_FRAMETYPE_DEFAULT;
     strcpy(log_path, DEFAULT_LOG_PATH);
     int c;
-    while ((c = getopt(argc, argv, "n:m:c:b:o:f:a:l:?")) != -1) {
+    while ((c = getopt(argc, argv, "n:m:c:b:o:f:a:l:P:?")) != -1) {
         switch (c) {
             case 'n':
                 if (num_interfaces < DB_MAX_ADAPTERS) {
@@ -102,6 +103,9 @@ void process_command_line_args(int argc, char *argv[]) {
             case 'a':
                 prox_adhere_80211 = (int) strtol(optarg, NULL, 10);
                 break;
+            case 'P':
+                raw_version = (int) strtol(optarg, NULL, 10);
+                break;
             case '?':
                 LOG_SYS_STD(LOG_INFO,
                             "DroneBridge Proxy module is used to do any UDP <-> DB_CONTROL_AIR routing. UDP IP given by "
@@ -115,12 +119,19 @@ void process_command_line_args(int argc, char *argv[]) {
                             "\n\t-b bit rate:\tin Mbps (1|2|5|6|9|11|12|18|24|36|48|54)\n\t\t(bitrate option only "
                             "supported with Ralink chipsets)"
                             "\n\t-a [0|1] to disable/enable. Offsets the payload by some bytes so that it sits outside "
-                            "then 802.11 header. Set this to 1 if you are using a non DB-Rasp Kernel!");
+                            "then 802.11 header. Set this to 1 if you are using a non DB-Rasp Kernel!"
+                            "\n\t-P [2|3] DroneBridge raw protocol version of sent frames (default: %i). v3 requires "
+                            "v3 support on the UAV", DB_RAW_DEFAULT_VERSION);
                 break;
             default:
                 abort();
         }
     }
+    if (raw_version != 2 && raw_version != 3) {
+        LOG_SYS_STD(LOG_ERR, "DB_PROXY: Unsupported raw protocol version %i. Using v%i\n", raw_version,
+                    DB_RAW_DEFAULT_VERSION);
+        raw_version = DB_RAW_DEFAULT_VERSION;
+    }
     if (strlen(log_path) > 0 && log_path[strlen(log_path) - 1] != '/')
         strcat(log_path, "/");
 }
@@ -203,6 +214,7 @@ int main(int argc, char *argv[]) {
     for (int i = 0; i < num_interfaces; ++i) {
         raw_interfaces[i] = open_db_socket(adapters[i], comm_id, db_mode, bitrate_op, DB_DIREC_DRONE, DB_PORT_PROXY,
                                            frame_type);
+        db_socket_set_version(&raw_interfaces[i], raw_version);
     }
     int fifo_osd = -1, new_tcp_client;
     int tcp_clients[MAX_TCP_CLIENTS] = {0};
@@ -211,7 +223,7 @@ int main(int argc, char *argv[]) {
     }
 
     // init variables
-    uint16_t radiotap_length = 0;
+    db_frame_view_t frame_view;
     fd_set fd_socket_set;
     struct timeval select_timeout;
     size_t recv_length = 0;
@@ -223,11 +235,11 @@ int main(int argc, char *argv[]) {
     // open log file for messages incoming from long range link
     struct log_file_t log_file = open_telemetry_log_file();
 
-    struct data_uni *data_uni_to_drone = get_hp_raw_buffer(prox_adhere_80211);
-    uint8_t seq_num = 0, seq_num_proxy = 0, last_recv_seq_num = 0;
+    uint16_t seq_num = 0;
+    db_dedup_t telem_dedup;
+    db_dedup_init(&telem_dedup);
     uint8_t lr_buffer[DATA_UNI_LENGTH];
     uint8_t tcp_buffer[TCP_BUFFER_SIZE];
-    size_t payload_length = 0;
 
     LOG_SYS_STD(LOG_INFO, "DB_PROXY_GROUND: started! Enabled diversity on %i adapters.\n", num_interfaces);
     while (keeprunning) {
@@ -261,16 +273,15 @@ int main(int argc, char *argv[]) {
                     // ---------------
                     // incoming form long range proxy port - write data to OSD-FIFO and pass on to connected TCP clients
                     // ---------------
-                    ssize_t l = recv(raw_interfaces[i].db_socket, lr_buffer, DATA_UNI_LENGTH, 0);
+                    ssize_t l = db_recv(raw_interfaces[i].db_socket, lr_buffer, DATA_UNI_LENGTH, 0);
                     int err = errno;
                     if (l > 0) {
-                        payload_length = get_db_payload(lr_buffer, l, tcp_buffer, &seq_num_proxy, &radiotap_length);
-                        if (seq_num_proxy != last_recv_seq_num) {
-                            last_recv_seq_num = seq_num_proxy;
-                            log_telem_to_file(log_file.file_pntr, tcp_buffer, payload_length);
-                            send_to_all_tcp_clients(tcp_clients, tcp_buffer, payload_length);
+                        if (db_parse_frame(lr_buffer, l, &frame_view) == 0 &&
+                            db_dedup_check(&telem_dedup, &frame_view)) {
+                            log_telem_to_file(log_file.file_pntr, frame_view.payload, frame_view.payload_length);
+                            send_to_all_tcp_clients(tcp_clients, frame_view.payload, frame_view.payload_length);
                             if (fifo_osd != -1 && write_to_osdfifo == 'Y') {
-                                ssize_t written = write(fifo_osd, tcp_buffer, payload_length);
+                                ssize_t written = write(fifo_osd, frame_view.payload, frame_view.payload_length);
                                 if (written < 1)
                                     perror("DB_PROXY_GROUND: Could not write to OSD FIFO");
                             }
@@ -311,10 +322,11 @@ int main(int argc, char *argv[]) {
                         tcp_clients[i] = 0;
                     } else {
                         // client sent us some information. Process it...
-                        memcpy(data_uni_to_drone->bytes, tcp_buffer, recv_length);
+                        // same sequence number on all adapters so that the receiver drops the diversity copies
+                        uint16_t msg_seq_num = update_seq_num16(&seq_num);
                         for (int j = 0; j < num_interfaces; j++)
-                            db_send_hp_div(&raw_interfaces[j], DB_PORT_CONTROLLER, (u_int16_t) recv_length,
-                                           update_seq_num(&seq_num));
+                            db_send_div(&raw_interfaces[j], tcp_buffer, DB_PORT_CONTROLLER, (u_int16_t) recv_length,
+                                        msg_seq_num, prox_adhere_80211);
                     }
                 }
             }
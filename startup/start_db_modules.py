@@ -42,6 +42,7 @@ def start_gnd_modules():
     video_fecs = config.getint(COMMON, 'video_fecs')
     video_blocklength = config.getint(COMMON, 'video_blocklength')
     compatibility_mode = config.getint(COMMON, 'compatibility_mode')
+    raw_protocol_version = config.getint(COMMON, 'raw_protocol_version', fallback=2)
     datarate = config.getint(GROUND, 'datarate')
     interface_selection = config.get(GROUND, 'interface_selection')
     interface_control = config.get(GROUND, 'interface_control')
@@ -85,7 +86,8 @@ def start_gnd_modules():
 
     print(f"{GND_STRING_TAG} Starting proxy module...")
     comm_proxy = [os.path.join(DRONEBRIDGE_BIN_PATH, 'proxy', 'db_proxy'), "-m", "m", "-c", str(communication_id),
-                  "-f", str(frametype), "-b", str(get_bit_rate(datarate)), "-a", str(compatibility_mode)]
+                  "-f", str(frametype), "-b", str(get_bit_rate(datarate)), "-a", str(compatibility_mode),
+                  "-P", str(raw_protocol_version)]
     comm_proxy.extend(interface_proxy.split())
     Popen(comm_proxy, shell=False, stdin=None, stdout=None, stderr=None)
 
@@ -94,7 +96,7 @@ def start_gnd_modules():
         comm_control = [os.path.join(DRONEBRIDGE_BIN_PATH, 'control', 'control_ground'), "-j",
                         str(joy_interface), "-m", "m", "-v", str(rc_proto), "-o", str(en_rc_overwrite), "-c",
                         str(communication_id), "-t", str(frametype), "-b", str(get_bit_rate(datarate)), "-a",
-                        str(compatibility_mode)]
+                        str(compatibility_mode), "-P", str(raw_protocol_version)]
         comm_control.extend(interface_control.split())
         Popen(comm_control, shell=False, stdin=None, stdout=None, stderr=None, close_fds=True)
 
@@ -111,7 +113,7 @@ def start_gnd_modules():
         print(f"{GND_STRING_TAG} Starting video module... (FEC: {video_blocks}/{video_fecs}/{video_blocklength})")
         receive_comm = [os.path.join(DRONEBRIDGE_BIN_PATH, 'video', 'video_gnd'), "-d", str(video_blocks),
                         "-r", str(video_fecs), "-f", str(video_blocklength), "-c", str(communication_id), "-p", "N",
-                        "-v", str(fwd_stream_port), "-o"]
+                        "-v", str(fwd_stream_port), "-t", fwd_stream, "-o"]
         receive_comm.extend(interface_video.split())
         db_video_receive = Popen(receive_comm, stdout=subprocess.PIPE, close_fds=True, shell=False, bufsize=0)
         print(f"{GND_STRING_TAG} Starting video player...")
@@ -128,6 +130,7 @@ def start_uav_modules():
     communication_id = config.getint(COMMON, 'communication_id')
     cts_protection = config.get(COMMON, 'cts_protection')
     compatibility_mode = config.getint(COMMON, 'compatibility_mode')
+    raw_protocol_version = config.getint(COMMON, 'raw_protocol_version', fallback=2)
     datarate = config.getint(UAV, 'datarate')
     interface_selection = config.get(UAV, 'interface_selection')
     interface_control = config.get(UAV, 'interface_control')
@@ -192,7 +195,7 @@ def start_uav_modules():
         comm = [os.path.join(DRONEBRIDGE_BIN_PATH, 'control', 'control_air'), "-u", str(serial_int_cont), "-m", "m",
                 "-c", str(communication_id), "-v", str(serial_prot), "-t", str(frametype), "-l",
                 str(pass_through_packet_size), "-r", str(baud_control), "-e", str(enable_sumd_rc), "-s",
-                str(serial_int_sumd), "-b", str(get_bit_rate(2))]
+                str(serial_int_sumd), "-b", str(get_bit_rate(2)), "-P", str(raw_protocol_version)]
         comm.extend(interface_control.split())
         Popen(comm, shell=False, stdin=None, stdout=None, stderr=None)
 
@@ -215,7 +218,8 @@ def start_uav_modules():
 
         video_air_comm = [os.path.join(DRONEBRIDGE_BIN_PATH, 'video', 'video_air'), "-d", str(video_blocks), "-r",
                           str(video_fecs), "-f", str(video_blocklength), "-t", str(frametype),
-                          "-b", str(get_bit_rate(datarate)), "-c", str(communication_id), "-a", str(compatibility_mode)]
+                          "-b", str(get_bit_rate(datarate)), "-c", str(communication_id), "-a", str(compatibility_mode),
+                          "-P", str(raw_protocol_version)]
         video_air_comm.extend(interface_video.split())
         Popen(video_air_comm, stdin=raspivid_task.stdout, stdout=None, stderr=None, close_fds=True, shell=False)
 
@@ -87,16 +87,16 @@ int main(int argc, char *argv[]) {
     signal(SIGINT, int_handler);
     signal(SIGTERM, int_handler);
     struct timespec timestamp;
-    int restarts = 0, cardcounter = 0, select_return, max_sd, new_tcp_client, prev_seq_num_status = 0;
+    int restarts = 0, cardcounter = 0, select_return, max_sd, new_tcp_client;
     struct timeval timecheck;
     long start, rightnow, status_message_update_rate = 100; // send status messages every 100ms (10Hz)
     int8_t best_dbm = 0;
     ssize_t l;
-    uint8_t seq_num_status = 0;
-    uint16_t radiotap_length;
+    db_frame_view_t frame_view;
+    db_dedup_t status_dedup;
+    db_dedup_init(&status_dedup);
     uint8_t lr_buffer[DATA_UNI_LENGTH];
     memset(lr_buffer, 0, DATA_UNI_LENGTH);
-    uint8_t message_buff[DATA_UNI_LENGTH - DB_RAW_V2_HEADER_LENGTH];
     uint8_t tcp_message_buff[NET_BUFF_SIZE];
     int tcp_clients[MAX_TCP_CLIENTS] = {0};
 
@@ -175,14 +175,14 @@ int main(int argc, char *argv[]) {
                     // ---------------
                     // status message from long range link (UAV)
                     // ---------------
-                    l = recv(raw_interfaces_status[i].db_socket, lr_buffer, DATA_UNI_LENGTH, 0);
+                    l = db_recv(raw_interfaces_status[i].db_socket, lr_buffer, DATA_UNI_LENGTH, 0);
                     if (l > 0) {
-                        get_db_payload(lr_buffer, l, message_buff, &seq_num_status, &radiotap_length);
-                        if (prev_seq_num_status != seq_num_status) {
-                            prev_seq_num_status = seq_num_status;
+                        if (db_parse_frame(lr_buffer, l, &frame_view) == 0 &&
+                            frame_view.payload_length >= sizeof(struct uav_rc_status_update_message_t) &&
+                            db_dedup_check(&status_dedup, &frame_view)) {
                             // process payload (currently only one type of raw status frame is supported: RC_AIR --> STATUS_GROUND)
                             // must be a uav_rc_status_update_message_t
-                            struct uav_rc_status_update_message_t *rc_status_message = (struct uav_rc_status_update_message_t *) message_buff;
+                            struct uav_rc_status_update_message_t *rc_status_message = (struct uav_rc_status_update_message_t *) frame_view.payload;
                             db_sys_status_message.rssi_drone = rc_status_message->rssi_rc_uav;
                             db_sys_status_message.recv_pack_sec = rc_status_message->recv_pack_sec;
                             db_rc_status_t->adapter[0].current_signal_dbm = db_sys_status_message.rssi_drone;
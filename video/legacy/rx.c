@@ -13,7 +13,7 @@
  *   with this program; if not, write to the Free Software Foundation, Inc.,
  *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
-#include "fec.h"
+#include "../../fec/fec.h"
 #include "lib.h"
 #include "wifibroadcast.h"
 #include "radiotap.h"
@@ -20,7 +20,7 @@
 #include <unistd.h>
 #include <time.h>
 #include <sys/resource.h>
-#include "fec.h"
+#include "../../fec/fec.h"
 #include "lib.h"
 #include "wifibroadcast.h"
 #include <netpacket/packet.h>
@@ -0,0 +1,339 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "video_clients.h"
+#include "../common/db_common.h"
+
+#define HINT_BUFF_SIZE 256
+
+static struct {
+    int sock;
+    uint16_t default_port;
+    output_policy_t default_policy;
+    uint8_t default_format;
+    int lease_s; // 0 = hint destinations never expire
+    struct sockaddr_in default_addr;
+    video_client_t table[DB_GND_MAX_VIDEO_CLIENTS]; // index matches db_gnd_status->video_client
+    db_gnd_status_t *status;
+} clients;
+
+/**
+ * Sink: decoded stream via UDP to one destination. All waiting packets (usually a whole block) get sent with one UDP
+ * GSO send or sendmmsg() call. Every packet stays a datagram of its own
+ */
+static int send_client_batch(void *ctx, const struct iovec *packets, int num_packets) {
+    video_client_t *client = ctx;
+    return output_udp_send(clients.sock, (struct sockaddr *) &client->addr, sizeof(client->addr), packets,
+                           num_packets, &client->use_gso);
+}
+
+/**
+ * Sink: decoded stream packetized as RTP/H.264 to one destination. RTP packets that could not be sent stay in the
+ * queue of the packetizer, the sink stays busy until the queue is empty
+ */
+static int send_client_rtp(void *ctx, const struct iovec *packets, int num_packets) {
+    video_client_t *client = ctx;
+    int consumed = 0;
+    while (video_rtp_send(client->rtp, clients.sock, (struct sockaddr *) &client->addr, sizeof(client->addr),
+                          &client->use_gso)) {
+        if (consumed == num_packets) return consumed;
+        // fill the queue so that the RTP packets of several chunks get sent at once
+        while (consumed < num_packets && video_rtp_queue_free(client->rtp) >= VIDEO_RTP_QUEUE_PACKETS / 4) {
+            video_rtp_packetize(client->rtp, packets[consumed].iov_base, (uint32_t) packets[consumed].iov_len);
+            consumed++;
+        }
+    }
+    return consumed | OUTPUT_BATCH_QUEUED;
+}
+
+/**
+ * The overflow policy skipped packets of the RTP destination: the NAL unit that was being packetized is incomplete
+ */
+static void skip_client_rtp(void *ctx) {
+    video_client_t *client = ctx;
+    video_rtp_reset(client->rtp);
+}
+
+static void log_client(const char *action, const video_client_t *client) {
+    char ip_str[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &client->addr.sin_addr, ip_str, INET_ADDRSTRLEN);
+    LOG_SYS_STD(LOG_NOTICE, "DB_VIDEO_GND: %s video destination %s:%i (%s, overflow policy: %s)\n", action, ip_str,
+                ntohs(client->addr.sin_port), client->format == VIDEO_FORMAT_RTP ? "rtp" : "raw",
+                output_policy_name(client->policy));
+}
+
+/**
+ * @param str raw or rtp
+ * @param format Parsed format
+ * @return 0 on success or -1 if unknown
+ */
+int video_parse_format(const char *str, uint8_t *format) {
+    if (strcmp(str, "raw") == 0) *format = VIDEO_FORMAT_RAW;
+    else if (strcmp(str, "rtp") == 0) *format = VIDEO_FORMAT_RTP;
+    else return -1;
+    return 0;
+}
+
+static int find_client(const struct sockaddr_in *addr) {
+    for (int i = 0; i < DB_GND_MAX_VIDEO_CLIENTS; i++) {
+        if (clients.table[i].used && clients.table[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+            clients.table[i].addr.sin_port == addr->sin_port)
+            return i;
+    }
+    return -1;
+}
+
+static void remove_client(int index, const char *reason) {
+    video_client_t *client = &clients.table[index];
+    output_remove_sink(client->sink_id);
+    free(client->rtp);
+    client->rtp = NULL;
+    client->used = false;
+    client->status->active = 0;
+    clients.status->video_client_cnt--;
+    log_client(reason, client);
+}
+
+/**
+ * Registers a destination with the output thread
+ *
+ * @return Index of the destination or -1 if the table is full
+ */
+static int add_client(const struct sockaddr_in *addr, uint8_t type, output_policy_t policy, uint8_t format,
+                      bool is_default) {
+    int index = -1;
+    time_t oldest_hint = 0;
+    for (int i = 0; i < DB_GND_MAX_VIDEO_CLIENTS; i++) {
+        // the default destination gets replaced by the first real one
+        if (clients.table[i].used && clients.table[i].is_default && !is_default) remove_client(i, "Replaced");
+        if (!clients.table[i].used && index < 0) index = i;
+    }
+    if (index < 0 && type == VIDEO_CLIENT_HINT) {
+        // table is full: replace the hint destination that was refreshed the longest time ago
+        for (int i = 0; i < DB_GND_MAX_VIDEO_CLIENTS; i++) {
+            if (clients.table[i].type == VIDEO_CLIENT_HINT && (index < 0 || clients.table[i].last_hint < oldest_hint)) {
+                index = i;
+                oldest_hint = clients.table[i].last_hint;
+            }
+        }
+    }
+    if (index < 0) return -1;
+    if (clients.table[index].used) remove_client(index, "Replaced");
+
+    video_client_t *client = &clients.table[index];
+    memset(client, 0, sizeof(video_client_t));
+    client->addr = *addr;
+    client->type = type;
+    client->policy = policy;
+    client->format = format;
+    client->is_default = is_default;
+    client->use_gso = true;
+    client->last_hint = type == VIDEO_CLIENT_HINT ? time(NULL) : 0;
+    client->status = &clients.status->video_client[index];
+    char name[8];
+    snprintf(name, sizeof(name), "udp%u", (unsigned int) index % DB_GND_MAX_VIDEO_CLIENTS);
+    if (format == VIDEO_FORMAT_RTP) {
+        client->rtp = malloc(sizeof(video_rtp_t));
+        if (client->rtp == NULL) return -1;
+        video_rtp_init(client->rtp, (uint32_t) random());
+    }
+    client->sink_id = output_add_sink(name, policy, clients.sock, NULL,
+                                      format == VIDEO_FORMAT_RTP ? send_client_rtp : send_client_batch,
+                                      format == VIDEO_FORMAT_RTP ? skip_client_rtp : NULL, client,
+                                      &client->status->stats);
+    if (client->sink_id < 0) {
+        free(client->rtp);
+        client->rtp = NULL;
+        return -1;
+    }
+    client->used = true;
+    client->status->type = type;
+    client->status->format = format;
+    client->status->ip = addr->sin_addr.s_addr;
+    client->status->port = ntohs(addr->sin_port);
+    client->status->last_hint = client->last_hint;
+    client->status->active = 1;
+    clients.status->video_client_cnt++;
+    log_client("Added", client);
+    return index;
+}
+
+/**
+ * Falls back to the default destination (IP checker address) once there is no other destination
+ */
+static void update_default_client() {
+    for (int i = 0; i < DB_GND_MAX_VIDEO_CLIENTS; i++) {
+        if (clients.table[i].used) return;
+    }
+    add_client(&clients.default_addr, VIDEO_CLIENT_STATIC, clients.default_policy, clients.default_format, true);
+}
+
+/**
+ * Registers, refreshes or removes a destination based on a video destination hint packet
+ *
+ * @param hint Content of the packet. Older apps send anything, unknown content is ignored
+ * @param src Source address of the packet
+ */
+static void process_hint(char *hint, const struct sockaddr_in *src) {
+    struct sockaddr_in addr = *src;
+    addr.sin_port = htons(clients.default_port);
+    output_policy_t policy = clients.default_policy;
+    uint8_t format = clients.default_format;
+    bool leave = false;
+    char *save_ptr;
+    for (char *token = strtok_r(hint, " \t\r\n", &save_ptr); token; token = strtok_r(NULL, " \t\r\n", &save_ptr)) {
+        if (strncmp(token, "port=", 5) == 0) {
+            long port = strtol(token + 5, NULL, 10);
+            if (port > 0 && port <= 0xFFFF) addr.sin_port = htons((uint16_t) port);
+        } else if (strncmp(token, "policy=", 7) == 0) {
+            output_parse_policy(token + 7, &policy);
+        } else if (strncmp(token, "format=", 7) == 0) {
+            video_parse_format(token + 7, &format);
+        } else if (strcmp(token, "leave") == 0) {
+            leave = true;
+        }
+    }
+    // hints are not authenticated: a slow destination must not stall the output of all others
+    if (policy == OUTPUT_BLOCK) policy = OUTPUT_DROP_TO_KEYFRAME;
+    int index = find_client(&addr);
+    if (leave) {
+        if (index >= 0 && clients.table[index].type == VIDEO_CLIENT_HINT) {
+            remove_client(index, "Removed");
+            update_default_client();
+        }
+        return;
+    }
+    if (index >= 0 && !clients.table[index].is_default) {
+        video_client_t *client = &clients.table[index];
+        if (client->type == VIDEO_CLIENT_HINT && (client->policy != policy || client->format != format)) {
+            // re-register to apply the new policy/format
+            remove_client(index, "Updating");
+            add_client(&addr, VIDEO_CLIENT_HINT, policy, format, false);
+        } else if (client->type == VIDEO_CLIENT_HINT) {
+            client->last_hint = time(NULL);
+            client->status->last_hint = client->last_hint;
+        }
+        return;
+    }
+    if (add_client(&addr, VIDEO_CLIENT_HINT, policy, format, false) < 0)
+        LOG_SYS_STD(LOG_NOTICE, "DB_VIDEO_GND: Too many video destinations. Ignoring hint\n");
+}
+
+/**
+ * Init the table of UDP video destinations. Must be called after output_init() and before the output thread starts
+ *
+ * @param udp_socket Socket bound to port 5000. Receives the hints and sends the video stream
+ * @param default_port Port of destinations that did not request one
+ * @param default_policy Overflow policy of destinations that did not request one
+ * @param default_format Format of destinations that did not request one (VIDEO_FORMAT_RAW or VIDEO_FORMAT_RTP)
+ * @param lease_s Seconds after which a hint destination expires if it was not refreshed. 0 to never expire
+ * @param default_ip Destination used while there is no other one (IP checker address)
+ * @param status Shared memory to export the table to
+ * @return 0 on success
+ */
+int video_clients_init(int udp_socket, uint16_t default_port, output_policy_t default_policy, uint8_t default_format,
+                       int lease_s, const char *default_ip, db_gnd_status_t *status) {
+    memset(&clients, 0, sizeof(clients));
+    clients.sock = udp_socket;
+    clients.default_port = default_port;
+    clients.default_policy = default_policy;
+    clients.default_format = default_format;
+    clients.lease_s = lease_s;
+    clients.status = status;
+    clients.default_addr.sin_family = AF_INET;
+    clients.default_addr.sin_port = htons(default_port);
+    if (inet_pton(AF_INET, default_ip, &clients.default_addr.sin_addr) != 1) return -1;
+    srandom((unsigned int) (time(NULL) ^ getpid())); // RTP SSRCs
+    status->video_client_cnt = 0;
+    memset(status->video_client, 0, sizeof(status->video_client));
+    update_default_client();
+    return 0;
+}
+
+/**
+ * Adds a destination that never expires. Must be called before the output thread starts
+ *
+ * @param dst <ip>[:<port>] Multicast groups are supported
+ * @param multicast_ttl TTL of packets sent to a multicast group
+ * @return 0 on success, -1 if the address or port is invalid or the table is full
+ */
+int video_clients_add_static(const char *dst, int multicast_ttl) {
+    char ip_str[INET_ADDRSTRLEN] = {0};
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(clients.default_port)};
+    const char *port_str = strchr(dst, ':');
+    size_t ip_len = port_str ? (size_t) (port_str - dst) : strlen(dst);
+    if (ip_len >= INET_ADDRSTRLEN) return -1;
+    memcpy(ip_str, dst, ip_len);
+    if (inet_pton(AF_INET, ip_str, &addr.sin_addr) != 1) return -1;
+    if (port_str) {
+        char *end;
+        errno = 0;
+        long port = strtol(port_str + 1, &end, 10);
+        if (errno != 0 || end == port_str + 1 || *end != '\0' || port <= 0 || port > 0xFFFF) return -1;
+        addr.sin_port = htons((uint16_t) port);
+    }
+    uint8_t type = VIDEO_CLIENT_STATIC;
+    if (IN_MULTICAST(ntohl(addr.sin_addr.s_addr))) {
+        type = VIDEO_CLIENT_MULTICAST;
+        unsigned char ttl = (unsigned char) multicast_ttl;
+        if (setsockopt(clients.sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0)
+            perror("DB_VIDEO_GND: Could not set multicast TTL");
+    }
+    int index = find_client(&addr);
+    if (index >= 0 && !clients.table[index].is_default) return 0;
+    return add_client(&addr, type, clients.default_policy, clients.default_format, false) < 0 ? -1 : 0;
+}
+
+/**
+ * Housekeeping of the output thread: processes received video destination hints and removes expired destinations
+ *
+ * @param readable Hints are waiting on the socket
+ */
+void video_clients_housekeeping(bool readable) {
+    char hint[HINT_BUFF_SIZE];
+    struct sockaddr_in src;
+    socklen_t src_len = sizeof(src);
+    while (readable) {
+        ssize_t l = recvfrom(clients.sock, hint, sizeof(hint) - 1, MSG_DONTWAIT, (struct sockaddr *) &src, &src_len);
+        if (l < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("DB_VIDEO_GND: Error receiving on UDP socket");
+            break;
+        }
+        hint[l] = '\0';
+        if (src.sin_family == AF_INET) process_hint(hint, &src);
+        src_len = sizeof(src);
+    }
+    if (clients.lease_s <= 0) return;
+    time_t now = time(NULL);
+    for (int i = 0; i < DB_GND_MAX_VIDEO_CLIENTS; i++) {
+        if (clients.table[i].used && clients.table[i].type == VIDEO_CLIENT_HINT &&
+            now - clients.table[i].last_hint > clients.lease_s) {
+            remove_client(i, "Lease expired for");
+            update_default_client();
+        }
+    }
+}
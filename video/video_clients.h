@@ -0,0 +1,77 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DRONEBRIDGE_VIDEO_CLIENTS_H
+#define DRONEBRIDGE_VIDEO_CLIENTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <netinet/in.h>
+#include "video_output.h"
+#include "video_rtp.h"
+#include "../common/shared_memory.h"
+
+/*
+ * Table of the UDP destinations of the decoded video stream. Every destination is a sink of the output thread with its
+ * own cursor, overflow policy and counters (db_gnd_status->video_client), so a pilot display and a laptop can watch at
+ * the same time without slowing down each other.
+ * Destinations get registered by video destination hint packets sent to port 5000 of the ground station. The source IP
+ * of the hint is the destination. The hint may contain space separated options:
+ *   port=<port>      destination port (default: -v)
+ *   policy=<policy>  overflow policy (oldest, keyframe). Hint destinations never block (block becomes keyframe),
+ *                    only static destinations may stall the output thread
+ *   format=<format>  raw (H.264 byte stream) or rtp (RTP/H.264, RFC 6184)
+ *   leave            remove the destination
+ * Hint destinations expire if they are not refreshed within the lease time. Static destinations (-i, multicast groups)
+ * never expire. The default destination (IP checker address) is only used while there is no other destination.
+ * The table is owned by the output thread: after video_clients_init() it is only accessed by the housekeeping function
+ */
+
+#define VIDEO_CLIENT_HINT 0
+#define VIDEO_CLIENT_STATIC 1
+#define VIDEO_CLIENT_MULTICAST 2
+
+#define VIDEO_FORMAT_RAW 0
+#define VIDEO_FORMAT_RTP 1
+
+typedef struct {
+    bool used;
+    bool is_default;
+    uint8_t type;
+    uint8_t format;
+    struct sockaddr_in addr;
+    output_policy_t policy;
+    int sink_id;
+    time_t last_hint;
+    bool use_gso;
+    video_rtp_t *rtp; // packetizer of RTP destinations
+    db_video_client_status_t *status;
+} video_client_t;
+
+int video_parse_format(const char *str, uint8_t *format);
+
+int video_clients_init(int udp_socket, uint16_t default_port, output_policy_t default_policy, uint8_t default_format,
+                       int lease_s, const char *default_ip, db_gnd_status_t *status);
+
+int video_clients_add_static(const char *dst, int multicast_ttl);
+
+void video_clients_housekeeping(bool readable);
+
+#endif //DRONEBRIDGE_VIDEO_CLIENTS_H
@@ -0,0 +1,309 @@
+#!/usr/bin/env python3
+#
+#   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+#
+#   Copyright 2019 Wolfgang Christl
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+
+"""
+End-to-end benchmark of the video pipeline over an emulated lossy link (no radio required).
+
+A reference H.264 elementary stream is piped into video_air at a fixed bit rate. video_air and video_gnd run on emulated
+adapters of a db_link_emu hub that impairs the link. The output of video_gnd is compared with the input. Reported per
+run: recovered block ratio, damaged blocks, added latency per block, CPU time per Mbit of video on each side and
+byte-exactness of the output. Sweeps over -d/-r/-f, the video_gnd reorder window (-w), the video_gnd decode threads
+(-j) and link models.
+
+Example:
+    ./video_e2e_bench.py --build-dir ../build -d 8 -r 4 -f 1024 1400 --loss "loss=0" "loss=0.05" "ge_p=0.02,ge_r=0.3"
+"""
+
+import argparse
+import bisect
+import csv
+import itertools
+import json
+import os
+import random
+import shutil
+import signal
+import struct
+import subprocess
+import sys
+import threading
+import time
+
+DB_VIDEO_HEADER_LENGTH = 4      # data_length field of every video data packet
+CLK_TCK = os.sysconf('SC_CLK_TCK')
+SYNC_LENGTH = 32                # bytes that need to match to align the output with the input
+AIR_IF = 'emuair'
+GND_IF = 'emugnd'
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(description='End-to-end benchmark of video_air -> emulated link -> video_gnd')
+    parser.add_argument('--build-dir', default='.', help='Directory searched for video_air, video_gnd, db_link_emu')
+    parser.add_argument('--input', help='Reference H.264 elementary stream. Generated with ffmpeg (or synthetic if '
+                                        'ffmpeg is not installed) when not set')
+    parser.add_argument('--duration', type=float, default=10, help='Length of the generated stream in seconds')
+    parser.add_argument('--bitrate', type=float, default=6, help='Rate the stream is fed into video_air in Mbit/s')
+    parser.add_argument('-d', type=int, nargs='+', default=[8], help='Data packets per block (video_air -d)')
+    parser.add_argument('-r', type=int, nargs='+', default=[4], help='FEC packets per block (video_air -r)')
+    parser.add_argument('-f', type=int, nargs='+', default=[1024], help='Bytes per packet (video_air -f)')
+    parser.add_argument('-w', type=int, nargs='+', default=[1], help='Reorder window in blocks (video_gnd -w)')
+    parser.add_argument('-j', type=int, nargs='+', default=[1], help='FEC decode threads (video_gnd -j)')
+    parser.add_argument('--loss', nargs='+', default=['loss=0', 'loss=0.05', 'ge_p=0.02,ge_r=0.3'],
+                        help='Link models of db_link_emu -l (without interface name), e.g. "loss=0.1,delay=2"')
+    parser.add_argument('--adapters', type=int, default=1, help='Number of receiving (ground) adapters')
+    parser.add_argument('--seed', type=int, default=1, help='Seed of the link emulator')
+    parser.add_argument('--csv', help='Write the results to this CSV file')
+    parser.add_argument('--json', help='Write the results to this JSON file')
+    parser.add_argument('-v', '--verbose', action='store_true', help='Show the output of the modules')
+    return parser.parse_args()
+
+
+def find_binary(build_dir, name):
+    for root, dirs, files in os.walk(build_dir):
+        if name in files and os.access(os.path.join(root, name), os.X_OK):
+            return os.path.join(root, name)
+    path = shutil.which(name)
+    if path is None:
+        sys.exit("Could not find " + name + " in " + build_dir + " or PATH")
+    return path
+
+
+def reference_stream(args) -> bytes:
+    """
+    :return: The reference stream. Read from --input, encoded with ffmpeg or synthetic (random NAL units)
+    """
+    if args.input:
+        with open(args.input, 'rb') as f:
+            return f.read()
+    if shutil.which('ffmpeg'):
+        cmd = ['ffmpeg', '-loglevel', 'error', '-f', 'lavfi', '-i', 'testsrc=size=1280x720:rate=30',
+               '-t', str(args.duration), '-c:v', 'libx264', '-preset', 'ultrafast', '-tune', 'zerolatency',
+               '-b:v', str(int(args.bitrate * 0.9e6)), '-f', 'h264', '-']
+        result = subprocess.run(cmd, stdout=subprocess.PIPE)
+        if result.returncode == 0 and len(result.stdout) > 0:
+            return result.stdout
+    print("ffmpeg with libx264 not available. Using a synthetic stream of random NAL units")
+    rand = random.Random(0)
+    stream = bytearray()
+    while len(stream) < args.duration * args.bitrate * 1e6 / 8:
+        length = rand.randint(200, 8000)
+        stream += b'\x00\x00\x00\x01' + rand.getrandbits(8 * length).to_bytes(length, 'little')
+    return bytes(stream)
+
+
+class OutputReader(threading.Thread):
+    """Reads the stdout of video_gnd and remembers when each byte arrived"""
+
+    def __init__(self, pipe):
+        super().__init__(daemon=True)
+        self.pipe = pipe
+        self.data = bytearray()
+        self.read_end = []      # offset after each read
+        self.read_time = []     # time of each read
+
+    def run(self):
+        while True:
+            chunk = os.read(self.pipe.fileno(), 1 << 16)
+            if not chunk:
+                break
+            self.data += chunk
+            self.read_end.append(len(self.data))
+            self.read_time.append(time.monotonic())
+
+    def time_of(self, offset):
+        return self.read_time[bisect.bisect_right(self.read_end, offset)]
+
+
+def align(ref, out, window):
+    """
+    Aligns the output of video_gnd with the reference stream. Lost packets leave gaps in the output, corrupted packets
+    of damaged blocks show up as garbage.
+
+    :return: List of matching spans (out_offset, ref_offset, length), bytes lost, garbage bytes
+    """
+    spans, lost, garbage = [], 0, 0
+    i = j = 0
+    while i < len(out) and j < len(ref):
+        if out[i:i + SYNC_LENGTH] == ref[j:j + SYNC_LENGTH] or (len(out) - i < SYNC_LENGTH and
+                                                                out[i:] == ref[j:j + len(out) - i]):
+            n = 0
+            while True:  # compare in chunks, byte by byte only inside the first differing chunk
+                m = min(4096, len(out) - i - n, len(ref) - j - n)
+                if m <= 0:
+                    break
+                a, b = out[i + n:i + n + m], ref[j + n:j + n + m]
+                if a == b:
+                    n += m
+                    continue
+                k = 0
+                while a[k] == b[k]:
+                    k += 1
+                n += k
+                break
+            spans.append((i, j, n))
+            i, j = i + n, j + n
+            continue
+        k = ref.find(out[i:i + SYNC_LENGTH], j, j + window)
+        if k >= 0:
+            lost += k - j
+            j = k
+        else:
+            garbage += 1
+            i += 1
+    lost += max(0, len(ref) - j)
+    return spans, lost, garbage
+
+
+def cpu_seconds(pid):
+    try:
+        with open('/proc/%d/stat' % pid) as f:
+            fields = f.read().rsplit(')', 1)[1].split()
+        return (int(fields[11]) + int(fields[12])) / CLK_TCK
+    except (OSError, IndexError):
+        return 0.0
+
+
+def read_shm(name, fmt):
+    try:
+        with open('/dev/shm/' + name, 'rb') as f:
+            return struct.unpack_from(fmt, f.read(struct.calcsize(fmt)))
+    except (OSError, struct.error):
+        return None
+
+
+def terminate(proc):
+    if proc.poll() is None:
+        proc.send_signal(signal.SIGINT)
+        try:
+            proc.wait(timeout=3)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+            proc.wait()
+
+
+def run_once(args, binaries, ref, data_blocks, fec_blocks, packet_size, window, workers, link_model, run_no):
+    hub = 'bench%d_%d' % (os.getpid(), run_no)
+    env = dict(os.environ, DB_EMU=hub)
+    log = None if args.verbose else subprocess.DEVNULL
+    gnd_ifs = [GND_IF + str(a) for a in range(args.adapters)]
+    hub_cmd = [binaries['db_link_emu'], '-s', hub, '-r', str(args.seed)]
+    for gnd_if in gnd_ifs:
+        hub_cmd += ['-l', gnd_if + ',' + link_model]
+    hub_proc = subprocess.Popen(hub_cmd, stdout=subprocess.PIPE, stderr=log, universal_newlines=True)
+    time.sleep(0.2)
+    gnd_cmd = [binaries['video_gnd'], '-d', str(data_blocks), '-r', str(fec_blocks), '-f', str(packet_size),
+               '-w', str(window), '-j', str(workers), '-i', '127.0.0.1', '-v', '5999']
+    for gnd_if in gnd_ifs:
+        gnd_cmd += ['-n', gnd_if]
+    gnd_proc = subprocess.Popen(gnd_cmd, env=env, stdout=subprocess.PIPE, stderr=log)
+    air_proc = subprocess.Popen([binaries['video_air'], '-n', AIR_IF, '-d', str(data_blocks), '-r', str(fec_blocks),
+                                 '-f', str(packet_size)], env=env, stdin=subprocess.PIPE, stdout=log, stderr=log)
+    reader = OutputReader(gnd_proc.stdout)
+    reader.start()
+    time.sleep(0.3)
+
+    # append filler so that the last data leaves the partially filled air-side block and the ground reorder window
+    block_bytes = data_blocks * (packet_size - DB_VIDEO_HEADER_LENGTH)
+    stream = ref + bytes(4 * block_bytes)
+    write_end, write_time = [], []
+    chunk_size = 4096
+    bytes_per_second = args.bitrate * 1e6 / 8
+    start = time.monotonic()
+    for offset in range(0, len(stream), chunk_size):
+        due = start + offset / bytes_per_second
+        delay = due - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+        air_proc.stdin.write(stream[offset:offset + chunk_size])
+        air_proc.stdin.flush()
+        write_end.append(min(offset + chunk_size, len(stream)))
+        write_time.append(time.monotonic())
+    deadline = time.monotonic() + 2
+    while len(reader.data) < len(ref) and time.monotonic() < deadline:
+        time.sleep(0.05)
+    time.sleep(0.2)
+    cpu_air, cpu_gnd = cpu_seconds(air_proc.pid), cpu_seconds(gnd_proc.pid)
+    gnd_status = read_shm('db_gnd_status_t', '<qIIIIIIII')
+    uav_status = read_shm('db_uav_status_t', '<iBBIIIiI')
+    terminate(air_proc)
+    terminate(gnd_proc)
+    terminate(hub_proc)
+    hub_log = hub_proc.stdout.read()
+    reader.join(timeout=1)
+
+    out = bytes(reader.data)
+    spans, lost, garbage = align(ref, out, 8 * block_bytes)
+    latencies = {}
+    for out_offset, ref_offset, length in spans:
+        for end in range(ref_offset + min(length, block_bytes), ref_offset + length + 1, block_bytes):
+            # latency of the last byte of each block: written to video_air -> read from video_gnd
+            t_in = write_time[bisect.bisect_left(write_end, end)]
+            t_out = reader.time_of(out_offset + end - ref_offset - 1)
+            block = (end - 1) // block_bytes
+            latencies[block] = max(latencies.get(block, 0), t_out - t_in)
+    latency_ms = sorted(v * 1000 for v in latencies.values())
+    blocks_sent = uav_status[3] if uav_status else 0
+    damaged = gnd_status[2] if gnd_status else 0
+    mbit = len(ref) * 8 / 1e6
+    frames_lost = sum(int(line.split()[4]) for line in hub_log.splitlines()
+                      if line.startswith('DB_LINK_EMU:') and line.split()[1] in gnd_ifs)
+
+    def percentile(p):
+        return round(latency_ms[min(len(latency_ms) - 1, int(p / 100 * len(latency_ms)))], 2) if latency_ms else None
+
+    return {
+        'd': data_blocks, 'r': fec_blocks, 'f': packet_size, 'w': window, 'j': workers, 'link': link_model,
+        'input_bytes': len(ref), 'output_bytes': min(len(out), len(ref)), 'byte_exact': out[:len(ref)] == ref,
+        'lost_bytes': lost, 'garbage_bytes': garbage, 'frames_lost_on_link': frames_lost,
+        'blocks_sent': blocks_sent, 'damaged_blocks': damaged,
+        'recovered_block_ratio': round(1 - damaged / blocks_sent, 5) if blocks_sent else None,
+        'latency_ms_p50': percentile(50), 'latency_ms_p99': percentile(99),
+        'latency_ms_max': round(latency_ms[-1], 2) if latency_ms else None,
+        'cpu_ms_per_mbit_air': round(cpu_air * 1000 / mbit, 3),
+        'cpu_ms_per_mbit_gnd': round(cpu_gnd * 1000 / mbit, 3),
+    }
+
+
+def main():
+    args = parse_arguments()
+    binaries = {name: find_binary(args.build_dir, name) for name in ('video_air', 'video_gnd', 'db_link_emu')}
+    ref = reference_stream(args)
+    print("Reference stream: %d bytes, fed at %.1f Mbit/s" % (len(ref), args.bitrate))
+    results = []
+    columns = ['d', 'r', 'f', 'w', 'j', 'link', 'byte_exact', 'recovered_block_ratio', 'damaged_blocks', 'blocks_sent',
+               'lost_bytes', 'latency_ms_p50', 'latency_ms_p99', 'cpu_ms_per_mbit_air', 'cpu_ms_per_mbit_gnd']
+    print(' '.join('%-22s' % c if c == 'link' else '%-10s' % c[:10] for c in columns))
+    for run_no, (d, r, f, w, j, link_model) in enumerate(itertools.product(args.d, args.r, args.f, args.w, args.j,
+                                                                          args.loss)):
+        result = run_once(args, binaries, ref, d, r, f, w, j, link_model, run_no)
+        results.append(result)
+        print(' '.join('%-22s' % result[c] if c == 'link' else '%-10s' % str(result[c])[:10] for c in columns))
+        sys.stdout.flush()
+    if args.csv:
+        with open(args.csv, 'w', newline='') as f:
+            writer = csv.DictWriter(f, fieldnames=list(results[0].keys()))
+            writer.writeheader()
+            writer.writerows(results)
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(results, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 #include "video_lib.h"
 
 void lib_init_packet_buffer(packet_buffer_t *p) {
@@ -55,3 +56,92 @@ void lib_free_packet_buffer_list(packet_buffer_t *p, size_t num_packets) {
 
 	free(p);
 }
+
+/**
+ * Checks if a NAL unit starts a new access unit once the current one contains a slice (H.264 7.4.1.2.3): AUD, SEI,
+ * SPS, PPS, prefix/subset NAL units or a slice with first_mb_in_slice == 0
+ *
+ * @param nal_type Type of the NAL unit
+ * @param first_mb_zero Slices only: first_mb_in_slice is 0 (first bit of the slice header is set)
+ * @return 1 if the NAL unit starts a new access unit
+ */
+int lib_h264_nal_starts_au(uint8_t nal_type, int first_mb_zero) {
+	return nal_type == 6 || (nal_type >= 7 && nal_type <= 9) || (nal_type >= 14 && nal_type <= 18) ||
+	       ((nal_type == 1 || nal_type == 5) && first_mb_zero);
+}
+
+/**
+ * Checks if the current NAL unit starts a new access unit: the first one that does so after a slice of the current
+ * access unit
+ */
+static int lib_h264_starts_au(h264_au_parser_t *parser, int first_mb_zero) {
+	uint8_t type = parser->nal_type;
+	int vcl = type >= 1 && type <= 5;
+	int new_au = parser->au_has_vcl && lib_h264_nal_starts_au(type, first_mb_zero);
+	if (new_au) parser->au_has_vcl = 0;
+	if (vcl) parser->au_has_vcl = 1;
+	parser->in_vcl = vcl;
+	return new_au;
+}
+
+/**
+ * Scans a chunk of a H.264 Annex B byte stream for the beginning of the next access unit. The stream may be cut at any
+ * position, the parser keeps its state between the chunks.
+ *
+ * @param parser Parser state, zero initialized before the first chunk
+ * @param data Chunk of the byte stream
+ * @param length Length of the chunk
+ * @param scanned Returns the number of bytes processed. Continue with data + scanned
+ * @return Offset of the start code of the first NAL unit of the new access unit or -1 if there is none. 0 if the start
+ * code began in an earlier chunk
+ */
+int lib_h264_find_au_start(h264_au_parser_t *parser, const uint8_t *data, uint32_t length, uint32_t *scanned) {
+	uint32_t i = 0;
+	int start_code_pos = 0;
+	while (i < length) {
+		uint8_t b = data[i++];
+		if (parser->slice_pending) {
+			parser->slice_pending = 0;
+			if (lib_h264_starts_au(parser, (b & 0x80) != 0)) {
+				parser->zeros = (b == 0);
+				*scanned = i;
+				return start_code_pos;
+			}
+		} else if (parser->header_pending) {
+			parser->header_pending = 0;
+			parser->nal_type = (uint8_t) (b & 0x1F);
+			if (parser->nal_type == 1 || parser->nal_type == 5) {
+				parser->slice_pending = 1;
+			} else if (lib_h264_starts_au(parser, 0)) {
+				*scanned = i;
+				return start_code_pos;
+			}
+			continue;
+		}
+		if (b == 0) {
+			parser->zeros++;
+			continue;
+		}
+		if (b == 1 && parser->zeros >= 2) {
+			start_code_pos = (int) (i - 1) - (int) parser->zeros;
+			if (start_code_pos < 0) start_code_pos = 0;
+			parser->header_pending = 1;
+			parser->in_vcl = 0;
+		}
+		parser->zeros = 0;
+		if (!parser->header_pending && !parser->slice_pending) {
+			// nothing of interest till the next zero byte
+			const uint8_t *zero = memchr(data + i, 0, length - i);
+			i = zero ? (uint32_t) (zero - data) : length;
+		}
+	}
+	*scanned = length;
+	return -1;
+}
+
+/**
+ * @return 1 if the last scanned byte belongs to a slice (the access unit may be complete if no more data follows)
+ */
+int lib_h264_in_slice(const h264_au_parser_t *parser) {
+	return parser->in_vcl || parser->slice_pending;
+}
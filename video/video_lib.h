@@ -12,11 +12,31 @@ typedef struct {
 	uint8_t *data; // this is video_packet_data_t
 } packet_buffer_t;
 
+typedef enum {
+	BLOCK_FREE, // buffer holds no block
+	BLOCK_RECEIVING, // waiting for more packets of the block
+	BLOCK_COMPLETE, // block can be fully decoded. Waits for the older blocks of the window to be published first
+	BLOCK_DECODING // block left the window and is on its way through the decoders to the output
+} block_state_t;
+
 typedef struct {
 	int block_num;
+	block_state_t state;
+	int datas_received; // DATA packets with correct CRC in packet_buffer_list
+	int fecs_received; // FEC packets with correct CRC in packet_buffer_list
+	int corrupt_received; // packets stored with wrong CRC (not yet replaced by a correct copy)
+	int reconstruction_failed; // set by the decoder: not enough FEC packets to repair all DATA packets
+	int short_block; // the DATA packets that were not sent (short block) are filled in
+	uint32_t release_seq; // position of the block in the output order
+	uint64_t release_ns, decode_start_ns, decode_end_ns; // CLOCK_MONOTONIC, left the window/decode start/decode end
 	packet_buffer_t *packet_buffer_list;
 } block_buffer_t;
 
+// sequence_number: bits 0-26 are the packet sequence number. Bits 27-31 are the number of DATA packets missing at the
+// end of a short block (sent before it was full). Those were FEC encoded as zero filled packets and are not sent
+#define VIDEO_SEQ_NUM_BITS 27
+#define VIDEO_SEQ_NUM_MASK ((1u << VIDEO_SEQ_NUM_BITS) - 1)
+
 // outside of FEC
 typedef struct {
     uint32_t sequence_number;
@@ -34,4 +54,20 @@ typedef struct {
 	video_packet_data_t video_packet_data; // protected by FEC
 } __attribute__((packed)) db_video_packet_t;
 
+// finds the access unit (frame) boundaries of a H.264 Annex B byte stream
+typedef struct {
+	uint32_t zeros; // zero bytes in a row, may be the beginning of a start code
+	uint8_t nal_type; // type of the current NAL unit
+	int header_pending; // start code found, next byte is the NAL unit header
+	int slice_pending; // slice found, the first byte of the slice header decides if it starts a new access unit
+	int au_has_vcl; // the current access unit contains a slice
+	int in_vcl; // the current NAL unit is a slice
+} h264_au_parser_t;
+
 packet_buffer_t *lib_alloc_packet_buffer_list(size_t num_packets, size_t packet_length);
+
+int lib_h264_nal_starts_au(uint8_t nal_type, int first_mb_zero);
+
+int lib_h264_find_au_start(h264_au_parser_t *parser, const uint8_t *data, uint32_t length, uint32_t *scanned);
+
+int lib_h264_in_slice(const h264_au_parser_t *parser);
@@ -30,36 +30,79 @@
 #include <getopt.h>
 #include <stdbool.h>
 #include <signal.h>
-#include "fec.h"
+#include <pthread.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/timerfd.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include "../fec/fec.h"
 #include "video_lib.h"
 #include "recorder.h"
 #include "../common/db_protocol.h"
 #include "../common/db_raw_send_receive.h"
 #include "../common/shared_memory.h"
 #include "../common/db_common.h"
+#include "../common/db_ring.h"
 
 #define MAX_PACKET_LENGTH (DATA_UNI_LENGTH + RADIOTAP_LENGTH + DB_RAW_V2_HEADER_LENGTH)
 #define MAX_DATA_OR_FEC_PACKETS_PER_BLOCK 32
 #define MAX_USER_PACKET_LENGTH 1450
+#define NUM_BLOCK_SLOTS 8 // blocks in flight between the ingest, FEC encoding and injection stage
+#define RING_WAIT_MS 500
+#define INGEST_READ_SIZE (1 << 16)
 
-bool keeprunning = true;
-uint8_t comm_id, frame_type, db_vid_seqnum = 0;
+// alignment of the packets to the H.264 access units (frames) of the input
+#define FRAME_ALIGN_OFF 0 // packets get closed after every read from stdin
+#define FRAME_ALIGN_PACKET 1 // packets get filled up and closed at the end of a frame, frames never share a packet
+#define FRAME_ALIGN_BLOCK 2 // like FRAME_ALIGN_PACKET, the block gets sent right away as short block
+#define FRAME_QUIET_MS_DEFAULT 5 // input pause inside a slice after which the frame counts as complete
+
+volatile bool keeprunning = true;
+uint8_t comm_id, frame_type;
+uint16_t db_vid_seqnum = 0; // raw protocol sequence number, only used by the encoder thread
 unsigned int num_interfaces = 0, num_data_block = 8, num_fec_block = 4, pack_size = 1024, bitrate_op = 11, vid_adhere_80211;
+int use_tx_ring = 0, frame_align = FRAME_ALIGN_OFF, raw_version = DB_RAW_DEFAULT_VERSION;
+int param_min_packet_length = 24;
+int max_block_age_ms = 0; // 0 = blocks only get sent once all data packets are full (or at the end of a frame)
+int frame_quiet_ms = FRAME_QUIET_MS_DEFAULT; // 0 = a frame only ends once the next one starts (or at max block age)
+int block_timer_fd = -1;
 db_uav_status_t *db_uav_status;
 char adapters[DB_MAX_ADAPTERS][IFNAMSIZ];
 db_socket_t raw_sockets[DB_MAX_ADAPTERS];
-struct timespec start_time, end_time;
+fec_ctx_t fec_ctx;
 
 volatile int recorder_running = 1;
 volatile uint32_t receive_count = 0;
 uint8_t rec_buff[REC_BUFF_SIZE] = {0};
 
+/*
+ * A block travels through the pipeline: the ingest stage (main thread) fills the data packets from stdin, the encoder
+ * thread adds the FEC packets and every adapter has an injection thread that sends them. Once all adapters sent the
+ * block it returns to the ingest stage.
+ * All blocks are allocated at startup and handed between the stages via SPSC rings, so no stage ever waits for a lock
+ * and a slow injection does not stop reading from stdin as long as there are free blocks. A slow adapter does not
+ * hold back the others.
+ */
 typedef struct {
-    uint32_t seq_nr;
-    int fd;
-    int curr_pb;
-    packet_buffer_t *pb_list;
-} input_t;
+    uint32_t seq_nr; // sequence number of the first packet of the block
+    uint16_t raw_seq_nr; // raw protocol sequence number of the first packet. The same on all adapters
+    int num_data; // data packets filled by the ingest stage. Less than num_data_block for short blocks
+    atomic_int pending_injections; // adapters that did not send the block yet
+    packet_buffer_t *pb_list; // data packets (video_packet_data_t)
+    uint8_t *fec_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
+} air_block_t;
+
+air_block_t block_slots[NUM_BLOCK_SLOTS];
+db_ring_t free_rings[DB_MAX_ADAPTERS];   // injection -> ingest, one per adapter
+sem_t free_items; // shared by the free rings
+db_ring_t encode_ring; // ingest -> encoder
+db_ring_t inject_rings[DB_MAX_ADAPTERS]; // encoder -> injection, one per adapter
+db_send_batch_t send_batches[DB_MAX_ADAPTERS]; // one per injection thread
+// injection statistics, updated by all injection threads and copied to the (packed) db_uav_status
+atomic_uint injection_fail_cnt, injected_packet_cnt, injected_block_cnt;
+air_block_t *ingest_block = NULL; // block filled by the ingest stage
+int ingest_pb = 0; // packet of ingest_block that gets filled
 
 static int TimeSpecToUSeconds(struct timespec *ts) {
     return (int) (ts->tv_sec + ts->tv_nsec / 1000.0);
@@ -70,105 +113,388 @@ void int_handler(int dummy) {
 }
 
 /**
- * Sends a DATA or FEC block or any other data using all available adapters
+ * Sends the DATA and FEC packets of an encoded block interleaved via one adapter. All packets of the block are
+ * submitted as one batch (sendmmsg or TX ring), so a block needs one or a few syscalls instead of one per packet.
+ * The missing DATA packets of a short block are not sent, every packet tells the receiver how many are missing.
  *
- * @param seq_nr Video header sequence number
- * @param data_uni_to_ground Pointer to transmission buffer
- * @param packet_data Packet payload (FEC block or DATA block + length field)
- * @param data_length payload length
- * @param best_adapter Index of best wifi adapter inside raw_sockets[]
+ * @param block The block with data and FEC packets
+ * @param fec_packet_size: FEC block size
+ * @param adapter Index of the adapter (raw_sockets) to send the block with
+ * @return Number of sent packets
+ */
+int transmit_block(air_block_t *block, uint fec_packet_size, int adapter) {
+    int i, num_packets = 0;
+    struct timespec start_time, end_time;
+    // video header and payload of each packet in the order they get sent
+    video_packet_header_t video_headers[2 * MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
+    struct iovec packets[2 * MAX_DATA_OR_FEC_PACKETS_PER_BLOCK][2];
+
+    //send data and FEC packets interleaved - that algo needs to match with receiving side
+    int di = 0;
+    int fi = 0;
+    uint32_t seq_nr_tmp = block->seq_nr;
+    uint32_t missing = (uint32_t) (num_data_block - block->num_data) << VIDEO_SEQ_NUM_BITS;
+    while (di < num_data_block || fi < num_fec_block) {
+        if (di < num_data_block) {
+            if (di < block->num_data) {
+                video_headers[num_packets].sequence_number = seq_nr_tmp | missing;
+                packets[num_packets][1].iov_base = block->pb_list[di].data;
+                num_packets++;
+            }
+            seq_nr_tmp++; // every packet gets a sequence number
+            di++;
+        }
+
+        if (fi < num_fec_block) {
+            video_headers[num_packets].sequence_number = seq_nr_tmp | missing;
+            packets[num_packets][1].iov_base = block->fec_blocks[fi];
+            num_packets++;
+            seq_nr_tmp++; // every packet gets a sequence number
+            fi++;
+        }
+    }
+    for (i = 0; i < num_packets; i++) {
+        packets[i][0].iov_base = &video_headers[i];
+        packets[i][0].iov_len = sizeof(video_packet_header_t);
+        packets[i][1].iov_len = fec_packet_size;
+    }
+
+    // the copies of a packet sent by the other adapters carry the same raw sequence number
+    db_send_batch_t *send_batch = &send_batches[adapter];
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    db_batch_reset(send_batch);
+    for (i = 0; i < num_packets; i++) {
+        db_batch_add(send_batch, &raw_sockets[adapter], DB_PORT_VIDEO, packets[i], 2,
+                     (uint16_t) (block->raw_seq_nr + i), vid_adhere_80211);
+    }
+    unsigned int failed = (unsigned int) db_send_batch(&raw_sockets[adapter], send_batch);
+    db_uav_status->injection_fail_cnt = atomic_fetch_add(&injection_fail_cnt, failed) + failed;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    db_uav_status->injection_time_packet = (TimeSpecToUSeconds(&end_time) - TimeSpecToUSeconds(&start_time)) /
+                                           num_packets;
+    return num_packets;
+}
+
+/**
+ * Encoder stage: generates the FEC packets of every block filled by the ingest stage and assigns the sequence numbers
  */
-void transmit_packet(uint32_t seq_nr, const uint8_t *packet_data, uint data_length, int best_adapter) {
-    // create pointer directly to sockets send buffer (use of DB high performance send function)
-    struct data_uni *data_to_ground = get_hp_raw_buffer(vid_adhere_80211);
-    // set video packet to payload field of raw protocol buffer
-    db_video_packet_t *db_video_p = (db_video_packet_t *) (data_to_ground->bytes);
-    db_video_p->video_packet_header.sequence_number = seq_nr;
-    db_uav_status->injected_packet_cnt++;
-
-    //copy data to raw packet payload buffer (into video packet struct)
-    memcpy(&db_video_p->video_packet_data, packet_data, (size_t) data_length);
-    uint16_t payload_length = sizeof(video_packet_header_t) + data_length;
-    if (best_adapter == 5) {
-        for (int i = 0; i < num_interfaces; i++) {
+void *encode_thread(void *arg) {
+    uint32_t seq_nr = 0;
+    uint8_t *data_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
+    struct timespec start_time, end_time;
+    while (keeprunning) {
+        air_block_t *block = db_ring_pop_wait(&encode_ring, RING_WAIT_MS);
+        if (block == NULL) continue;
+        block->seq_nr = seq_nr;
+        seq_nr += num_data_block + num_fec_block; // block sent: update sequence number
+        block->raw_seq_nr = (uint16_t) (db_vid_seqnum + 1);
+        db_vid_seqnum += block->num_data + num_fec_block; // missing data packets of short blocks are not sent
+        // the upper bits of the sequence number signal short blocks. Wrap around at a block boundary
+        if (seq_nr > VIDEO_SEQ_NUM_MASK - (num_data_block + num_fec_block)) seq_nr = 0;
+        if (num_fec_block) { // Number of FEC packets per block can be 0
+            for (int i = 0; i < num_data_block; ++i) {
+                data_blocks[i] = block->pb_list[i].data;
+                // the receiver fills in the packets missing in a short block as zero filled packets
+                if (i >= block->num_data) memset(block->pb_list[i].data, 0, pack_size);
+            }
+            // always FEC encode packets of length pack_size, even if payload (data_length) is less
             clock_gettime(CLOCK_MONOTONIC, &start_time);
-            if (db_send_hp_div(&raw_sockets[i], DB_PORT_VIDEO, payload_length, update_seq_num(&db_vid_seqnum)) ==
-                -1)
-                db_uav_status->injection_fail_cnt++;
+            fec_ctx_encode(&fec_ctx, pack_size, data_blocks, num_data_block, block->fec_blocks, num_fec_block);
             clock_gettime(CLOCK_MONOTONIC, &end_time);
+            db_uav_status->encoding_time = TimeSpecToUSeconds(&end_time) - TimeSpecToUSeconds(&start_time);
         }
-    } else {
-        clock_gettime(CLOCK_MONOTONIC, &start_time);
-        if (db_send_hp_div(&raw_sockets[best_adapter], DB_PORT_VIDEO, payload_length,
-                           update_seq_num(&db_vid_seqnum)) == -1)
-            db_uav_status->injection_fail_cnt++;
-        clock_gettime(CLOCK_MONOTONIC, &end_time);
+        atomic_store(&block->pending_injections, (int) num_interfaces);
+        for (int a = 0; a < num_interfaces; a++)
+            db_ring_push(&inject_rings[a], block);
     }
-    db_uav_status->injection_time_packet = TimeSpecToUSeconds(&end_time) - TimeSpecToUSeconds(&start_time);
+    return NULL;
 }
 
 /**
- * Takes payload data (a block), generates FEC block for DATA and sends DATA and FEC packets interleaved
+ * Injection stage of one adapter: sends the packets of encoded blocks. The last adapter that sent a block hands it
+ * back to the ingest stage
  *
- * @param pbl Array where the future payload data is located as blocks of data (payload is split into arrays)
- * @param seq_nr: video_packet_header_t sequence number
- * @param fec_packet_size: FEC block size
+ * @param arg Index of the adapter
  */
-void transmit_block(packet_buffer_t *pbl, uint32_t *seq_nr, uint fec_packet_size) {
-    int i;
-    uint8_t *data_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
-    uint8_t fec_pool[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK][MAX_USER_PACKET_LENGTH];
-    uint8_t *fec_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
+void *inject_thread(void *arg) {
+    int adapter = (int) (intptr_t) arg;
+    while (keeprunning) {
+        air_block_t *block = db_ring_pop_wait(&inject_rings[adapter], RING_WAIT_MS);
+        if (block == NULL) continue;
+        int num_packets = transmit_block(block, pack_size, adapter);
+        if (atomic_fetch_sub(&block->pending_injections, 1) > 1) continue;
 
-    for (i = 0; i < num_data_block; ++i) {
-        data_blocks[i] = pbl[i].data;
+        //reset the length back
+        for (int i = 0; i < num_data_block; ++i) {
+            block->pb_list[i].len = 0;
+        }
+        db_uav_status->injected_packet_cnt = atomic_fetch_add(&injected_packet_cnt, num_packets) + num_packets;
+        db_uav_status->injected_block_cnt = atomic_fetch_add(&injected_block_cnt, 1) + 1;
+        db_ring_push(&free_rings[adapter], block);
+        if (db_uav_status->injected_block_cnt % 500 == 1) {
+            LOG_SYS_STD(LOG_INFO, "DB_VIDEO_AIR: \ttried to inject %i packets, failed %i, injection time/packet %ius, FEC encoding time %ius         \r",
+                        db_uav_status->injected_packet_cnt, db_uav_status->injection_fail_cnt,
+                        db_uav_status->injection_time_packet, db_uav_status->encoding_time);
+        }
     }
+    return NULL;
+}
 
-    if (num_fec_block) { // Number of FEC packets per block can be 0
-        for (i = 0; i < num_fec_block; ++i) {
-            fec_blocks[i] = fec_pool[i];
+/**
+ * Allocates all blocks and the rings connecting the pipeline stages. All blocks start out in the free ring.
+ */
+void init_pipeline() {
+    int failed = sem_init(&free_items, 0, 0) || db_ring_init(&encode_ring, NUM_BLOCK_SLOTS, NULL);
+    for (int a = 0; a < num_interfaces && !failed; a++) {
+        failed = db_ring_init(&free_rings[a], NUM_BLOCK_SLOTS, &free_items) ||
+                 db_ring_init(&inject_rings[a], NUM_BLOCK_SLOTS, NULL);
+    }
+    if (failed) {
+        LOG_SYS_STD(LOG_ERR, "DB_VIDEO_AIR: Could not create pipeline rings\n");
+        abort();
+    }
+    for (int b = 0; b < NUM_BLOCK_SLOTS; b++) {
+        block_slots[b].pb_list = lib_alloc_packet_buffer_list(num_data_block, MAX_PACKET_LENGTH);
+        for (int j = 0; j < num_data_block; ++j) {
+            block_slots[b].pb_list[j].len = 0;
         }
-        clock_gettime(CLOCK_MONOTONIC, &start_time);
-        fec_encode(fec_packet_size, data_blocks, num_data_block, (unsigned char **) fec_blocks, num_fec_block);
-        clock_gettime(CLOCK_MONOTONIC, &end_time);
-        db_uav_status->encoding_time = TimeSpecToUSeconds(&end_time) - TimeSpecToUSeconds(&start_time);
+        for (int i = 0; i < num_fec_block; ++i) {
+            block_slots[b].fec_blocks[i] = malloc(MAX_USER_PACKET_LENGTH);
+            if (block_slots[b].fec_blocks[i] == NULL) {
+                perror("DB_VIDEO_AIR: malloc");
+                abort();
+            }
+        }
+        db_ring_push(&free_rings[0], &block_slots[b]);
     }
+}
 
-    //send data and FEC packets interleaved - that algo needs to match with receiving side
-    int di = 0;
-    int fi = 0;
-    uint32_t seq_nr_tmp = *seq_nr;
-    while (di < num_data_block || fi < num_fec_block) {
-        if (di < num_data_block) {
-            transmit_packet(seq_nr_tmp, data_blocks[di], fec_packet_size, 5);
-            seq_nr_tmp++; // every packet gets a sequence number
-            di++;
-        }
+/**
+ * Waits until the ingest stage has a free block to fill
+ *
+ * @return false if the program terminates
+ */
+bool ingest_get_block() {
+    while (ingest_block == NULL) {
+        if (!keeprunning) return false;
+        // all blocks in flight: injection is slower than the input
+        ingest_block = db_ring_pop_any(free_rings, (int) num_interfaces, RING_WAIT_MS);
+        ingest_pb = 0;
+    }
+    return true;
+}
 
-        if (fi < num_fec_block) {
-            transmit_packet(seq_nr_tmp, fec_blocks[fi], fec_packet_size, 5);
-            seq_nr_tmp++; // every packet gets a sequence number
-            fi++;
+/**
+ * Starts/stops the max block age timer
+ *
+ * @param arm true once the first data got into a block, false once the block got handed to the encoder
+ */
+void block_timer_set(bool arm) {
+    if (block_timer_fd < 0) return;
+    struct itimerspec its = {0};
+    if (arm) {
+        its.it_value.tv_sec = max_block_age_ms / 1000;
+        its.it_value.tv_nsec = (max_block_age_ms % 1000) * 1000000L;
+    }
+    if (timerfd_settime(block_timer_fd, 0, &its, NULL) < 0)
+        perror("DB_VIDEO_AIR: Could not set block timer");
+}
+
+/**
+ * Prepares a fresh packet: space for the length field
+ */
+void ingest_start_packet(packet_buffer_t *pb) {
+    if (pb->len != 0) return;
+    pb->len = sizeof(uint32_t); //make space for a length field (will be filled later)
+}
+
+/**
+ * Accounts for payload that got copied into the packet. The age of a block starts with its first payload byte
+ */
+void ingest_add_payload(packet_buffer_t *pb, uint32_t length) {
+    if (length > 0 && ingest_pb == 0 && pb->len == sizeof(uint32_t)) block_timer_set(true);
+    pb->len += length;
+}
+
+/**
+ * Hands the block to the encoder, it gets sent as soon as the FEC packets are ready
+ *
+ * @param num_data Number of closed data packets. Less than num_data_block for a short block
+ */
+void ingest_send_block(int num_data) {
+    block_timer_set(false);
+    if (num_data < num_data_block) {
+        ingest_block->pb_list[num_data].len = 0; // might have been started
+        db_uav_status->short_block_cnt++;
+    }
+    ingest_block->num_data = num_data;
+    db_ring_push(&encode_ring, ingest_block);
+    ingest_block = NULL;
+}
+
+/**
+ * Closes the packet that gets filled. Hands the block to the encoder once all its data packets are closed
+ */
+void ingest_close_packet() {
+    packet_buffer_t *pb = ingest_block->pb_list + ingest_pb;
+    ((video_packet_data_t *) pb->data)->data_length = pb->len;
+    if (ingest_pb == num_data_block - 1) {
+        ingest_send_block(num_data_block);
+    } else {
+        ingest_pb++;
+    }
+}
+
+/**
+ * Sends the block that gets filled right away as short block (max block age reached, end of a frame)
+ */
+void ingest_flush_block() {
+    if (ingest_block == NULL) return;
+    if (ingest_block->pb_list[ingest_pb].len > sizeof(uint32_t)) ingest_close_packet();
+    if (ingest_block != NULL && ingest_pb > 0) ingest_send_block(ingest_pb);
+}
+
+/**
+ * Event loop of the ingest stage: waits for data on stdin. Sends the block that gets filled once it reaches the max
+ * block age
+ *
+ * @param timeout_ms Max time to wait for input
+ * @param idle Set to true if nothing happened within timeout_ms. May be NULL
+ * @return true if stdin can be read
+ */
+bool ingest_wait_input(int timeout_ms, bool *idle) {
+    struct pollfd pfds[2] = {{.fd = STDIN_FILENO, .events = POLLIN}, {.fd = block_timer_fd, .events = POLLIN}};
+    int ret = poll(pfds, block_timer_fd < 0 ? 1 : 2, timeout_ms);
+    if (idle != NULL) *idle = ret == 0;
+    if (ret < 0) {
+        if (errno != EINTR) perror("DB_VIDEO_AIR: poll");
+        return false;
+    }
+    if (ret > 0 && (pfds[1].revents & POLLIN)) {
+        uint64_t expirations;
+        if (read(block_timer_fd, &expirations, sizeof(expirations)) > 0)
+            ingest_flush_block();
+    }
+    return (pfds[0].revents & (POLLIN | POLLHUP)) != 0;
+}
+
+/**
+ * Appends input data to the packets of the ingest stage. Full packets get closed
+ */
+void ingest_append(const uint8_t *data, uint32_t length) {
+    while (length > 0 && ingest_get_block()) {
+        packet_buffer_t *pb = ingest_block->pb_list + ingest_pb;
+        ingest_start_packet(pb);
+        uint32_t n = pack_size - pb->len;
+        if (n > length) n = length;
+        memcpy(pb->data + pb->len, data, n);
+        ingest_add_payload(pb, n);
+        data += n;
+        length -= n;
+        if (pb->len == pack_size) ingest_close_packet();
+    }
+}
+
+/**
+ * End of an access unit: closes the packet. With FRAME_ALIGN_BLOCK the block gets sent as short block, so the frame
+ * gets sent right away instead of waiting for the data of the next one
+ */
+void ingest_end_frame() {
+    if (ingest_block == NULL) return;
+    if (frame_align == FRAME_ALIGN_BLOCK)
+        ingest_flush_block();
+    else if (ingest_block->pb_list[ingest_pb].len > sizeof(uint32_t))
+        ingest_close_packet();
+}
+
+/**
+ * Ingest stage without frame alignment: fill the data packets of free blocks with data from stdin. Every read closes a
+ * packet
+ */
+void ingest_stream() {
+    while (keeprunning) {
+        if (!ingest_wait_input(RING_WAIT_MS, NULL) || !ingest_get_block()) continue;
+        // get a packet buffer from list
+        packet_buffer_t *pb = ingest_block->pb_list + ingest_pb;
+        // if the buffer is fresh we add a payload header
+        ingest_start_packet(pb);
+        //read the data into packet buffer (inside block)
+        ssize_t inl = read(STDIN_FILENO, pb->data + pb->len, pack_size - pb->len);
+        if (inl < 0 || inl > pack_size - pb->len) {
+            perror("DB_VIDEO_AIR: reading stdin\n");
+            abort();
+        }
+        if (inl == 0) { // EOF
+            LOG_SYS_STD(LOG_ERR, "\nDB_VIDEO_AIR: Warning: Lost connection to stdin. Please make sure that a data source is connected");
+            usleep((__useconds_t) 5e5);
+            continue;
         }
+        ingest_add_payload(pb, (uint32_t) inl);
+
+        // check if this packet is finished
+        if (pb->len >= param_min_packet_length) ingest_close_packet();
     }
-    *seq_nr += num_data_block + num_fec_block; // block sent: update sequence number
+}
 
-    //reset the length back
-    for (i = 0; i < num_data_block; ++i) {
-        pbl[i].len = 0;
+/**
+ * Ingest stage with frame alignment: the input is parsed as H.264 Annex B byte stream. A frame ends once the next one
+ * starts. Encoders may write a frame with several writes, so the last frame before a pause in the input only counts as
+ * complete once there was no input for frame_quiet_ms while inside a slice (or the max block age is reached)
+ */
+void ingest_frame_aligned() {
+    static uint8_t buf[INGEST_READ_SIZE];
+    h264_au_parser_t parser;
+    memset(&parser, 0, sizeof(parser));
+    bool frame_open = false; // data of the current frame was appended since its last end
+    while (keeprunning) {
+        bool idle;
+        bool wait_quiet = frame_open && frame_quiet_ms > 0 && lib_h264_in_slice(&parser);
+        if (!ingest_wait_input(wait_quiet ? frame_quiet_ms : RING_WAIT_MS, &idle)) {
+            if (idle && wait_quiet) {
+                ingest_end_frame();
+                frame_open = false;
+            }
+            continue;
+        }
+        ssize_t inl = read(STDIN_FILENO, buf, sizeof(buf));
+        if (inl < 0) {
+            if (errno == EINTR) continue;
+            perror("DB_VIDEO_AIR: reading stdin\n");
+            abort();
+        }
+        if (inl == 0) { // EOF
+            LOG_SYS_STD(LOG_ERR, "\nDB_VIDEO_AIR: Warning: Lost connection to stdin. Please make sure that a data source is connected");
+            usleep((__useconds_t) 5e5);
+            continue;
+        }
+        uint32_t pos = 0, copied = 0, scanned;
+        while (pos < inl) {
+            int au_start = lib_h264_find_au_start(&parser, buf + pos, (uint32_t) inl - pos, &scanned);
+            if (au_start >= 0) {
+                ingest_append(buf + copied, pos + au_start - copied);
+                ingest_end_frame();
+                copied = pos + au_start;
+            }
+            pos += scanned;
+        }
+        ingest_append(buf + copied, (uint32_t) inl - copied);
+        frame_open = true;
     }
-    db_uav_status->injected_block_cnt++;
 }
 
 void process_command_line_args(int argc, char *argv[]) {
     num_interfaces = 0, comm_id = DEFAULT_V2_COMMID, bitrate_op = 11;
-    num_data_block = 8, num_fec_block = 4, pack_size = 1024, frame_type = 1, vid_adhere_80211 = 0;
+    num_data_block = 8, num_fec_block = 4, pack_size = 1024, frame_type = 1, vid_adhere_80211 = 0, use_tx_ring = 0;
+    frame_align = FRAME_ALIGN_OFF, max_block_age_ms = 0, frame_quiet_ms = FRAME_QUIET_MS_DEFAULT,
+    raw_version = DB_RAW_DEFAULT_VERSION;
     int c;
-    while ((c = getopt(argc, argv, "n:c:d:r:f:b:t:a:")) != -1) {
+    while ((c = getopt(argc, argv, "n:c:d:r:f:b:t:a:z:g:l:q:P:")) != -1) {
         switch (c) {
             case 'n':
-                strncpy(adapters[num_interfaces], optarg, IFNAMSIZ);
-                num_interfaces++;
+                if (num_interfaces < DB_MAX_ADAPTERS) {
+                    strncpy(adapters[num_interfaces], optarg, IFNAMSIZ);
+                    num_interfaces++;
+                }
                 break;
             case 'c':
                 comm_id = (uint8_t) strtol(optarg, NULL, 10);
@@ -190,6 +516,21 @@ void process_command_line_args(int argc, char *argv[]) {
             case 'a':
                 vid_adhere_80211 = (uint) strtol(optarg, NULL, 10);
                 break;
+            case 'z':
+                use_tx_ring = (int) strtol(optarg, NULL, 10);
+                break;
+            case 'g':
+                frame_align = (int) strtol(optarg, NULL, 10);
+                break;
+            case 'l':
+                max_block_age_ms = (int) strtol(optarg, NULL, 10);
+                break;
+            case 'q':
+                frame_quiet_ms = (int) strtol(optarg, NULL, 10);
+                break;
+            case 'P':
+                raw_version = (int) strtol(optarg, NULL, 10);
+                break;
             default:
                 printf("Based of Wifibroadcast by befinitiv, based on packetspammer by Andy Green.  Licensed under GPL2\n"
                        "This tool takes a data stream via the DroneBridge long range video port and outputs it via stdout, "
@@ -206,7 +547,20 @@ void process_command_line_args(int argc, char *argv[]) {
                        "supported with Ralink chipsets)"
                        "\n\t-t [1|2] DroneBridge v2 raw protocol packet/frame type: 1=RTS, 2=DATA (CTS protection)"
                        "\n\t-a [0|1] disable/enable. Offsets the payload by some bytes so that it sits outside the "
-                       "802.11 header. Set this to 1 if you are using a non DB-Rasp Kernel!\n", 1024, DATA_UNI_LENGTH);
+                       "802.11 header. Set this to 1 if you are using a non DB-Rasp Kernel!"
+                       "\n\t-z [0|1] disable/enable. Inject via a memory mapped TX ring (PACKET_TX_RING) bypassing the "
+                       "qdisc layer. Falls back to regular injection if not supported by the kernel"
+                       "\n\t-g [0|1|2] Align packets to the frames of a H.264 Annex B input. 0: off, 1: frames never "
+                       "share a packet, 2: additionally the block gets sent at the end of every frame as short block. "
+                       "Removes up to one frame interval of latency at low bit rates"
+                       "\n\t-l Max block age in ms (default 0: off). A block that is not full by then gets sent as "
+                       "short block. Bounds the latency at low bit rates. Short blocks need a video_gnd that supports "
+                       "them"
+                       "\n\t-q With -g: pause of the input in ms after which the last frame counts as complete "
+                       "(default %d, 0: only once the next frame starts or after the max block age)"
+                       "\n\t-P [2|3] DroneBridge raw protocol version of sent frames (default: %d). v3 requires v3 "
+                       "support on the ground station\n",
+                       1024, DATA_UNI_LENGTH, FRAME_QUIET_MS_DEFAULT, DB_RAW_DEFAULT_VERSION);
                 abort();
         }
     }
@@ -222,13 +576,12 @@ int main(int argc, char *argv[]) {
     setpriority(PRIO_PROCESS, 0, -10);
     process_command_line_args(argc, argv);
 
-    input_t input;
     db_uav_status = db_uav_status_memory_open();
     db_uav_status->injection_fail_cnt = 0;
     db_uav_status->skipped_fec_cnt = 0, db_uav_status->injected_block_cnt = 0,
     db_uav_status->injection_time_packet = 0, db_uav_status->wifi_adapter_cnt = num_interfaces;
     db_uav_status->injected_packet_cnt = 0;
-    int param_min_packet_length = 24;
+    db_uav_status->short_block_cnt = 0;
 
     if (num_interfaces == 0) {
         LOG_SYS_STD(LOG_ERR, "DB_VIDEO_AIR: No interface specified. Aborting\n");
@@ -255,69 +608,52 @@ int main(int argc, char *argv[]) {
         abort();
     }
 
-    input.fd = STDIN_FILENO;
-    input.seq_nr = 0;
-    input.curr_pb = 0;
-    input.pb_list = lib_alloc_packet_buffer_list(num_data_block, MAX_PACKET_LENGTH);
+    if (raw_version != 2 && raw_version != 3) {
+        LOG_SYS_STD(LOG_ERR, "DB_VIDEO_AIR: Unsupported raw protocol version %d\n", raw_version);
+        abort();
+    }
 
-    //prepare the buffers with headers
-    int j = 0;
-    for (j = 0; j < num_data_block; ++j) {
-        input.pb_list[j].len = 0;
+    init_pipeline();
+    if (max_block_age_ms > 0) {
+        block_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (block_timer_fd < 0) {
+            perror("DB_VIDEO_AIR: Could not create block timer");
+            abort();
+        }
+        LOG_SYS_STD(LOG_INFO, "DB_VIDEO_AIR: Sending blocks after %ims at the latest\n", max_block_age_ms);
     }
 
     //initialize forward error correction
-    fec_init();
+    fec_ctx_init(&fec_ctx, FEC_KERNEL_AUTO);
+    LOG_SYS_STD(LOG_INFO, "DB_VIDEO_AIR: Using %s FEC kernel\n", fec_ctx_kernel_name(&fec_ctx));
 
     // open DroneBridge raw sockets
     for (int k = 0; k < num_interfaces; ++k) {
         raw_sockets[k] = open_db_socket(adapters[k], comm_id, 'm', bitrate_op, DB_DIREC_GROUND, DB_PORT_VIDEO,
                                         frame_type);
+        db_socket_set_version(&raw_sockets[k], raw_version);
+        // ring holds the packets of one block, so each block gets sent with a single flush
+        if (use_tx_ring && db_socket_enable_tx_ring(&raw_sockets[k], 2 * MAX_DATA_OR_FEC_PACKETS_PER_BLOCK) == 0)
+            LOG_SYS_STD(LOG_INFO, "DB_VIDEO_AIR: Using TX ring on %s\n", adapters[k]);
         strncpy(db_uav_status->adapter[k].name, adapters[k], IFNAMSIZ);
     }
-    LOG_SYS_STD(LOG_INFO, "DB_VIDEO_AIR: started!\n");
-    while (keeprunning) {
-        // get a packet buffer from list
-        packet_buffer_t *pb = input.pb_list + input.curr_pb;
-        // if the buffer is fresh we add a payload header
-        if (pb->len == 0) {
-            pb->len += sizeof(uint32_t); //make space for a length field (will be filled later)
-        }
-        //read the data into packet buffer (inside block)
-        ssize_t inl = read(input.fd, pb->data + pb->len, pack_size - pb->len);
-        if (inl < 0 || inl > pack_size - pb->len) {
-            perror("DB_VIDEO_AIR: reading stdin\n");
-            abort();
-        }
-        if (inl == 0) { // EOF
-            LOG_SYS_STD(LOG_ERR, "\nDB_VIDEO_AIR: Warning: Lost connection to stdin. Please make sure that a data source is connected");
-            usleep((__useconds_t) 5e5);
-            continue;
-        }
-        pb->len += inl;
-
-        // check if this packet is finished
-        if (pb->len >= param_min_packet_length) {
-            video_packet_data_t *video_p_data = (video_packet_data_t *) (pb->data);
-            video_p_data->data_length = pb->len;
-            // check if this block is finished
-            if (input.curr_pb == num_data_block - 1) {
-                // transmit entire block - consisting of packets that get sent interleaved
-                // always transmit/FEC encode packets of length pack_size, even if payload (data_length) is less
-                transmit_block(input.pb_list, &(input.seq_nr),
-                               pack_size); // input.pb_list is video_packet_data_t[num_fec + num_data]
-                if (db_uav_status->injected_block_cnt % 500 == 1) {
-                    LOG_SYS_STD(LOG_INFO, "DB_VIDEO_AIR: \ttried to inject %i packets, failed %i, injection time/packet %ius, FEC encoding time %ius         \r",
-                           db_uav_status->injected_packet_cnt, db_uav_status->injection_fail_cnt,
-                           db_uav_status->injection_time_packet, db_uav_status->encoding_time);
-                }
-
-                input.curr_pb = 0;
-            } else {
-                input.curr_pb++;
-            }
-        }
+    pthread_t encoder, injectors[DB_MAX_ADAPTERS];
+    int failed = pthread_create(&encoder, NULL, encode_thread, NULL);
+    for (int a = 0; a < num_interfaces && !failed; a++)
+        failed = pthread_create(&injectors[a], NULL, inject_thread, (void *) (intptr_t) a);
+    if (failed) {
+        LOG_SYS_STD(LOG_ERR, "DB_VIDEO_AIR: Could not start pipeline threads\n");
+        abort();
     }
+    LOG_SYS_STD(LOG_INFO, "DB_VIDEO_AIR: started!\n");
+    if (frame_align != FRAME_ALIGN_OFF)
+        ingest_frame_aligned();
+    else
+        ingest_stream();
+    pthread_join(encoder, NULL);
+    for (int a = 0; a < num_interfaces; a++)
+        pthread_join(injectors[a], NULL);
+    if (block_timer_fd >= 0) close(block_timer_fd);
 
     LOG_SYS_STD(LOG_INFO, "DB_VIDEO_AIR: Terminated!\n");
     return (0);
@@ -18,9 +18,9 @@
 /**
  * Program to receive a continuous stream of data from the UAV unit. Stream is protected by FEC. This program decodes
  * the FEC data and outputs the payload to various end-points. Endpoints are UDP (192.192.2.1) and a UNIX domain socket
- * on /tmp/db_video_out (see db_protocol.h). The UDP destination address can be changed by sending a UDP packet of any
- * content to this application on port 5000. The source address of that packet will be the new destination address.
- * It is called a video destination hint packet.
+ * on /tmp/db_video_out (see db_protocol.h). Additional UDP destinations can be registered by sending a UDP packet to this
+ * application on port 5000. The source address of that packet will be a new destination address. It is called a video
+ * destination hint packet (see video_clients.h). Every destination receives the stream with its own overflow policy.
  */
 
 #include <stdbool.h>
@@ -34,19 +34,33 @@
 #include <sys/time.h>
 #include <sys/socket.h>
 #include <sys/un.h>
-#include "fec.h"
+#include <pthread.h>
+#include <fcntl.h>
+#include <limits.h>
+#include "../fec/fec.h"
 #include "video_lib.h"
+#include "video_output.h"
+#include "video_clients.h"
 #include "../common/shared_memory.h"
 #include "../common/db_raw_receive.h"
 #include "../common/radiotap/radiotap_iter.h"
 #include "../common/db_raw_send_receive.h"
 #include "../common/db_common.h"
+#include "../common/db_ring.h"
 
 #define MAX_PACKET_LENGTH 4192
 #define MAX_USER_PACKET_LENGTH 1450
 #define MAX_DATA_OR_FEC_PACKETS_PER_BLOCK 32
+#define MAX_BLOCK_WINDOW 256
+#define MAX_DECODE_WORKERS 8
+#define DECODE_QUEUE_BLOCKS 32 // block buffers on top of the window for blocks inside the decoders and the output
+#define RING_WAIT_MS 500
 #define DEBUG 0
 #define UDP_BUFF_SIZE 2048
+// RX ring: 16 x 64 KiB per adapter. A block is handed over once full or after the timeout (bounds the added latency)
+#define RX_RING_BLOCK_SIZE (1 << 16)
+#define RX_RING_BLOCK_NR 16
+#define RX_RING_TIMEOUT_MS 5
 
 int num_interfaces = 0;
 int dest_port_video, unix_sock;
@@ -54,7 +68,11 @@ uint8_t comm_id, num_data_block, num_fec_block;
 uint8_t lr_buffer[MAX_DB_DATA_LENGTH] = {0};
 bool pass_through, udp_enabled = true, output_to_usb_bridge = false, send_to_std_out = true;
 volatile bool keeprunning = true;
-int param_block_buffers = 1;
+int param_block_buffers = 1; // reorder window in blocks. Power of two, block_num & block_window_mask is its position
+uint block_window_mask = 0;
+int next_block_num = -1; // oldest block of the window. Blocks are published in order starting with this one
+int num_decode_workers = 1;
+fec_ctx_t fec_ctx;
 int pack_size = MAX_USER_PACKET_LENGTH;
 db_gnd_status_t *db_gnd_status = NULL;
 int max_block_num = -1, udp_socket;
@@ -66,12 +84,40 @@ int bytes_written = 0;
 socklen_t server_length = sizeof(struct sockaddr_un);
 
 char adapters[DB_MAX_ADAPTERS][IFNAMSIZ];
-char overwrite_ip[INET6_ADDRSTRLEN];
-bool fixed_ip = false;
+char static_dsts[DB_GND_MAX_VIDEO_CLIENTS][INET_ADDRSTRLEN + 6]; // <ip>[:<port>] set via -i
+int num_static_dsts = 0;
+int client_lease_s = 0, multicast_ttl = 1;
+uint8_t udp_format = VIDEO_FORMAT_RAW;
+char recorder_path[PATH_MAX] = {0};
+int recorder_fd = -1;
+output_policy_t stdout_policy = OUTPUT_DROP_TO_KEYFRAME, udp_policy = OUTPUT_DROP_OLDEST,
+        usb_bridge_policy = OUTPUT_DROP_OLDEST, recorder_policy = OUTPUT_DROP_OLDEST;
+
+/*
+ * Decode pipeline: the receive thread (main) collects the packets of a block inside the reorder window. Once the block
+ * is complete or falls out of the window it gets handed to one of the decode workers (round robin) and its place in the
+ * window is free again. The publish thread collects the decoded blocks, puts them back into the order they left the
+ * window and publishes them. Afterwards the block buffer returns to the receive thread. All block buffers are allocated
+ * at startup and handed between the threads via SPSC rings, so heavy FEC repair never delays the reception of frames.
+ */
+block_buffer_t *block_pool;
+int block_pool_size;
+block_buffer_t **free_blocks; // receive thread only: buffers ready to take a new block
+int num_free_blocks = 0;
+uint32_t release_seq = 0; // receive thread only: output position of the next block leaving the window
+int next_decode_worker = 0;
+db_ring_t decode_rings[MAX_DECODE_WORKERS];  // receive -> decode worker
+db_ring_t decoded_rings[MAX_DECODE_WORKERS]; // decode worker -> publish, all share decoded_items
+sem_t decoded_items;
+db_ring_t returned_ring;                     // publish -> receive
+block_buffer_t **reorder_buffer; // publish thread only: decoded blocks by release_seq & reorder_mask
+uint32_t reorder_mask;
 
 typedef struct {
     int selectable_fd;
     int n80211HeaderLength;
+    db_rx_ring_t rx_ring; // rx_ring.map is NULL if the ring is not available. recv() is used then
+    db_radiotap_cache_t radiotap_cache; // radiotap layout of the adapter, so the header is not parsed for every frame
 } monitor_interface_t;
 
 
@@ -79,6 +125,12 @@ void int_handler(int dummy) {
     keeprunning = false;
 }
 
+uint64_t current_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
 long long current_timestamp() {
     struct timeval te;
     gettimeofday(&te, NULL); // get current time
@@ -112,35 +164,73 @@ void init_outputs() {
 }
 
 /**
- * Write final data to various outputs (UDP, (TCP) etc.)
- *
- * @param data Data to publish
- * @param message_length Lenght of data
- * @param fec_decoded Indicator if the data also contains FEC packets. True if pure DATA packets (and fully decoded FEC)
+ * Sink: decoded stream to stdout (non blocking pipe to a video player)
  */
-void publish_data(uint8_t *data, uint32_t message_length, bool fec_decoded) {
-    if (output_to_usb_bridge) {
-        // We assume the consumer is faster than the producer and that it will always be able to send
-        if (sendto(unix_sock, data, message_length, 0, (struct sockaddr *) &unix_socket_addr, server_length) < 0) {
-            if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                // ignore non existing dst socket addr. usbbridge might not have a connected dev
-                if (errno != ENOENT && errno != ECONNREFUSED)
-                    perror("DB_VIDEO_GND: Error sending via UNIX domain socket");
-                // else: usbbridge might not started or device not connected
-            } // else
-//                LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Error sending to unix domain - might lost a packet\n");
-        }
+int send_stdout(void *ctx, const uint8_t *data, uint32_t length) {
+    if (write(STDOUT_FILENO, data, length) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return OUTPUT_AGAIN;
+        LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Error writing to stdout %s\n", strerror(errno));
     }
-    if (udp_enabled) {
-        if (sendto(udp_socket, data, message_length, 0, (struct sockaddr *) &client_video_addr,
-                   sizeof(client_video_addr)) < message_length)
-            perror("DB_VIDEO_GND: Not all data sent via UDP\n");
+    return OUTPUT_SENT;
+}
+
+/**
+ * Sink: decoded stream to the unix domain socket of DroneBridge USBBridge
+ */
+int send_usb_bridge(void *ctx, const uint8_t *data, uint32_t length) {
+    if (sendto(unix_sock, data, length, 0, (struct sockaddr *) &unix_socket_addr, server_length) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return OUTPUT_AGAIN;
+        // ignore non existing dst socket addr. usbbridge might not started or device not connected
+        if (errno != ENOENT && errno != ECONNREFUSED)
+            perror("DB_VIDEO_GND: Error sending via UNIX domain socket");
+    }
+    return OUTPUT_SENT;
+}
+
+/**
+ * Sink: decoded stream appended to the recording file
+ */
+int send_recorder(void *ctx, const uint8_t *data, uint32_t length) {
+    uint32_t written = 0;
+    while (written < length) {
+        ssize_t l = write(recorder_fd, data + written, length - written);
+        if (l < 0) {
+            if (errno == EINTR) continue;
+            LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Error writing to recording %s\n", strerror(errno));
+            break;
+        }
+        written += l;
     }
-    if (send_to_std_out && fec_decoded) {
-        // only output decoded fec packets to stdout so that video player can read data stream directly
-        if (write(STDOUT_FILENO, data, message_length) < 0)
-            LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Error writing to stdout %s\n", strerror(errno));
+    return OUTPUT_SENT;
+}
+
+/**
+ * Forwards the still FEC encoded payload (pass through mode) directly from the receive thread via UDP and to the
+ * USBBridge. Decoding must happen on the following applications
+ *
+ * @param data Payload of raw protocol
+ * @param message_length Length of data
+ */
+void publish_pass_through(uint8_t *data, uint32_t message_length) {
+    if (output_to_usb_bridge && sendto(unix_sock, data, message_length, 0, (struct sockaddr *) &unix_socket_addr,
+                                       server_length) < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOENT && errno != ECONNREFUSED)
+            perror("DB_VIDEO_GND: Error sending via UNIX domain socket");
     }
+    if (udp_enabled && sendto(udp_socket, data, message_length, MSG_DONTWAIT, (struct sockaddr *) &client_video_addr,
+                              sizeof(client_video_addr)) < message_length && errno != EAGAIN)
+        perror("DB_VIDEO_GND: Not all data sent via UDP\n");
+}
+
+/**
+ * Hands decoded data to the output thread that writes it to the various outputs (stdout, UDP, USBBridge, recorder).
+ * Only called by the publish thread
+ *
+ * @param data Data to publish
+ * @param message_length Lenght of data
+ */
+void publish_data(uint8_t *data, uint32_t message_length) {
+    output_push(data, message_length);
     now = current_timestamp();
     bytes_written += message_length;
     if (now - prev_time > 500) {
@@ -151,308 +241,611 @@ void publish_data(uint8_t *data, uint32_t message_length, bool fec_decoded) {
     }
 }
 
-void block_buffer_list_reset(block_buffer_t *block_buffer_list, int block_buffer_list_len) {
-    int i;
-    block_buffer_t *rb = block_buffer_list;
-
-    for (i = 0; i < block_buffer_list_len; ++i) {
-        rb->block_num = -1;
-
-        int j;
-        packet_buffer_t *p = rb->packet_buffer_list;
-        for (j = 0; j < num_data_block + num_fec_block; ++j) {
-            p->valid = 0;
-            p->crc_correct = 0;
-            p->len = 0;
-            p++;
+/**
+ * Frees the buffer of a block: Marks all packets as not received and clears the completion counters
+ *
+ * @param block The block buffer to reset
+ */
+void block_buffer_reset(block_buffer_t *block) {
+    packet_buffer_t *p = block->packet_buffer_list;
+    for (int j = 0; j < num_data_block + num_fec_block; ++j) {
+        p->valid = 0;
+        p->crc_correct = 0;
+        p->len = 0;
+        p++;
+    }
+    block->block_num = -1;
+    block->state = BLOCK_FREE;
+    block->datas_received = 0;
+    block->fecs_received = 0;
+    block->corrupt_received = 0;
+    block->reconstruction_failed = 0;
+    block->short_block = 0;
+}
+
+/**
+ * Takes a buffer for a new block. Buffers that came back from the publish thread get collected once we run out
+ *
+ * @return A free block buffer or NULL if all of them are in use
+ */
+block_buffer_t *get_free_block() {
+    if (num_free_blocks == 0) {
+        block_buffer_t *returned;
+        while ((returned = db_ring_pop_wait(&returned_ring, 0)) != NULL)
+            free_blocks[num_free_blocks++] = returned;
+    }
+    if (num_free_blocks == 0) return NULL;
+    return free_blocks[--num_free_blocks];
+}
+
+/**
+ * Drops all blocks of the window without publishing them
+ *
+ * @param block_window The reorder window (param_block_buffers long)
+ */
+void block_window_reset(block_buffer_t **block_window) {
+    for (int i = 0; i < param_block_buffers; ++i) {
+        if (block_window[i] != NULL) {
+            block_buffer_reset(block_window[i]);
+            free_blocks[num_free_blocks++] = block_window[i];
+            block_window[i] = NULL;
         }
+    }
+}
+
+/**
+ * Packets of a block are stored interleaved: DATA - FEC - DATA - FEC ... until one of both kinds runs out
+ *
+ * @param packet_num Position of the packet inside the block
+ * @return true if the packet at that position is a DATA packet, false for FEC packets
+ */
+bool is_data_packet(uint packet_num) {
+    uint interleaved = 2u * (num_data_block < num_fec_block ? num_data_block : num_fec_block);
+    if (packet_num < interleaved)
+        return packet_num % 2 == 0;
+    return num_data_block > num_fec_block;
+}
 
-        rb++;
+/**
+ * Short block: the DATA packets at the end of the block were not sent. They were FEC encoded as zero filled packets, so
+ * they get filled in as received
+ *
+ * @param block The block
+ * @param missing Number of DATA packets that were not sent
+ */
+void fill_short_block(block_buffer_t *block, uint missing) {
+    block->short_block = 1;
+    if (missing >= num_data_block) return; // garbage
+    uint interleaved = num_data_block < num_fec_block ? num_data_block : num_fec_block;
+    for (uint di = num_data_block - missing; di < num_data_block; di++) {
+        // position of the DATA packet: interleaved with FEC packets until one of both kinds runs out
+        uint packet_num = di < interleaved ? 2 * di : interleaved + di;
+        packet_buffer_t *p = &block->packet_buffer_list[packet_num];
+        if (p->valid && p->crc_correct) continue;
+        if (p->valid) block->corrupt_received--;
+        memset(p->data, 0, (size_t) pack_size);
+        p->len = (uint) pack_size;
+        p->valid = 1;
+        p->crc_correct = 1;
+        block->datas_received++;
     }
 }
 
 /**
- * Takes a stream of payload (FEC & DATA) and does error correction publishing the corrected data in the end
+ * Repairs missing/corrupt DATA packets of a block with the received FEC packets. Runs on the decode workers
  *
- * @param data: The payload of raw protocol (a db_video_packet_t)
- * @param data_len: Length of the payload
- * @param crc_correct: Was the FCF of the raw packet OK
- * @param block_buffer_list: An array of block_buffer_t structs
+ * @param block The block to decode. Repaired DATA packets are written into their packet buffers
  */
-void process_video_payload(uint8_t *data, uint16_t data_len, int crc_correct, block_buffer_t *block_buffer_list) {
-    uint block_num;
-    uint packet_num;
+void decode_block(block_buffer_t *block) {
     int i;
+    packet_buffer_t *packet_buffer_list = block->packet_buffer_list;
+
+    //we have both pointers to the packet buffers (to get information about crc and vadility) and raw data pointers for fec_decode
+    packet_buffer_t *data_pkgs[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
+    packet_buffer_t *fec_pkgs[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
+    uint8_t *data_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
+    uint8_t *fec_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
+    int datas_missing = 0, datas_corrupt = 0, fecs_missing = 0, fecs_corrupt = 0;
+    uint di = 0, fi = 0;
+
+
+    // first, split the received packets into DATA a FEC packets and count the damaged packets
+    // We assume that the packets are correctly ordered inside the packet buffer list
+    i = 0;
+    while (di < num_data_block || fi < num_fec_block) {
+        if (di < num_data_block) {
+            data_pkgs[di] = packet_buffer_list + i++;
+            data_blocks[di] = data_pkgs[di]->data;
+            if (!data_pkgs[di]->valid)
+                datas_missing++;
+            if (data_pkgs[di]->valid && !data_pkgs[di]->crc_correct)
+                datas_corrupt++;
+            di++;
+        }
 
-    db_video_packet_t *db_video_packet = (db_video_packet_t *) data;
-    //if aram_data_packets_per_block+num_fec_block would be limited to powers of two, this could be replaced by a logical AND operation
-    block_num = db_video_packet->video_packet_header.sequence_number / (num_data_block + num_fec_block);
+        if (fi < num_fec_block) {
+            fec_pkgs[fi] = packet_buffer_list + i++;
+            if (!fec_pkgs[fi]->valid)
+                fecs_missing++;
 
-    //LOG_SYS_STD(LOG_ERR, "seq %i blk %i crc %d len %i\n", db_video_packet->video_packet_header.sequence_number, block_num, crc_correct, (int) data_len);
+            if (fec_pkgs[fi]->valid && !fec_pkgs[fi]->crc_correct)
+                fecs_corrupt++;
 
-    //we have received a block number that exceeds the currently seen ones -> we need to make room for this new block
-    //or we have received a block_num that is several times smaller than the current window of buffers -> this indicated that either the window is too small or that the transmitter has been restarted
-    int tx_restart = (block_num + 128 * param_block_buffers < max_block_num);
-    // with block_buffer_list length == 1 (d=1) this means we received all packets of a block (we still might miss some)
-    if ((block_num > max_block_num || tx_restart) && crc_correct) {
-        if (tx_restart) {
-            db_gnd_status->tx_restart_cnt++;
-            LOG_SYS_STD(LOG_ERR,
-                        "TX RESTART: Detected blk %x that lies outside of the current retr block buffer window "
-                        "(max_block_num = %x) (if there was no tx restart, increase window size via -d)\n",
-                        block_num, max_block_num);
-            block_buffer_list_reset(block_buffer_list, param_block_buffers);
-        }
-        //first, find the minimum block num in the buffers list. this will be the block that we replace
-        int min_block_num = INT_MAX;
-        int min_block_num_idx = 0;
-        for (i = 0; i < param_block_buffers; ++i) {
-            if (block_buffer_list[i].block_num < min_block_num) {
-                min_block_num = block_buffer_list[i].block_num;
-                min_block_num_idx = i;
-            }
+            fi++;
         }
+    }
 
-        //debug_print("removing block %x at index %i for block %x\n", min_block_num, min_block_num_idx, block_num);
-
-        packet_buffer_t *packet_buffer_list = block_buffer_list[min_block_num_idx].packet_buffer_list;
-        int last_block_num = block_buffer_list[min_block_num_idx].block_num;
-
-        if (last_block_num != -1) {
-            //db_gnd_status->adapter[].received_block_cnt++;
-
-            //we have both pointers to the packet buffers (to get information about crc and vadility) and raw data pointers for fec_decode
-            packet_buffer_t *data_pkgs[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
-            packet_buffer_t *fec_pkgs[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
-            uint8_t *data_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
-            uint8_t *fec_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
-            int datas_missing = 0, datas_corrupt = 0, fecs_missing = 0, fecs_corrupt = 0;
-            uint di = 0, fi = 0;
-
-
-            // first, split the received packets into DATA a FEC packets and count the damaged packets
-            // We assume that the packets are correctly ordered inside the packet buffer list
-            i = 0;
-            while (di < num_data_block || fi < num_fec_block) {
-                if (di < num_data_block) {
-                    data_pkgs[di] = packet_buffer_list + i++;
-                    data_blocks[di] = data_pkgs[di]->data;
-                    if (!data_pkgs[di]->valid)
-                        datas_missing++;
-                    if (data_pkgs[di]->valid && !data_pkgs[di]->crc_correct)
-                        datas_corrupt++;
-                    di++;
-                }
+    const int good_fecs_c = num_fec_block - fecs_missing - fecs_corrupt;
+    const int datas_missing_c = datas_missing;
+    const int datas_corrupt_c = datas_corrupt;
+
+    int good_fecs = good_fecs_c;
+    //the following three fields are infos for fec_decode
+    unsigned int fec_block_nos[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
+    unsigned int erased_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
+    unsigned short nr_fec_blocks = 0;
+
+    fi = 0;
+    di = 0;
+
+    //look for missing DATA and replace them with good FECs
+    while (di < num_data_block && fi < num_fec_block) {
+        //if this data is fine we go to the next
+        if (data_pkgs[di]->valid && data_pkgs[di]->crc_correct) {
+            di++;
+            continue;
+        }
 
-                if (fi < num_fec_block) {
-                    fec_pkgs[fi] = packet_buffer_list + i++;
-                    if (!fec_pkgs[fi]->valid)
-                        fecs_missing++;
+        //if this DATA is corrupt and there are less good fecs than missing datas we cannot do anything for this data
+        if (data_pkgs[di]->valid && !data_pkgs[di]->crc_correct && good_fecs <= datas_missing) {
+            di++;
+            continue;
+        }
 
-                    if (fec_pkgs[fi]->valid && !fec_pkgs[fi]->crc_correct)
-                        fecs_corrupt++;
+        //if this FEC is not received we go on to the next
+        if (!fec_pkgs[fi]->valid) {
+            fi++;
+            continue;
+        }
 
-                    fi++;
-                }
-            }
+        //if this FEC is corrupted and there are more lost packages than good fecs we should replace this DATA even with this corrupted FEC
+        if (!fec_pkgs[fi]->crc_correct && datas_missing > good_fecs) {
+            fi++;
+            continue;
+        }
 
-            const int good_fecs_c = num_fec_block - fecs_missing - fecs_corrupt;
-            const int datas_missing_c = datas_missing;
-            const int datas_corrupt_c = datas_corrupt;
-
-            int good_fecs = good_fecs_c;
-            //the following three fields are infos for fec_decode
-            unsigned int fec_block_nos[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
-            unsigned int erased_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
-            unsigned short nr_fec_blocks = 0;
-
-            fi = 0;
-            di = 0;
-
-            //look for missing DATA and replace them with good FECs
-            while (di < num_data_block && fi < num_fec_block) {
-                //if this data is fine we go to the next
-                if (data_pkgs[di]->valid && data_pkgs[di]->crc_correct) {
-                    di++;
-                    continue;
-                }
 
-                //if this DATA is corrupt and there are less good fecs than missing datas we cannot do anything for this data
-                if (data_pkgs[di]->valid && !data_pkgs[di]->crc_correct && good_fecs <= datas_missing) {
-                    di++;
-                    continue;
-                }
+        if (!data_pkgs[di]->valid)
+            datas_missing--;
+        else if (!data_pkgs[di]->crc_correct)
+            datas_corrupt--;
 
-                //if this FEC is not received we go on to the next
-                if (!fec_pkgs[fi]->valid) {
-                    fi++;
-                    continue;
-                }
+        if (fec_pkgs[fi]->crc_correct)
+            good_fecs--;
 
-                //if this FEC is corrupted and there are more lost packages than good fecs we should replace this DATA even with this corrupted FEC
-                if (!fec_pkgs[fi]->crc_correct && datas_missing > good_fecs) {
-                    fi++;
-                    continue;
-                }
+        //at this point, data is invalid and fec is good -> replace data with fec
+        erased_blocks[nr_fec_blocks] = di;
+        fec_block_nos[nr_fec_blocks] = fi;
+        fec_blocks[nr_fec_blocks] = fec_pkgs[fi]->data;
+        di++;
+        fi++;
+        nr_fec_blocks++;
+    }
 
+    //we did not have enough FEC packets to repair this block if this is set
+    block->reconstruction_failed = datas_missing_c + datas_corrupt_c > good_fecs_c;
+    if (block->reconstruction_failed) {
+        //LOG_SYS_STD(LOG_ERR, "Could not fully reconstruct block %x! Damage rate: %f (%d / %d blocks)\n", last_block_num, 1.0 * rx_status->damaged_block_cnt / rx_status->received_block_cnt, rx_status->damaged_block_cnt, rx_status->received_block_cnt);
+        //debug_print("Data mis: %d\tData corr: %d\tFEC mis: %d\tFEC corr: %d\n", datas_missing_c, datas_corrupt_c, fecs_missing_c, fecs_corrupt_c);
+    }
 
-                if (!data_pkgs[di]->valid)
-                    datas_missing--;
-                else if (!data_pkgs[di]->crc_correct)
-                    datas_corrupt--;
 
-                if (fec_pkgs[fi]->crc_correct)
-                    good_fecs--;
+    fec_ctx_decode(&fec_ctx, (unsigned int) pack_size, data_blocks, num_data_block, fec_blocks, fec_block_nos,
+                   erased_blocks, nr_fec_blocks);
+}
 
-                //at this point, data is invalid and fec is good -> replace data with fec
-                erased_blocks[nr_fec_blocks] = di;
-                fec_block_nos[nr_fec_blocks] = fi;
-                fec_blocks[nr_fec_blocks] = fec_pkgs[fi]->data;
-                di++;
-                fi++;
-                nr_fec_blocks++;
+/**
+ * Publishes the DATA packets of a decoded block. Runs on the publish thread
+ *
+ * @param block The decoded block
+ */
+void publish_block(block_buffer_t *block) {
+    if (block->reconstruction_failed)
+        db_gnd_status->damaged_block_cnt++;
+    for (uint p = 0; p < num_data_block + num_fec_block; ++p) {
+        if (!is_data_packet(p)) continue;
+        packet_buffer_t *data_pkg = &block->packet_buffer_list[p];
+        video_packet_data_t *vpd_corrected = (video_packet_data_t *) data_pkg->data;
+
+        // empty DATA packets are padding of blocks sent before they were full (video_air -g 2)
+        if ((!block->reconstruction_failed || data_pkg->valid) && vpd_corrected->data_length > 4) {
+            //if reconstruction did fail, the data_length value is undefined. better limit it to some sensible value
+            if (vpd_corrected->data_length > pack_size) {
+                vpd_corrected->data_length = (uint32_t) pack_size;
             }
+            // do not publish the data_length field of video_packet_data_t struct
+            publish_data(data_pkg->data + 4, vpd_corrected->data_length - 4);
+        }
+    }
+}
 
-            int reconstruction_failed = datas_missing_c + datas_corrupt_c > good_fecs_c;
-
-            if (reconstruction_failed) {
-                //we did not have enough FEC packets to repair this block
-                db_gnd_status->damaged_block_cnt++;
-                //LOG_SYS_STD(LOG_ERR, "Could not fully reconstruct block %x! Damage rate: %f (%d / %d blocks)\n", last_block_num, 1.0 * rx_status->damaged_block_cnt / rx_status->received_block_cnt, rx_status->damaged_block_cnt, rx_status->received_block_cnt);
-                //debug_print("Data mis: %d\tData corr: %d\tFEC mis: %d\tFEC corr: %d\n", datas_missing_c, datas_corrupt_c, fecs_missing_c, fecs_corrupt_c);
-            }
+/**
+ * Decode worker: FEC decodes the blocks handed over by the receive thread and passes them on to the publish thread
+ *
+ * @param arg Index of the worker
+ */
+void *decode_thread(void *arg) {
+    int worker = (int) (intptr_t) arg;
+    while (keeprunning) {
+        block_buffer_t *block = db_ring_pop_wait(&decode_rings[worker], RING_WAIT_MS);
+        if (block == NULL) continue;
+        block->decode_start_ns = current_time_ns();
+        decode_block(block);
+        block->decode_end_ns = current_time_ns();
+        db_ring_push(&decoded_rings[worker], block);
+    }
+    return NULL;
+}
 
+/**
+ * Publish stage: brings the decoded blocks of all workers back into order, publishes them and returns the buffers to
+ * the receive thread
+ */
+void *publish_thread(void *arg) {
+    uint32_t next_seq = 0;
+    while (keeprunning) {
+        block_buffer_t *block = db_ring_pop_any(decoded_rings, num_decode_workers, RING_WAIT_MS);
+        if (block == NULL) continue;
+        reorder_buffer[block->release_seq & reorder_mask] = block;
+        while ((block = reorder_buffer[next_seq & reorder_mask]) != NULL) {
+            reorder_buffer[next_seq & reorder_mask] = NULL;
+            next_seq++;
+            publish_block(block);
+            uint32_t latency_us = (uint32_t) ((current_time_ns() - block->release_ns) / 1000);
+            db_gnd_status->decode_time_us = (uint32_t) ((block->decode_end_ns - block->decode_start_ns) / 1000);
+            db_gnd_status->decode_latency_us = latency_us;
+            if (latency_us > db_gnd_status->decode_latency_max_us)
+                db_gnd_status->decode_latency_max_us = latency_us;
+            block_buffer_reset(block);
+            db_ring_push(&returned_ring, block);
+        }
+        output_wake();
+    }
+    return NULL;
+}
 
-            //decode data and publish it
-            fec_decode((unsigned int) pack_size, data_blocks, num_data_block, fec_blocks, fec_block_nos, erased_blocks,
-                       nr_fec_blocks);
-            for (i = 0; i < num_data_block; ++i) {
-                video_packet_data_t *vpd_corrected = (video_packet_data_t *) data_blocks[i];
+/**
+ * Hands the oldest block of the window to the decoders and moves the window on by one block. Incomplete blocks (late
+ * path) get decoded with the packets that arrived so far
+ *
+ * @param block_window The reorder window
+ */
+void release_oldest_block(block_buffer_t **block_window) {
+    block_buffer_t *block = block_window[next_block_num & block_window_mask];
+    if (block != NULL) {
+        //db_gnd_status->adapter[].received_block_cnt++;
+        block_window[next_block_num & block_window_mask] = NULL;
+        block->state = BLOCK_DECODING;
+        block->release_seq = release_seq++;
+        block->release_ns = current_time_ns();
+        // holds at most all block buffers, can not be full
+        db_ring_push(&decode_rings[next_decode_worker], block);
+        next_decode_worker = (next_decode_worker + 1) % num_decode_workers;
+    }
+    next_block_num++;
+}
 
-                if (!reconstruction_failed || data_pkgs[i]->valid) {
-                    //if reconstruction did fail, the data_length value is undefined. better limit it to some sensible value
-                    if (vpd_corrected->data_length > pack_size) {
-                        vpd_corrected->data_length = (uint32_t) pack_size;
-                    }
-                    // do not publish the data_length field of video_packet_data_t struct
-                    publish_data(data_blocks[i] + 4, vpd_corrected->data_length - 4, true);
-                }
-            }
+/**
+ * Hands all completed blocks at the start of the window to the decoders
+ *
+ * @param block_window The reorder window
+ */
+void publish_completed_blocks(block_buffer_t **block_window) {
+    block_buffer_t *block;
+    while ((block = block_window[next_block_num & block_window_mask]) != NULL && block->state == BLOCK_COMPLETE)
+        release_oldest_block(block_window);
+}
 
+/**
+ * Takes a stream of payload (FEC & DATA) and does error correction publishing the corrected data in the end.
+ * Blocks are kept in a window of param_block_buffers blocks (ring indexed by block_num & block_window_mask) so packets
+ * may arrive reordered by that many blocks. Blocks are published in order: Completed blocks right away, incomplete
+ * blocks once they fall out of the window.
+ *
+ * @param data: The payload of raw protocol (a db_video_packet_t)
+ * @param data_len: Length of the payload
+ * @param crc_correct: Was the FCF of the raw packet OK
+ * @param block_window: The reorder window (param_block_buffers long)
+ */
+void process_video_payload(uint8_t *data, uint16_t data_len, int crc_correct, block_buffer_t **block_window) {
+    db_video_packet_t *db_video_packet = (db_video_packet_t *) data;
+    uint32_t seq_nr = db_video_packet->video_packet_header.sequence_number & VIDEO_SEQ_NUM_MASK;
+    uint missing_datas = db_video_packet->video_packet_header.sequence_number >> VIDEO_SEQ_NUM_BITS;
+    //if aram_data_packets_per_block+num_fec_block would be limited to powers of two, this could be replaced by a logical AND operation
+    int block_num = (int) (seq_nr / (num_data_block + num_fec_block));
+    uint packet_num = seq_nr % (num_data_block + num_fec_block);
 
-            //reset buffers
-            for (i = 0; i < num_data_block + num_fec_block; ++i) {
-                packet_buffer_t *p = packet_buffer_list + i;
-                p->valid = 0;
-                p->crc_correct = 0;
-                p->len = 0;
-            }
-        }
+    //LOG_SYS_STD(LOG_ERR, "seq %i blk %i crc %d len %i\n", db_video_packet->video_packet_header.sequence_number, block_num, crc_correct, (int) data_len);
 
-        block_buffer_list[min_block_num_idx].block_num = block_num;
+    // Only packets with a correct checksum may open blocks or move the window. The block_num of others might be garbage
+    if (next_block_num == -1) {
+        if (!crc_correct) return;
+        next_block_num = block_num;
+    } else if (block_num + 128 * param_block_buffers < max_block_num) {
+        //we have received a block_num that is several times smaller than the current window of buffers -> this
+        //indicated that either the window is too small or that the transmitter has been restarted
+        if (!crc_correct) return;
+        db_gnd_status->tx_restart_cnt++;
+        LOG_SYS_STD(LOG_ERR,
+                    "TX RESTART: Detected blk %x that lies outside of the current retr block buffer window "
+                    "(max_block_num = %x) (if there was no tx restart, increase window size via -w)\n",
+                    block_num, max_block_num);
+        block_window_reset(block_window);
+        next_block_num = block_num;
         max_block_num = block_num;
     }
-
-
-    //find the buffer into which we have to write this packet
-    block_buffer_t *rbb = block_buffer_list;
-    for (i = 0; i < param_block_buffers; ++i) {
-        if (rbb->block_num == block_num) {
-            break;
+    // late packet of a block that was already published (or given up)
+    if (block_num < next_block_num) return;
+
+    //we have received a block number that exceeds the window -> we need to make room for this new block
+    if (block_num >= next_block_num + param_block_buffers) {
+        if (!crc_correct) return;
+        for (int i = 0; i < param_block_buffers && block_num >= next_block_num + param_block_buffers; i++)
+            release_oldest_block(block_window);
+        // the whole window got published. Skip the blocks in between that we never received a packet of
+        if (block_num >= next_block_num + param_block_buffers)
+            next_block_num = block_num - param_block_buffers + 1;
+        publish_completed_blocks(block_window);
+    }
+    if (block_num > max_block_num) max_block_num = block_num;
+
+    block_buffer_t *block = block_window[block_num & block_window_mask];
+    if (block == NULL) {
+        if (!crc_correct) return;
+        if ((block = get_free_block()) == NULL) {
+            // decoders and output can not keep up. Drop rather than stalling the reception
+            db_gnd_status->decode_overflow_cnt++;
+            return;
         }
-        rbb++;
-    }
-
-    //check if we have actually found the corresponding block. this could not be the case due to a corrupt packet
-    if (i != param_block_buffers) {
-        packet_buffer_t *packet_buffer_list = rbb->packet_buffer_list;
-        packet_num = db_video_packet->video_packet_header.sequence_number % (num_data_block +
-                                                                             num_fec_block); //if retr_block_size would be limited to powers of two, this could be replace by a locical and operation
-
-        //only overwrite packets where the checksum is not yet correct. otherwise the packets are already received correctly
-        if (packet_buffer_list[packet_num].crc_correct == 0) {
-            memcpy(packet_buffer_list[packet_num].data, data + sizeof(video_packet_header_t),
-                   data_len - sizeof(video_packet_header_t));
-            packet_buffer_list[packet_num].len = (uint) (data_len - sizeof(video_packet_header_t));
-            packet_buffer_list[packet_num].valid = 1;
-            packet_buffer_list[packet_num].crc_correct = crc_correct;
+        block->block_num = block_num;
+        block->state = BLOCK_RECEIVING;
+        block_window[block_num & block_window_mask] = block;
+    }
+    // packets of completed blocks are not needed anymore
+    if (block->state != BLOCK_RECEIVING) return;
+
+    packet_buffer_t *packet_buffer_list = block->packet_buffer_list;
+    if (missing_datas > 0 && crc_correct && !block->short_block)
+        fill_short_block(block, missing_datas);
+    //only overwrite packets where the checksum is not yet correct. otherwise the packets are already received correctly
+    if (packet_buffer_list[packet_num].crc_correct == 0) {
+        if (packet_buffer_list[packet_num].valid)
+            block->corrupt_received--;
+        memcpy(packet_buffer_list[packet_num].data, data + sizeof(video_packet_header_t),
+               data_len - sizeof(video_packet_header_t));
+        packet_buffer_list[packet_num].len = (uint) (data_len - sizeof(video_packet_header_t));
+        packet_buffer_list[packet_num].valid = 1;
+        packet_buffer_list[packet_num].crc_correct = crc_correct;
+        if (!crc_correct)
+            block->corrupt_received++;
+        else if (is_data_packet(packet_num))
+            block->datas_received++;
+        else
+            block->fecs_received++;
+
+        // Early completion: all DATA packets are there or enough good FECs arrived to repair the missing ones.
+        // No need to wait for a packet of the next block. With corrupt packets inside the block we keep waiting for
+        // correct copies (other adapters) and let the block be decoded once it falls out of the window
+        if (block->datas_received == num_data_block ||
+            (block->corrupt_received == 0 && block->datas_received + block->fecs_received >= num_data_block)) {
+            block->state = BLOCK_COMPLETE;
+            publish_completed_blocks(block_window);
         }
     }
-    // TODO: Check if we got all possible packets of a block already and decode, no need to wait for a packet of the next block to indicate
 }
 
 /**
- * Extracts the payload from received packet, reads radiotap header for RSSI info and forwards payload to decoding stage
+ * Extracts the payload from a received frame, reads radiotap header for RSSI info and forwards payload to decoding stage
  *
- * @param interface
- * @param block_buffer_list
+ * @param frame The received frame starting with the radiotap header
+ * @param frame_length Length of the frame
+ * @param radiotap_cache Radiotap layout cache of the adapter
+ * @param block_window
  * @param adapter_no
  */
-void process_packet(monitor_interface_t *interface, block_buffer_t *block_buffer_list, int adapter_no) {
-    struct ieee80211_radiotap_iterator rti;
-
-    uint8_t payload_buffer[DATA_UNI_LENGTH]; // contains payload of raw protocol (video header + data = db_video_packet)
-    uint16_t radiotap_length = 0;
+void process_frame(uint8_t *frame, ssize_t frame_length, db_radiotap_cache_t *radiotap_cache,
+                   block_buffer_t **block_window, int adapter_no) {
+    db_frame_view_t view; // payload of raw protocol (video header + data = db_video_packet) stays inside the frame
     int checksum_correct = 1;
-    uint8_t current_antenna_indx = 0, seq_num_video = 0;
-    uint16_t message_length = 0;
+    uint8_t current_antenna_indx = 0;
+
+    db_gnd_status->received_packet_cnt++;
+    if (db_parse_frame(frame, frame_length, &view) != 0) {
+        LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Received malformed frame\n");
+        return;
+    }
+    if (pass_through) {
+        // Do not decode using FEC - pure UDP pass through, decoding of FEC must happen on following applications
+        // TODO: Implement custom protocol in case of pass_through that tells the receiver about the adapter that it was received on
+        publish_pass_through(view.payload, view.payload_length);
+    }
+    const db_radiotap_layout_t *layout = db_radiotap_get_layout(radiotap_cache, frame, view.radiotap_length);
+    if (layout == NULL) {
+        LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Could not init radiotap header\n");
+        return;
+    }
+    for (int i = 0; i < layout->num_fields; i++) {
+        uint8_t *field = frame + layout->fields[i].offset;
+        switch (layout->fields[i].index) {
+            case IEEE80211_RADIOTAP_RATE:
+                db_gnd_status->adapter[adapter_no].rate = (*field);
+                break;
+            case IEEE80211_RADIOTAP_ANTENNA:
+                current_antenna_indx = (*field);
+                break;
+            case IEEE80211_RADIOTAP_FLAGS:
+                checksum_correct = (*field & IEEE80211_RADIOTAP_F_BADFCS) == 0;
+                break;
+            case IEEE80211_RADIOTAP_LOCK_QUALITY:
+                db_gnd_status->adapter[adapter_no].lock_quality = (*field);
+            case IEEE80211_RADIOTAP_DBM_ANTSIGNAL:
+                if (current_antenna_indx == 0) // first occurrence in header will be general RSSI
+                    db_gnd_status->adapter[adapter_no].current_signal_dbm = (int8_t) (*field);
+                if (current_antenna_indx <= MAX_ANTENNA_CNT)
+                    db_gnd_status->adapter[adapter_no].ant_signal_dbm[current_antenna_indx] = (int8_t) (*field);
+                break;
+            default:
+                break;
+        }
+    }
+    db_gnd_status->adapter[adapter_no].num_antennas = (uint8_t) (current_antenna_indx + 1);
+    if (!checksum_correct)
+        db_gnd_status->adapter[adapter_no].wrong_crc_cnt++;
+    db_gnd_status->adapter[adapter_no].received_packet_cnt++;
 
+    db_gnd_status->last_update = time(NULL);
+    process_video_payload(view.payload, view.payload_length, checksum_correct, block_window);
+}
+
+/**
+ * Processes all frames that are waiting on a readable interface. With the RX ring all frames of the retired blocks
+ * are processed without a syscall per frame, without the ring one frame gets received via recv()
+ *
+ * @param interface
+ * @param block_window
+ * @param adapter_no
+ */
+void process_packets(monitor_interface_t *interface, block_buffer_t **block_window, int adapter_no) {
+    if (interface->rx_ring.map) {
+        uint8_t *frame;
+        uint32_t frame_length;
+        while (db_rx_ring_next(&interface->rx_ring, &frame, &frame_length))
+            process_frame(frame, frame_length, &interface->radiotap_cache, block_window, adapter_no);
+        return;
+    }
     // receive
-    ssize_t l = recv(interface->selectable_fd, lr_buffer, MAX_DB_DATA_LENGTH, 0);
+    ssize_t l = db_recv(interface->selectable_fd, lr_buffer, MAX_DB_DATA_LENGTH, 0);
     int err = errno;
     if (l > 0) {
-        db_gnd_status->received_packet_cnt++;
-        message_length = get_db_payload(lr_buffer, l, payload_buffer, &seq_num_video, &radiotap_length);
-        if (pass_through) {
-            // Do not decode using FEC - pure UDP pass through, decoding of FEC must happen on following applications
-            // TODO: Implement custom protocol in case of pass_through that tells the receiver about the adapter that it was received on
-            publish_data(payload_buffer, message_length, false);
-        }
-        if (ieee80211_radiotap_iterator_init(&rti, (struct ieee80211_radiotap_header *) lr_buffer, radiotap_length,
-                                             NULL) != 0) {
-            LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Could not init radiotap header\n");
-            return;
-        }
-        while ((ieee80211_radiotap_iterator_next(&rti)) == 0) {
-            switch (rti.this_arg_index) {
-                case IEEE80211_RADIOTAP_RATE:
-                    db_gnd_status->adapter[adapter_no].rate = (*rti.this_arg);
-                    break;
-                case IEEE80211_RADIOTAP_ANTENNA:
-                    current_antenna_indx = (*rti.this_arg);
-                    break;
-                case IEEE80211_RADIOTAP_FLAGS:
-                    checksum_correct = (*rti.this_arg & IEEE80211_RADIOTAP_F_BADFCS) == 0;
-                    break;
-                case IEEE80211_RADIOTAP_LOCK_QUALITY:
-                    db_gnd_status->adapter[adapter_no].lock_quality = (*rti.this_arg);
-                case IEEE80211_RADIOTAP_DBM_ANTSIGNAL:
-                    if (current_antenna_indx == 0) // first occurrence in header will be general RSSI
-                        db_gnd_status->adapter[adapter_no].current_signal_dbm = (int8_t) (*rti.this_arg);
-                    if (current_antenna_indx <= MAX_ANTENNA_CNT)
-                        db_gnd_status->adapter[adapter_no].ant_signal_dbm[current_antenna_indx] = (int8_t) (*rti.this_arg);
-                    break;
-                default:
-                    break;
-            }
-        }
-        db_gnd_status->adapter[adapter_no].num_antennas = (uint8_t) (current_antenna_indx + 1);
-        if (!checksum_correct)
-            db_gnd_status->adapter[adapter_no].wrong_crc_cnt++;
-        db_gnd_status->adapter[adapter_no].received_packet_cnt++;
-
-        db_gnd_status->last_update = time(NULL);
-        process_video_payload(payload_buffer, message_length, checksum_correct, block_buffer_list);
+        process_frame(lr_buffer, l, &interface->radiotap_cache, block_window, adapter_no);
     } else {
         LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Received an error: %s\n", strerror(err));
     }
 }
 
+/**
+ * Allocates all block buffers and the rings connecting the receive thread, the decode workers and the publish thread.
+ * The window and the decoders/output together may hold all block buffers, so no ring can ever be full.
+ */
+void init_decode_pipeline() {
+    block_pool_size = param_block_buffers + DECODE_QUEUE_BLOCKS;
+    block_pool = malloc(sizeof(block_buffer_t) * block_pool_size);
+    free_blocks = malloc(sizeof(block_buffer_t *) * block_pool_size);
+    uint32_t reorder_size = 1;
+    while (reorder_size < (uint32_t) block_pool_size) reorder_size <<= 1;
+    reorder_buffer = calloc(reorder_size, sizeof(block_buffer_t *));
+    reorder_mask = reorder_size - 1;
+    if (block_pool == NULL || free_blocks == NULL || reorder_buffer == NULL) {
+        perror("DB_VIDEO_GND: malloc");
+        abort();
+    }
+    sem_init(&decoded_items, 0, 0);
+    if (db_ring_init(&returned_ring, (uint32_t) block_pool_size, NULL)) {
+        LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Could not create decode pipeline rings\n");
+        abort();
+    }
+    for (int i = 0; i < num_decode_workers; i++) {
+        if (db_ring_init(&decode_rings[i], (uint32_t) block_pool_size, NULL) ||
+            db_ring_init(&decoded_rings[i], (uint32_t) block_pool_size, &decoded_items)) {
+            LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Could not create decode pipeline rings\n");
+            abort();
+        }
+    }
+    for (int i = 0; i < block_pool_size; ++i) {
+        block_pool[i].packet_buffer_list = lib_alloc_packet_buffer_list(num_data_block + num_fec_block,
+                                                                        MAX_PACKET_LENGTH);
+        block_buffer_reset(&block_pool[i]);
+        free_blocks[num_free_blocks++] = &block_pool[i];
+    }
+}
+
+/**
+ * Parses the -q option
+ *
+ * @param arg <output>:<policy> e.g. "stdout:block"
+ */
+void parse_output_policy(const char *arg) {
+    char sink_name[8] = {0};
+    const char *policy_str = strchr(arg, ':');
+    output_policy_t policy;
+    if (policy_str == NULL || policy_str - arg >= (long) sizeof(sink_name) ||
+        output_parse_policy(policy_str + 1, &policy) != 0) {
+        LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Invalid output policy %s. Use <stdout|udp|usb|rec>:<oldest|keyframe|block>\n",
+                    arg);
+        abort();
+    }
+    memcpy(sink_name, arg, (size_t) (policy_str - arg));
+    if (strcmp(sink_name, "stdout") == 0) stdout_policy = policy;
+    else if (strcmp(sink_name, "udp") == 0) udp_policy = policy;
+    else if (strcmp(sink_name, "usb") == 0) usb_bridge_policy = policy;
+    else if (strcmp(sink_name, "rec") == 0) recorder_policy = policy;
+    else {
+        LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Unknown output %s. Use stdout, udp, usb or rec\n", sink_name);
+        abort();
+    }
+}
+
+/**
+ * Registers an output with the output thread and exports its counters via db_gnd_status->sink
+ */
+void add_output_sink(const char *name, output_policy_t policy, int poll_fd, output_send_fn send,
+                     output_send_batch_fn send_batch) {
+    if (output_add_sink(name, policy, poll_fd, send, send_batch, NULL, NULL,
+                        &db_gnd_status->sink[db_gnd_status->sink_cnt]) >= 0) {
+        db_gnd_status->sink_cnt++;
+        LOG_SYS_STD(LOG_NOTICE, "DB_VIDEO_GND: Output %s (overflow policy: %s)\n", name, output_policy_name(policy));
+    }
+}
+
+/**
+ * Registers all enabled outputs with the output thread
+ */
+void init_output_sinks() {
+    if (output_init(MAX_USER_PACKET_LENGTH, &keeprunning) != 0) abort();
+    db_gnd_status->sink_cnt = 0;
+    if (send_to_std_out) {
+        // the output thread must never block on a slow video player
+        fcntl(STDOUT_FILENO, F_SETFL, fcntl(STDOUT_FILENO, F_GETFL) | O_NONBLOCK);
+        add_output_sink("stdout", stdout_policy, STDOUT_FILENO, send_stdout, NULL);
+    }
+    if (udp_enabled && !pass_through) {
+        // UDP destinations are sinks of their own, managed by the output thread
+        if (video_clients_init(udp_socket, (uint16_t) dest_port_video, udp_policy, udp_format, client_lease_s,
+                               DB_AP_CLIENT_IP, db_gnd_status) != 0)
+            abort();
+        for (int i = 0; i < num_static_dsts; i++) {
+            if (video_clients_add_static(static_dsts[i], multicast_ttl) != 0)
+                LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Invalid video destination %s\n", static_dsts[i]);
+        }
+        output_set_housekeeping(udp_socket, video_clients_housekeeping);
+    }
+    // sending to a full unix datagram socket does not show up in poll(), retry instead
+    if (output_to_usb_bridge)
+        add_output_sink("usb", usb_bridge_policy, -1, send_usb_bridge, NULL);
+    if (recorder_path[0] != '\0') {
+        recorder_fd = open(recorder_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (recorder_fd < 0)
+            LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Could not open recording %s: %s\n", recorder_path, strerror(errno));
+        else
+            add_output_sink("rec", recorder_policy, -1, send_recorder, NULL);
+    }
+}
+
 void process_command_line_args(int argc, char *argv[]) {
     num_interfaces = 0, comm_id = DEFAULT_V2_COMMID, pass_through = false, udp_enabled = true, send_to_std_out = true;
     num_data_block = 8, num_fec_block = 4, pack_size = 1024, dest_port_video = APP_PORT_VIDEO;
     int c;
-    while ((c = getopt(argc, argv, "n:c:r:f:p:d:u:v:i:os")) != -1) {
+    while ((c = getopt(argc, argv, "n:c:r:f:p:d:u:v:i:l:m:t:w:j:q:R:os")) != -1) {
         switch (c) {
             case 'n':
                 strncpy(adapters[num_interfaces], optarg, IFNAMSIZ);
@@ -484,8 +877,34 @@ void process_command_line_args(int argc, char *argv[]) {
                 dest_port_video = (int) strtol(optarg, NULL, 10);
                 break;
             case 'i':
-                fixed_ip = true;
-                strncpy(overwrite_ip, optarg, INET6_ADDRSTRLEN);
+                if (num_static_dsts < DB_GND_MAX_VIDEO_CLIENTS) {
+                    strncpy(static_dsts[num_static_dsts], optarg, sizeof(static_dsts[0]) - 1);
+                    num_static_dsts++;
+                }
+                break;
+            case 'l':
+                client_lease_s = (int) strtol(optarg, NULL, 10);
+                break;
+            case 'm':
+                multicast_ttl = (int) strtol(optarg, NULL, 10);
+                break;
+            case 't':
+                if (video_parse_format(optarg, &udp_format) != 0) {
+                    LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Unknown UDP format %s. Use raw or rtp\n", optarg);
+                    abort();
+                }
+                break;
+            case 'w':
+                param_block_buffers = (int) strtol(optarg, NULL, 10);
+                break;
+            case 'j':
+                num_decode_workers = (int) strtol(optarg, NULL, 10);
+                break;
+            case 'q':
+                parse_output_policy(optarg);
+                break;
+            case 'R':
+                strncpy(recorder_path, optarg, PATH_MAX - 1);
                 break;
             case 'o':
                 output_to_usb_bridge = true;
@@ -505,13 +924,30 @@ void process_command_line_args(int argc, char *argv[]) {
                        "\n\t-r Number of FEC packets per block (default 4). Needs to match with tx."
                        "\n\t-f Bytes per packet (default %d. max %d). This is also the FEC "
                        "block size. Needs to match with tx."
+                       "\n\t-w Reorder window in blocks (default 1, rounded up to a power of two, max %d). Incomplete "
+                       "blocks are published once they fall out of the window. Increase for interleaving or "
+                       "adapters with different delays"
+                       "\n\t-j Number of FEC decode threads (default 1, max %d). Blocks are published in order"
                        "\n\t-u <Y|N> to enable or disable UDP forwarding of decoded data"
-                       "\n\t-i UDP DST IP overwrite: Ignore DroneBridge IP checker shared memory and send data to this IP"
+                       "\n\t-i <ip>[:<port>] Static UDP destination, replaces the IP checker address. Can be used "
+                       "multiple times (max %d). Multicast groups are supported. Further destinations register via "
+                       "video destination hint packets on port %d (options: port=<port> policy=<policy> format=<format> leave)"
+                       "\n\t-l Lease of destinations registered via hint in seconds (default 0: never expire)"
+                       "\n\t-m TTL of the video stream sent to multicast groups (default 1)"
+                       "\n\t-t <raw|rtp> Format of the decoded stream sent via UDP: raw H.264 byte stream (default) or "
+                       "RTP/H.264 (RFC 6184, payload type 96) e.g. for QGroundControl or Mission Planner"
                        "\n\t-p <Y|N> to enable/disable pass through of encoded FEC packets via UDP to port: %i"
                        "\n\t-v Destination port of video stream when set via UDP (IP checker address) or TCP"
                        "\n\t-o Send to output to unix domain socket at %s so that DroneBridge USBBridge can forward it"
-                       "\n\t-s Disable decoded output to stdout",
-                       1024, MAX_USER_PACKET_LENGTH, APP_PORT_VIDEO_FEC, DB_UNIX_DOMAIN_VIDEO_PATH);
+                       "\n\t-s Disable decoded output to stdout"
+                       "\n\t-R <file> Record the decoded stream to this file (appends)"
+                       "\n\t-q <output>:<policy> What to do if an output (stdout, udp, usb, rec) can not keep up. The udp "
+                       "policy is the default of all UDP destinations. Destinations registered via hint never block, "
+                       "they use keyframe instead. "
+                       "Policies: oldest (drop oldest data), keyframe (drop until next H.264 key frame), block (wait, "
+                       "may cause loss on reception). Default: stdout:keyframe, udp:oldest, usb:oldest, rec:oldest",
+                       1024, MAX_USER_PACKET_LENGTH, MAX_BLOCK_WINDOW, MAX_DECODE_WORKERS, DB_GND_MAX_VIDEO_CLIENTS, APP_PORT_VIDEO, APP_PORT_VIDEO_FEC,
+                       DB_UNIX_DOMAIN_VIDEO_PATH);
                 abort();
         }
     }
@@ -526,7 +962,7 @@ int main(int argc, char *argv[]) {
     int i;
     struct sockaddr_in udp_video_hint_src;
     uint8_t udp_buff[UDP_BUFF_SIZE];
-    block_buffer_t *block_buffer_list;
+    block_buffer_t **block_window;
 
     process_command_line_args(argc, argv);
     if (num_interfaces == 0) {
@@ -540,11 +976,30 @@ int main(int argc, char *argv[]) {
         abort();
     }
 
-    fec_init();
+    if (param_block_buffers < 1 || param_block_buffers > MAX_BLOCK_WINDOW) {
+        LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Reorder window must be 1-%d blocks (you requested %d)\n", MAX_BLOCK_WINDOW,
+                    param_block_buffers);
+        abort();
+    }
+    int window = 1;
+    while (window < param_block_buffers) window <<= 1;
+    param_block_buffers = window;
+    block_window_mask = (uint) (window - 1);
+    if (num_decode_workers < 1 || num_decode_workers > MAX_DECODE_WORKERS) {
+        LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Number of decode threads must be 1-%d (you requested %d)\n",
+                    MAX_DECODE_WORKERS, num_decode_workers);
+        abort();
+    }
+
+    fec_ctx_init(&fec_ctx, FEC_KERNEL_AUTO);
+    LOG_SYS_STD(LOG_NOTICE, "DB_VIDEO_GND: Using %s FEC kernel\n", fec_ctx_kernel_name(&fec_ctx));
     init_outputs();
-    if (fixed_ip && udp_enabled) {
-        LOG_SYS_STD(LOG_NOTICE, "DB_VIDEO_GND: Sending to %s\n", overwrite_ip);
-        client_video_addr.sin_addr.s_addr = inet_addr(overwrite_ip);
+    if (num_static_dsts > 0 && udp_enabled && pass_through) {
+        // pass through sends to a single destination: the first static one (port is always APP_PORT_VIDEO_FEC)
+        char *port_str = strchr(static_dsts[0], ':');
+        if (port_str) *port_str = '\0';
+        LOG_SYS_STD(LOG_NOTICE, "DB_VIDEO_GND: Sending to %s\n", static_dsts[0]);
+        client_video_addr.sin_addr.s_addr = inet_addr(static_dsts[0]);
     }
 
     db_gnd_status = db_gnd_status_memory_open();
@@ -553,11 +1008,19 @@ int main(int argc, char *argv[]) {
     db_gnd_status->received_block_cnt = 0;
     db_gnd_status->damaged_block_cnt = 0;
     db_gnd_status->tx_restart_cnt = 0;
+    db_gnd_status->decode_time_us = 0;
+    db_gnd_status->decode_latency_us = 0;
+    db_gnd_status->decode_latency_max_us = 0;
+    db_gnd_status->decode_overflow_cnt = 0;
 
     // init DroneBridge raw sockets to listen for incoming data
     for (int j = 0; j < num_interfaces; ++j) {
         db_socket_t db_sock = open_db_socket(adapters[j], comm_id, 'm', 11, DB_DIREC_DRONE, DB_PORT_VIDEO, DB_FRAMETYPE_DATA);
         interfaces[j].selectable_fd = db_sock.db_socket;
+        memset(&interfaces[j].radiotap_cache, 0, sizeof(db_radiotap_cache_t));
+        if (db_rx_ring_open(&interfaces[j].rx_ring, db_sock.db_socket, RX_RING_BLOCK_SIZE, RX_RING_BLOCK_NR,
+                            RX_RING_TIMEOUT_MS) != 0)
+            LOG_SYS_STD(LOG_NOTICE, "DB_VIDEO_GND: RX ring not available on %s. Using recv()\n", adapters[j]);
         strcpy(db_gnd_status->adapter[j].name, adapters[j]);
         LOG_SYS_STD(LOG_NOTICE, "\t%s\n", db_gnd_status->adapter[j].name);
         db_gnd_status->adapter[j].received_packet_cnt = 0;
@@ -574,15 +1037,28 @@ int main(int argc, char *argv[]) {
     memset(&unix_socket_addr, 0x00, sizeof(unix_socket_addr));
     unix_socket_addr.sun_family = AF_UNIX;
     strcpy(unix_socket_addr.sun_path, DB_UNIX_DOMAIN_VIDEO_PATH);
-    // UDP server socket to receive video dst hints
 
-    //block buffers contain both the block_num as well as packet buffers for a block.
-    block_buffer_list = malloc(sizeof(block_buffer_t) * param_block_buffers);
-    for (i = 0; i < param_block_buffers; ++i) {
-        block_buffer_list[i].block_num = -1;
-        block_buffer_list[i].packet_buffer_list = lib_alloc_packet_buffer_list(num_data_block + num_fec_block,
-                                                                               MAX_PACKET_LENGTH);
+    //the window holds pointers to the block buffers of the blocks we are currently receiving
+    block_window = calloc((size_t) param_block_buffers, sizeof(block_buffer_t *));
+    init_decode_pipeline();
+    init_output_sinks();
+    // only the receive thread handles SIGINT, so select() gets interrupted
+    sigset_t sigset, old_sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigset, &old_sigset);
+    pthread_t decoders[MAX_DECODE_WORKERS], publisher, output;
+    for (i = 0; i < num_decode_workers; i++) {
+        if (pthread_create(&decoders[i], NULL, decode_thread, (void *) (intptr_t) i)) {
+            LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Could not start decode threads\n");
+            abort();
+        }
     }
+    if (pthread_create(&publisher, NULL, publish_thread, NULL) || pthread_create(&output, NULL, output_thread, NULL)) {
+        LOG_SYS_STD(LOG_ERR, "DB_VIDEO_GND: Could not start publish/output thread\n");
+        abort();
+    }
+    pthread_sigmask(SIG_SETMASK, &old_sigset, NULL);
 
     LOG_SYS_STD(LOG_NOTICE, "DB_VIDEO_GND: started on %i interfaces\n", num_interfaces);
     fd_set readset;
@@ -590,8 +1066,12 @@ int main(int argc, char *argv[]) {
     while (keeprunning) {
         FD_ZERO(&readset);
 
-        int max_sd = udp_socket;
-        FD_SET(udp_socket, &readset);
+        // in pass through mode the receive thread handles the video dst hints, otherwise the output thread does
+        int max_sd = 0;
+        if (udp_enabled && pass_through) {
+            max_sd = udp_socket;
+            FD_SET(udp_socket, &readset);
+        }
         for (i = 0; i < num_interfaces; i++) {
             FD_SET(interfaces[i].selectable_fd, &readset);
             if (interfaces[i].selectable_fd > max_sd)
@@ -602,7 +1082,7 @@ int main(int argc, char *argv[]) {
         if (select_return == -1 && errno != EINTR) {
             perror("DB_VIDEO_GND: select() returned error: ");
         } else if (select_return > 0) {
-            if (FD_ISSET(udp_socket, &readset)) {
+            if (udp_enabled && pass_through && FD_ISSET(udp_socket, &readset)) {
                 // received a video destination hint. Update video destination udp address
                 if (recvfrom(udp_socket, udp_buff, UDP_BUFF_SIZE, 0, (struct sockaddr *) &udp_video_hint_src,
                              &client_address_size) != -1) {
@@ -615,13 +1095,20 @@ int main(int argc, char *argv[]) {
             }
             for (i = 0; i < num_interfaces; i++) {
                 if (FD_ISSET(interfaces[i].selectable_fd, &readset)) {
-                    process_packet(&interfaces[i], block_buffer_list, i);
+                    process_packets(&interfaces[i], block_window, i);
                 }
             }
         }
     }
 
-    for (int g = 0; i < num_interfaces; ++i) {
+    for (i = 0; i < num_decode_workers; i++)
+        pthread_join(decoders[i], NULL);
+    pthread_join(publisher, NULL);
+    pthread_join(output, NULL);
+    if (send_to_std_out) fcntl(STDOUT_FILENO, F_SETFL, fcntl(STDOUT_FILENO, F_GETFL) & ~O_NONBLOCK);
+    if (recorder_fd >= 0) close(recorder_fd);
+    for (int g = 0; g < num_interfaces; ++g) {
+        db_rx_ring_close(&interfaces[g].rx_ring);
         close(interfaces[g].selectable_fd);
     }
     unlink(DB_UNIX_DOMAIN_VIDEO_PATH);
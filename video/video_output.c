@@ -0,0 +1,449 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include "video_output.h"
+#include "../common/db_common.h"
+
+#define OUTPUT_RETRY_MS 2       // retry interval of busy sinks that can not be polled
+#define OUTPUT_IDLE_WAIT_MS 500
+#define OUTPUT_SPACE_WAIT_MS 100
+#define OUTPUT_GSO_MAX_BYTES 65000 // payload of one UDP GSO send (max. IP datagram size minus headers)
+#define OUTPUT_GSO_MAX_SEGMENTS 64
+
+typedef struct {
+    uint32_t length;
+    uint8_t keyframe; // packet contains the start of a SPS or IDR NAL unit
+    uint8_t data[];
+} output_packet_t;
+
+static struct {
+    uint8_t *slots;
+    size_t slot_size;
+    uint32_t max_packet_length;
+    _Atomic uint32_t head; // next packet to write, only modified by the producer
+    output_sink_t sinks[OUTPUT_MAX_SINKS];
+    int input_fd; // polled for POLLIN, passed to housekeeping
+    output_housekeeping_fn housekeeping;
+    _Atomic bool detect_keyframes; // only scan for key frames if a sink needs them (sinks may be added at runtime)
+    int wake_fd; // eventfd: new packets for the output thread
+    sem_t space; // posted by the output thread after it made room for a waiting producer
+    _Atomic int producer_waiting;
+    volatile bool *running;
+} output;
+
+static output_packet_t *output_slot(uint32_t pos) {
+    return (output_packet_t *) (output.slots + (pos & (OUTPUT_RING_PACKETS - 1)) * output.slot_size);
+}
+
+/**
+ * Allocates the output ring. Call before adding sinks
+ *
+ * @param max_packet_length Longest packet that will be pushed
+ * @param running Output thread and waiting producer stop once this turns false
+ * @return 0 on success or -1 on failure
+ */
+int output_init(uint32_t max_packet_length, volatile bool *running) {
+    memset(&output, 0, sizeof(output));
+    output.max_packet_length = max_packet_length;
+    output.slot_size = (sizeof(output_packet_t) + max_packet_length + 7) & ~((size_t) 7);
+    output.slots = malloc(output.slot_size * OUTPUT_RING_PACKETS);
+    if (output.slots == NULL) {
+        perror("DB_VIDEO_GND: Could not allocate output ring");
+        return -1;
+    }
+    output.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (output.wake_fd < 0 || sem_init(&output.space, 0, 0) == -1) {
+        perror("DB_VIDEO_GND: Could not init output ring");
+        return -1;
+    }
+    atomic_init(&output.head, 0);
+    atomic_init(&output.producer_waiting, 0);
+    output.running = running;
+    output.input_fd = -1;
+    return 0;
+}
+
+/**
+ * Registers a sink. Must be called before the output thread is started or by the output thread itself (e.g. from the
+ * housekeeping function). A sink added at runtime starts with the next pushed packet
+ *
+ * @param name Short name used for the shared memory counters (max. 7 characters)
+ * @param policy What to do once the sink lags behind
+ * @param poll_fd File descriptor to poll for POLLOUT if the sink returned OUTPUT_AGAIN or -1
+ * @param send Writes one packet to the sink. Returns OUTPUT_SENT or OUTPUT_AGAIN
+ * @param send_batch Writes several packets to the sink at once or NULL. Used instead of send if set
+ * @param skip Called once the overflow policy skipped packets or NULL
+ * @param ctx Passed to send/send_batch/skip
+ * @param status Where to export lag and drop counters or NULL
+ * @return ID of the sink or -1 if there are too many sinks
+ */
+int output_add_sink(const char *name, output_policy_t policy, int poll_fd, output_send_fn send,
+                    output_send_batch_fn send_batch, output_skip_fn skip, void *ctx, db_sink_status_t *status) {
+    int id = 0;
+    while (id < OUTPUT_MAX_SINKS && atomic_load(&output.sinks[id].active)) id++;
+    if (id == OUTPUT_MAX_SINKS) return -1;
+    output_sink_t *sink = &output.sinks[id];
+    memset(sink, 0, sizeof(output_sink_t));
+    strncpy(sink->name, name, sizeof(sink->name) - 1);
+    sink->policy = policy;
+    sink->poll_fd = poll_fd;
+    sink->send = send;
+    sink->send_batch = send_batch;
+    sink->skip = skip;
+    sink->ctx = ctx;
+    sink->waiting_for_keyframe = false;
+    atomic_init(&sink->cursor, atomic_load(&output.head));
+    sink->status = status;
+    if (status) {
+        memset(status, 0, sizeof(db_sink_status_t));
+        strncpy(status->name, sink->name, sizeof(status->name) - 1);
+    }
+    if (policy == OUTPUT_DROP_TO_KEYFRAME) atomic_store_explicit(&output.detect_keyframes, true, memory_order_relaxed);
+    // the producer must see the cursor before it takes the sink into account
+    atomic_store_explicit(&sink->active, true, memory_order_release);
+    return id;
+}
+
+/**
+ * Removes a sink. Must be called before the output thread is started or by the output thread itself
+ *
+ * @param sink_id ID returned by output_add_sink()
+ */
+void output_remove_sink(int sink_id) {
+    if (sink_id >= 0 && sink_id < OUTPUT_MAX_SINKS)
+        atomic_store_explicit(&output.sinks[sink_id].active, false, memory_order_release);
+}
+
+/**
+ * Sets a function that the output thread calls on every wake up (at least every OUTPUT_IDLE_WAIT_MS) together with a
+ * file descriptor it waits on for input. Must be called before the output thread is started
+ *
+ * @param input_fd File descriptor to poll for POLLIN or -1
+ * @param housekeeping The function
+ */
+void output_set_housekeeping(int input_fd, output_housekeeping_fn housekeeping) {
+    output.input_fd = input_fd;
+    output.housekeeping = housekeeping;
+}
+
+/**
+ * @param str "oldest", "keyframe" or "block"
+ * @param policy Parsed policy
+ * @return 0 on success or -1 if the string is unknown
+ */
+int output_parse_policy(const char *str, output_policy_t *policy) {
+    if (strcmp(str, "oldest") == 0) *policy = OUTPUT_DROP_OLDEST;
+    else if (strcmp(str, "keyframe") == 0) *policy = OUTPUT_DROP_TO_KEYFRAME;
+    else if (strcmp(str, "block") == 0) *policy = OUTPUT_BLOCK;
+    else return -1;
+    return 0;
+}
+
+const char *output_policy_name(output_policy_t policy) {
+    switch (policy) {
+        case OUTPUT_DROP_OLDEST:
+            return "oldest";
+        case OUTPUT_DROP_TO_KEYFRAME:
+            return "keyframe";
+        default:
+            return "block";
+    }
+}
+
+/**
+ * Looks for an Annex B start code followed by a SPS (7) or IDR slice (5). Start codes that got split across two
+ * packets are not detected, the sink then resumes with the next key frame.
+ */
+static bool output_has_keyframe(const uint8_t *data, uint32_t length) {
+    for (uint32_t i = 0; i + 3 < length; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            uint8_t nal_type = (uint8_t) (data[i + 3] & 0x1f);
+            if (nal_type == 5 || nal_type == 7) return true;
+            i += 2;
+        }
+    }
+    return false;
+}
+
+static uint32_t output_min_cursor(uint32_t head) {
+    uint32_t min_cursor = head;
+    for (int i = 0; i < OUTPUT_MAX_SINKS; i++) {
+        if (!atomic_load_explicit(&output.sinks[i].active, memory_order_acquire)) continue;
+        uint32_t cursor = atomic_load_explicit(&output.sinks[i].cursor, memory_order_acquire);
+        if (head - cursor > head - min_cursor) min_cursor = cursor;
+    }
+    return min_cursor;
+}
+
+/**
+ * Signals the output thread that there are new packets. Call once after pushing a batch of packets (e.g. a block)
+ */
+void output_wake(void) {
+    uint64_t one = 1;
+    if (write(output.wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("DB_VIDEO_GND: Could not wake output thread");
+}
+
+/**
+ * Adds a packet to the output ring. Must only be called by one (producer) thread. Waits if a sink with the
+ * OUTPUT_BLOCK policy lags behind by the whole ring
+ *
+ * @param data Packet to output
+ * @param length Length of the packet. Longer packets than set with output_init() get truncated
+ */
+void output_push(const uint8_t *data, uint32_t length) {
+    uint32_t head = atomic_load_explicit(&output.head, memory_order_relaxed);
+    while (head - output_min_cursor(head) >= OUTPUT_RING_PACKETS) {
+        atomic_store(&output.producer_waiting, 1);
+        output_wake();
+        if (head - output_min_cursor(head) < OUTPUT_RING_PACKETS) break;
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += OUTPUT_SPACE_WAIT_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        sem_timedwait(&output.space, &deadline);
+        if (!*output.running) return;
+    }
+    if (length > output.max_packet_length) length = output.max_packet_length;
+    output_packet_t *packet = output_slot(head);
+    memcpy(packet->data, data, length);
+    packet->length = length;
+    packet->keyframe = (uint8_t) (atomic_load_explicit(&output.detect_keyframes, memory_order_relaxed) &&
+                                    output_has_keyframe(data, length));
+    atomic_store_explicit(&output.head, head + 1, memory_order_release);
+}
+
+/**
+ * Applies the overflow policy of a sink that lags behind by more than OUTPUT_HIGH_WATER packets
+ */
+static void output_apply_policy(output_sink_t *sink, uint32_t head) {
+    uint32_t cursor = atomic_load_explicit(&sink->cursor, memory_order_relaxed);
+    if (sink->policy == OUTPUT_BLOCK || head - cursor <= OUTPUT_HIGH_WATER) return;
+    uint32_t target = head - OUTPUT_RING_PACKETS / 2;
+    if (sink->policy == OUTPUT_DROP_TO_KEYFRAME) {
+        while (target != head && !output_slot(target)->keyframe) target++;
+        // no key frame inside the ring: drop everything till the next one arrives
+        sink->waiting_for_keyframe = (target == head);
+    }
+    LOG_SYS_STD(LOG_NOTICE, "DB_VIDEO_GND: Output %s can not keep up, skipping %u packets\n", sink->name,
+                target - cursor);
+    sink->drop_cnt += target - cursor;
+    atomic_store_explicit(&sink->cursor, target, memory_order_release);
+    if (sink->skip) sink->skip(sink->ctx);
+}
+
+/**
+ * Sends all packets the sink has not seen yet
+ *
+ * @return true if the sink is busy and has packets left
+ */
+static bool output_drain(output_sink_t *sink, uint32_t head) {
+    uint32_t cursor = atomic_load_explicit(&sink->cursor, memory_order_relaxed);
+    bool busy = false;
+    if (sink->queued && cursor == head) {
+        // no new packets: only flush the internal queue of the sink
+        sink->queued = (sink->send_batch(sink->ctx, NULL, 0) & OUTPUT_BATCH_QUEUED) != 0;
+        busy = sink->queued;
+    }
+    while (cursor != head) {
+        output_packet_t *packet = output_slot(cursor);
+        if (sink->waiting_for_keyframe) {
+            if (!packet->keyframe) {
+                sink->drop_cnt++;
+                cursor++;
+                continue;
+            }
+            sink->waiting_for_keyframe = false;
+        }
+        if (sink->send_batch) {
+            struct iovec batch[OUTPUT_MAX_BATCH];
+            int num_packets = 0;
+            for (uint32_t pos = cursor; pos != head && num_packets < OUTPUT_MAX_BATCH; pos++, num_packets++) {
+                batch[num_packets].iov_base = output_slot(pos)->data;
+                batch[num_packets].iov_len = output_slot(pos)->length;
+            }
+            int ret = sink->send_batch(sink->ctx, batch, num_packets);
+            int sent = ret & ~OUTPUT_BATCH_QUEUED;
+            sink->queued = (ret & OUTPUT_BATCH_QUEUED) != 0;
+            for (int i = 0; i < sent; i++)
+                sink->sent_bytes += batch[i].iov_len;
+            sink->sent_cnt += sent;
+            cursor += sent;
+            if (sent < num_packets || sink->queued) {
+                busy = true;
+                break;
+            }
+            continue;
+        }
+        if (sink->send(sink->ctx, packet->data, packet->length) == OUTPUT_AGAIN) {
+            busy = true;
+            break;
+        }
+        sink->sent_cnt++;
+        sink->sent_bytes += packet->length;
+        cursor++;
+    }
+    atomic_store_explicit(&sink->cursor, cursor, memory_order_release);
+    return busy;
+}
+
+/**
+ * Output thread: hands the packets of the ring to all sinks. Sleeps until new packets arrive or a busy sink can take
+ * more data.
+ *
+ * @param arg unused
+ */
+void *output_thread(void *arg) {
+    struct pollfd pfds[OUTPUT_MAX_SINKS + 2];
+    bool readable = false;
+    while (*output.running) {
+        if (output.housekeeping) output.housekeeping(readable);
+        uint32_t head = atomic_load_explicit(&output.head, memory_order_acquire);
+        int nfds = 2, timeout = OUTPUT_IDLE_WAIT_MS;
+        pfds[0].fd = output.wake_fd;
+        pfds[0].events = POLLIN;
+        pfds[1].fd = output.input_fd; // ignored by poll() if -1
+        pfds[1].events = POLLIN;
+        for (int i = 0; i < OUTPUT_MAX_SINKS; i++) {
+            output_sink_t *sink = &output.sinks[i];
+            if (!atomic_load_explicit(&sink->active, memory_order_relaxed)) continue;
+            output_apply_policy(sink, head);
+            if (output_drain(sink, head)) {
+                if (sink->poll_fd >= 0) {
+                    pfds[nfds].fd = sink->poll_fd;
+                    pfds[nfds].events = POLLOUT;
+                    nfds++;
+                } else {
+                    timeout = OUTPUT_RETRY_MS;
+                }
+            }
+            if (sink->status) {
+                sink->status->lag = head - atomic_load_explicit(&sink->cursor, memory_order_relaxed);
+                sink->status->drop_cnt = sink->drop_cnt;
+                sink->status->sent_cnt = sink->sent_cnt;
+                sink->status->sent_bytes = sink->sent_bytes;
+            }
+        }
+        if (atomic_exchange(&output.producer_waiting, 0))
+            sem_post(&output.space);
+        readable = false;
+        if (poll(pfds, (nfds_t) nfds, timeout) > 0) {
+            readable = (pfds[1].revents & POLLIN) != 0;
+            uint64_t cnt;
+            if ((pfds[0].revents & POLLIN) && read(output.wake_fd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+                perror("DB_VIDEO_GND: Could not read output wake up");
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Sends one UDP GSO datagram: the kernel (or NIC) splits it into datagrams of segment_size bytes, the last one may be
+ * shorter. Datagram boundaries are the same as if every packet was sent on its own.
+ */
+static ssize_t output_udp_send_gso(int sock, const struct sockaddr *dst, socklen_t dst_len, const struct iovec *packets,
+                                   int num_packets, uint16_t segment_size) {
+    char control[CMSG_SPACE(sizeof(uint16_t))] = {0};
+    struct msghdr msg = {0};
+    msg.msg_name = (void *) dst;
+    msg.msg_namelen = dst_len;
+    msg.msg_iov = (struct iovec *) packets;
+    msg.msg_iovlen = (size_t) num_packets;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+    return sendmsg(sock, &msg, MSG_DONTWAIT);
+}
+
+/**
+ * Sends packets as individual UDP datagrams to one destination with as few syscalls as possible. Runs of packets with
+ * the same length (the last one may be shorter) get sent with a single UDP GSO send (UDP_SEGMENT). Without kernel
+ * support for UDP GSO all packets get sent with sendmmsg().
+ *
+ * @param sock Non blocking UDP socket
+ * @param dst Destination address
+ * @param dst_len Length of the destination address
+ * @param packets The packets, one datagram each
+ * @param num_packets Number of packets (max. OUTPUT_MAX_BATCH)
+ * @param use_gso Try UDP GSO. Gets set to false if the kernel does not support it
+ * @return Number of consumed packets (sent or dropped because of an error). Less than num_packets if the socket buffer
+ *         is full
+ */
+int output_udp_send(int sock, const struct sockaddr *dst, socklen_t dst_len, const struct iovec *packets,
+                    int num_packets, bool *use_gso) {
+    int i = 0;
+    while (*use_gso && i < num_packets) {
+        size_t segment_size = packets[i].iov_len, total = segment_size;
+        int j = i + 1;
+        while (j < num_packets && j - i < OUTPUT_GSO_MAX_SEGMENTS && total + packets[j].iov_len <= OUTPUT_GSO_MAX_BYTES
+               && packets[j].iov_len <= segment_size) {
+            total += packets[j].iov_len;
+            if (packets[j++].iov_len < segment_size) break; // shorter segment must be the last one
+        }
+        ssize_t l = (j - i > 1) ? output_udp_send_gso(sock, dst, dst_len, packets + i, j - i, (uint16_t) segment_size)
+                                : sendto(sock, packets[i].iov_base, packets[i].iov_len, MSG_DONTWAIT, dst, dst_len);
+        if (l < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return i;
+            if (j - i > 1 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)) {
+                LOG_SYS_STD(LOG_NOTICE, "DB_VIDEO_GND: UDP GSO not supported (%s). Using sendmmsg()\n", strerror(errno));
+                *use_gso = false;
+                break;
+            }
+            perror("DB_VIDEO_GND: Not all data sent via UDP");
+        }
+        i = j;
+    }
+    while (i < num_packets) {
+        struct mmsghdr msgs[OUTPUT_MAX_BATCH];
+        int n = 0;
+        for (; n < num_packets - i && n < OUTPUT_MAX_BATCH; n++) {
+            memset(&msgs[n], 0, sizeof(struct mmsghdr));
+            msgs[n].msg_hdr.msg_name = (void *) dst;
+            msgs[n].msg_hdr.msg_namelen = dst_len;
+            msgs[n].msg_hdr.msg_iov = (struct iovec *) &packets[i + n];
+            msgs[n].msg_hdr.msg_iovlen = 1;
+        }
+        int sent = sendmmsg(sock, msgs, (unsigned int) n, MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return i;
+            perror("DB_VIDEO_GND: Not all data sent via UDP");
+            sent = 1; // skip the packet that caused the error
+        }
+        i += sent;
+    }
+    return num_packets;
+}
@@ -0,0 +1,106 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DRONEBRIDGE_VIDEO_OUTPUT_H
+#define DRONEBRIDGE_VIDEO_OUTPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include "../common/shared_memory.h"
+
+/*
+ * Output stage of the ground station: the decoded video stream is written into a ring of packets by a single producer
+ * (output_push()). The output thread hands the packets to all sinks (stdout, UDP, usbbridge, recorder). Every sink
+ * reads the ring with its own cursor, so a slow sink does not hold back the others. Once a sink lags behind by more
+ * than OUTPUT_HIGH_WATER packets its overflow policy decides what happens:
+ *   OUTPUT_DROP_OLDEST       skip the oldest packets so that the sink only lags behind by half the ring
+ *   OUTPUT_DROP_TO_KEYFRAME  like drop oldest, but continue with the first packet that starts a H.264 key frame
+ *                            (SPS or IDR NAL unit) so a video player can decode the stream right away
+ *   OUTPUT_BLOCK             nothing gets dropped, the producer waits once the ring is full
+ */
+#define OUTPUT_RING_PACKETS 1024
+#define OUTPUT_HIGH_WATER (OUTPUT_RING_PACKETS - OUTPUT_RING_PACKETS / 8)
+#define OUTPUT_MAX_SINKS (DB_GND_MAX_SINKS + DB_GND_MAX_VIDEO_CLIENTS)
+#define OUTPUT_MAX_BATCH 64 // packets handed to output_send_batch_fn at once
+
+// return values of output_send_fn
+#define OUTPUT_SENT 0   // packet was consumed (sent, or dropped by the sink itself, e.g. no receiver)
+#define OUTPUT_AGAIN 1  // sink is busy, retry the same packet later
+// or-ed to the return value of output_send_batch_fn: the sink still holds queued data of the consumed packets. It is
+// kept busy and gets called again (with num_packets = 0 if there are no new packets) until its queue is empty
+#define OUTPUT_BATCH_QUEUED 0x10000
+
+typedef enum {
+    OUTPUT_DROP_OLDEST = 0,
+    OUTPUT_DROP_TO_KEYFRAME,
+    OUTPUT_BLOCK
+} output_policy_t;
+
+typedef int (*output_send_fn)(void *ctx, const uint8_t *data, uint32_t length);
+// sends several packets at once. Returns the number of consumed packets, less than num_packets if the sink is busy.
+// See OUTPUT_BATCH_QUEUED for sinks with an internal queue
+typedef int (*output_send_batch_fn)(void *ctx, const struct iovec *packets, int num_packets);
+// called once the overflow policy skipped packets of the sink, e.g. to reset a parser that spans packets
+typedef void (*output_skip_fn)(void *ctx);
+// called by the output thread on every wake up, readable is set if the registered input fd can be read
+typedef void (*output_housekeeping_fn)(bool readable);
+
+typedef struct {
+    _Atomic bool active; // slot is in use. Sinks can be added and removed at runtime by the output thread
+    char name[8];
+    output_policy_t policy;
+    int poll_fd; // polled for POLLOUT while the sink is busy or -1 to retry after OUTPUT_RETRY_MS
+    output_send_fn send;
+    output_send_batch_fn send_batch; // used instead of send if set
+    output_skip_fn skip; // or NULL
+    void *ctx;
+    _Atomic uint32_t cursor; // next packet to send, only modified by the output thread
+    bool waiting_for_keyframe;
+    bool queued; // send_batch returned OUTPUT_BATCH_QUEUED
+    uint32_t drop_cnt, sent_cnt;
+    uint64_t sent_bytes;
+    db_sink_status_t *status; // exported counters or NULL
+} output_sink_t;
+
+int output_init(uint32_t max_packet_length, volatile bool *running);
+
+int output_add_sink(const char *name, output_policy_t policy, int poll_fd, output_send_fn send,
+                    output_send_batch_fn send_batch, output_skip_fn skip, void *ctx, db_sink_status_t *status);
+
+void output_remove_sink(int sink_id);
+
+void output_set_housekeeping(int input_fd, output_housekeeping_fn housekeeping);
+
+int output_parse_policy(const char *str, output_policy_t *policy);
+
+const char *output_policy_name(output_policy_t policy);
+
+void output_push(const uint8_t *data, uint32_t length);
+
+void output_wake(void);
+
+void *output_thread(void *arg);
+
+int output_udp_send(int sock, const struct sockaddr *dst, socklen_t dst_len, const struct iovec *packets,
+                    int num_packets, bool *use_gso);
+
+#endif //DRONEBRIDGE_VIDEO_OUTPUT_H
@@ -0,0 +1,260 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <string.h>
+#include <time.h>
+#include <sys/uio.h>
+#include "video_rtp.h"
+#include "video_output.h"
+#include "video_lib.h"
+
+#define NAL_TYPE_FU_A 28
+
+/**
+ * Queues an RTP packet. If the queue is full the packet is dropped, its sequence number is used anyway so the receiver
+ * detects the loss
+ */
+static void rtp_emit(video_rtp_t *rtp, bool marker, const uint8_t *prefix, int prefix_length, const uint8_t *payload,
+                     uint16_t length) {
+    if (rtp->queue_len == VIDEO_RTP_QUEUE_PACKETS) {
+        rtp->overflow_cnt++;
+        rtp->seq++;
+        return;
+    }
+    video_rtp_packet_t *packet = &rtp->queue[rtp->queue_len++];
+    uint8_t *h = packet->data;
+    h[0] = 0x80; // version 2, no padding, no extension, no CSRC
+    h[1] = (uint8_t) ((marker ? 0x80 : 0) | VIDEO_RTP_PAYLOAD_TYPE);
+    h[2] = (uint8_t) (rtp->seq >> 8);
+    h[3] = (uint8_t) rtp->seq;
+    h[4] = (uint8_t) (rtp->timestamp >> 24);
+    h[5] = (uint8_t) (rtp->timestamp >> 16);
+    h[6] = (uint8_t) (rtp->timestamp >> 8);
+    h[7] = (uint8_t) rtp->timestamp;
+    h[8] = (uint8_t) (rtp->ssrc >> 24);
+    h[9] = (uint8_t) (rtp->ssrc >> 16);
+    h[10] = (uint8_t) (rtp->ssrc >> 8);
+    h[11] = (uint8_t) rtp->ssrc;
+    memcpy(h + VIDEO_RTP_HEADER_LENGTH, prefix, (size_t) prefix_length);
+    memcpy(h + VIDEO_RTP_HEADER_LENGTH + prefix_length, payload, length);
+    packet->length = (uint16_t) (VIDEO_RTP_HEADER_LENGTH + prefix_length + length);
+    rtp->seq++;
+}
+
+static void rtp_emit_fragment(video_rtp_t *rtp, uint8_t nal_header, bool start, bool end, bool marker,
+                              const uint8_t *payload, uint16_t length) {
+    uint8_t fu[2];
+    fu[0] = (uint8_t) ((nal_header & 0xE0) | NAL_TYPE_FU_A); // FU indicator
+    fu[1] = (uint8_t) ((start ? 0x80 : 0) | (end ? 0x40 : 0) | (nal_header & 0x1F)); // FU header
+    rtp_emit(rtp, marker, fu, 2, payload, length);
+}
+
+/**
+ * Sends the held back last packet of the previous NAL unit
+ */
+static void rtp_finish_tail(video_rtp_t *rtp, bool marker) {
+    if (!rtp->tail_pending) return;
+    if (rtp->tail_fragmented)
+        rtp_emit_fragment(rtp, rtp->tail_header, false, true, marker, rtp->tail, rtp->tail_len);
+    else
+        rtp_emit(rtp, marker, &rtp->tail_header, 1, rtp->tail, rtp->tail_len);
+    rtp->tail_pending = false;
+}
+
+static uint32_t rtp_clock_90khz() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ((uint64_t) ts.tv_sec * 90000 + (uint64_t) ts.tv_nsec * 9 / 100000);
+}
+
+/**
+ * Checks if the current NAL unit starts a new access unit (H.264 7.4.1.2.3) and finishes the previous one
+ *
+ * @param first_mb_zero Slices only: first_mb_in_slice is 0 (first bit of the slice header is set)
+ */
+static void rtp_resolve(video_rtp_t *rtp, bool first_mb_zero) {
+    uint8_t type = (uint8_t) (rtp->cur_header & 0x1F);
+    bool new_au = rtp->au_has_vcl && lib_h264_nal_starts_au(type, first_mb_zero);
+    rtp_finish_tail(rtp, new_au);
+    if (new_au || !rtp->au_started) {
+        uint32_t now = rtp_clock_90khz();
+        // access units that arrive in the same burst still get increasing timestamps
+        if (rtp->au_started && (int32_t) (now - rtp->timestamp) <= 0) now = rtp->timestamp + 1;
+        rtp->timestamp = now;
+        rtp->au_started = true;
+        rtp->au_has_vcl = false;
+    }
+    if (type >= 1 && type <= 5) rtp->au_has_vcl = true;
+    rtp->cur_resolved = true;
+}
+
+static void rtp_begin_nal(video_rtp_t *rtp, uint8_t nal_header) {
+    rtp->in_nal = true;
+    rtp->cur_header = nal_header;
+    rtp->cur_len = 0;
+    rtp->cur_fragmented = false;
+    rtp->cur_resolved = false;
+    uint8_t type = (uint8_t) (nal_header & 0x1F);
+    // slices need the first byte of the slice header
+    if (type != 1 && type != 5) rtp_resolve(rtp, false);
+}
+
+/**
+ * Appends payload to the current NAL unit. Sends a FU-A fragment once it does not fit into one RTP packet any more
+ */
+static void rtp_append(video_rtp_t *rtp, const uint8_t *data, uint32_t length) {
+    if (length == 0) return;
+    if (!rtp->cur_resolved) rtp_resolve(rtp, (data[0] & 0x80) != 0);
+    while (length > 0) {
+        // single NAL unit packet: header + payload, fragment: FU indicator + FU header + payload
+        uint16_t limit = (uint16_t) (rtp->cur_fragmented ? VIDEO_RTP_MAX_PAYLOAD - 2 : VIDEO_RTP_MAX_PAYLOAD - 1);
+        if (rtp->cur_len == limit) {
+            uint16_t n = VIDEO_RTP_MAX_PAYLOAD - 2;
+            rtp_emit_fragment(rtp, rtp->cur_header, !rtp->cur_fragmented, false, false, rtp->cur, n);
+            rtp->cur_fragmented = true;
+            memmove(rtp->cur, rtp->cur + n, (size_t) (rtp->cur_len - n));
+            rtp->cur_len -= n;
+            continue;
+        }
+        uint32_t n = limit - rtp->cur_len;
+        if (n > length) n = length;
+        memcpy(rtp->cur + rtp->cur_len, data, n);
+        rtp->cur_len += n;
+        data += n;
+        length -= n;
+    }
+}
+
+static void rtp_append_zeros(video_rtp_t *rtp) {
+    static const uint8_t zeros[64] = {0};
+    while (rtp->zeros > 0) {
+        uint32_t n = rtp->zeros < sizeof(zeros) ? rtp->zeros : sizeof(zeros);
+        if (rtp->in_nal) rtp_append(rtp, zeros, n);
+        rtp->zeros -= n;
+    }
+}
+
+/**
+ * The current NAL unit ended (start code of the next one). Its last packet waits until it is known whether the next NAL
+ * unit starts a new access unit
+ */
+static void rtp_end_nal(video_rtp_t *rtp) {
+    if (!rtp->in_nal) return;
+    if (!rtp->cur_resolved) rtp_resolve(rtp, false);
+    memcpy(rtp->tail, rtp->cur, rtp->cur_len);
+    rtp->tail_len = rtp->cur_len;
+    rtp->tail_header = rtp->cur_header;
+    rtp->tail_fragmented = rtp->cur_fragmented;
+    rtp->tail_pending = true;
+    rtp->in_nal = false;
+}
+
+/**
+ * @param rtp The packetizer
+ * @param ssrc Synchronization source identifier of the RTP stream. Should be random
+ */
+void video_rtp_init(video_rtp_t *rtp, uint32_t ssrc) {
+    memset(rtp, 0, sizeof(video_rtp_t));
+    rtp->ssrc = ssrc;
+    rtp->seq = (uint16_t) (ssrc >> 16);
+}
+
+/**
+ * Discontinuity in the byte stream (skipped data): drops the NAL unit that gets packetized and the held back packet of
+ * the previous one. The packetizer waits for the next start code. The sequence number skips one so that the receiver
+ * detects the loss. Packets that are already queued still get sent
+ *
+ * @param rtp The packetizer
+ */
+void video_rtp_reset(video_rtp_t *rtp) {
+    rtp->zeros = 0;
+    rtp->in_nal = false;
+    rtp->expect_header = false;
+    rtp->cur_len = 0;
+    rtp->cur_fragmented = false;
+    rtp->cur_resolved = false;
+    rtp->tail_pending = false;
+    rtp->au_started = false; // the next access unit gets a new timestamp
+    rtp->au_has_vcl = false;
+    rtp->seq++;
+}
+
+/**
+ * Parses the next chunk of the Annex B byte stream and queues the resulting RTP packets. Make sure the queue has some
+ * free space (video_rtp_queue_free()), a chunk of a few KiB produces a few packets
+ *
+ * @param rtp The packetizer
+ * @param data Chunk of the H.264 Annex B byte stream
+ * @param length Length of the chunk
+ */
+void video_rtp_packetize(video_rtp_t *rtp, const uint8_t *data, uint32_t length) {
+    uint32_t i = 0;
+    while (i < length) {
+        uint8_t b = data[i];
+        if (b == 0) {
+            rtp->zeros++;
+            i++;
+            continue;
+        }
+        if (b == 1 && rtp->zeros >= 2) {
+            // start code. Additional zero bytes are trailing_zero_8bits of the previous NAL unit
+            rtp_end_nal(rtp);
+            rtp->zeros = 0;
+            rtp->expect_header = true;
+            i++;
+            continue;
+        }
+        rtp_append_zeros(rtp);
+        if (rtp->expect_header) {
+            rtp->expect_header = false;
+            rtp_begin_nal(rtp, b);
+            i++;
+            continue;
+        }
+        // copy everything till the next zero byte that might start a start code
+        const uint8_t *zero = memchr(data + i, 0, length - i);
+        uint32_t n = zero ? (uint32_t) (zero - (data + i)) : length - i;
+        if (rtp->in_nal) rtp_append(rtp, data + i, n); // otherwise garbage before the first start code
+        i += n;
+    }
+}
+
+int video_rtp_queue_free(const video_rtp_t *rtp) {
+    return VIDEO_RTP_QUEUE_PACKETS - rtp->queue_len;
+}
+
+/**
+ * Sends the queued RTP packets
+ *
+ * @return true if the queue is empty, false if the socket is busy
+ */
+bool video_rtp_send(video_rtp_t *rtp, int sock, const struct sockaddr *dst, socklen_t dst_len, bool *use_gso) {
+    if (rtp->queue_sent < rtp->queue_len) {
+        struct iovec packets[VIDEO_RTP_QUEUE_PACKETS];
+        int num_packets = rtp->queue_len - rtp->queue_sent;
+        for (int i = 0; i < num_packets; i++) {
+            packets[i].iov_base = rtp->queue[rtp->queue_sent + i].data;
+            packets[i].iov_len = rtp->queue[rtp->queue_sent + i].length;
+        }
+        rtp->queue_sent += output_udp_send(sock, dst, dst_len, packets, num_packets, use_gso);
+        if (rtp->queue_sent < rtp->queue_len) return false;
+    }
+    rtp->queue_len = rtp->queue_sent = 0;
+    return true;
+}
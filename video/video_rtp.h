@@ -0,0 +1,81 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DRONEBRIDGE_VIDEO_RTP_H
+#define DRONEBRIDGE_VIDEO_RTP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+
+/*
+ * RTP packetizer for H.264 (RFC 6184, packetization mode 1). The decoded stream is an Annex B byte stream that arrives
+ * in chunks cut at arbitrary positions. The packetizer searches the start codes and sends every NAL unit that fits into
+ * VIDEO_RTP_MAX_PAYLOAD as a single NAL unit packet, larger ones as FU-A fragments. Fragments are sent as soon as they
+ * are full, so only up to one payload of a NAL unit is kept. All NAL units of an access unit share a 90 kHz timestamp
+ * taken from the clock when the access unit starts. The marker bit is set on the last packet of an access unit. Since
+ * the end of an access unit is only known once the first NAL unit of the next one arrives, its last packet is held back
+ * until then.
+ */
+#define VIDEO_RTP_HEADER_LENGTH 12
+#define VIDEO_RTP_MAX_PAYLOAD 1400 // RTP packet fits into a 1500 byte MTU
+#define VIDEO_RTP_PAYLOAD_TYPE 96
+#define VIDEO_RTP_QUEUE_PACKETS 32 // RTP packets waiting to be sent
+
+typedef struct {
+    uint8_t data[VIDEO_RTP_HEADER_LENGTH + VIDEO_RTP_MAX_PAYLOAD];
+    uint16_t length;
+} video_rtp_packet_t;
+
+typedef struct {
+    uint32_t ssrc, timestamp;
+    uint16_t seq;
+    bool au_started;
+    bool au_has_vcl; // current access unit contains a slice. The next non VCL NAL unit or first slice starts a new one
+    // NAL unit parser
+    uint32_t zeros; // zero bytes seen that may belong to a start code
+    bool in_nal;
+    bool expect_header;
+    uint8_t cur_header; // NAL unit header of the current NAL unit
+    bool cur_resolved; // checked if the current NAL unit starts a new access unit
+    bool cur_fragmented; // first FU-A fragment of the current NAL unit was sent
+    uint8_t cur[VIDEO_RTP_MAX_PAYLOAD]; // payload of the current NAL unit that was not sent yet
+    uint16_t cur_len;
+    bool tail_pending; // last packet of the previous NAL unit waits for the marker bit
+    uint8_t tail_header;
+    bool tail_fragmented;
+    uint8_t tail[VIDEO_RTP_MAX_PAYLOAD];
+    uint16_t tail_len;
+    // packets waiting to be sent
+    video_rtp_packet_t queue[VIDEO_RTP_QUEUE_PACKETS];
+    int queue_len, queue_sent;
+    uint32_t overflow_cnt;
+} video_rtp_t;
+
+void video_rtp_init(video_rtp_t *rtp, uint32_t ssrc);
+
+void video_rtp_reset(video_rtp_t *rtp);
+
+void video_rtp_packetize(video_rtp_t *rtp, const uint8_t *data, uint32_t length);
+
+int video_rtp_queue_free(const video_rtp_t *rtp);
+
+bool video_rtp_send(video_rtp_t *rtp, int sock, const struct sockaddr *dst, socklen_t dst_len, bool *use_gso);
+
+#endif //DRONEBRIDGE_VIDEO_RTP_H